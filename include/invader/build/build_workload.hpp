@@ -4,6 +4,9 @@
 #define INVADER__BUILD__BUILD_WORKLOAD_HPP
 
 #include <vector>
+#include <memory>
+#include <new>
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <filesystem>
@@ -245,6 +248,111 @@ namespace Invader {
          */
         static BuildWorkload compile_single_tag(const std::byte *tag_data, std::size_t tag_data_size, const std::vector<std::filesystem::path> &tags_directories = std::vector<std::filesystem::path>(), bool recursion = false, bool error_checking = false);
 
+        /**
+         * Find a tag in the tags directories and read it, printing an error if that fails.
+         * @param tag              tag to open
+         * @param tags_directories tags directories to look in
+         * @return                 tag data
+         * @throws                 std::exception if the tag could not be found or read
+         */
+        static std::vector<std::byte> open_tag_file(const File::TagFilePath &tag, const std::vector<std::filesystem::path> &tags_directories);
+
+        /**
+         * Open the scenario tag a map built with the parameters would use and merge its child scenarios into it, just
+         * like when building.
+         * @param parameters      build parameters to use
+         * @param child_scenarios if set, the child scenarios merged into the scenario are added to this
+         * @return                scenario
+         * @throws                std::exception if a tag could not be found or read
+         */
+        static Parser::Scenario load_scenario(const BuildParameters &parameters, std::vector<File::TagFilePath> *child_scenarios = nullptr);
+
+        /**
+         * Find every tag a map built with the parameters would have without compiling anything. Child scenarios are
+         * merged, scripts are compiled from the scenario tag's source data, and the target engine's required tags are
+         * included, just like when building.
+         * @param parameters      build parameters to use
+         * @param child_scenarios if set, the child scenarios merged into the scenario are added to this
+         * @return                tags in the order they were found (Halo path separators), starting with the scenario
+         * @throws                std::exception if a tag could not be found or read
+         */
+        static std::vector<File::TagFilePath> find_map_tags(const BuildParameters &parameters, std::vector<File::TagFilePath> *child_scenarios = nullptr);
+
+        /** Bump allocator for struct data, dependencies, and pointers; everything is freed at once when it is destroyed */
+        class BuildWorkloadArena {
+        public:
+            /**
+             * Allocate memory
+             * @param size      number of bytes
+             * @param alignment alignment (no more than alignof(std::max_align_t))
+             * @return          pointer to the memory
+             */
+            void *allocate(std::size_t size, std::size_t alignment);
+
+            /**
+             * Free memory. This only gives the memory back if it was the last thing allocated.
+             * @param pointer pointer to the memory
+             * @param size    number of bytes
+             */
+            void deallocate(void *pointer, std::size_t size) noexcept;
+
+            /**
+             * Get the number of bytes allocated for blocks
+             * @return bytes
+             */
+            std::size_t get_reserved() const noexcept {
+                return this->reserved;
+            }
+
+        private:
+            static constexpr std::size_t BLOCK_SIZE = 1024 * 1024;
+            std::vector<std::unique_ptr<std::byte []>> blocks;
+            std::byte *cursor = nullptr;
+            std::byte *end = nullptr;
+            std::byte *last = nullptr;
+            std::size_t reserved = 0;
+        };
+
+        /** Allocator that uses an arena if it has one and the heap otherwise */
+        template <typename T> struct BuildWorkloadAllocator {
+            using value_type = T;
+            using propagate_on_container_copy_assignment = std::true_type;
+            using propagate_on_container_move_assignment = std::true_type;
+            using propagate_on_container_swap = std::true_type;
+
+            /** Arena to allocate from, or nullptr to use the heap */
+            BuildWorkloadArena *arena = nullptr;
+
+            BuildWorkloadAllocator() noexcept = default;
+            BuildWorkloadAllocator(BuildWorkloadArena *arena) noexcept : arena(arena) {}
+            template <typename U> BuildWorkloadAllocator(const BuildWorkloadAllocator<U> &other) noexcept : arena(other.arena) {}
+
+            T *allocate(std::size_t n) {
+                if(this->arena) {
+                    if(n > SIZE_MAX / sizeof(T)) {
+                        throw std::bad_array_new_length();
+                    }
+                    return static_cast<T *>(this->arena->allocate(n * sizeof(T), alignof(T)));
+                }
+                return std::allocator<T>().allocate(n);
+            }
+
+            void deallocate(T *pointer, std::size_t n) noexcept {
+                if(this->arena) {
+                    this->arena->deallocate(pointer, n * sizeof(T));
+                }
+                else {
+                    std::allocator<T>().deallocate(pointer, n);
+                }
+            }
+
+            template <typename U> bool operator==(const BuildWorkloadAllocator<U> &other) const noexcept {
+                return this->arena == other.arena;
+            }
+        };
+
+        template <typename T> using BuildWorkloadVector = std::vector<T, BuildWorkloadAllocator<T>>;
+
         /** Denotes an individual tag dependency */
         struct BuildWorkloadDependency {
             /** Index of the depended tag */
@@ -283,13 +391,13 @@ namespace Invader {
         /** Denotes an individual tag struct */
         struct BuildWorkloadStruct {
             /** Data in the struct */
-            std::vector<std::byte> data;
+            BuildWorkloadVector<std::byte> data;
 
             /** Dependencies in the struct */
-            std::vector<BuildWorkloadDependency> dependencies;
+            BuildWorkloadVector<BuildWorkloadDependency> dependencies;
 
             /** Struct dependencies in the struct */
-            std::vector<BuildWorkloadStructPointer> pointers;
+            BuildWorkloadVector<BuildWorkloadStructPointer> pointers;
 
             /** Offset of the struct in tag data if it's currently present */
             std::optional<std::size_t> offset;
@@ -338,6 +446,14 @@ namespace Invader {
              * @return       true if it can be
              */
             bool can_dedupe(const BuildWorkloadStruct &other) const noexcept;
+
+            BuildWorkloadStruct() = default;
+
+            /**
+             * Make a struct whose data, dependencies, and pointers are allocated from an arena
+             * @param arena arena to allocate from
+             */
+            explicit BuildWorkloadStruct(BuildWorkloadArena *arena) : data(arena), dependencies(arena), pointers(arena) {}
         };
 
         /** Denotes an individual tag */
@@ -370,9 +486,20 @@ namespace Invader {
             std::size_t path_offset;
         };
 
+        /** Arena that struct data is allocated from (this must be destroyed after the structs, so it comes first) */
+        std::unique_ptr<BuildWorkloadArena> struct_arena = std::make_unique<BuildWorkloadArena>();
+
         /** Structs being worked with */
         std::vector<BuildWorkloadStruct> structs;
 
+        /**
+         * Add a struct whose data, dependencies, and pointers are allocated from the workload's arena
+         * @return the new struct
+         */
+        BuildWorkloadStruct &add_struct() {
+            return this->structs.emplace_back(this->struct_arena.get());
+        }
+
         /** Uncompressed vertices for models */
         std::vector<Parser::ModelVertexUncompressed::struct_little> uncompressed_model_vertices;
 
@@ -449,6 +576,7 @@ namespace Invader {
          */
         void compile_tag_data_recursively(const std::byte *tag_data, std::size_t tag_data_size, std::size_t tag_index, std::optional<TagFourCC> tag_fourcc = std::nullopt);
         
+        BuildWorkload(BuildWorkload &&) = default;
         ~BuildWorkload() override = default;
 
     private:
@@ -3,6 +3,7 @@
 #ifndef INVADER__EXTRACT__EXTRACTION_HPP
 #define INVADER__EXTRACT__EXTRACTION_HPP
 
+#include <mutex>
 #include <vector>
 #include "../map/tag.hpp"
 #include "../error_handler/error_handler.hpp"
@@ -31,8 +32,17 @@ namespace Invader {
          * @param overwrite       overwrite tag files that exist
          * @param non_mp_globals  allow extraction of non-multiplayer globals
          * @param reporting_level reporting level to use
+         * @param max_threads     maximum number of tags to extract at once
          */
-        static void extract_map(const Map &map, const std::string &tags, const std::vector<std::string> &queries, const std::vector<std::string> &queries_exclude, bool recursive = false, bool overwrite = false, bool non_mp_globals = false, ReportingLevel reporting_level = ReportingLevel::REPORTING_LEVEL_ALL);
+        static void extract_map(const Map &map, const std::string &tags, const std::vector<std::string> &queries, const std::vector<std::string> &queries_exclude, bool recursive = false, bool overwrite = false, bool non_mp_globals = false, ReportingLevel reporting_level = ReportingLevel::REPORTING_LEVEL_ALL, std::size_t max_threads = 1);
+        
+        /**
+         * Report an error; this can be called from multiple threads at once
+         * @param type      type of error
+         * @param error     error message
+         * @param tag_index tag index the error is for, if any
+         */
+        void report_error(ErrorType type, const char *error, std::optional<std::size_t> tag_index = std::nullopt);
         
     private:
         /**
@@ -49,9 +59,10 @@ namespace Invader {
          * @param recursive       also extract tags depended by a tag
          * @param overwrite       overwrite tag files that exist
          * @param non_mp_globals  allow extraction of non-multiplayer globals
+         * @param max_threads     maximum number of tags to extract at once
          * @return                number of tags successfully extracted
          */
-        std::size_t perform_extraction(const std::vector<std::string> &queries, const std::vector<std::string> &queries_exclude, const std::filesystem::path &tags, bool recursive, bool overwrite, bool non_mp_globals);
+        std::size_t perform_extraction(const std::vector<std::string> &queries, const std::vector<std::string> &queries_exclude, const std::filesystem::path &tags, bool recursive, bool overwrite, bool non_mp_globals, std::size_t max_threads);
         
         /** Map reference */
         const Map &map;
@@ -62,6 +73,9 @@ namespace Invader {
         /** All tags that were matched */
         std::vector<std::size_t> matched_tags;
         
+        /** Held while reporting errors or printing progress */
+        std::mutex output_mutex;
+        
         ExtractionWorkload(const Map &map, ReportingLevel reporting_level);
         ~ExtractionWorkload() override = default;
     };
@@ -60,6 +60,15 @@ namespace Invader::File {
             return (*this <=> other) == std::strong_ordering::less;
         }
     };
+
+    /**
+     * Hash a tag path and class so TagFilePath can be used as a key in unordered containers
+     */
+    struct TagFilePathHash {
+        std::size_t operator()(const TagFilePath &path) const noexcept {
+            return std::hash<std::string>()(path.path) ^ (static_cast<std::size_t>(path.fourcc) * 0x9E3779B97F4A7C15ull);
+        }
+    };
     
     /**
      * Attempt to open the file and read it all into a buffer
@@ -68,6 +77,50 @@ namespace Invader::File {
      */
     std::optional<std::vector<std::byte>> open_file(const std::filesystem::path &path);
 
+    /**
+     * Read-only view of a whole file. The file is memory mapped if possible, otherwise it is read into a buffer.
+     */
+    class MemoryMappedFile {
+    public:
+        /**
+         * Attempt to map the file into memory
+         * @param path path to the file
+         * @return     mapped file or std::nullopt if failed
+         */
+        static std::optional<MemoryMappedFile> map_file(const std::filesystem::path &path);
+
+        /**
+         * Get the file data
+         * @return pointer to the file data
+         */
+        const std::byte *data() const noexcept {
+            return this->file_data;
+        }
+
+        /**
+         * Get the size of the file
+         * @return size in bytes
+         */
+        std::size_t size() const noexcept {
+            return this->file_size;
+        }
+
+        MemoryMappedFile(MemoryMappedFile &&move) noexcept;
+        MemoryMappedFile &operator=(MemoryMappedFile &&move) noexcept;
+        MemoryMappedFile(const MemoryMappedFile &) = delete;
+        MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+        ~MemoryMappedFile();
+
+    private:
+        MemoryMappedFile() = default;
+        void unmap() noexcept;
+
+        const std::byte *file_data = nullptr;
+        std::size_t file_size = 0;
+        bool mapped = false;
+        std::vector<std::byte> fallback;
+    };
+
     /**
      * Attempt to save the file
      * @param  path path to the file
@@ -76,6 +129,25 @@ namespace Invader::File {
      */
     bool save_file(const std::filesystem::path &path, const std::vector<std::byte> &data);
 
+    /**
+     * Attempt to save the file by writing it to a temporary file in the same directory and then renaming it over the
+     * file, so the file is never left partially written. If the path is a symlink, the file it points to is replaced,
+     * and an existing file's permissions are kept.
+     * @param  path path to the file
+     * @param  data data to write
+     * @return      true on success; false on failure
+     */
+    bool save_file_atomically(const std::filesystem::path &path, const std::vector<std::byte> &data);
+
+    /**
+     * Attempt to copy a file, replacing the destination if it exists. On Linux, the copy is done by the kernel with
+     * copy_file_range() so the data does not need to be read into memory.
+     * @param  from file to copy
+     * @param  to   path to copy to
+     * @return      true on success; false on failure
+     */
+    bool copy_file(const std::filesystem::path &from, const std::filesystem::path &to);
+
     /**
      * Convert a tag path to a file path for one tags directory. The file must exist, or std::nullopt will be returned.
      * @param  tag_path   tag path to use
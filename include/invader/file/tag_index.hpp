@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef INVADER__FILE__TAG_INDEX_HPP
+#define INVADER__FILE__TAG_INDEX_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file.hpp"
+
+namespace Invader::File {
+    /**
+     * Index of every tag in a tags directory, saved to the tags directory so it does not need to be rediscovered each
+     * time. Directories and tags are checked against their modification times when refreshed, so only new or modified
+     * directories are listed and only new or modified tags are read.
+     */
+    class TagIndex {
+    public:
+        /** Name of the index file in the tags directory */
+        static constexpr const char *FILE_NAME = ".invader-index";
+
+        /**
+         * Tag in the index
+         */
+        struct IndexedTag {
+            /** Path relative to the tags directory using the system's preferred separators, including the extension */
+            std::string tag_path;
+
+            /** Tag class of this tag */
+            HEK::TagFourCC tag_fourcc = {};
+
+            /** Size of the file in bytes */
+            std::uint64_t size = 0;
+
+            /** Modification time of the file */
+            std::int64_t modified = 0;
+
+            /** 64-bit FNV-1a hash of the file's contents, or 0 if it hasn't been read */
+            std::uint64_t hash = 0;
+
+            /** Dependencies have been read and are up-to-date */
+            bool dependencies_read = false;
+
+            /** The tag was read but could not be parsed, so it has no dependencies */
+            bool invalid = false;
+
+            /** Tags this tag references (Halo path separators) */
+            std::vector<TagFilePath> dependencies;
+        };
+
+        /**
+         * Check if a tags directory has an index
+         * @param tags_directory tags directory
+         * @return               true if it has an index
+         */
+        static bool exists(const std::filesystem::path &tags_directory);
+
+        /**
+         * Get all of the tags a tag references
+         * @param tag_data      tag file data
+         * @param tag_data_size size of the tag file data
+         * @return              dependencies with Halo path separators, not including null references
+         * @throws              std::exception if the tag could not be parsed
+         */
+        static std::vector<TagFilePath> read_dependencies(const std::byte *tag_data, std::size_t tag_data_size);
+
+        /**
+         * Bring the index up-to-date with the tags directory
+         * @param read_dependencies check every tag for modifications and read the dependencies of new or modified tags;
+         *                          otherwise, tags are only listed, and they are checked the next time dependencies are read
+         */
+        void refresh(bool read_dependencies = true);
+
+        /**
+         * Save the index to the tags directory if it changed
+         * @throws std::exception on failure
+         */
+        void save();
+
+        /**
+         * Get all tags in the index
+         * @return tags
+         */
+        const std::vector<IndexedTag> &get_tags() const noexcept {
+            return this->tags;
+        }
+
+        /**
+         * Find a tag in the index
+         * @param tag_path path relative to the tags directory using the system's preferred separators, including the extension
+         * @return         tag if found, or nullptr if not
+         */
+        const IndexedTag *find_tag(const std::string &tag_path) const noexcept;
+
+        /**
+         * Find a tag in the index, only checking that tag's file for modifications rather than refreshing the index
+         * @param tag_path path relative to the tags directory using the system's preferred separators, including the extension
+         * @return         tag if its dependencies were read and it has not been modified since, or nullptr if not
+         */
+        const IndexedTag *find_unchanged_tag(const std::string &tag_path) const;
+
+        /**
+         * Find all tags in the index that reference a tag. The lookup table is built from the tags' dependencies the
+         * first time this is called after the index is loaded or refreshed, so it is not thread-safe.
+         * @param tag tag to find (Halo path separators)
+         * @return    indices of the tags in get_tags() in order, or nullptr if nothing references it
+         */
+        const std::vector<std::size_t> *find_referencing_tags(const TagFilePath &tag);
+
+        /**
+         * Get the tags directory
+         * @return tags directory
+         */
+        const std::filesystem::path &get_tags_directory() const noexcept {
+            return this->tags_directory;
+        }
+
+        /**
+         * Open the index for a tags directory. If no index exists or it can't be read, an empty index is opened.
+         * @param tags_directory tags directory
+         */
+        TagIndex(const std::filesystem::path &tags_directory);
+
+    private:
+        struct IndexedDirectory {
+            std::int64_t modified = 0;
+            std::vector<std::string> directories;
+            std::vector<std::string> files;
+        };
+
+        std::filesystem::path tags_directory;
+
+        // Modification time of the index when it was loaded; anything modified within the same window could have been
+        // modified again without its modification time changing
+        std::int64_t index_modified = 0;
+
+        // Whether or not anything changed since the index was loaded or saved
+        bool changed = false;
+
+        // Directories by path relative to the tags directory with a trailing separator (or empty for the tags directory)
+        std::unordered_map<std::string, IndexedDirectory> directories;
+
+        std::vector<IndexedTag> tags;
+        std::unordered_map<std::string, std::size_t> tag_lookup;
+
+        // Reverse edges (tags that reference each tag), built when first needed
+        std::unordered_map<TagFilePath, std::vector<std::size_t>, TagFilePathHash> referencing_tags;
+        bool referencing_tags_built = false;
+
+        void load();
+        bool is_unchanged(std::int64_t old_modified, std::int64_t new_modified) const noexcept;
+    };
+}
+
+#endif
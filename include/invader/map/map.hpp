@@ -281,6 +281,15 @@ namespace Invader {
          */
         std::optional<std::size_t> find_tag(const char *tag_path, TagFourCC tag_fourcc) const noexcept;
 
+        /**
+         * Find all tags whose path and extension match the search queries (see File::path_matches()). Only tags that
+         * share a query's non-wildcard prefix are tested.
+         * @param queries         queries to match; if empty, all tags that aren't excluded are matched
+         * @param queries_exclude queries to exclude
+         * @return                indices of the matching tags, in order
+         */
+        std::vector<std::size_t> search_tags(const std::vector<std::string> &queries, const std::vector<std::string> &queries_exclude) const;
+
         /**
          * Get the scenario tag ID
          * @return The scenario tag ID
@@ -350,6 +359,27 @@ namespace Invader {
         /** Tag array */
         std::vector<Tag> tags;
 
+        /** Hash table slot; tag_index is offset by 1 so 0 means the slot is empty */
+        struct PathIndexSlot {
+            std::uint32_t hash;
+            std::uint32_t tag_index;
+        };
+
+        /** Lookup tables for the tag array, built when the tag array is populated */
+        struct PathIndex {
+            /** Open addressing table of exact paths and classes (first tag with each is kept) */
+            std::vector<PathIndexSlot> exact;
+
+            /** Lowercase path of each tag with backslashes and the tag extension */
+            std::vector<std::string> normalized_paths;
+
+            /** Tag indices sorted by normalized path, for prefix searches */
+            std::vector<std::uint32_t> sorted;
+        };
+
+        /** Path index (see build_path_index()) */
+        PathIndex path_index;
+
         /** Scenario tag ID */
         std::size_t scenario_tag_id = 0;
 
@@ -408,6 +438,9 @@ namespace Invader {
         /** Get BSPs */
         void get_bsps();
 
+        /** Build the path index from the tag array */
+        void build_path_index();
+
         /**
          * Decompress if we are compressed
          * @param data      pointer to data
@@ -5,6 +5,8 @@
 
 #include <vector>
 #include <map>
+#include <string_view>
+#include <filesystem>
 
 #include "../hek/data_type.hpp"
 #include "../tag/parser/parser_struct.hpp"
@@ -105,10 +107,26 @@ namespace Invader {
         std::string string() const;
         static JMS from_string(const char *string, const char **end = nullptr);
         
+        /**
+         * Parse a JMS from a buffer that does not need to be null terminated
+         * @param string JMS data
+         * @return       parsed JMS
+         */
+        static JMS from_string(std::string_view string);
+        
+        /**
+         * Memory map and parse a JMS file
+         * @param path path to the JMS file
+         * @return     parsed JMS
+         */
+        static JMS from_file(const std::filesystem::path &path);
+        
         /**
          * Optimize, removing duplicate vertices
+         * @param weld_threshold if greater than zero, also merge vertices whose attributes snap to the same multiple of this
+         * @return               number of vertices removed
          */
-        void optimize();
+        std::size_t optimize(float weld_threshold = 0.0F);
     };
     
     using JMSMap = std::map<std::string, JMS>;
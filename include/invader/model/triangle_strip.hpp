@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef INVADER__MODEL__TRIANGLE_STRIP_HPP
+#define INVADER__MODEL__TRIANGLE_STRIP_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Invader::TriangleStrip {
+    /**
+     * Triangle as three vertex indices
+     */
+    using Triangle = std::array<std::uint32_t, 3>;
+
+    /**
+     * Reorder triangles so consecutive triangles reuse recently transformed vertices (Tom Forsyth's linear-speed vertex
+     * cache optimization). Winding order is preserved.
+     * @param triangles    triangles to reorder
+     * @param vertex_count number of vertices referenced by the triangles
+     * @return             reordered triangles
+     */
+    std::vector<Triangle> optimize_vertex_cache(const std::vector<Triangle> &triangles, std::size_t vertex_count);
+
+    /**
+     * Generate a single triangle strip out of the given triangles, joining separate strips with degenerate triangles.
+     *
+     * Even triangles in the strip are (i, i + 1, i + 2) and odd triangles are (i, i + 2, i + 1). Degenerate input
+     * triangles are dropped since they do not render anything.
+     * @param triangles    triangles to strip (these should be cache optimized first)
+     * @param vertex_count number of vertices referenced by the triangles
+     * @return             strip indices
+     */
+    std::vector<std::uint32_t> generate_triangle_strip(const std::vector<Triangle> &triangles, std::size_t vertex_count);
+
+    /**
+     * Renumber vertices in the order they are first referenced so vertex fetches are sequential.
+     * @param indices      indices to renumber (modified in place)
+     * @param vertex_count number of vertices
+     * @return             old vertex index for each new vertex index; unreferenced vertices are put at the end
+     */
+    std::vector<std::uint32_t> reorder_vertices(std::vector<std::uint32_t> &indices, std::size_t vertex_count);
+}
+
+#endif
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef INVADER__SOUND__RESAMPLER_HPP
+#define INVADER__SOUND__RESAMPLER_HPP
+
+#include <cstddef>
+#include <vector>
+#include <optional>
+
+namespace Invader::SoundResampler {
+    enum ResampleQuality {
+        /** Short polyphase FIR filter; fastest, intended for previews */
+        RESAMPLE_QUALITY_FAST,
+
+        /** Long polyphase FIR filter; good enough for most sounds */
+        RESAMPLE_QUALITY_MEDIUM,
+
+        /** libsamplerate's best sinc interpolator; slowest */
+        RESAMPLE_QUALITY_BEST
+    };
+
+    /**
+     * Get the resample quality from a string
+     * @param  quality quality string ("fast", "medium", or "best")
+     * @return         quality if valid
+     */
+    std::optional<ResampleQuality> ResampleQuality_from_string(const char *quality) noexcept;
+
+    /**
+     * Resample interleaved floating point PCM data.
+     *
+     * If the ratio can be expressed as a fraction with a small numerator, the fast and medium tiers use exactly that
+     * many filter phases, so integer ratios (e.g. 44100 Hz to 22050 Hz) are computed without any phase error.
+     * @param pcm           interleaved PCM data
+     * @param channel_count number of channels
+     * @param ratio         output sample rate divided by input sample rate
+     * @param quality       quality to use
+     * @return              resampled PCM data
+     * @throws              Invader::InvalidArgumentException if the arguments are invalid or resampling fails
+     */
+    std::vector<float> resample(const std::vector<float> &pcm, std::size_t channel_count, double ratio, ResampleQuality quality = ResampleQuality::RESAMPLE_QUALITY_BEST);
+}
+
+#endif
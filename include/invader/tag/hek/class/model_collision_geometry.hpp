@@ -3,10 +3,14 @@
 #ifndef INVADER__TAG__HEK__CLASS__MODEL_COLLISION_GEOMETRY_HPP
 #define INVADER__TAG__HEK__CLASS__MODEL_COLLISION_GEOMETRY_HPP
 
+#include <memory>
+#include <vector>
 #include "../../../hek/data_type.hpp"
 #include "../definition.hpp"
 
 namespace Invader::HEK {
+    class IntersectionCheck;
+    
     /**
      * Struct for containing all information required to find intersections among other things
      */
@@ -31,24 +35,46 @@ namespace Invader::HEK {
         std::uint32_t render_leaf_count = 0;
         
         /**
-         * Determine if a point intersects vertically with the BSP.
+         * Flattened copy of the BSP for queries (see flatten()); if null, batched queries build one for the batch
+         */
+        std::shared_ptr<const IntersectionCheck> intersection_check;
+        
+        /**
+         * Result of a batched query
+         */
+        struct QueryResult {
+            bool found = false;
+            std::uint32_t surface_index = 0;
+            std::uint32_t leaf_index = 0;
+        };
+        
+        /**
+         * Build a native endian, flattened copy of the BSP that all queries will use. This should be called once all of
+         * the pointers are set, and the copy is kept for as long as this BSPData is.
+         */
+        void flatten();
+        
+        /**
+         * Determine if a point intersects vertically with the BSP. flatten() must have been called first.
          * @param point_a            one point in the line to check
          * @param point_b            the other point in the line to check
          * @param intersection_point if non-null and this function returns true, this will be set to the point where an intersection was found
          * @param surface_index      if non-null and this function returns true, this will be set to the surface index where the intersection was found
          * @param leaf_index         if non-null and this function returns true, this will be set to the leaf index where the intersection was found
          * @return                   true if an intersection was found
+         * @throws InvalidArgumentException if the BSP was not flattened
          */
         bool check_for_intersection(const Point3D<LittleEndian> &point_a, const Point3D<LittleEndian> &point_b, Point3D<LittleEndian> *intersection_point = nullptr, std::uint32_t *surface_index = nullptr, std::uint32_t *leaf_index = nullptr) const;
         
         /**
-         * Determine if a point intersects vertically with the BSP.
+         * Determine if a point intersects vertically with the BSP. flatten() must have been called first.
          * @param point              point to check
          * @param range              range up-and-down to check
          * @param intersection_point if non-null and this function returns true, this will be set to the point where an intersection was found
          * @param surface_index      if non-null and this function returns true, this will be set to the surface index where the intersection was found
          * @param leaf_index         if non-null and this function returns true, this will be set to the leaf index where the intersection was found
          * @return                   true if an intersection was found
+         * @throws InvalidArgumentException if the BSP was not flattened
          */
         bool check_for_intersection(const Point3D<LittleEndian> &point, float range, Point3D<LittleEndian> *intersection_point = nullptr, std::uint32_t *surface_index = nullptr, std::uint32_t *leaf_index = nullptr) const;
         
@@ -58,6 +84,21 @@ namespace Invader::HEK {
          * @param leaf_index if non-null and this function returns true, this will be set to the leaf index where the point is located
          */
         bool check_if_point_inside_bsp(const Point3D<LittleEndian> &point, std::uint32_t *leaf_index = nullptr) const;
+        
+        /**
+         * Do check_for_intersection(point, range) for each point, splitting the points across threads.
+         * @param points points to check
+         * @param range  range up-and-down to check
+         * @return       results for each point
+         */
+        std::vector<QueryResult> check_for_intersections(const std::vector<Point3D<LittleEndian>> &points, float range) const;
+        
+        /**
+         * Do check_if_point_inside_bsp(point) for each point, splitting the points across threads.
+         * @param points points to check
+         * @return       results for each point (surface_index is always 0)
+         */
+        std::vector<QueryResult> check_if_points_inside_bsp(const std::vector<Point3D<LittleEndian>> &points) const;
     };
 }
 #endif
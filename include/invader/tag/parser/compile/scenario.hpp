@@ -25,6 +25,15 @@ namespace Invader::Parser {
      * @param scripts            optional array of scripts (filename-data pairs). If not set, use source data from the scenario tag
      */
     void compile_scripts(Scenario &scenario, const HEK::GameEngineInfo &info, std::vector<std::string> &warnings, const std::vector<std::filesystem::path> &tags_directories, const std::optional<std::vector<std::pair<std::string, std::vector<std::byte>>>> &scripts = std::nullopt);
+    
+    /**
+     * Merge the scenario's child scenarios (and their child scenarios) into it
+     * @param workload  workload to report errors to
+     * @param tag_index index of the scenario tag in the workload
+     * @param scenario  scenario to merge into
+     * @return          paths of the child scenarios that were merged (Halo path separators) in the order they were merged
+     */
+    std::vector<std::string> merge_child_scenarios(BuildWorkload &workload, std::size_t tag_index, Scenario &scenario);
 }
 
 #endif
@@ -7,9 +7,11 @@
 #include <deque>
 #include <cstddef>
 #include <list>
+#include <iterator>
 #include <optional>
 #include <variant>
 #include <memory>
+#include <string_view>
 #include "../hek/definition.hpp"
 
 namespace Invader {
@@ -122,6 +124,15 @@ namespace Invader::Parser {
         }
     };
 
+    /**
+     * Tag reference found by scanning tag data without parsing it. The path points into the tag data, so it is only valid
+     * for as long as the tag data is, and it is exactly as it is stored (Halo path separators, not normalized).
+     */
+    struct DependencyView {
+        TagFourCC tag_fourcc;
+        std::string_view path;
+    };
+
     class ParserStructValue {
     public:
         enum ValueType {
@@ -214,7 +225,7 @@ namespace Invader::Parser {
          * @return the comment
          */
         const char *get_comment() const noexcept {
-            return this->comment;
+            return this->descriptor->comment;
         }
         
         /**
@@ -222,7 +233,7 @@ namespace Invader::Parser {
          * @return minimum value or nullopt if there is no minimum
          */
         std::optional<Number> get_minimum() const noexcept {
-            return this->minimum;
+            return this->descriptor->minimum;
         }
         
         /**
@@ -230,7 +241,7 @@ namespace Invader::Parser {
          * @return maximum value or nullopt if there is no maximum
          */
         std::optional<Number> get_maximum() const noexcept {
-            return this->maximum;
+            return this->descriptor->maximum;
         }
 
         /**
@@ -270,7 +281,7 @@ namespace Invader::Parser {
          * @return value type
          */
         ValueType get_type() const noexcept {
-            return this->type;
+            return this->descriptor->type;
         }
 
         /**
@@ -278,7 +289,7 @@ namespace Invader::Parser {
          * @return name of the value
          */
         const char *get_name() const noexcept {
-            return this->name;
+            return this->descriptor->name;
         }
 
         /**
@@ -286,7 +297,7 @@ namespace Invader::Parser {
          * @return member name of the value
          */
         const char *get_member_name() const noexcept {
-            return this->member_name;
+            return this->descriptor->member_name;
         }
 
         /**
@@ -302,7 +313,7 @@ namespace Invader::Parser {
          * @return unit
          */
         const char *get_unit() const noexcept {
-            return this->unit;
+            return this->descriptor->unit;
         }
         
         /**
@@ -310,7 +321,7 @@ namespace Invader::Parser {
          * @return volatile
          */
         bool is_volatile() const noexcept {
-            return this->volatile_value;
+            return this->descriptor->volatile_value;
         }
 
         /**
@@ -329,7 +340,7 @@ namespace Invader::Parser {
          * @return       object in array
          */
         ParserStruct &get_object_in_array(std::size_t index) {
-            return this->get_object_in_array_fn(index, this->address);
+            return this->descriptor->get_object_in_array_fn(index, this->address);
         }
 
         /**
@@ -346,7 +357,7 @@ namespace Invader::Parser {
          * @return number of elements in array
          */
         std::size_t get_array_size() const noexcept {
-            return this->get_array_size_fn(this->address);
+            return this->descriptor->get_array_size_fn(this->address);
         }
 
         /**
@@ -354,7 +365,7 @@ namespace Invader::Parser {
          * @return minimum number of elements in array
          */
         std::size_t get_array_minimum_size() const noexcept {
-            return this->min_array_size;
+            return this->descriptor->min_array_size;
         }
 
         /**
@@ -362,7 +373,7 @@ namespace Invader::Parser {
          * @return maximum number of elements in array
          */
         std::size_t get_array_maximum_size() const noexcept {
-            return this->max_array_size;
+            return this->descriptor->max_array_size;
         }
 
         /**
@@ -371,7 +382,7 @@ namespace Invader::Parser {
          * @param count number of objects to delete
          */
         void delete_objects_in_array(std::size_t index, std::size_t count) {
-            return this->delete_objects_in_array_fn(index, count, this->address);
+            return this->descriptor->delete_objects_in_array_fn(index, count, this->address);
         }
 
         /**
@@ -380,7 +391,7 @@ namespace Invader::Parser {
          * @param count number of objects to create
          */
         void insert_objects_in_array(std::size_t index, std::size_t count) {
-            return this->insert_objects_in_array_fn(index, count, this->address);
+            return this->descriptor->insert_objects_in_array_fn(index, count, this->address);
         }
 
         /**
@@ -390,7 +401,7 @@ namespace Invader::Parser {
          * @param count      number of objects to create
          */
         void duplicate_objects_in_array(std::size_t index_from, std::size_t index_to, std::size_t count) {
-            return this->duplicate_objects_in_array_fn(index_from, index_to, count, this->address);
+            return this->descriptor->duplicate_objects_in_array_fn(index_from, index_to, count, this->address);
         }
 
         /**
@@ -400,7 +411,7 @@ namespace Invader::Parser {
          * @param count      number of objects to create
          */
         void swap_objects_in_array(std::size_t index_from, std::size_t index_to, std::size_t count) {
-            return this->swap_objects_in_array_fn(index_from, index_to, count, this->address);
+            return this->descriptor->swap_objects_in_array_fn(index_from, index_to, count, this->address);
         }
 
         /**
@@ -408,7 +419,7 @@ namespace Invader::Parser {
          * @return is bounds
          */
         bool is_bounds() const noexcept {
-            return this->bounds;
+            return this->descriptor->bounds;
         }
 
         /**
@@ -432,7 +443,7 @@ namespace Invader::Parser {
          * @return enum
          */
         const char *read_enum() const {
-            return this->read_enum_fn(address);
+            return this->descriptor->read_enum_fn(address);
         }
 
         /**
@@ -440,7 +451,7 @@ namespace Invader::Parser {
          * @param value value to write
          */
         void write_enum(const char *value) {
-            this->write_enum_fn(value, address);
+            this->descriptor->write_enum_fn(value, address);
         }
 
         /**
@@ -449,7 +460,7 @@ namespace Invader::Parser {
          * @return value
          */
         bool read_bitfield(const char *field) const {
-            return this->read_bitfield_fn(field, address);
+            return this->descriptor->read_bitfield_fn(field, address);
         }
 
         /**
@@ -458,7 +469,7 @@ namespace Invader::Parser {
          * @param  value value name
          */
         void write_bitfield(const char *field, bool value) {
-            this->write_bitfield_fn(field, value, address);
+            this->descriptor->write_bitfield_fn(field, value, address);
         }
 
         /**
@@ -474,7 +485,7 @@ namespace Invader::Parser {
          * @return all enum values
          */
         std::vector<const char *> list_enum() const noexcept {
-            return this->list_enum_fn();
+            return this->descriptor->list_enum_fn();
         }
 
         /**
@@ -482,7 +493,7 @@ namespace Invader::Parser {
          * @return all enum values
          */
         std::vector<const char *> list_enum_pretty() const noexcept {
-            return this->list_enum_pretty_fn();
+            return this->descriptor->list_enum_pretty_fn();
         }
 
         using get_object_in_array_fn_type = ParserStruct &(*)(std::size_t index, void *addr);
@@ -709,7 +720,7 @@ namespace Invader::Parser {
          * @return all allowed classes
          */
         const std::vector<TagFourCC> &get_allowed_classes() const noexcept {
-            return this->allowed_classes;
+            return this->descriptor->allowed_classes;
         }
 
         /**
@@ -717,213 +728,208 @@ namespace Invader::Parser {
          * @return true if value is read only
          */
         bool is_read_only() const noexcept {
-            return this->read_only;
+            return this->descriptor->read_only;
         }
 
         /**
-         * Instantiate a ParserStructValue with a group start
-         * @param name    name of the group
-         * @param comment comments
-         */
-        ParserStructValue(
-            const char *name,
-            const char *comment
-        );
-
-        /**
-         * Instantiate a ParserStructValue with a dependency
-         * @param name            name of the dependency
-         * @param member_name     variable name of the dependency
-         * @param comment         comments
-         * @param dependency      pointer to the dependency
-         * @param allowed_classes array of allowed classes
-         * @param count           number of allowed classes in array
-         * @param read_only       value is read only
-         */
-        ParserStructValue(
-            const char *       name,
-            const char *       member_name,
-            const char *       comment,
-            Dependency *       dependency,
-            const TagFourCC *allowed_classes,
-            std::size_t        count,
-            bool               read_only
-        );
-
-        /**
-         * Instantiate a ParserStructValue with an array
-         * @param name                          name of the array
-         * @param member_name                   variable name of the array
-         * @param comment                       comments
-         * @param array                         pointer to the array
-         * @param get_object_in_array_fn        pointer to function for getting object in array
-         * @param get_array_size_fn             pointer to function for getting the size of array
-         * @param delete_objects_in_array_fn    pointer to function for deleting objects from an array
-         * @param insert_objects_in_array_fn    pointer to function for inserting objects in an array
-         * @param duplicate_objects_in_array_fn pointer to function for duplicating objects in an array
-         * @param swap_objects_in_array_fn      pointer to function for swapping objects in an array
-         * @param minimum_array_size            minimum number of elements in the array
-         * @param maximum_array_size            maximum number of elements in the array
-         * @param read_only                     value is read only
-         */
-        ParserStructValue(
-            const char *                        name,
-            const char *                        member_name,
-            const char *                        comment,
-            void *                              array,
-            get_object_in_array_fn_type         get_object_in_array_fn,
-            get_array_size_fn_type              get_array_size_fn,
-            delete_objects_in_array_fn_type     delete_objects_in_array_fn,
-            insert_objects_in_array_fn_type     insert_objects_in_array_fn,
-            duplicate_objects_in_array_fn_type  duplicate_objects_in_array_fn,
-            swap_objects_in_array_fn_type       swap_objects_in_array_fn,
-            std::size_t                         minimum_array_size,
-            std::size_t                         maximum_array_size,
-            bool                                read_only
-        );
-
-        /**
-         * Instantiate a ParserStructValue with a TagString
-         * @param name        name of the value
-         * @param member_name variable name of the value
-         * @param comment     comments
-         * @param string      pointer to string
-         * @param read_only   value is read only
-         */
-        ParserStructValue(
-            const char *    name,
-            const char *    member_name,
-            const char *    comment,
-            HEK::TagString *string,
-            bool            read_only
-        );
-
-        /**
-         * Instantiate a ParserStructValue with a TagDataOffset
-         * @param name        name of the value
-         * @param member_name variable name of the value
-         * @param comment     comments
-         * @param offset      pointer to offset
-         * @param read_only   value is read only
-         */
-        ParserStructValue(
-            const char *            name,
-            const char *            member_name,
-            const char *            comment,
-            std::vector<std::byte> *offset,
-            bool                    read_only
-        );
-
-        /**
-         * Instantiate a ParserStructValue with a TagEnum
-         * @param name                 name of the value
-         * @param member_name          variable name of the value
-         * @param comment              comments
-         * @param value                pointer to value
-         * @param list_enum_fn         pointer to function for listing enums
-         * @param list_enum_pretty_fn  pointer to function for listing enums with definition naming
-         * @param read_enum_fn         pointer to function for reading enums
-         * @param write_enum_fn        pointer to function for writing enums
-         * @param read_only            value is read only
-         */
-        ParserStructValue(
-            const char *       name,
-            const char *       member_name,
-            const char *       comment,
-            void *             value,
-            list_enum_fn_type  list_enum_fn,
-            list_enum_fn_type  list_enum_pretty_fn,
-            read_enum_fn_type  read_enum_fn,
-            write_enum_fn_type write_enum_fn,
-            bool               read_only
-        );
-
-        /**
-         * Instantiate a ParserStructValue with a bitfield
-         * @param name                 name of the value
-         * @param member_name          variable name of the value
-         * @param comment              comments
-         * @param value                pointer to value
-         * @param list_enum_fn         pointer to function for listing enums
-         * @param list_enum_pretty_fn  pointer to function for listing enums with definition naming
-         * @param read_bitfield_fn     pointer to function for reading enums
-         * @param write_bitfield_fn    pointer to function for writing enums
-         * @param read_only            value is read only
-         */
-        ParserStructValue(
-            const char *           name,
-            const char *           member_name,
-            const char *           comment,
-            void *                 value,
-            list_enum_fn_type      list_enum_fn,
-            list_enum_fn_type      list_enum_pretty_fn,
-            read_bitfield_fn_type  read_bitfield_fn,
-            write_bitfield_fn_type write_bitfield_fn,
-            bool                   read_only
-        );
-
-        /**
-         * Instantiate a ParserStructValue with a value
-         * @param name           name of the value
-         * @param member_name    variable name of the value
-         * @param comment        comments
-         * @param object         pointer to the object
-         * @param type           type of value
-         * @param unit           unit to use
-         * @param count          number of values (if multiple values or bounds)
-         * @param bounds         whether or not this is bounds
-         * @param volatile_value value is volatile
-         * @param read_only      value is read only
-         * @param minimum        optional minimum value
-         * @param maximum        optional maximum value
-         */
-        ParserStructValue(
-            const char *          name,
-            const char *          member_name,
-            const char *          comment,
-            void *                object,
-            ValueType             type,
-            const char *          unit = nullptr,
-            std::size_t           count = 1,
-            bool                  bounds = false,
-            bool                  volatile_value = false,
-            bool                  read_only = false,
-            std::optional<Number> minimum = std::nullopt,
-            std::optional<Number> maximum = std::nullopt
-        );
+         * Description of a value in a struct, shared by every instance of the struct
+         */
+        class Descriptor {
+        public:
+            /**
+             * Get the offset of the value in the struct
+             * @return offset
+             */
+            std::size_t get_offset() const noexcept {
+                return this->offset;
+            }
+
+            /**
+             * Instantiate a descriptor for a group start
+             * @param name    name of the group
+             * @param comment comments
+             */
+            Descriptor(
+                const char *name,
+                const char *comment
+            );
+
+            /**
+             * Instantiate a descriptor for a dependency
+             * @param name            name of the dependency
+             * @param member_name     variable name of the dependency
+             * @param comment         comments
+             * @param dependency      offset of the dependency in the struct
+             * @param allowed_classes array of allowed classes
+             * @param count           number of allowed classes in array
+             * @param read_only       value is read only
+             */
+            Descriptor(
+                const char *       name,
+                const char *       member_name,
+                const char *       comment,
+                std::size_t        dependency,
+                const TagFourCC *allowed_classes,
+                std::size_t        count,
+                bool               read_only
+            );
+
+            /**
+             * Instantiate a descriptor for an array
+             * @param name                          name of the array
+             * @param member_name                   variable name of the array
+             * @param comment                       comments
+             * @param array                         offset of the array in the struct
+             * @param get_object_in_array_fn        pointer to function for getting object in array
+             * @param get_array_size_fn             pointer to function for getting the size of array
+             * @param delete_objects_in_array_fn    pointer to function for deleting objects from an array
+             * @param insert_objects_in_array_fn    pointer to function for inserting objects in an array
+             * @param duplicate_objects_in_array_fn pointer to function for duplicating objects in an array
+             * @param swap_objects_in_array_fn      pointer to function for swapping objects in an array
+             * @param minimum_array_size            minimum number of elements in the array
+             * @param maximum_array_size            maximum number of elements in the array
+             * @param read_only                     value is read only
+             */
+            Descriptor(
+                const char *                        name,
+                const char *                        member_name,
+                const char *                        comment,
+                std::size_t                         array,
+                get_object_in_array_fn_type         get_object_in_array_fn,
+                get_array_size_fn_type              get_array_size_fn,
+                delete_objects_in_array_fn_type     delete_objects_in_array_fn,
+                insert_objects_in_array_fn_type     insert_objects_in_array_fn,
+                duplicate_objects_in_array_fn_type  duplicate_objects_in_array_fn,
+                swap_objects_in_array_fn_type       swap_objects_in_array_fn,
+                std::size_t                         minimum_array_size,
+                std::size_t                         maximum_array_size,
+                bool                                read_only
+            );
+
+            /**
+             * Instantiate a descriptor for a TagEnum
+             * @param name                 name of the value
+             * @param member_name          variable name of the value
+             * @param comment              comments
+             * @param value                offset of the value in the struct
+             * @param list_enum_fn         pointer to function for listing enums
+             * @param list_enum_pretty_fn  pointer to function for listing enums with definition naming
+             * @param read_enum_fn         pointer to function for reading enums
+             * @param write_enum_fn        pointer to function for writing enums
+             * @param read_only            value is read only
+             */
+            Descriptor(
+                const char *       name,
+                const char *       member_name,
+                const char *       comment,
+                std::size_t        value,
+                list_enum_fn_type  list_enum_fn,
+                list_enum_fn_type  list_enum_pretty_fn,
+                read_enum_fn_type  read_enum_fn,
+                write_enum_fn_type write_enum_fn,
+                bool               read_only
+            );
+
+            /**
+             * Instantiate a descriptor for a bitfield
+             * @param name                 name of the value
+             * @param member_name          variable name of the value
+             * @param comment              comments
+             * @param value                offset of the value in the struct
+             * @param list_enum_fn         pointer to function for listing enums
+             * @param list_enum_pretty_fn  pointer to function for listing enums with definition naming
+             * @param read_bitfield_fn     pointer to function for reading enums
+             * @param write_bitfield_fn    pointer to function for writing enums
+             * @param read_only            value is read only
+             */
+            Descriptor(
+                const char *           name,
+                const char *           member_name,
+                const char *           comment,
+                std::size_t            value,
+                list_enum_fn_type      list_enum_fn,
+                list_enum_fn_type      list_enum_pretty_fn,
+                read_bitfield_fn_type  read_bitfield_fn,
+                write_bitfield_fn_type write_bitfield_fn,
+                bool                   read_only
+            );
+
+            /**
+             * Instantiate a descriptor for a value
+             * @param name           name of the value
+             * @param member_name    variable name of the value
+             * @param comment        comments
+             * @param object         offset of the object in the struct
+             * @param type           type of value
+             * @param unit           unit to use
+             * @param count          number of values (if multiple values or bounds)
+             * @param bounds         whether or not this is bounds
+             * @param volatile_value value is volatile
+             * @param read_only      value is read only
+             * @param minimum        optional minimum value
+             * @param maximum        optional maximum value
+             */
+            Descriptor(
+                const char *          name,
+                const char *          member_name,
+                const char *          comment,
+                std::size_t           object,
+                ValueType             type,
+                const char *          unit = nullptr,
+                std::size_t           count = 1,
+                bool                  bounds = false,
+                bool                  volatile_value = false,
+                bool                  read_only = false,
+                std::optional<Number> minimum = std::nullopt,
+                std::optional<Number> maximum = std::nullopt
+            );
+
+        private:
+            friend class ParserStructValue;
+
+            const char *name = nullptr;
+            const char *member_name = nullptr;
+            const char *comment = nullptr;
+            ValueType type;
+            std::size_t offset = 0;
+            std::vector<TagFourCC> allowed_classes;
+            std::size_t count = 1;
+            bool bounds = false;
+            const char *unit = nullptr;
+            std::optional<Number> minimum;
+            std::optional<Number> maximum;
+
+            get_object_in_array_fn_type get_object_in_array_fn = nullptr;
+            get_array_size_fn_type get_array_size_fn = nullptr;
+            delete_objects_in_array_fn_type delete_objects_in_array_fn = nullptr;
+            insert_objects_in_array_fn_type insert_objects_in_array_fn = nullptr;
+            duplicate_objects_in_array_fn_type duplicate_objects_in_array_fn = nullptr;
+            swap_objects_in_array_fn_type swap_objects_in_array_fn = nullptr;
+
+            list_enum_fn_type list_enum_fn = nullptr;
+            list_enum_fn_type list_enum_pretty_fn = nullptr;
+            read_enum_fn_type read_enum_fn = nullptr;
+            write_enum_fn_type write_enum_fn = nullptr;
+            read_bitfield_fn_type read_bitfield_fn = nullptr;
+            write_bitfield_fn_type write_bitfield_fn = nullptr;
+
+            std::size_t min_array_size;
+            std::size_t max_array_size;
+
+            bool volatile_value = false;
+            bool read_only = false;
+        };
+
+        /**
+         * Instantiate a ParserStructValue
+         * @param descriptor description of the value
+         * @param address    address of the value
+         */
+        ParserStructValue(const Descriptor &descriptor, void *address) noexcept : descriptor(&descriptor), address(address) {}
 
     private:
-        const char *name = nullptr;
-        const char *member_name = nullptr;
-        const char *comment = nullptr;
-        ValueType type;
+        const Descriptor *descriptor;
         void *address;
-        std::vector<TagFourCC> allowed_classes;
-        std::size_t count = 1;
-        bool bounds = false;
-        const char *unit = nullptr;
-        std::optional<Number> minimum;
-        std::optional<Number> maximum;
-
-        get_object_in_array_fn_type get_object_in_array_fn = nullptr;
-        get_array_size_fn_type get_array_size_fn = nullptr;
-        delete_objects_in_array_fn_type delete_objects_in_array_fn = nullptr;
-        insert_objects_in_array_fn_type insert_objects_in_array_fn = nullptr;
-        duplicate_objects_in_array_fn_type duplicate_objects_in_array_fn = nullptr;
-        swap_objects_in_array_fn_type swap_objects_in_array_fn = nullptr;
-
-        list_enum_fn_type list_enum_fn = nullptr;
-        list_enum_fn_type list_enum_pretty_fn = nullptr;
-        read_enum_fn_type read_enum_fn = nullptr;
-        write_enum_fn_type write_enum_fn = nullptr;
-        read_bitfield_fn_type read_bitfield_fn = nullptr;
-        write_bitfield_fn_type write_bitfield_fn = nullptr;
-
-        std::size_t min_array_size;
-        std::size_t max_array_size;
-
-        bool volatile_value = false;
-        bool read_only = false;
 
         template <typename T>
         static void assert_range_exists(std::size_t index, std::size_t count, const T &array) {
@@ -939,6 +945,96 @@ namespace Invader::Parser {
         }
     };
 
+    /**
+     * Values in a struct. These are made from the struct's value descriptors as they are accessed, so getting and walking
+     * through a struct's values does not allocate anything.
+     */
+    class ParserStructValues {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = ParserStructValue;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = ParserStructValue;
+
+            ParserStructValue operator*() const noexcept {
+                return ParserStructValue(*this->descriptor, this->base + this->descriptor->get_offset());
+            }
+
+            iterator &operator++() noexcept {
+                this->descriptor++;
+                return *this;
+            }
+
+            iterator operator++(int) noexcept {
+                auto copy = *this;
+                this->descriptor++;
+                return copy;
+            }
+
+            bool operator==(const iterator &other) const noexcept {
+                return this->descriptor == other.descriptor;
+            }
+
+            bool operator!=(const iterator &other) const noexcept {
+                return this->descriptor != other.descriptor;
+            }
+
+            iterator(const ParserStructValue::Descriptor *descriptor, std::byte *base) noexcept : descriptor(descriptor), base(base) {}
+
+        private:
+            const ParserStructValue::Descriptor *descriptor;
+            std::byte *base;
+        };
+
+        /**
+         * Get the number of values
+         * @return number of values
+         */
+        std::size_t size() const noexcept {
+            return this->descriptors->size();
+        }
+
+        /**
+         * Get whether or not there are no values
+         * @return true if there are no values
+         */
+        bool empty() const noexcept {
+            return this->descriptors->empty();
+        }
+
+        /**
+         * Get the value at the index
+         * @param index index of the value
+         * @return      value
+         */
+        ParserStructValue operator[](std::size_t index) const noexcept {
+            auto &descriptor = (*this->descriptors)[index];
+            return ParserStructValue(descriptor, this->base + descriptor.get_offset());
+        }
+
+        iterator begin() const noexcept {
+            return iterator(this->descriptors->data(), this->base);
+        }
+
+        iterator end() const noexcept {
+            return iterator(this->descriptors->data() + this->descriptors->size(), this->base);
+        }
+
+        /**
+         * Instantiate a ParserStructValues
+         * @param descriptors descriptors of the struct's values
+         * @param base        address of the struct
+         */
+        ParserStructValues(const std::vector<ParserStructValue::Descriptor> &descriptors, std::byte *base) noexcept : descriptors(&descriptors), base(base) {}
+
+    private:
+        const std::vector<ParserStructValue::Descriptor> *descriptors;
+        std::byte *base;
+    };
+
     struct ParserStruct {
         /**
          * Get whether or not the data is formatted for cache files.
@@ -955,6 +1051,17 @@ namespace Invader::Parser {
          */
         static std::unique_ptr<ParserStruct> parse_hek_tag_file(const std::byte *data, std::size_t data_size, bool postprocess = false);
 
+        /**
+         * Find all non-null tag references in a HEK tag file. This is much faster than parsing the tag file since only
+         * the sizes of reflexives, tag references, and data blocks are read, and nothing is copied or allocated apart from
+         * the vector.
+         * @param  data         Tag file data to read from
+         * @param  data_size    Size of the tag file
+         * @param  dependencies Vector to add the references to; the paths point into data
+         * @throws              InvalidTagDataException or OutOfBoundsException if the tag file is invalid
+         */
+        static void scan_hek_tag_file_dependencies(const std::byte *data, std::size_t data_size, std::vector<DependencyView> &dependencies);
+
         /**
          * Generate a tag base struct
          * @param  tag_class tag class
@@ -1065,13 +1172,15 @@ namespace Invader::Parser {
          * Get the values in the struct
          * @return values in the struct
          */
-        std::vector<ParserStructValue> &get_values();
+        ParserStructValues get_values() {
+            return ParserStructValues(this->get_value_descriptors(), reinterpret_cast<std::byte *>(this));
+        }
 
         /**
          * Get the values in the struct
          * @return values in the struct
          */
-        const std::vector<ParserStructValue> &get_values() const {
+        ParserStructValues get_values() const {
             return const_cast<ParserStruct *>(this)->get_values();
         }
 
@@ -1119,12 +1228,14 @@ namespace Invader::Parser {
     protected:
         bool cache_formatted = false;
         
-        virtual std::vector<ParserStructValue> get_values_internal() = 0;
+        /**
+         * Get the descriptors of the struct's values. These are made once per class.
+         * @return descriptors
+         */
+        virtual const std::vector<ParserStructValue::Descriptor> &get_value_descriptors() const = 0;
         
     private:
         bool compare(const ParserStruct *what, bool precision, bool ignore_volatile, std::list<std::string> *differences, std::size_t depth) const;
-        
-        std::optional<std::vector<ParserStructValue>> values;
     };
 }
 
@@ -3,14 +3,19 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <list>
 #include <archive.h>
 #include <archive_entry.h>
 #include <invader/version.hpp>
 #include <invader/printf.hpp>
 #include <invader/build/build_workload.hpp>
-#include <invader/map/map.hpp>
 #include <invader/dependency/found_tag_dependency.hpp>
 #include "../command_line_option.hpp"
+#include "../util/parallel.hpp"
 #include <invader/file/file.hpp>
 
 struct Format {
@@ -18,14 +23,15 @@ struct Format {
     const char *extension;
     int (*filter)(archive *a);
     int (*format)(archive *a);
+    bool threaded_filter;
 };
 
 static const constexpr Format formats[] = {
-    {"7z", ".7z", nullptr, archive_write_set_format_7zip},
-    {"tar-gz", ".tar.xz", archive_write_add_filter_gzip, archive_write_set_format_pax_restricted},
-    {"tar-xz", ".tar.xz", archive_write_add_filter_xz, archive_write_set_format_pax_restricted},
-    {"tar-zst", ".tar.zst", archive_write_add_filter_zstd, archive_write_set_format_pax_restricted},
-    {"zip", ".zip", nullptr, archive_write_set_format_zip}
+    {"7z", ".7z", nullptr, archive_write_set_format_7zip, false},
+    {"tar-gz", ".tar.xz", archive_write_add_filter_gzip, archive_write_set_format_pax_restricted, false},
+    {"tar-xz", ".tar.xz", archive_write_add_filter_xz, archive_write_set_format_pax_restricted, true},
+    {"tar-zst", ".tar.zst", archive_write_add_filter_zstd, archive_write_set_format_pax_restricted, true},
+    {"zip", ".zip", nullptr, archive_write_set_format_zip, false}
 };
 
 static std::string list_formats() {
@@ -56,6 +62,7 @@ int main(int argc, const char **argv) {
         bool overwrite = false;
         std::optional<HEK::GameEngine> engine;
         const Format *format = &formats[0];
+        std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
     } archive_options;
 
     static constexpr char DESCRIPTION[] = "Generate .tar.xz archives of the tags required to build a cache file.";
@@ -75,7 +82,8 @@ int main(int argc, const char **argv) {
         CommandLineOption("output", 'o', 1, "Output to a specific file. Extension must be .tar.xz unless using --copy which then it's a directory.", "<file>"),
         CommandLineOption("fs-path", 'P', 0, "Use a filesystem path for the tag."),
         CommandLineOption("copy", 'C', 0, "Copy instead of making an archive."),
-        CommandLineOption("verbose", 'v', 0, "Print whether or not tags are omitted. Do verbose comparisons.")
+        CommandLineOption("verbose", 'v', 0, "Print whether or not tags are omitted. Do verbose comparisons."),
+        CommandLineOption("threads", 'j', 1, "Set the number of threads to use for reading, comparing, compressing, and copying tags. Default: CPU thread count", "<#>")
     };
 
     auto remaining_arguments = CommandLineOption::parse_arguments<ArchiveOptions &>(argc, argv, options, USAGE, DESCRIPTION, 1, 1, archive_options, [](char opt, const auto &arguments, auto &archive_options) {
@@ -136,6 +144,19 @@ int main(int argc, const char **argv) {
             case 'C':
                 archive_options.copy = true;
                 break;
+            case 'j':
+                try {
+                    int threads = std::stoi(arguments[0]);
+                    if(threads < 1) {
+                        throw std::exception();
+                    }
+                    archive_options.max_threads = static_cast<std::size_t>(threads);
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid number of threads %s", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
         }
     });
 
@@ -214,45 +235,27 @@ int main(int argc, const char **argv) {
     File::remove_duplicate_slashes_chars(base_tag.data());
 
     if(!archive_options.single_tag) {
-        // Build the map
-        std::vector<std::byte> map;
+        // Find every tag the map would have, plus its child scenarios, without building it
+        std::vector<File::TagFilePath> map_tags;
+        std::vector<File::TagFilePath> child_scenarios;
 
         try {
             BuildWorkload::BuildParameters parameters(*archive_options.engine);
             parameters.scenario = base_tag;
             parameters.tags_directories = archive_options.tags;
-            parameters.use_tags_for_script_data = true; // TODODILE: use data folder and implement tags/ and data/ split in output archive
-            if(parameters.details.build_cache_file_engine == HEK::CacheFileEngine::CACHE_FILE_XBOX) {
-                parameters.details.build_compression_level = 0;
-            }
-            if(parameters.details.build_cache_file_engine != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-                parameters.details.build_maximum_cache_file_size = UINT32_MAX;
-            }
             parameters.verbosity = BuildWorkload::BuildParameters::BUILD_VERBOSITY_QUIET;
-
-            map = BuildWorkload::compile_map(parameters);
+            map_tags = BuildWorkload::find_map_tags(parameters, &child_scenarios);
         }
         catch(std::exception &e) {
-            eprintf_error("Failed to compile scenario %s into a map: %s", base_tag.c_str(), e.what());
-            return EXIT_FAILURE;
-        }
-
-        // Parse the map
-        std::unique_ptr<Map> parsed_map;
-        try {
-            parsed_map = std::make_unique<Map>(Map::map_with_move(std::move(map)));
-        }
-        catch(std::exception &e) {
-            eprintf_error("Failed to parse the map file generated with scenario %s: %s", base_tag.c_str(), e.what());
+            eprintf_error("Failed to get dependencies of %s.scenario: %s", base_tag.c_str(), e.what());
             return EXIT_FAILURE;
         }
-        auto tag_count = parsed_map->get_tag_count();
 
         // Go through each tag and see if we can find everything.
-        archive_list.reserve(tag_count + 64);
+        archive_list.reserve(map_tags.size() + child_scenarios.size());
         
-        auto archive_it = [&archive_options, &archive_list](const std::string &path, TagFourCC fourcc) {
-            std::string full_tag_path = File::halo_path_to_preferred_path(path) + "." + tag_fourcc_to_extension(fourcc);
+        auto archive_it = [&archive_options, &archive_list](const File::TagFilePath &tag) {
+            std::string full_tag_path = File::halo_path_to_preferred_path(tag.join());
 
             // Check each tags directory if it exists. If so, archive it (todo: refactor to tag_path_to_file_path())
             bool exists = false;
@@ -271,27 +274,13 @@ int main(int argc, const char **argv) {
             }
         };
         
-        for(std::size_t i = 0; i < tag_count; i++) {
-            // Get the tag path information
-            auto &tag = parsed_map->get_tag(i);
-            archive_it(tag.get_path(), tag.get_tag_fourcc());
+        for(auto &tag : map_tags) {
+            archive_it(tag);
         }
         
         // Archive child scenarios
-        try {
-            auto path = Invader::File::tag_path_to_file_path(base_tag + ".scenario", archive_options.tags);
-            auto scenario_data = Invader::File::open_file(path.value()).value();
-            auto scenario_ptr = Invader::Parser::ParserStruct::parse_hek_tag_file(scenario_data.data(), scenario_data.size());
-            auto &scenario = dynamic_cast<Invader::Parser::Scenario &>(*scenario_ptr);
-            for(auto &child : scenario.child_scenarios) {
-                if(!child.child_scenario.path.empty()) {
-                    archive_it(child.child_scenario.path, child.child_scenario.tag_fourcc);
-                }
-            }
-        }
-        catch(std::exception &e) {
-            eprintf_error("Failed to get dependencies of %s.scenario: %s", base_tag.c_str(), e.what());
-            return EXIT_FAILURE;
+        for(auto &child : child_scenarios) {
+            archive_it(child);
         }
     }
     else {
@@ -354,44 +343,87 @@ int main(int argc, const char **argv) {
         }
     }
     
-    for(auto &i : archive_options.tags_excluded_same) {
-        for(std::size_t t = 0; t < archive_list.size(); t++) {
-            // First check if it exists
-            auto path_to_test = i / File::halo_path_to_preferred_path(archive_list[t].second);
-            
-            if(std::filesystem::exists(path_to_test)) {
+    // Compare tags with the excluded directories' tags in parallel, then omit the ones that matched in order
+    if(!archive_options.tags_excluded_same.empty()) {
+        struct MatchResult {
+            bool omit = false;
+            bool failed = false;
+            std::filesystem::path path_failed;
+            std::list<std::string> differences;
+        };
+        std::vector<MatchResult> results(archive_list.size());
+
+        for_each_in_parallel(archive_list.size(), archive_options.max_threads, [&archive_options, &archive_list, &results](std::size_t t) {
+            auto &result = results[t];
+            std::optional<std::vector<std::byte>> tag_archive_data;
+            std::unique_ptr<Parser::ParserStruct> tag_archive;
+
+            for(auto &i : archive_options.tags_excluded_same) {
+                // First check if it exists
+                auto path_to_test = i / File::halo_path_to_preferred_path(archive_list[t].second);
+                if(!std::filesystem::exists(path_to_test)) {
+                    continue;
+                }
+
                 // Okay it exists. Open both then
-                std::list<std::string> differences;
-                    
                 try {
-                    auto tag_archive_data = File::open_file(archive_list[t].first).value();
-                    auto tag_archive = Parser::ParserStruct::parse_hek_tag_file(tag_archive_data.data(), tag_archive_data.size(), true);
-
+                    if(!tag_archive_data.has_value()) {
+                        tag_archive_data = File::open_file(archive_list[t].first).value();
+                    }
                     auto tag_exclude_data = File::open_file(path_to_test).value();
+
+                    // Identical files are functionally the same, so there is no need to parse them
+                    if(*tag_archive_data == tag_exclude_data) {
+                        result.omit = true;
+                        return;
+                    }
+
+                    if(!tag_archive) {
+                        tag_archive = Parser::ParserStruct::parse_hek_tag_file(tag_archive_data->data(), tag_archive_data->size(), true);
+                    }
                     auto tag_exclude = Parser::ParserStruct::parse_hek_tag_file(tag_exclude_data.data(), tag_exclude_data.size(), true);
 
                     // Do a functional comparison
-                    if(!tag_archive->compare(tag_exclude.get(), true, true, archive_options.verbose ? &differences : nullptr)) {
-                        continue;
+                    std::list<std::string> differences;
+                    if(tag_archive->compare(tag_exclude.get(), true, true, archive_options.verbose ? &differences : nullptr)) {
+                        result.omit = true;
+                        result.differences = std::move(differences);
+                        return;
                     }
                 }
                 catch (std::exception &) {
-                    eprintf_error("Failed to do a functional comparison of %s and %s\n", archive_list[t].first.string().c_str(), path_to_test.string().c_str());
-                    std::exit(EXIT_FAILURE);
+                    result.failed = true;
+                    result.path_failed = path_to_test;
+                    return;
                 }
-                
-                if(archive_options.verbose) {
-                    std::printf("Omitting %s\n", archive_list[t].second.c_str());
-                    
-                    for(auto &i : differences) {
-                        eprintf("%s\n", i.c_str());
-                    }
+            }
+        });
+
+        std::size_t kept = 0;
+        for(std::size_t t = 0; t < archive_list.size(); t++) {
+            auto &result = results[t];
+            if(result.failed) {
+                eprintf_error("Failed to do a functional comparison of %s and %s\n", archive_list[t].first.string().c_str(), result.path_failed.string().c_str());
+                return EXIT_FAILURE;
+            }
+
+            if(!result.omit) {
+                if(kept != t) {
+                    archive_list[kept] = std::move(archive_list[t]);
+                }
+                kept++;
+                continue;
+            }
+
+            if(archive_options.verbose) {
+                std::printf("Omitting %s\n", archive_list[t].second.c_str());
+
+                for(auto &i : result.differences) {
+                    eprintf("%s\n", i.c_str());
                 }
-                
-                archive_list.erase(archive_list.begin() + t);
-                t--;
             }
         }
+        archive_list.resize(kept);
     }
     
     // If we eliminate all tags, don't bother archiving anything
@@ -410,12 +442,91 @@ int main(int argc, const char **argv) {
         if(archive_options.format->format) {
             archive_options.format->format(archive);
         }
+
+        // Compress on multiple threads if the filter can (older versions of libarchive and liblzma ignore this)
+        if(archive_options.format->threaded_filter) {
+            archive_write_set_filter_option(archive, nullptr, "threads", std::to_string(archive_options.max_threads).c_str());
+        }
+
         archive_write_open_filename(archive, archive_options.output.c_str());
 
+        // Read tags ahead on other threads while this one writes them. libarchive can only be used from one thread, so
+        // tags are still written in order here.
+        struct ReadTag {
+            std::optional<std::vector<std::byte>> data;
+            std::time_t modified = 0;
+            bool read = false;
+        };
+        std::vector<ReadTag> read_tags(archive_list.size());
+        std::mutex read_mutex;
+        std::condition_variable read_cv;
+        std::size_t next_to_read = 0;
+        std::size_t next_to_write = 0;
+        bool stop_reading = false;
+        std::size_t read_ahead = archive_options.max_threads * 2;
+
+        auto read_work = [&archive_list, &read_tags, &read_mutex, &read_cv, &next_to_read, &next_to_write, &stop_reading, &read_ahead]() {
+            while(true) {
+                std::size_t i;
+                {
+                    std::unique_lock<std::mutex> lock(read_mutex);
+                    read_cv.wait(lock, [&]() { return stop_reading || next_to_read >= archive_list.size() || next_to_read < next_to_write + read_ahead; });
+                    if(stop_reading || next_to_read >= archive_list.size()) {
+                        return;
+                    }
+                    i = next_to_read++;
+                }
+
+                auto str_path = archive_list[i].first.string();
+                const char *path = str_path.c_str();
+                ReadTag tag;
+                tag.data = File::open_file(path);
+
+                // Get the modified time
+                struct stat s;
+                stat(path, &s);
+
+                // Windows uses mtime which is a time_t rather than a struct with nanoseconds
+                #ifdef _WIN32
+                tag.modified = s.st_mtime;
+                #else
+                tag.modified = s.st_mtim.tv_sec;
+                #endif
+
+                {
+                    std::lock_guard<std::mutex> lock(read_mutex);
+                    read_tags[i] = std::move(tag);
+                    read_tags[i].read = true;
+                }
+                read_cv.notify_all();
+            }
+        };
+
+        std::vector<std::thread> readers;
+        std::size_t reader_count = std::min(archive_options.max_threads, archive_list.size());
+        readers.reserve(reader_count);
+        for(std::size_t t = 0; t < reader_count; t++) {
+            readers.emplace_back(read_work);
+        }
+
         // Go through each tag path we got
+        bool failed = false;
         for(std::size_t i = 0; i < archive_list.size(); i++) {
-            auto str_path = archive_list[i].first.string();
-            const char *path = str_path.c_str();
+            ReadTag tag;
+            {
+                std::unique_lock<std::mutex> lock(read_mutex);
+                read_cv.wait(lock, [&read_tags, &i]() { return read_tags[i].read; });
+                tag = std::move(read_tags[i]);
+                next_to_write = i + 1;
+            }
+            read_cv.notify_all();
+
+            if(!tag.data.has_value()) {
+                eprintf_error("Failed to open %s\n", archive_list[i].first.string().c_str());
+                failed = true;
+                break;
+            }
+            auto &data = tag.data.value();
 
             // libarchive always needs POSIX paths.
             auto archive_path = archive_list[i].second;
@@ -430,27 +541,7 @@ int main(int argc, const char **argv) {
             archive_entry_set_pathname(entry, archive_path.c_str());
             archive_entry_set_perm(entry, 0644);
             archive_entry_set_filetype(entry, AE_IFREG);
-
-            auto data_maybe = File::open_file(path);
-            if(!data_maybe.has_value()) {
-                eprintf_error("Failed to open %s\n", path);
-                return EXIT_FAILURE;
-            }
-            auto &data = data_maybe.value();
-
-            // Get the filesystem path and write time
-            std::filesystem::path path_path = path;
-
-            // Get the modified time
-            struct stat s;
-            stat(path, &s);
-
-            // Windows uses mtime which is a time_t rather than a struct with nanoseconds
-            #ifdef _WIN32
-            archive_entry_set_mtime(entry, s.st_mtime, 0);
-            #else
-            archive_entry_set_mtime(entry, s.st_mtim.tv_sec, 0);
-            #endif
+            archive_entry_set_mtime(entry, tag.modified, 0);
 
             // Archive that bastard
             archive_entry_set_size(entry, data.size());
@@ -461,10 +552,24 @@ int main(int argc, const char **argv) {
             archive_entry_free(entry);
         }
 
+        // Stop reading (if we failed, there may still be tags left to read)
+        {
+            std::lock_guard<std::mutex> lock(read_mutex);
+            stop_reading = true;
+        }
+        read_cv.notify_all();
+        for(auto &t : readers) {
+            t.join();
+        }
+
         // Save and close
         archive_write_close(archive);
         archive_write_free(archive);
 
+        if(failed) {
+            return EXIT_FAILURE;
+        }
+
         oprintf("Saved %s\n", archive_options.output.c_str());
     }
     // Copy
@@ -481,47 +586,46 @@ int main(int argc, const char **argv) {
             }
         }
 
-        // Go through each file to archive
+        // Figure out what to copy and make the directories first so the copies don't race to make them
+        std::vector<std::filesystem::path> new_paths;
+        std::vector<char> placed(archive_list.size());
+        std::vector<std::size_t> to_copy;
+        new_paths.reserve(archive_list.size());
         for(std::size_t i = 0; i < archive_list.size(); i++) {
-            auto old_path = std::filesystem::path(archive_list[i].first.c_str());
-            auto new_path = base_path / std::filesystem::path(archive_list[i].second.c_str());
-
-            // Copy function
-            auto place_if_possible = [&new_path, &old_path, &archive_options]() -> bool {
-                // If it exists, continue
-                if(!archive_options.overwrite && std::filesystem::exists(new_path)) {
-                    return false;
-                }
+            auto &new_path = new_paths.emplace_back(base_path / std::filesystem::path(archive_list[i].second.c_str()));
 
-                // Try to see if we need to create the directory
-                auto up_one_dir = new_path.parent_path();
-                if(!std::filesystem::exists(up_one_dir)) {
-                    try {
-                        std::filesystem::create_directories(up_one_dir);
-                    }
-                    catch(std::exception &e) {
-                        eprintf_error("Failed to create directory %s: %s", up_one_dir.string().c_str(), e.what());
-                        return false;
-                    }
-                }
+            // If it exists, continue
+            if(!archive_options.overwrite && std::filesystem::exists(new_path)) {
+                continue;
+            }
 
-                // Now copy
+            // Try to see if we need to create the directory
+            auto up_one_dir = new_path.parent_path();
+            if(!std::filesystem::exists(up_one_dir)) {
                 try {
-                    std::filesystem::copy_file(old_path, new_path, std::filesystem::copy_options::overwrite_existing);
+                    std::filesystem::create_directories(up_one_dir);
                 }
                 catch(std::exception &e) {
-                    eprintf_error("Failed to create copy %s to %s: %s", old_path.string().c_str(), new_path.string().c_str(), e.what());
-                    return false;
+                    eprintf_error("Failed to create directory %s: %s", up_one_dir.string().c_str(), e.what());
+                    continue;
                 }
+            }
 
-                return true;
-            };
+            to_copy.emplace_back(i);
+        }
 
-            if(place_if_possible()) {
-                oprintf_success("Saved %s", new_path.string().c_str());
+        // Now copy
+        for_each_in_parallel(to_copy.size(), archive_options.max_threads, [&archive_list, &new_paths, &placed, &to_copy](std::size_t c) {
+            auto i = to_copy[c];
+            placed[i] = File::copy_file(archive_list[i].first, new_paths[i]);
+        });
+
+        for(std::size_t i = 0; i < archive_list.size(); i++) {
+            if(placed[i]) {
+                oprintf_success("Saved %s", new_paths[i].string().c_str());
             }
             else {
-                eprintf_warn("Skipping %s...", new_path.string().c_str());
+                eprintf_warn("Skipping %s...", new_paths[i].string().c_str());
             }
         }
     }
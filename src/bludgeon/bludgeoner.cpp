@@ -172,7 +172,7 @@ namespace Invader::Bludgeoner {
         bool rval = false;
         
         // Go through all the values. Fix the stuff.
-        for(auto &i : s->get_values()) {
+        for(auto i : s->get_values()) {
             switch(i.get_type()) {
                 case Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE: {
                     auto count = i.get_array_size();
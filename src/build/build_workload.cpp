@@ -2,6 +2,7 @@
 
 #include <ctime>
 #include <cstdio>
+#include <unordered_set>
 
 #include <invader/build/build_workload.hpp>
 #include <invader/hek/map.hpp>
@@ -11,6 +12,7 @@
 #include <invader/crc/hek/crc.hpp>
 #include <invader/compress/compression.hpp>
 #include <invader/tag/index/index.hpp>
+#include <invader/tag/parser/compile/scenario.hpp>
 #include <invader/tag/parser/compile/scenario_structure_bsp.hpp>
 #include <invader/resource/list/resource_list.hpp>
 #include "../crc/crc32.h"
@@ -51,6 +53,53 @@ namespace Invader {
 
     BuildWorkload::BuildWorkload() : ErrorHandler() {}
 
+    void *BuildWorkload::BuildWorkloadArena::allocate(std::size_t size, std::size_t alignment) {
+        // Anything big gets its own block so the rest of the current block isn't wasted
+        if(size > BLOCK_SIZE / 4) {
+            auto &block = this->blocks.emplace_back(std::make_unique<std::byte []>(size));
+            this->reserved += size;
+            return block.get();
+        }
+
+        auto space = static_cast<std::size_t>(this->end - this->cursor);
+        auto padding = this->cursor ? (alignment - reinterpret_cast<std::uintptr_t>(this->cursor) % alignment) % alignment : 0;
+        if(!this->cursor || space < padding || space - padding < size) {
+            auto &block = this->blocks.emplace_back(std::make_unique<std::byte []>(BLOCK_SIZE));
+            this->reserved += BLOCK_SIZE;
+            this->cursor = block.get();
+            this->end = this->cursor + BLOCK_SIZE;
+            padding = 0;
+        }
+
+        this->last = this->cursor + padding;
+        this->cursor = this->last + size;
+        return this->last;
+    }
+
+    void BuildWorkload::BuildWorkloadArena::deallocate(void *pointer, std::size_t size) noexcept {
+        // A vector that grows frees its old data after allocating the new data, so this mostly helps with shrinking
+        if(pointer == this->last && this->last + size == this->cursor) {
+            this->cursor = this->last;
+        }
+    }
+
+    static void set_reporting_level_for_verbosity(BuildWorkload &workload, BuildWorkload::BuildParameters::BuildVerbosity verbosity) {
+        switch(verbosity) {
+            case BuildWorkload::BuildParameters::BuildVerbosity::BUILD_VERBOSITY_SHOW_ALL:
+                break;
+            case BuildWorkload::BuildParameters::BuildVerbosity::BUILD_VERBOSITY_HIDE_PEDANTIC:
+                workload.set_reporting_level(BuildWorkload::REPORTING_LEVEL_HIDE_ALL_PEDANTIC_WARNINGS);
+                break;
+            case BuildWorkload::BuildParameters::BuildVerbosity::BUILD_VERBOSITY_QUIET:
+            case BuildWorkload::BuildParameters::BuildVerbosity::BUILD_VERBOSITY_HIDE_WARNINGS:
+                workload.set_reporting_level(BuildWorkload::REPORTING_LEVEL_HIDE_ALL_WARNINGS);
+                break;
+            case BuildWorkload::BuildParameters::BuildVerbosity::BUILD_VERBOSITY_HIDE_ERRORS:
+                workload.set_reporting_level(BuildWorkload::REPORTING_LEVEL_HIDE_EVERYTHING);
+                break;
+        }
+    }
+
     std::vector<std::byte> BuildWorkload::compile_map(const BuildParameters &parameters) {
         BuildWorkload workload;
         workload.parameters = &parameters;
@@ -59,20 +108,7 @@ namespace Invader {
         workload.start = std::chrono::steady_clock::now();
 
         // Hide these?
-        switch(parameters.verbosity) {
-            case BuildParameters::BuildVerbosity::BUILD_VERBOSITY_SHOW_ALL:
-                break;
-            case BuildParameters::BuildVerbosity::BUILD_VERBOSITY_HIDE_PEDANTIC:
-                workload.set_reporting_level(REPORTING_LEVEL_HIDE_ALL_PEDANTIC_WARNINGS);
-                break;
-            case BuildParameters::BuildVerbosity::BUILD_VERBOSITY_QUIET:
-            case BuildParameters::BuildVerbosity::BUILD_VERBOSITY_HIDE_WARNINGS:
-                workload.set_reporting_level(REPORTING_LEVEL_HIDE_ALL_WARNINGS);
-                break;
-            case BuildParameters::BuildVerbosity::BUILD_VERBOSITY_HIDE_ERRORS:
-                workload.set_reporting_level(REPORTING_LEVEL_HIDE_EVERYTHING);
-                break;
-        }
+        set_reporting_level_for_verbosity(workload, parameters.verbosity);
 
         return workload.build_cache_file();
     }
@@ -656,7 +692,7 @@ namespace Invader {
         auto &tags = this->tags;
         auto &workload = *this;
         auto do_compile_tag = [&structs, &tags, &workload, &tag_index](auto new_tag_struct) {
-            auto &new_struct = structs.emplace_back();
+            auto &new_struct = workload.add_struct();
             tags[tag_index].base_struct = &new_struct - structs.data();
             new_struct.data.resize(sizeof(typename decltype(new_tag_struct)::struct_little), std::byte());
             new_tag_struct.compile(workload, tag_index, &new_struct - structs.data());
@@ -1061,6 +1097,197 @@ namespace Invader {
         return workload;
     }
 
+    static void find_struct_dependencies(const Parser::ParserStruct &s, std::vector<File::TagFilePath> &dependencies) {
+        for(auto value : s.get_values()) {
+            switch(value.get_type()) {
+                case Parser::ParserStructValue::ValueType::VALUE_TYPE_DEPENDENCY: {
+                    const auto &dependency = value.get_dependency();
+                    if(!dependency.path.empty()) {
+                        dependencies.emplace_back(dependency.path, dependency.tag_fourcc);
+                    }
+                    break;
+                }
+                case Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE: {
+                    std::size_t count = value.get_array_size();
+                    for(std::size_t i = 0; i < count; i++) {
+                        find_struct_dependencies(value.get_object_in_array(i), dependencies);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    std::vector<std::byte> BuildWorkload::open_tag_file(const File::TagFilePath &tag, const std::vector<std::filesystem::path> &tags_directories) {
+        auto formatted_path = File::halo_path_to_preferred_path(tag.join());
+        auto file_path = File::tag_path_to_file_path(formatted_path, tags_directories);
+        if(!file_path.has_value() || !std::filesystem::exists(*file_path)) {
+            eprintf_error("Failed to find %s", formatted_path.c_str());
+            throw InvalidTagPathException();
+        }
+
+        auto tag_file = File::open_file(*file_path);
+        if(!tag_file.has_value()) {
+            eprintf_error("Failed to open %s", formatted_path.c_str());
+            throw FailedToOpenFileException();
+        }
+        return std::move(*tag_file);
+    }
+
+    Parser::Scenario BuildWorkload::load_scenario(const BuildParameters &parameters, std::vector<File::TagFilePath> *child_scenarios) {
+        BuildWorkload workload;
+        workload.parameters = &parameters;
+        set_reporting_level_for_verbosity(workload, parameters.verbosity);
+
+        // Merge its child scenarios into it like Scenario::pre_compile() does
+        auto &scenario_tag = workload.tags.emplace_back();
+        scenario_tag.path = File::remove_duplicate_slashes(File::preferred_path_to_halo_path(parameters.scenario));
+        scenario_tag.tag_fourcc = TagFourCC::TAG_FOURCC_SCENARIO;
+
+        auto scenario_data = open_tag_file(File::TagFilePath(scenario_tag.path, scenario_tag.tag_fourcc), parameters.tags_directories);
+        auto scenario = Parser::Scenario::parse_hek_tag_file(scenario_data.data(), scenario_data.size(), true);
+        scenario_data.clear();
+
+        auto merged_scenarios = Parser::merge_child_scenarios(workload, 0, scenario);
+        if(child_scenarios) {
+            for(auto &m : merged_scenarios) {
+                child_scenarios->emplace_back(m, TagFourCC::TAG_FOURCC_SCENARIO);
+            }
+        }
+
+        return scenario;
+    }
+
+    std::vector<File::TagFilePath> BuildWorkload::find_map_tags(const BuildParameters &parameters, std::vector<File::TagFilePath> *child_scenarios) {
+        BuildWorkload workload;
+        workload.parameters = &parameters;
+        set_reporting_level_for_verbosity(workload, parameters.verbosity);
+
+        const auto &tags_directories = parameters.tags_directories;
+        std::vector<File::TagFilePath> tags;
+        std::unordered_set<File::TagFilePath, File::TagFilePathHash> found_tags;
+
+        auto add_tag = [&tags, &found_tags](const std::string &path, TagFourCC tag_fourcc) {
+            File::TagFilePath tag(File::remove_duplicate_slashes(path), tag_fourcc);
+            if(found_tags.insert(tag).second) {
+                tags.emplace_back(std::move(tag));
+            }
+        };
+
+        auto add_dependencies = [&add_tag](const std::vector<File::TagFilePath> &dependencies) {
+            for(auto &d : dependencies) {
+                add_tag(d.path, d.fourcc);
+            }
+        };
+
+        // Start with the scenario
+        add_tag(File::preferred_path_to_halo_path(parameters.scenario), TagFourCC::TAG_FOURCC_SCENARIO);
+        auto &scenario_tag = workload.tags.emplace_back();
+        scenario_tag.path = tags[0].path;
+        scenario_tag.tag_fourcc = TagFourCC::TAG_FOURCC_SCENARIO;
+
+        auto scenario = load_scenario(parameters, child_scenarios);
+
+        // Scripts are recompiled when building, and whatever they reference is added to the scenario's references
+        if((scenario.scripts.size() > 0 || scenario.globals.size() > 0) && scenario.source_files.size() == 0) {
+            workload.report_error(BuildWorkload::ErrorType::ERROR_TYPE_FATAL_ERROR, "Scenario tag has script data but no source file data", 0);
+            eprintf_warn("To fix this, recompile the scripts");
+            throw InvalidTagDataException();
+        }
+        std::vector<std::string> warnings;
+        Parser::compile_scripts(scenario, HEK::GameEngineInfo::get_game_engine_info(parameters.details.build_game_engine), warnings, tags_directories);
+
+        std::vector<File::TagFilePath> dependencies;
+        find_struct_dependencies(scenario, dependencies);
+        add_dependencies(dependencies);
+
+        // Then the tags required by the target engine for the scenario type
+        auto scenario_type = scenario.type;
+        bool demo_ui = scenario.flags & HEK::ScenarioFlagsFlag::SCENARIO_FLAGS_FLAG_USE_DEMO_UI;
+        const auto &required_tags = parameters.details.build_required_tags;
+
+        auto add_all = [&add_tag](auto &what) {
+            for(std::size_t c = 0; c < what.count; c++) {
+                add_tag(what.ptr[c].path, what.ptr[c].fourcc);
+            }
+        };
+
+        add_all(required_tags.all);
+        switch(scenario_type) {
+            case ScenarioType::SCENARIO_TYPE_SINGLEPLAYER:
+                add_all(required_tags.singleplayer);
+                add_all(demo_ui ? required_tags.singleplayer_demo : required_tags.singleplayer_full);
+                break;
+            case ScenarioType::SCENARIO_TYPE_MULTIPLAYER:
+                add_all(required_tags.multiplayer);
+                add_all(demo_ui ? required_tags.multiplayer_demo : required_tags.multiplayer_full);
+                break;
+            case ScenarioType::SCENARIO_TYPE_USER_INTERFACE:
+                add_all(required_tags.user_interface);
+                add_all(demo_ui ? required_tags.user_interface_demo : required_tags.user_interface_full);
+                break;
+            case ScenarioType::SCENARIO_TYPE_ENUM_COUNT:
+                std::terminate();
+        }
+
+        // Go through everything else. Most tags' references can be scanned for without parsing them, but globals and
+        // meter tags drop some references when compiled, so those are parsed and dropped the same way.
+        std::vector<Parser::DependencyView> dependency_views;
+        for(std::size_t t = 1; t < tags.size(); t++) {
+            auto tag = tags[t];
+            auto tag_data = open_tag_file(tag, tags_directories);
+            dependencies.clear();
+
+            try {
+                HEK::TagFileHeader::validate_header(reinterpret_cast<const HEK::TagFileHeader *>(tag_data.data()), tag_data.size(), tag.fourcc);
+
+                switch(tag.fourcc) {
+                    case TagFourCC::TAG_FOURCC_GLOBALS: {
+                        auto globals = Parser::Globals::parse_hek_tag_file(tag_data.data(), tag_data.size(), true);
+                        if(scenario_type != ScenarioType::SCENARIO_TYPE_MULTIPLAYER) {
+                            globals.multiplayer_information.clear();
+                            globals.cheat_powerups.clear();
+                            globals.weapon_list.clear();
+                        }
+                        if(scenario_type == ScenarioType::SCENARIO_TYPE_USER_INTERFACE) {
+                            globals.falling_damage.clear();
+                            globals.materials.clear();
+                            for(auto &p : globals.player_information) {
+                                p.unit = {};
+                            }
+                        }
+                        find_struct_dependencies(globals, dependencies);
+                        break;
+                    }
+                    case TagFourCC::TAG_FOURCC_METER: {
+                        auto meter = Parser::Meter::parse_hek_tag_file(tag_data.data(), tag_data.size(), true);
+                        meter.source_bitmap = {};
+                        meter.stencil_bitmaps = {};
+                        find_struct_dependencies(meter, dependencies);
+                        break;
+                    }
+                    default:
+                        dependency_views.clear();
+                        Parser::ParserStruct::scan_hek_tag_file_dependencies(tag_data.data(), tag_data.size(), dependency_views);
+                        for(auto &d : dependency_views) {
+                            dependencies.emplace_back(std::string(d.path), d.tag_fourcc);
+                        }
+                        break;
+                }
+            }
+            catch(std::exception &) {
+                eprintf("Failed to read tag %s\n", File::halo_path_to_preferred_path(tag.join()).c_str());
+                throw;
+            }
+
+            add_dependencies(dependencies);
+        }
+
+        return tags;
+    }
+
     template <typename Tag, HEK::Pointer64 stub_address, bool native> static void do_generate_tag_array(std::size_t tag_count, std::vector<BuildWorkload::BuildWorkloadTag> &tags, std::vector<BuildWorkload::BuildWorkloadStruct> &structs) {
         TAG_ARRAY_STRUCT.data.resize(sizeof(Tag) * tag_count);
 
@@ -1199,57 +1426,90 @@ namespace Invader {
 
         auto &cache_version = this->parameters->details.build_cache_file_engine;
 
-        auto recursively_generate_data = [&structs, &tags, &pointers, &pointers_64_bit, &pointer_of_tag_path, &cache_version](std::vector<std::byte> &data, std::size_t struct_index, auto &recursively_generate_data) {
-            auto &s = structs[struct_index];
-
-            // Return the pointer thingy
-            if(s.offset.has_value()) {
-                return;
-            }
+        auto generate_data = [&structs, &tags, &pointers, &pointers_64_bit, &pointer_of_tag_path, &cache_version](std::vector<std::byte> &data, std::size_t struct_index) {
+            // Lay everything out first so the data only has to be allocated once and each struct is only copied once. Each
+            // struct goes where it's first reached, followed by anything it points to that hasn't been placed yet, then
+            // padding.
+            std::vector<std::size_t> placed_structs;
+            std::size_t pointer_count = 0;
+            std::size_t pointer_64_bit_count = 0;
+            std::size_t data_size = data.size();
+
+            auto lay_out = [&structs, &placed_structs, &pointer_count, &pointer_64_bit_count, &data_size, &cache_version](std::size_t struct_index, auto &lay_out) -> void {
+                auto &s = structs[struct_index];
+
+                // Already placed?
+                if(s.offset.has_value()) {
+                    return;
+                }
 
-            // Set the offset thingy
-            std::size_t offset = data.size();
-            s.offset = offset;
-            data.insert(data.end(), s.data.begin(), s.data.end());
+                s.offset = data_size;
+                data_size += s.data.size();
+                placed_structs.emplace_back(struct_index);
 
-            // Get the pointers
-            for(auto &pointer : s.pointers) {
-                recursively_generate_data(data, pointer.struct_index, recursively_generate_data);
-                PointerInternal pointer_internal { pointer.offset + offset, pointer.struct_index, pointer.struct_data_offset };
-                if(cache_version != HEK::CacheFileEngine::CACHE_FILE_NATIVE || pointer.limit_to_32_bits) {
-                    pointers.emplace_back(pointer_internal);
+                for(auto &pointer : s.pointers) {
+                    if(cache_version != HEK::CacheFileEngine::CACHE_FILE_NATIVE || pointer.limit_to_32_bits) {
+                        pointer_count++;
+                    }
+                    else {
+                        pointer_64_bit_count++;
+                    }
+                    lay_out(pointer.struct_index, lay_out);
                 }
-                else {
-                    pointers_64_bit.emplace_back(pointer_internal);
+
+                data_size += REQUIRED_PADDING_32_BIT(data_size);
+            };
+            lay_out(struct_index, lay_out);
+
+            data.reserve(data_size);
+            pointers.reserve(pointers.size() + pointer_count);
+            pointers_64_bit.reserve(pointers_64_bit.size() + pointer_64_bit_count);
+
+            // Structs were placed in order, so they can just be appended
+            for(auto i : placed_structs) {
+                auto &s = structs[i];
+                std::size_t offset = *s.offset;
+                data.resize(offset);
+                data.insert(data.end(), s.data.begin(), s.data.end());
+
+                // Get the pointers
+                for(auto &pointer : s.pointers) {
+                    PointerInternal pointer_internal { pointer.offset + offset, pointer.struct_index, pointer.struct_data_offset };
+                    if(cache_version != HEK::CacheFileEngine::CACHE_FILE_NATIVE || pointer.limit_to_32_bits) {
+                        pointers.emplace_back(pointer_internal);
+                    }
+                    else {
+                        pointers_64_bit.emplace_back(pointer_internal);
+                    }
                 }
-            }
 
-            // Get the pointers
-            for(auto &dependency : s.dependencies) {
-                auto tag_index = dependency.tag_index;
-                std::uint32_t full_id = static_cast<std::uint32_t>((tag_index + 0x6174) | 0x8000) << 16 | static_cast<std::uint16_t>(tag_index); // salt = (0x6174 'at' | 0x8000) + index
-                HEK::TagID new_tag_id = { full_id };
+                // Get the dependencies
+                for(auto &dependency : s.dependencies) {
+                    auto tag_index = dependency.tag_index;
+                    std::uint32_t full_id = static_cast<std::uint32_t>((tag_index + 0x6174) | 0x8000) << 16 | static_cast<std::uint16_t>(tag_index); // salt = (0x6174 'at' | 0x8000) + index
+                    HEK::TagID new_tag_id = { full_id };
 
-                if(dependency.tag_id_only) {
-                    *reinterpret_cast<HEK::LittleEndian<HEK::TagID> *>(data.data() + offset + dependency.offset) = new_tag_id;
-                }
-                else {
-                    auto &dependency_struct = *reinterpret_cast<HEK::TagDependency<HEK::LittleEndian> *>(data.data() + offset + dependency.offset);
-                    dependency_struct.tag_fourcc = tags[tag_index].tag_fourcc;
-                    dependency_struct.tag_id = new_tag_id;
-                    if(cache_version != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-                        dependency_struct.path_pointer = pointer_of_tag_path(tag_index);
+                    if(dependency.tag_id_only) {
+                        *reinterpret_cast<HEK::LittleEndian<HEK::TagID> *>(data.data() + offset + dependency.offset) = new_tag_id;
+                    }
+                    else {
+                        auto &dependency_struct = *reinterpret_cast<HEK::TagDependency<HEK::LittleEndian> *>(data.data() + offset + dependency.offset);
+                        dependency_struct.tag_fourcc = tags[tag_index].tag_fourcc;
+                        dependency_struct.tag_id = new_tag_id;
+                        if(cache_version != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
+                            dependency_struct.path_pointer = pointer_of_tag_path(tag_index);
+                        }
                     }
                 }
             }
 
             // Append stuff
-            data.insert(data.end(), REQUIRED_PADDING_32_BIT(data.size()), std::byte());
+            data.resize(data_size);
         };
 
         // Build the tag data for the main tag data
         auto &tag_data_struct = this->map_data_structs.emplace_back();
-        recursively_generate_data(tag_data_struct, 0, recursively_generate_data);
+        generate_data(tag_data_struct, 0);
         auto *tag_data_b = tag_data_struct.data();
 
         // Adjust the pointers
@@ -1299,7 +1559,7 @@ namespace Invader {
                     pointers.clear();
                     pointers_64_bit.clear();
                     auto &bsp_data_struct = this->map_data_structs.emplace_back();
-                    recursively_generate_data(bsp_data_struct, base_struct, recursively_generate_data);
+                    generate_data(bsp_data_struct, base_struct);
                     
                     std::size_t bsp_size = bsp_data_struct.size();
                     
@@ -2350,8 +2610,8 @@ namespace Invader {
         auto &vertices_data_struct = this->structs[vertices_data_struct_index];
         
         // Add an entry for each part
-        auto *indices_array_data = reinterpret_cast<HEK::CacheFileModelPartIndicesXbox *>((indices_array_struct.data = std::vector<std::byte>(part_count * sizeof(HEK::CacheFileModelPartIndicesXbox))).data());
-        auto *vertices_array_data = reinterpret_cast<HEK::CacheFileModelPartVerticesXbox *>((vertices_array_struct.data = std::vector<std::byte>(part_count * sizeof(HEK::CacheFileModelPartVerticesXbox))).data());
+        auto *indices_array_data = reinterpret_cast<HEK::CacheFileModelPartIndicesXbox *>((indices_array_struct.data = BuildWorkloadVector<std::byte>(part_count * sizeof(HEK::CacheFileModelPartIndicesXbox))).data());
+        auto *vertices_array_data = reinterpret_cast<HEK::CacheFileModelPartVerticesXbox *>((vertices_array_struct.data = BuildWorkloadVector<std::byte>(part_count * sizeof(HEK::CacheFileModelPartVerticesXbox))).data());
         
         // Fill it up with the vertices/indices
         auto *indices_data = this->model_indices.data();
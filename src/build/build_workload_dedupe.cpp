@@ -11,7 +11,7 @@ namespace Invader {
         
         // Make sure dependencies match
         if(this->dependencies != other.dependencies) {
-            std::vector<BuildWorkloadDependency> this_dep_small;
+            BuildWorkloadVector<BuildWorkloadDependency> this_dep_small;
             for(auto &td : this->dependencies) {
                 if(td.offset < other_size) {
                     if(td.offset + sizeof(HEK::TagDependency<HEK::LittleEndian>) > other_size) { // other struct only contains part of the dependency
@@ -27,7 +27,7 @@ namespace Invader {
         
         // And now pointers
         if(this->pointers != other.pointers) {
-            std::vector<BuildWorkloadStructPointer> this_ptr_small;
+            BuildWorkloadVector<BuildWorkloadStructPointer> this_ptr_small;
             for(auto &ptr : this->pointers) {
                 if(ptr.offset < other_size) {
                     this_ptr_small.emplace_back(ptr);
@@ -5,6 +5,11 @@
 #include <vector>
 #include <cstring>
 #include <regex>
+#include <list>
+#include <optional>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <invader/map/map.hpp>
 #include <invader/resource/resource_map.hpp>
@@ -15,6 +20,7 @@
 #include <invader/tag/parser/parser.hpp>
 #include <invader/extract/extraction.hpp>
 #include "../command_line_option.hpp"
+#include "../util/fnv1a.hpp"
 
 using namespace Invader;
 
@@ -339,70 +345,167 @@ int main(int argc, const char **argv) {
     regular_comparison(compare_options.inputs, compare_options.precision, compare_options.show, compare_options.match_all, compare_options.functional, compare_options.by_path, compare_options.verbose, *compare_options.job_count);
 }
 
+// Lookup tables for an input
+struct InputIndex {
+    // Path of every tag in the input by map tag index or virtual directory index
+    std::vector<File::TagFilePath> paths;
+    
+    // Every tag in the input, in order, by path and by class
+    std::unordered_map<File::TagFilePath, std::vector<std::size_t>, File::TagFilePathHash> tags_by_path;
+    std::unordered_map<TagFourCC, std::vector<std::size_t>> tags_by_fourcc;
+    
+    // Number of tags that matched the search queries, by path and by class
+    std::unordered_map<File::TagFilePath, std::size_t, File::TagFilePathHash> searched_by_path;
+    std::unordered_map<TagFourCC, std::size_t> searched_by_fourcc;
+};
+
+// A tag that was compared against the first tag found for a path
+struct ComparisonResult {
+    std::size_t tag;
+    bool matched;
+    std::string other_path;
+    std::size_t other_input;
+    std::list<std::string> differences;
+};
+
+// Everything in a compiled tag that matters, put one after another so two compiled tags can be compared by bytes
+struct CompiledTagBytes {
+    std::vector<std::byte> data;
+    
+    void update(const void *data, std::size_t size) {
+        auto *bytes = reinterpret_cast<const std::byte *>(data);
+        this->data.insert(this->data.end(), bytes, bytes + size);
+    }
+    
+    template <typename... Args> void updatef(const char *fmt, Args... args) {
+        char o[1024] = {};
+        auto len = std::snprintf(o, sizeof(o), fmt, args...);
+        this->update(o, std::min(static_cast<std::size_t>(len), sizeof(o) - 1));
+    }
+};
+
+static bool has_tag_to_compare(const InputIndex &index, const File::TagFilePath &tag, ByPath by_path) {
+    auto same = index.searched_by_path.find(tag);
+    auto same_count = same == index.searched_by_path.end() ? 0 : same->second;
+    auto fourcc = index.searched_by_fourcc.find(tag.fourcc);
+    auto fourcc_count = fourcc == index.searched_by_fourcc.end() ? 0 : fourcc->second;
+    
+    switch(by_path) {
+        case ByPath::BY_PATH_SAME:
+            return same_count > 0;
+        case ByPath::BY_PATH_DIFFERENT:
+            return fourcc_count > same_count;
+        case ByPath::BY_PATH_ANY:
+            return fourcc_count > 0;
+    }
+    
+    return false;
+}
+
+static std::vector<std::byte> compiled_tag_bytes(Parser::ParserStruct &struct_v, TagFourCC tag_fourcc) {
+    auto hdata = struct_v.generate_hek_tag_data(tag_fourcc);
+    CompiledTagBytes bytes;
+    
+    // Compile it
+    auto compiled = BuildWorkload::compile_single_tag(hdata.data(), hdata.size());
+    
+    // Process each struct
+    for(auto &s : compiled.structs) {
+        // Process struct data
+        bytes.update(s.data.data(), s.data.size());
+        
+        // Process each dependency
+        for(auto &d : s.dependencies) {
+            bytes.updatef("D:%08zX->%08zX!", d.offset, d.tag_index);
+        }
+        
+        // Process each pointer
+        for(auto &p : s.pointers) {
+            bytes.updatef("P:%08zX->%08zX!", p.offset, p.struct_index);
+        }
+    }
+    
+    // Process each tag
+    for(auto &t : compiled.tags) {
+        bytes.updatef("T:%s.%s!", t.path.c_str(), HEK::tag_fourcc_to_extension(t.tag_fourcc));
+        
+        // Raw data pointers
+        for(auto &ad : t.asset_data) {
+            bytes.updatef("AD:%zu!", ad);
+        }
+    }
+    
+    // And of course we need the raw data
+    for(auto &rd : compiled.raw_data) {
+        bytes.update(rd.data(), rd.size());
+    }
+    
+    // Lastly, model data
+    bytes.update(compiled.uncompressed_model_vertices.data(), compiled.uncompressed_model_vertices.size() * sizeof(*compiled.uncompressed_model_vertices.data()));
+    bytes.update(compiled.compressed_model_vertices.data(), compiled.compressed_model_vertices.size() * sizeof(*compiled.compressed_model_vertices.data()));
+    bytes.update(compiled.model_indices.data(), compiled.model_indices.size() * sizeof(*compiled.model_indices.data()));
+    
+    return std::move(bytes.data);
+}
+
 static void regular_comparison(const std::vector<Input> &inputs, bool precision, Show show, bool match_all, bool functional, ByPath by_path, bool verbose, std::size_t job_count) {
-    // Find all tags we have in common first
     auto input_count = inputs.size();
-    std::vector<File::TagFilePath> tags;
     
-    #define CAN_COMPARE(by_path, path1, path2) ((by_path == ByPath::BY_PATH_SAME && path1 == path2) || (by_path == ByPath::BY_PATH_DIFFERENT && path1 != path2) || (by_path == ByPath::BY_PATH_ANY))
+    // Index every input by path and class so we don't have to scan them for each tag
+    std::vector<InputIndex> indices(input_count);
+    for(std::size_t i = 0; i < input_count; i++) {
+        auto &input = inputs[i];
+        auto &index = indices[i];
+        
+        if(input.map.has_value()) {
+            auto tag_count = input.map_data->get_tag_count();
+            index.paths.reserve(tag_count);
+            for(std::size_t t = 0; t < tag_count; t++) {
+                auto &map_tag = input.map_data->get_tag(t);
+                index.paths.emplace_back(map_tag.get_path(), map_tag.get_tag_fourcc());
+            }
+        }
+        else {
+            index.paths.reserve(input.virtual_directory.size());
+            for(auto &vd : input.virtual_directory) {
+                index.paths.emplace_back(File::split_tag_class_extension(File::preferred_path_to_halo_path(vd.tag_path)).value());
+            }
+        }
+        
+        for(std::size_t t = 0; t < index.paths.size(); t++) {
+            index.tags_by_path[index.paths[t]].emplace_back(t);
+            index.tags_by_fourcc[index.paths[t].fourcc].emplace_back(t);
+        }
+        for(auto &tag : input.tag_paths) {
+            index.searched_by_path[tag]++;
+            index.searched_by_fourcc[tag.fourcc]++;
+        }
+    }
     
-    // Do this thing
+    // Find all tags we have in common first
+    std::vector<File::TagFilePath> tags;
     if(match_all) {
         auto &first_input = inputs[0];
-        auto input_count = inputs.size();
         tags.reserve(first_input.tag_paths.size());
         for(auto &tag : first_input.tag_paths) {
-            bool not_found = false;
-            for(std::size_t i = 1; i < input_count; i++) {
-                bool found = false;
-                for(auto &tag2 : inputs[i].tag_paths) {
-                    if(tag2.fourcc != tag.fourcc) {
-                        continue;
-                    }
-                    if(CAN_COMPARE(by_path, tag.path, tag2.path)) {
-                        found = true;
-                        break;
-                    }
-                }
-                if(!found) {
-                    not_found = true;
-                    break;
-                }
+            bool found = true;
+            for(std::size_t i = 1; i < input_count && found; i++) {
+                found = has_tag_to_compare(indices[i], tag, by_path);
             }
-            if(not_found) {
-                continue;
+            if(found) {
+                tags.push_back(tag);
             }
-            tags.push_back(tag);
         }
     }
     else {
+        std::unordered_set<File::TagFilePath, File::TagFilePathHash> tags_added;
         for(std::size_t i = 0; i < input_count; i++) {
-            auto &input = inputs[i];
             for(std::size_t j = i + 1; j < input_count; j++) {
-                auto &input2 = inputs[j];
-                for(auto &tag : input.tag_paths) {
-                    // Make sure we don't add any duplicates
-                    bool found = false;
-                    for(auto &otag : tags) {
-                        if(otag == tag) {
-                            found = true;
-                            break;
-                        }
-                    }
-                    if(found) {
-                        continue;
-                    }
-                    
-                    // Add it if it's present!
-                    for(auto &tag2 : input2.tag_paths) {
-                        if(tag2.fourcc != tag.fourcc) {
-                            continue;
-                        }
-                        if(CAN_COMPARE(by_path, tag.path, tag2.path)) {
-                            found = true;
-                            tags.push_back(tag);
-                            break;
-                        }
+                for(auto &tag : inputs[i].tag_paths) {
+                    // Make sure we don't add any duplicates, then add it if it's present!
+                    if(tags_added.find(tag) == tags_added.end() && has_tag_to_compare(indices[j], tag, by_path)) {
+                        tags_added.insert(tag);
+                        tags.push_back(tag);
                     }
                 }
             }
@@ -414,284 +517,215 @@ static void regular_comparison(const std::vector<Input> &inputs, bool precision,
     bool show_all = (show & Show::SHOW_ALL) == Show::SHOW_ALL;
     
     // Next, compare each tag
-    std::size_t matched_count = 0;
-    std::size_t mismatched_count = 0;
-    
     std::mutex tag_mutex;
     std::mutex log_mutex;
     std::size_t tag_index = 0;
     
+    // Each thread keeps its own results; these are put back in order once everything is compared
+    std::vector<std::vector<ComparisonResult>> thread_results(job_count);
+    
+    // Compiled tags are only compiled once per input, no matter how many tags they're compared against
+    std::mutex digest_mutex;
+    std::vector<std::unordered_map<std::size_t, std::uint64_t>> compiled_digests(input_count);
+    
     std::vector<std::thread> threads;
     threads.reserve(job_count);
     for(std::size_t t = 0; t < job_count; t++) {
-        auto perform_comparison_thread = [](auto *inputs, auto *tags, auto by_path, auto show_all, auto show, auto *matched_count, auto *mismatched_count, auto functional, auto precision, auto verbose, auto *tag_mutex, auto *tag_index, auto *log_mutex) {
-            reset_loop: while(true) {
+        auto perform_comparison_thread = [](auto *inputs, auto *indices, auto *tags, auto by_path, auto show_all, auto functional, auto precision, auto verbose, auto *tag_mutex, auto *tag_index, auto *log_mutex, auto *digest_mutex, auto *compiled_digests, auto *results) {
+            while(true) {
                 tag_mutex->lock();
                 if(*tag_index >= tags->size()) {
                     tag_mutex->unlock();
                     return;
                 }
-                auto &tag = (*tags)[*tag_index];
-                (*tag_index)++;
+                auto this_tag_index = (*tag_index)++;
+                auto &tag = (*tags)[this_tag_index];
                 tag_mutex->unlock();
                 
-                std::vector<std::unique_ptr<Parser::ParserStruct>> structs;
-                std::vector<std::string> struct_paths;
-                std::vector<const Input *> struct_inputs;
-                
-                bool first_input = true;
-                bool only_finding_same_tag = true;
-                auto path_unsplit = File::halo_path_to_preferred_path(tag.path + "." + HEK::tag_fourcc_to_extension(tag.fourcc)); // combine this
+                auto report_error = [&tag, &log_mutex](const char *what, const std::exception &e) {
+                    log_mutex->lock();
+                    eprintf_error("Cannot %s %s.%s due to an error: %s", what, File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_fourcc_to_extension(tag.fourcc), e.what());
+                    log_mutex->unlock();
+                };
                 
-                try {
-                    // Go through each input
-                    for(auto &i : *inputs) {
-                        // On the first input, we always break when we find the tag since we're only looking for tags with the same path to match the tag with the outer loop
-                        // On subsequent inputs, we only break if we're *always* looking for tags with the same path.
-                        auto by_path_copy = by_path;
-                        if(first_input) {
-                            first_input = false; // set to false
-                            by_path_copy = ByPath::BY_PATH_SAME;
-                        }
-                        
-                        only_finding_same_tag = by_path_copy == ByPath::BY_PATH_SAME;
-                        
-                        // If it's a map, do this
-                        if(i.map.has_value()) {
-                            // First, extract it
-                            auto tag_count = i.map_data->get_tag_count();
-                            for(std::size_t t = 0; t < tag_count; t++) {
-                                auto &map_tag = i.map_data->get_tag(t);
-                                auto &map_tag_path = map_tag.get_path();
-                                if(map_tag.get_tag_fourcc() == tag.fourcc && CAN_COMPARE(by_path_copy, tag.path, map_tag_path)) {
-                                    // Lock the lock mutex in case issues arise when extracting the tag. This may slow down throughput a bit, but it's better than clobbering standard error while other stuff is logging.
-                                    log_mutex->lock();
-                                    
-                                    bool successful = false;
-                                    try {
-                                        auto extracted_data = Invader::ExtractionWorkload::extract_single_tag(i.map_data->get_tag(t));
-                                        structs.emplace_back(Parser::ParserStruct::parse_hek_tag_file(extracted_data.data(), extracted_data.size(), true));
-                                        struct_paths.emplace_back(map_tag_path);
-                                        struct_inputs.emplace_back(&i);
-                                        successful = true;
-                                    }
-                                    catch(std::exception &e) {
-                                        eprintf_error("Cannot compare %s.%s due to an error: %s", File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_fourcc_to_extension(tag.fourcc), e.what());
-                                        successful = false;
-                                    }
-                                    
-                                    // We can now unlock the mutex
-                                    log_mutex->unlock();
-                                    
-                                    // And if we failed, restart the whole loop
-                                    if(!successful) {
-                                        goto reset_loop;
-                                    }
-                                            
-                                    if(only_finding_same_tag) {
-                                        break;
-                                    }
-                                }
-                            }
+                // Find each tag to compare by input and map tag index or virtual directory index
+                std::vector<std::pair<std::size_t, std::size_t>> candidates;
+                auto input_count = inputs->size();
+                for(std::size_t i = 0; i < input_count; i++) {
+                    // On the first input, we only look for tags with the same path to match the tag with the outer loop
+                    // On subsequent inputs, we only take the first tag if we're *always* looking for tags with the same path.
+                    auto &index = (*indices)[i];
+                    if(i == 0 || by_path == ByPath::BY_PATH_SAME) {
+                        auto same = index.tags_by_path.find(tag);
+                        if(same != index.tags_by_path.end()) {
+                            candidates.emplace_back(i, same->second[0]);
                         }
-                        
-                        // If it's a tag, do this
-                        else {
-                            for(auto &vd : i.virtual_directory) {
-                                // Skip if the FourCC is different
-                                if(vd.tag_fourcc != tag.fourcc) {
-                                    continue;
-                                }
-                                
-                                if(CAN_COMPARE(by_path_copy, path_unsplit, vd.tag_path)) {
-                                    // Open it
-                                    auto file = Invader::File::open_file(vd.full_path).value();
-                                    
-                                    // Parse it
-                                    structs.emplace_back(Parser::ParserStruct::parse_hek_tag_file(file.data(), file.size(), true));
-                                    struct_paths.emplace_back(File::split_tag_class_extension(File::preferred_path_to_halo_path(vd.tag_path)).value().path);
-                                    struct_inputs.emplace_back(&i);
-                                    
-                                    if(only_finding_same_tag) {
-                                        break;
-                                    }
+                    }
+                    else {
+                        auto same_fourcc = index.tags_by_fourcc.find(tag.fourcc);
+                        if(same_fourcc != index.tags_by_fourcc.end()) {
+                            for(auto t : same_fourcc->second) {
+                                if(by_path == ByPath::BY_PATH_ANY || index.paths[t].path != tag.path) {
+                                    candidates.emplace_back(i, t);
                                 }
                             }
                         }
                     }
                 }
-                catch(std::exception &e) {
-                    log_mutex->lock();
-                    eprintf_error("Cannot compare %s.%s due to an error: %s", File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_fourcc_to_extension(tag.fourcc), e.what());
-                    log_mutex->unlock();
-                    continue;
-                }
                 
-                auto found_count = structs.size();
+                auto found_count = candidates.size();
                 if(found_count < 2) {
                     continue;
                 }
                 
-                #define MATCHED(type) "%s%s.%s", show_all ? type ": " : ""
-                #define MATCHED_TO(type) "%s%s.%s, %s.%s", show_all ? type ": " : ""
-                #define MATCHED_TO_DIFFERENT_INPUT(type) "%s%s.%s, %s.%s (%zu)", show_all ? type ": " : ""
+                auto load_tag_data = [&inputs, &log_mutex](const std::pair<std::size_t, std::size_t> &candidate) -> std::vector<std::byte> {
+                    auto &input = (*inputs)[candidate.first];
+                    
+                    // If it's a map, extract it
+                    if(input.map.has_value()) {
+                        // Lock the log mutex in case issues arise when extracting the tag. This may slow down throughput a bit, but it's better than clobbering standard error while other stuff is logging.
+                        std::lock_guard<std::mutex> lock(*log_mutex);
+                        return Invader::ExtractionWorkload::extract_single_tag(input.map_data->get_tag(candidate.second));
+                    }
+                    
+                    // If it's a tag, open it
+                    else {
+                        return Invader::File::open_file(input.virtual_directory[candidate.second].full_path).value();
+                    }
+                };
                 
-                auto &first_struct = structs[0];
+                auto add_result = [&results, &indices, &candidates, &this_tag_index](bool matched, std::size_t i, std::list<std::string> &&differences = {}) {
+                    auto &candidate = candidates[i];
+                    auto &result = results->emplace_back();
+                    result.tag = this_tag_index;
+                    result.matched = matched;
+                    result.other_path = File::halo_path_to_preferred_path((*indices)[candidate.first].paths[candidate.second].path);
+                    result.other_input = candidate.first;
+                    result.differences = std::move(differences);
+                };
                 
-                // Just for setting counter/debugging
-                auto match_log = [&tag, &matched_count, &show, &show_all, &mismatched_count, &struct_paths, &by_path, &struct_inputs, &inputs, &log_mutex](bool did_match, std::size_t i, const std::list<std::string> &other_messages = {}) {
-                    auto *extension = HEK::tag_fourcc_to_extension(tag.fourcc);
-                    auto other_path = File::halo_path_to_preferred_path(struct_paths[i]);
-                    bool show_different_input = inputs->size() > 2; // only need to show differing inputs if we have more than two inputs
-                    std::size_t input_of_other = 1;
+                if(functional) {
+                    // Get the digest of each compiled tag, compiling the ones we haven't compiled yet. The compiled bytes
+                    // of the tags compiled here are kept so matching digests can be confirmed without compiling again.
+                    std::vector<std::uint64_t> digests;
+                    std::vector<std::optional<std::vector<std::byte>>> compiled(found_count);
+                    digests.reserve(found_count);
+                    
+                    auto compile = [&candidates, &compiled, &load_tag_data, &report_error, &tag](std::size_t i) -> bool {
+                        std::unique_ptr<Parser::ParserStruct> struct_v;
+                        try {
+                            auto data = load_tag_data(candidates[i]);
+                            struct_v = Parser::ParserStruct::parse_hek_tag_file(data.data(), data.size(), true);
+                        }
+                        catch(std::exception &e) {
+                            report_error("compare", e);
+                            return false;
+                        }
+                        
+                        try {
+                            compiled[i] = compiled_tag_bytes(*struct_v, tag.fourcc);
+                        }
+                        catch(std::exception &e) {
+                            report_error("functional compare", e);
+                            return false;
+                        }
+                        
+                        return true;
+                    };
                     
-                    // If we're using multiple inputs, get the input of the other thing
-                    if(show_different_input) {
-                        auto *other_input = struct_inputs[i];
-                        for(auto &i : *inputs) {
-                            if(&i == other_input) {
-                                input_of_other = &i - inputs->data();
+                    bool failed = false;
+                    for(std::size_t i = 0; i < found_count; i++) {
+                        auto &c = candidates[i];
+                        std::optional<std::uint64_t> digest;
+                        digest_mutex->lock();
+                        auto &input_digests = (*compiled_digests)[c.first];
+                        auto existing = input_digests.find(c.second);
+                        if(existing != input_digests.end()) {
+                            digest = existing->second;
+                        }
+                        digest_mutex->unlock();
+                        
+                        if(!digest.has_value()) {
+                            if(!compile(i)) {
+                                failed = true;
                                 break;
                             }
+                            digest = fnv1a(compiled[i]->data(), compiled[i]->size());
+                            
+                            digest_mutex->lock();
+                            (*compiled_digests)[c.first][c.second] = *digest;
+                            digest_mutex->unlock();
                         }
+                        digests.emplace_back(*digest);
                     }
                     
-                    if(did_match) {
-                        if(show & Show::SHOW_MATCHED) {
-                            log_mutex->lock();
-                            if(by_path == ByPath::BY_PATH_SAME) {
-                                oprintf_success(MATCHED("Matched"), File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_fourcc_to_extension(tag.fourcc));
-                            }
-                            else if(show_different_input) {
-                                oprintf_success(MATCHED_TO_DIFFERENT_INPUT("Matched"), File::halo_path_to_preferred_path(tag.path).c_str(), extension, other_path.c_str(), extension, input_of_other);
-                            }
-                            else {
-                                oprintf_success(MATCHED_TO("Matched"), File::halo_path_to_preferred_path(tag.path).c_str(), extension, other_path.c_str(), extension);
-                            }
-                            for(auto &i : other_messages) {
-                                oprintf_success("%s", i.c_str());
-                            }
-                            log_mutex->unlock();
-                        }
-                        (*matched_count)++;
+                    if(failed) {
+                        continue;
                     }
-                    else {
-                        if(show & Show::SHOW_MISMATCHED) {
-                            log_mutex->lock();
-                            if(by_path == ByPath::BY_PATH_SAME) {
-                                oprintf_success_warn(MATCHED("Mismatched"), File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_fourcc_to_extension(tag.fourcc));
-                            }
-                            else if(show_different_input) {
-                                oprintf_success_warn(MATCHED_TO_DIFFERENT_INPUT("Mismatched"), File::halo_path_to_preferred_path(tag.path).c_str(), extension, other_path.c_str(), extension, input_of_other);
-                            }
-                            else {
-                                oprintf_success_warn(MATCHED_TO("Mismatched"), File::halo_path_to_preferred_path(tag.path).c_str(), extension, other_path.c_str(), extension);
-                            }
-                            for(auto &i : other_messages) {
-                                oprintf_success_warn("%s", i.c_str());
+                    
+                    // Different digests always mean different tags, but the same digest could be a collision, so check the bytes
+                    for(std::size_t i = 1; i < found_count; i++) {
+                        bool matched = false;
+                        if(digests[0] == digests[i]) {
+                            if((!compiled[0].has_value() && !compile(0)) || (!compiled[i].has_value() && !compile(i))) {
+                                continue;
                             }
-                            log_mutex->unlock();
+                            matched = *compiled[0] == *compiled[i];
                         }
-                        (*mismatched_count)++;
+                        add_result(matched, i);
                     }
-                };
-                
-                if(functional) {
+                }
+                else {
+                    // Load each tag, parsing the first one so we know it's valid
+                    std::vector<std::vector<std::byte>> data;
+                    std::vector<std::unique_ptr<Parser::ParserStruct>> structs(found_count);
+                    data.reserve(found_count);
                     try {
-                        auto meme_up_struct = [&tag](Parser::ParserStruct &struct_v) -> std::vector<std::uint8_t> {
-                            auto hdata = struct_v.generate_hek_tag_data(tag.fourcc);
-                            std::vector<std::uint8_t> meme_data;
-                            
-                            // Compile it
-                            auto compiled = BuildWorkload::compile_single_tag(hdata.data(), hdata.size());
-                            
-                            // Process each struct
-                            for(auto &s : compiled.structs) {
-                                // Process struct data
-                                meme_data.insert(meme_data.end(), reinterpret_cast<const std::uint8_t *>(s.data.data()), reinterpret_cast<const std::uint8_t *>(s.data.data() + s.data.size()));
-                                
-                                // Process each dependency
-                                for(auto &d : s.dependencies) {
-                                    char o[1024] = {};
-                                    auto len = std::snprintf(o, sizeof(o), "D:%08zX->%08zX!", d.offset, d.tag_index);
-                                    meme_data.insert(meme_data.end(), o, o + len);
-                                }
-                                
-                                // Process each pointer
-                                for(auto &p : s.pointers) {
-                                    char o[1024] = {};
-                                    auto len = std::snprintf(o, sizeof(o), "P:%08zX->%08zX!", p.offset, p.struct_index);
-                                    meme_data.insert(meme_data.end(), o, o + len);
-                                }
-                            }
-                            
-                            // Process each tag
-                            for(auto &t : compiled.tags) {
-                                char o[1024] = {};
-                                auto len = std::snprintf(o, sizeof(o), "T:%s.%s!", t.path.c_str(), HEK::tag_fourcc_to_extension(t.tag_fourcc));
-                                meme_data.insert(meme_data.end(), o, o + len);
-                                
-                                // Raw data pointers
-                                for(auto &ad : t.asset_data) {
-                                    std::snprintf(o, sizeof(o), "AD:%zu!", ad);
-                                    meme_data.insert(meme_data.end(), o, o + len);
-                                }
-                            }
-                            
-                            // And of course we need the raw data and model data
-                            for(auto &rd : compiled.raw_data) {
-                                meme_data.insert(meme_data.end(), reinterpret_cast<std::uint8_t *>(&*rd.begin()), reinterpret_cast<std::uint8_t *>(&*rd.end()));
-                            }
-                            
-                            // Lastly, model data
-                            meme_data.insert(meme_data.end(), reinterpret_cast<std::uint8_t *>(&*compiled.uncompressed_model_vertices.begin()), reinterpret_cast<std::uint8_t *>(&*compiled.uncompressed_model_vertices.end()));
-                            meme_data.insert(meme_data.end(), reinterpret_cast<std::uint8_t *>(&*compiled.compressed_model_vertices.begin()), reinterpret_cast<std::uint8_t *>(&*compiled.compressed_model_vertices.end()));
-                            meme_data.insert(meme_data.end(), reinterpret_cast<std::uint8_t *>(&*compiled.model_indices.begin()), reinterpret_cast<std::uint8_t *>(&*compiled.model_indices.end()));
-                            
-                            return meme_data;
-                        };
-                        
-                        auto first_meme = meme_up_struct(*first_struct);
-                        for(std::size_t i = 1; i < found_count; i++) {
-                            auto mms = meme_up_struct(*structs[i]);
-                            match_log(first_meme == mms, i);
+                        for(auto &c : candidates) {
+                            data.emplace_back(load_tag_data(c));
                         }
+                        structs[0] = Parser::ParserStruct::parse_hek_tag_file(data[0].data(), data[0].size(), true);
                     }
                     catch(std::exception &e) {
-                        log_mutex->lock();
-                        eprintf_error("Cannot functional compare %s.%s due to an error: %s", File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_fourcc_to_extension(tag.fourcc), e.what());
-                        log_mutex->unlock();
+                        report_error("compare", e);
+                        continue;
                     }
-                }
-                else {
+                    
+                    // Only parse the other tags if they aren't byte-for-byte identical to the first one
+                    auto get_struct = [&structs, &data](std::size_t i) -> const Parser::ParserStruct * {
+                        if(!structs[i]) {
+                            structs[i] = Parser::ParserStruct::parse_hek_tag_file(data[i].data(), data[i].size(), true);
+                        }
+                        return structs[i].get();
+                    };
+                    
                     for(std::size_t i = 1; i < found_count; i++) {
                         std::list<std::string> differences;
-                        bool matched = false;
-                        bool match_successful;
+                        bool matched;
                         
-                        try {
-                            matched = first_struct->compare(structs[i].get(), precision, true, verbose ? &differences : nullptr);
-                            match_successful = true;
+                        if(data[i] == data[0]) {
+                            matched = true;
                         }
-                        catch(std::exception &e) {
-                            log_mutex->lock();
-                            eprintf_error("Cannot compare %s.%s due to an error: %s", File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_fourcc_to_extension(tag.fourcc), e.what());
-                            log_mutex->unlock();
-                            match_successful = false;
+                        else {
+                            try {
+                                matched = get_struct(0)->compare(get_struct(i), precision, true, verbose ? &differences : nullptr);
+                            }
+                            catch(std::exception &e) {
+                                report_error("compare", e);
+                                continue;
+                            }
                         }
                         
-                        if(match_successful) {
-                            if(!show_all && verbose) {
-                                differences.emplace_back();
-                            }
-                            match_log(matched, i, differences);
+                        if(!show_all && verbose) {
+                            differences.emplace_back();
                         }
+                        add_result(matched, i, std::move(differences));
                     }
                 }
             }
         };
         
-        threads.emplace_back(perform_comparison_thread, &inputs, &tags, by_path, show_all, show, &matched_count, &mismatched_count, functional, precision, verbose, &tag_mutex, &tag_index, &log_mutex);
+        threads.emplace_back(perform_comparison_thread, &inputs, &indices, &tags, by_path, show_all, functional, precision, verbose, &tag_mutex, &tag_index, &log_mutex, &digest_mutex, &compiled_digests, &thread_results[t]);
     }
     
     // Wait for threads to finish
@@ -699,6 +733,62 @@ static void regular_comparison(const std::vector<Input> &inputs, bool precision,
         t.join();
     }
     
+    // Merge the results back into the order the tags were found in
+    std::vector<ComparisonResult> results;
+    for(auto &r : thread_results) {
+        results.insert(results.end(), std::make_move_iterator(r.begin()), std::make_move_iterator(r.end()));
+    }
+    std::stable_sort(results.begin(), results.end(), [](const ComparisonResult &a, const ComparisonResult &b) { return a.tag < b.tag; });
+    
+    #define MATCHED(type) "%s%s.%s", show_all ? type ": " : ""
+    #define MATCHED_TO(type) "%s%s.%s, %s.%s", show_all ? type ": " : ""
+    #define MATCHED_TO_DIFFERENT_INPUT(type) "%s%s.%s, %s.%s (%zu)", show_all ? type ": " : ""
+    
+    std::size_t matched_count = 0;
+    std::size_t mismatched_count = 0;
+    bool show_different_input = input_count > 2; // only need to show differing inputs if we have more than two inputs
+    
+    for(auto &r : results) {
+        auto &tag = tags[r.tag];
+        auto *extension = HEK::tag_fourcc_to_extension(tag.fourcc);
+        auto tag_path = File::halo_path_to_preferred_path(tag.path);
+        
+        if(r.matched) {
+            if(show & Show::SHOW_MATCHED) {
+                if(by_path == ByPath::BY_PATH_SAME) {
+                    oprintf_success(MATCHED("Matched"), tag_path.c_str(), extension);
+                }
+                else if(show_different_input) {
+                    oprintf_success(MATCHED_TO_DIFFERENT_INPUT("Matched"), tag_path.c_str(), extension, r.other_path.c_str(), extension, r.other_input);
+                }
+                else {
+                    oprintf_success(MATCHED_TO("Matched"), tag_path.c_str(), extension, r.other_path.c_str(), extension);
+                }
+                for(auto &i : r.differences) {
+                    oprintf_success("%s", i.c_str());
+                }
+            }
+            matched_count++;
+        }
+        else {
+            if(show & Show::SHOW_MISMATCHED) {
+                if(by_path == ByPath::BY_PATH_SAME) {
+                    oprintf_success_warn(MATCHED("Mismatched"), tag_path.c_str(), extension);
+                }
+                else if(show_different_input) {
+                    oprintf_success_warn(MATCHED_TO_DIFFERENT_INPUT("Mismatched"), tag_path.c_str(), extension, r.other_path.c_str(), extension, r.other_input);
+                }
+                else {
+                    oprintf_success_warn(MATCHED_TO("Mismatched"), tag_path.c_str(), extension, r.other_path.c_str(), extension);
+                }
+                for(auto &i : r.differences) {
+                    oprintf_success_warn("%s", i.c_str());
+                }
+            }
+            mismatched_count++;
+        }
+    }
+    
     // Show the total matched if we are showing both
     if(show_all) {
         auto total = matched_count + mismatched_count;
@@ -10,6 +10,7 @@
 #include <invader/map/map.hpp>
 #include "../command_line_option.hpp"
 #include <invader/file/file.hpp>
+#include <invader/file/tag_index.hpp>
 
 int main(int argc, char * const *argv) {
     set_up_color_term();
@@ -21,7 +22,8 @@ int main(int argc, char * const *argv) {
         CommandLineOption::from_preset(CommandLineOption::PRESET_COMMAND_LINE_OPTION_FS_PATH),
         CommandLineOption::from_preset(CommandLineOption::PRESET_COMMAND_LINE_OPTION_TAGS_MULTIPLE),
         CommandLineOption("reverse", 'R', 0, "Find all tags that depend on the tag, instead. The tag does not have to exist if not using --fs-path."),
-        CommandLineOption("recursive", 'r', 0, "Recursively get all depended tags."),
+        CommandLineOption("recursive", 'r', 0, "Recursively get all depended tags. If using --reverse, this gets all tags that depend on the tag, directly or indirectly."),
+        CommandLineOption("index", 'x', 0, "Create a tag index (.invader-index) in each tags directory that does not have one. Tag indices are kept up-to-date and used automatically when present, so later runs only need to read tags that changed."),
     };
 
     static constexpr char DESCRIPTION[] = "Check dependencies for a tag.";
@@ -32,6 +34,7 @@ int main(int argc, char * const *argv) {
         bool recursive = false;
         std::vector<std::filesystem::path> tags;
         bool use_filesystem_path = false;
+        bool index = false;
     } dependency_options;
 
     auto remaining_arguments = CommandLineOption::parse_arguments<DependencyOption &>(argc, argv, options, USAGE, DESCRIPTION, 1, 1, dependency_options, [](char opt, const auto &arguments, auto &dependency_options) {
@@ -51,6 +54,9 @@ int main(int argc, char * const *argv) {
             case 'P':
                 dependency_options.use_filesystem_path = true;
                 break;
+            case 'x':
+                dependency_options.index = true;
+                break;
         }
     });
 
@@ -58,6 +64,24 @@ int main(int argc, char * const *argv) {
     if(dependency_options.tags.size() == 0) {
         dependency_options.tags.emplace_back("tags");
     }
+    
+    // Create any indices we need to create
+    if(dependency_options.index) {
+        for(auto &t : dependency_options.tags) {
+            if(File::TagIndex::exists(t)) {
+                continue;
+            }
+            try {
+                File::TagIndex index(t);
+                index.refresh();
+                index.save();
+            }
+            catch(std::exception &e) {
+                eprintf_error("Failed to create a tag index for %s: %s", t.string().c_str(), e.what());
+                return EXIT_FAILURE;
+            }
+        }
+    }
 
     // Require a tag
     std::optional<std::string> tag_path;
@@ -3,38 +3,18 @@
 #include <invader/dependency/found_tag_dependency.hpp>
 #include <invader/printf.hpp>
 #include <invader/file/file.hpp>
-#include <invader/tag/parser/parser_struct.hpp>
+#include <invader/file/tag_index.hpp>
 
 #include <filesystem>
+#include <optional>
+#include <unordered_set>
 
 namespace Invader {
     static std::vector<File::TagFilePath> get_dependencies(const std::byte *tag_data, std::size_t tag_data_length) {
-        std::vector<File::TagFilePath> dependencies;
-        
-        auto recursively_get_dependencies = [&dependencies](const Parser::ParserStruct &st, auto &recursively_get_dependencies) -> void {
-            for(auto &v : st.get_values()) {
-                switch(v.get_type()) {
-                    case Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE: {
-                        auto count = v.get_array_size();
-                        for(std::size_t i = 0; i < count; i++) {
-                            recursively_get_dependencies(v.get_object_in_array(i), recursively_get_dependencies);
-                        }
-                        break;
-                    }
-                    case Parser::ParserStructValue::ValueType::VALUE_TYPE_DEPENDENCY: {
-                        auto &dep = v.get_dependency();
-                        if(!dep.path.empty()) {
-                            dependencies.emplace_back(File::halo_path_to_preferred_path(dep.path), dep.tag_fourcc);
-                        }
-                        break;
-                    }
-                    default: break;
-                }
-            }
-        };
-        
-        recursively_get_dependencies(*Parser::ParserStruct::parse_hek_tag_file(tag_data, tag_data_length), recursively_get_dependencies);
-        
+        auto dependencies = File::TagIndex::read_dependencies(tag_data, tag_data_length);
+        for(auto &d : dependencies) {
+            d.path = File::halo_path_to_preferred_path(d.path);
+        }
         return dependencies;
     }
 
@@ -42,32 +22,76 @@ namespace Invader {
         std::vector<FoundTagDependency> found_tags;
         success = true;
 
+        // Forward lookups only need the tags they look at, so those are checked against the index one at a time. Reverse
+        // lookups need the dependencies of every tag, so the index is brought up-to-date (or, if a tags directory doesn't
+        // have one, made in memory) so we only need to read tags that changed.
+        std::vector<std::optional<File::TagIndex>> indices(tags.size());
+        for(std::size_t d = 0; d < tags.size(); d++) {
+            bool saved = File::TagIndex::exists(tags[d]);
+            if(!reverse) {
+                if(saved) {
+                    indices[d].emplace(tags[d]);
+                }
+                continue;
+            }
+
+            auto &index = indices[d].emplace(tags[d]);
+            try {
+                index.refresh();
+            }
+            catch(std::exception &e) {
+                eprintf_warn("Failed to index %s: %s", tags[d].string().c_str(), e.what());
+                indices[d].reset();
+                continue;
+            }
+
+            if(saved) {
+                try {
+                    index.save();
+                }
+                catch(std::exception &e) {
+                    eprintf_warn("Failed to update the tag index for %s: %s", tags[d].string().c_str(), e.what());
+                }
+            }
+        }
+
         if(!reverse) {
-            auto find_dependencies_in_tag = [&tags, &found_tags, &recursive, &success](const char *tag_path_to_find_2, Invader::TagFourCC tag_int_to_find, auto recursion) -> void {
+            std::unordered_set<File::TagFilePath, File::TagFilePathHash> found_paths;
+            auto find_dependencies_in_tag = [&tags, &indices, &found_paths, &found_tags, &recursive, &success](const char *tag_path_to_find_2, Invader::TagFourCC tag_int_to_find, auto recursion) -> void {
                 std::string tag_path_to_find = File::halo_path_to_preferred_path(tag_path_to_find_2);
 
                 // See if we can open the tag
                 bool found = false;
-                for(auto &tags_directory : tags) {
-                    std::filesystem::path tag_path = std::filesystem::path(tags_directory) / (tag_path_to_find + "." + tag_fourcc_to_extension(tag_int_to_find));
-                    auto tag_data = File::open_file(tag_path);
-                    if(!tag_data.has_value()) {
-                        eprintf_error("Failed to read tag %s", tag_path.string().c_str());
-                        continue;
+                for(std::size_t d = 0; d < tags.size(); d++) {
+                    auto &tags_directory = tags[d];
+                    auto tag_file_path = tag_path_to_find + "." + tag_fourcc_to_extension(tag_int_to_find);
+                    std::filesystem::path tag_path = std::filesystem::path(tags_directory) / tag_file_path;
+
+                    // Use the index's dependencies if it has them and the tag hasn't changed; otherwise read the tag
+                    const auto *indexed_tag = indices[d].has_value() ? indices[d]->find_unchanged_tag(tag_file_path) : nullptr;
+                    std::optional<std::vector<std::byte>> tag_data;
+                    if(!indexed_tag || indexed_tag->invalid) {
+                        tag_data = File::open_file(tag_path);
+                        if(!tag_data.has_value()) {
+                            eprintf_error("Failed to read tag %s", tag_path.string().c_str());
+                            continue;
+                        }
                     }
 
                     try {
-                        auto dependencies = get_dependencies(tag_data->data(), tag_data->size());
+                        std::vector<File::TagFilePath> dependencies;
+                        if(tag_data.has_value()) {
+                            dependencies = get_dependencies(tag_data->data(), tag_data->size());
+                        }
+                        else {
+                            dependencies = indexed_tag->dependencies;
+                            for(auto &dependency : dependencies) {
+                                dependency.path = File::halo_path_to_preferred_path(dependency.path);
+                            }
+                        }
                         for(auto &dependency : dependencies) {
                             // Make sure it's not in found_tags
-                            bool dupe = false;
-                            for(auto &tag : found_tags) {
-                                if(tag.path == dependency.path && tag.fourcc == dependency.fourcc) {
-                                    dupe = true;
-                                    break;
-                                }
-                            }
-                            if(dupe) {
+                            if(!found_paths.insert(dependency).second) {
                                 continue;
                             }
 
@@ -111,74 +135,64 @@ namespace Invader {
             find_dependencies_in_tag(tag_path_to_find_2, tag_int_to_find, find_dependencies_in_tag);
         }
         else {
-            // Turn all forward slashes into backslashes if not on Windows
-            std::string tag_path_to_find = File::halo_path_to_preferred_path(tag_path_to_find_2);
-
-            // Iterate
-            for(auto &tags_directory : tags) {
-                auto iterate_recursively = [&found_tags, &tag_int_to_find, &tag_path_to_find](const std::string &current_path, const std::filesystem::path &dir, auto &recursion) -> void {
-                    for(auto file : std::filesystem::directory_iterator(dir)) {
-                        if(file.is_directory()) {
-                            std::string dir_tag_path = current_path + file.path().filename().string() + "\\";
-                            recursion(dir_tag_path, file.path(), recursion);
+            // A tag is overridden if a tags directory with higher precedence has it, too
+            auto is_overridden = [&indices](std::size_t tags_directory, const std::string &tag_path) -> bool {
+                for(std::size_t d = 0; d < tags_directory; d++) {
+                    if(indices[d].has_value() && indices[d]->find_tag(tag_path)) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+            // Warn about anything we couldn't read
+            for(std::size_t d = 0; d < tags.size(); d++) {
+                if(!indices[d].has_value()) {
+                    continue;
+                }
+                for(auto &t : indices[d]->get_tags()) {
+                    if(t.invalid && !is_overridden(d, t.tag_path)) {
+                        eprintf_warn("Warning: Failed to compile tag %s", (tags[d] / t.tag_path).string().c_str());
+                    }
+                }
+            }
+
+            // Look up what references the tag (and, if recursive, what references those)
+            File::TagFilePath tag_to_find(File::preferred_path_to_halo_path(tag_path_to_find_2), tag_int_to_find);
+            std::unordered_set<File::TagFilePath, File::TagFilePathHash> found_paths = { tag_to_find };
+
+            auto find_referencing_tags = [&tags, &indices, &found_paths, &found_tags, &recursive, &is_overridden](const File::TagFilePath &tag_to_find, auto &recursion) -> void {
+                for(std::size_t d = 0; d < tags.size(); d++) {
+                    if(!indices[d].has_value()) {
+                        continue;
+                    }
+
+                    auto &index = *indices[d];
+                    auto *referencing_tags = index.find_referencing_tags(tag_to_find);
+                    if(!referencing_tags) {
+                        continue;
+                    }
+
+                    for(auto t : *referencing_tags) {
+                        auto &indexed_tag = index.get_tags()[t];
+                        if(indexed_tag.invalid || is_overridden(d, indexed_tag.tag_path)) {
+                            continue;
                         }
-                        else if(file.is_regular_file()) {
-                            std::string dir_tag_path = current_path + file.path().filename().stem().string();
-                            auto fourcc = Invader::HEK::tag_extension_to_fourcc(file.path().extension().string().c_str() + 1);
-
-                            // Skip some obvious stuff as well as null tag class ints
-                            if(
-                                fourcc == Invader::TagFourCC::TAG_FOURCC_NULL ||
-                                fourcc == Invader::TagFourCC::TAG_FOURCC_BITMAP ||
-                                fourcc == Invader::TagFourCC::TAG_FOURCC_CAMERA_TRACK ||
-                                fourcc == Invader::TagFourCC::TAG_FOURCC_HUD_MESSAGE_TEXT ||
-                                fourcc == Invader::TagFourCC::TAG_FOURCC_PHYSICS ||
-                                fourcc == Invader::TagFourCC::TAG_FOURCC_SOUND_ENVIRONMENT ||
-                                fourcc == Invader::TagFourCC::TAG_FOURCC_UNICODE_STRING_LIST ||
-                                fourcc == Invader::TagFourCC::TAG_FOURCC_WIND) {
-                                continue;
-                            }
 
-                            // If we already found this, ignore it
-                            bool skip = false;
-                            for(auto &f : found_tags) {
-                                if(f.path == dir_tag_path && f.fourcc == fourcc) {
-                                    skip = true;
-                                    break;
-                                }
-                            }
-                            if(skip) {
-                                break;
-                            }
-                            
-                            // Open it
-                            auto fp = file.path();
-                            auto tag_data = File::open_file(fp);
-                            if(!tag_data.has_value()) {
-                                eprintf_error("Failed to read tag %s", fp.string().c_str());
-                                continue;
-                            }
+                        auto referencing_tag = File::split_tag_class_extension(File::preferred_path_to_halo_path(indexed_tag.tag_path));
+                        if(!referencing_tag.has_value() || !found_paths.insert(*referencing_tag).second) {
+                            continue;
+                        }
 
-                            // Attempt to parse
-                            try {
-                                auto dependencies = get_dependencies(tag_data->data(), tag_data->size());
-                                for(auto &dependency : dependencies) {
-                                    if(dependency.path == tag_path_to_find && dependency.fourcc == tag_int_to_find) {
-                                        found_tags.emplace_back(dir_tag_path, fourcc, false, file.path());
-                                        break;
-                                    }
-                                }
-                            }
-                            catch (std::exception &e) {
-                                eprintf_warn("Warning: Failed to compile tag %s: %s", file.path().string().c_str(), e.what());
-                            }
+                        found_tags.emplace_back(referencing_tag->path, referencing_tag->fourcc, false, tags[d] / indexed_tag.tag_path);
+                        if(recursive) {
+                            recursion(*referencing_tag, recursion);
                         }
                     }
-                };
+                }
+            };
 
-                std::filesystem::path tags_dir_path(tags_directory);
-                iterate_recursively("", tags_dir_path, iterate_recursively);
-            }
+            find_referencing_tags(tag_to_find, find_referencing_tags);
         }
 
         success = true;
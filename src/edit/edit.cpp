@@ -8,8 +8,16 @@
 #include <invader/tag/hek/header.hpp>
 #include "../crc/crc32.h"
 #include <string>
+#include <cstdarg>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <map>
 
 #include "expression.hpp"
+#include "../util/parallel.hpp"
 
 #ifdef __linux__
 #include <sys/ioctl.h>
@@ -41,16 +49,31 @@ struct Actions {
     std::string value;
     std::size_t count = 0;
     std::size_t position = 0;
+    std::size_t line = 0; // line in the script, if from one
 };
 
+// Thrown when a key, value, or action can't be used; whoever catches it prints the message
+class EditError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+[[noreturn]] static void edit_error(const char *format, ...) {
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    throw EditError(message);
+}
+
 static std::string get_top_member_name(const std::string &key, std::string &after_member) {
     auto *key_str = key.c_str();
     auto *c = key_str;
     for(; *c != 0 && *c != '.' && *c != '[' && *c != ']'; c++);
     
     if(c == key_str) {
-        eprintf_error("Invalid key %s", key.c_str());
-        throw std::exception();
+        edit_error("Invalid key %s", key.c_str());
     }
     
     auto return_value = std::string(key_str, c);
@@ -63,20 +86,17 @@ static std::pair<std::size_t, std::size_t> get_range(const std::string &key, std
     auto *key_end = key_str;
     
     if(key_str[0] == 0) {
-        eprintf_error("Expected range at end of key");
-        throw std::exception();
+        edit_error("Expected range at end of key");
     }
     
     if(key_str[0] != '[') {
-        eprintf_error("Invalid range in key %s", key.c_str());
-        throw std::exception();
+        edit_error("Invalid range in key %s", key.c_str());
     }
     
     for(; *key_end != ']'; key_end++) {
         // Unexpected end?
         if(*key_end == 0) {
-            eprintf_error("Invalid range in key %s", key.c_str());
-            throw std::exception();
+            edit_error("Invalid range in key %s", key.c_str());
         }
     }
     
@@ -103,8 +123,7 @@ static std::pair<std::size_t, std::size_t> get_range(const std::string &key, std
     
     // Okay
     if(hyphens > 1) {
-        eprintf_error("Invalid range %s", range_str.c_str());
-        throw std::exception();
+        edit_error("Invalid range %s", range_str.c_str());
     }
     
     if(hyphens == 0) {
@@ -133,15 +152,13 @@ static std::pair<std::size_t, std::size_t> get_range(const std::string &key, std
             }
         }
         catch (std::exception &) {
-            eprintf_error("Invalid range %s", range_str.c_str());
-            throw;
+            edit_error("Invalid range %s", range_str.c_str());
         }
     }
     
     // Did we exceed things?
     if(min > max) {
-        eprintf_error("Invalid range %s", range_str.c_str());
-        throw std::exception();
+        edit_error("Invalid range %s", range_str.c_str());
     }
     
     return { min, max };
@@ -149,28 +166,25 @@ static std::pair<std::size_t, std::size_t> get_range(const std::string &key, std
 
 static void build_array(Parser::ParserStruct *ps, std::string key, std::vector<Parser::ParserStructValue> &array, std::string *bitfield, std::pair<std::size_t, std::size_t> *range) {
     if(key == "") {
-        eprintf_error("Expected value name");
-        throw std::exception();
+        edit_error("Expected value name");
     }
     
     if(key[0] == '.') {
         key = std::string(key.begin() + 1, key.end());
     }
     else {
-        eprintf_error("Expected a dot before key %s", key.c_str());
-        throw std::exception();
+        edit_error("Expected a dot before key %s", key.c_str());
     }
     
     auto member = get_top_member_name(key, key);
     if(member == "") {
-        eprintf_error("No member name given for array");
-        throw std::exception();
+        edit_error("No member name given for array");
     }
     
-    auto &values = ps->get_values();
+    auto values = ps->get_values();
     
     // Do it!
-    for(auto &i : values) {
+    for(auto i : values) {
         auto *member_name = i.get_member_name();
         
         if(member_name && member_name == member) {
@@ -191,8 +205,7 @@ static void build_array(Parser::ParserStruct *ps, std::string key, std::vector<P
                         return;
                     }
                     
-                    eprintf_error("%s::%s is empty", ps->struct_name(), member.c_str());
-                    throw std::exception();
+                    edit_error("%s::%s is empty", ps->struct_name(), member.c_str());
                 }
                 
                 if(access_range.first == SIZE_MAX) {
@@ -204,8 +217,7 @@ static void build_array(Parser::ParserStruct *ps, std::string key, std::vector<P
                 }
                 
                 if(count < access_range.first || count <= access_range.second) {
-                    eprintf_error("%zu-%zu is out of bounds for %s::%s (%zu element%s)", access_range.first, access_range.second, ps->struct_name(), member.c_str(), count, count == 1 ? "" : "s");
-                    throw std::exception();
+                    edit_error("%zu-%zu is out of bounds for %s::%s (%zu element%s)", access_range.first, access_range.second, ps->struct_name(), member.c_str(), count, count == 1 ? "" : "s");
                 }
                 
                 // Are we returning a range?
@@ -227,18 +239,15 @@ static void build_array(Parser::ParserStruct *ps, std::string key, std::vector<P
                 // Is this a bitfield? If so, set it!
                 if(i.get_type() == Parser::ParserStructValue::ValueType::VALUE_TYPE_BITMASK) {
                     if(key.size() == 0) {
-                        eprintf_error("Expected bitfield but got the end of the key");
-                        throw std::exception();
+                        edit_error("Expected bitfield but got the end of the key");
                     }
                     else if(key[0] != '.') {
-                        eprintf_error("Expected bitfield but got %s", key.c_str());
-                        throw std::exception();
+                        edit_error("Expected bitfield but got %s", key.c_str());
                     }
                     *bitfield = key.substr(1);
                 }
                 else if(key.size() != 0) {
-                    eprintf_error("Expected end of key but got %s", key.c_str());
-                    throw std::exception();
+                    edit_error("Expected end of key but got %s", key.c_str());
                 }
                 
                 return;
@@ -246,16 +255,14 @@ static void build_array(Parser::ParserStruct *ps, std::string key, std::vector<P
         }
     }
     
-    eprintf_error("%s::%s does not exist", ps->struct_name(), member.c_str());
-    throw std::exception();
+    edit_error("%s::%s does not exist", ps->struct_name(), member.c_str());
 }
 
 static void require_writable_only(const std::vector<Parser::ParserStructValue> &values, bool writable_only) {
     if(writable_only) {
         for(auto &i : values) {
             if(i.is_read_only()) {
-                eprintf_error("%s is read-only", i.get_member_name());
-                throw std::exception();
+                edit_error("%s is read-only", i.get_member_name());
             }
         }
     }
@@ -296,8 +303,7 @@ static std::string get_value(const Parser::ParserStructValue &value, const std::
             case Parser::ParserStructValue::ValueType::VALUE_TYPE_BITMASK:
                 return std::to_string(value.read_bitfield(bitmask.c_str()) ? 1 : 0);
             default:
-                eprintf_error("Unsupported value type for this operation");
-                throw std::exception();
+                edit_error("Unsupported value type for this operation");
         }
     }
     
@@ -345,8 +351,7 @@ static void set_value(Parser::ParserStructValue &value, const std::string &new_v
         switch(type) {
             case Parser::ParserStructValue::ValueType::VALUE_TYPE_TAGSTRING:
                 if(new_value.size() > 31) {
-                    eprintf_error("String exceeds maximum length (%zu > 31)", new_value.size());
-                    throw std::exception();
+                    edit_error("String exceeds maximum length (%zu > 31)", new_value.size());
                 }
                 return value.set_string(new_value.c_str());
             case Parser::ParserStructValue::ValueType::VALUE_TYPE_DEPENDENCY: {
@@ -375,15 +380,16 @@ static void set_value(Parser::ParserStructValue &value, const std::string &new_v
                         dep.tag_fourcc = new_path.fourcc;
                     }
                     else {
-                        eprintf_error("%s tags cannot be referenced here", tag_fourcc_to_extension(new_path.fourcc));
-                        throw std::exception();
+                        edit_error("%s tags cannot be referenced here", tag_fourcc_to_extension(new_path.fourcc));
                     }
                 }
                 
                 // Hopefully no one comments on the fact I wrote "else try" a few lines up as if it was something equivalent to "else if".
+                catch (EditError &) {
+                    throw;
+                }
                 catch (std::exception &) {
-                    eprintf_error("Invalid tag path %s", new_value.c_str());
-                    throw std::exception();
+                    edit_error("Invalid tag path %s", new_value.c_str());
                 }
                 
                 return;
@@ -393,8 +399,7 @@ static void set_value(Parser::ParserStructValue &value, const std::string &new_v
                     return value.write_enum(new_value.c_str());
                 }
                 catch (std::exception &) {
-                    eprintf_error("Invalid enum value %s", new_value.c_str());
-                    throw std::exception();
+                    edit_error("Invalid enum value %s", new_value.c_str());
                 }
             case Parser::ParserStructValue::ValueType::VALUE_TYPE_BITMASK:
                 try {
@@ -405,17 +410,17 @@ static void set_value(Parser::ParserStructValue &value, const std::string &new_v
                         case 1:
                             return value.write_bitfield(bitfield.value().c_str(), true);
                         default:
-                            eprintf_error("Bitfields can only be set to 0 or 1");
-                            throw std::exception();
+                            edit_error("Bitfields can only be set to 0 or 1");
                     }
                 }
+                catch (EditError &) {
+                    throw;
+                }
                 catch (std::exception &) {
-                    eprintf_error("Invalid bitmask/value %s => %s", bitfield.value().c_str(), new_value.c_str());
-                    throw std::exception();
+                    edit_error("Invalid bitmask/value %s => %s", bitfield.value().c_str(), new_value.c_str());
                 }
             default:
-                eprintf_error("Unsupported value type");
-                throw std::exception();
+                edit_error("Unsupported value type");
         }
     }
     
@@ -438,23 +443,27 @@ static void set_value(Parser::ParserStructValue &value, const std::string &new_v
         expressions.emplace_back(start, cursor);
         
         if(expressions.size() != expected_value_count) {
-            eprintf_error("Expected %zu comma-separated value%s but only got %zu", expected_value_count, expected_value_count == 1 ? "" : "s", expressions.size());
-            throw std::exception();
+            edit_error("Expected %zu comma-separated value%s but only got %zu", expected_value_count, expected_value_count == 1 ? "" : "s", expressions.size());
         }
         
         auto all_values = value.get_values();
         for(std::size_t i = 0; i < expected_value_count; i++) {
             auto &v = all_values[i];
             auto *e = expressions[i].c_str();
-            switch(value.get_number_format()) {
-                case Parser::ParserStructValue::NumberFormat::NUMBER_FORMAT_INT:
-                    v = Edit::evaluate_expression(e, std::get<std::int64_t>(v));
-                    break;
-                case Parser::ParserStructValue::NumberFormat::NUMBER_FORMAT_FLOAT:
-                    v = Edit::evaluate_expression(e, std::get<double>(v));
-                    break;
-                default:
-                    std::terminate();
+            try {
+                switch(value.get_number_format()) {
+                    case Parser::ParserStructValue::NumberFormat::NUMBER_FORMAT_INT:
+                        v = Edit::evaluate_expression(e, std::get<std::int64_t>(v));
+                        break;
+                    case Parser::ParserStructValue::NumberFormat::NUMBER_FORMAT_FLOAT:
+                        v = Edit::evaluate_expression(e, std::get<double>(v));
+                        break;
+                    default:
+                        std::terminate();
+                }
+            }
+            catch (std::exception &) {
+                edit_error("Invalid expression %s", e);
             }
         }
         value.set_values(all_values);
@@ -463,7 +472,7 @@ static void set_value(Parser::ParserStructValue &value, const std::string &new_v
 
 // Ensure a struct has at least one of everything in everything (for listing)
 static Parser::ParserStruct &populate_struct(Parser::ParserStruct &ps) {
-    for(auto &i : ps.get_values()) {
+    for(auto i : ps.get_values()) {
         if(i.get_type() == Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
             i.insert_objects_in_array(0, 1);
             populate_struct(i.get_object_in_array(0));
@@ -481,7 +490,7 @@ struct TagDataListTreeElement {
 };
 
 static void list_everything(Parser::ParserStruct &ps, std::vector<TagDataListTreeElement> &output, bool with_values, std::size_t level = 0) {
-    for(auto &i : ps.get_values()) {
+    for(auto i : ps.get_values()) {
         auto *mv = i.get_member_name();
         if(!mv) {
             continue;
@@ -756,6 +765,424 @@ static void list_everything(Parser::ParserStruct &ps, std::vector<std::string> &
     }
 }
 
+// Do an action on a tag, returning true if it changed the tag; throws EditError if it couldn't be done
+static bool apply_action(Parser::ParserStruct &tag_struct, HEK::TagFourCC tag_class, const Actions &action, bool check_read_only, std::vector<std::string> &output) {
+    bool modified = false;
+    
+    switch(action.type) {
+        case ActionType::ACTION_TYPE_LIST: {
+            list_everything(populate_struct(*Parser::ParserStruct::generate_base_struct(tag_class)), output, false);
+            break;
+        }
+        case ActionType::ACTION_TYPE_LIST_ALL_VALUES: {
+            list_everything(tag_struct, output, true);
+            break;
+        }
+        case ActionType::ACTION_TYPE_GET: {
+            std::string bitfield;
+            auto arr = get_values_for_key(&tag_struct, action.key == "" ? "" : (std::string(".") + action.key), bitfield, false);
+            for(auto &k : arr) {
+                output.emplace_back(get_value(k, bitfield));
+            }
+            break;
+        }
+        case ActionType::ACTION_TYPE_SET: {
+            std::string bitfield;
+            modified = true;
+            auto arr = get_values_for_key(&tag_struct, action.key == "" ? "" : (std::string(".") + action.key), bitfield, check_read_only);
+            for(auto &k : arr) {
+                set_value(k, action.value, bitfield);
+            }
+            break;
+        }
+        case ActionType::ACTION_TYPE_COUNT: {
+            auto arr = get_values_for_key(&tag_struct, action.key == "" ? "" : (std::string(".") + action.key), false);
+            for(auto &k : arr) {
+                if(k.get_type() == Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
+                    output.emplace_back(std::to_string(k.get_array_size()));
+                }
+                else {
+                    edit_error("%s is not an array", k.get_member_name());
+                }
+            }
+            break;
+        }
+        case ActionType::ACTION_TYPE_INSERT: {
+            modified = true;
+            auto arr = get_values_for_key(&tag_struct, action.key == "" ? "" : (std::string(".") + action.key), check_read_only);
+            for(auto &k : arr) {
+                if(k.get_type() != Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
+                    edit_error("%s is not an array", k.get_member_name());
+                }
+                
+                if(action.count + k.get_array_size() > k.get_array_maximum_size()) {
+                    edit_error("%s's maximum size of %zu exceeded", k.get_member_name(), k.get_array_maximum_size());
+                }
+                k.insert_objects_in_array(action.position == SIZE_MAX ? k.get_array_size() : action.position, action.count);
+            }
+            break;
+        }
+        case ActionType::ACTION_TYPE_DELETE: {
+            modified = true;
+            std::pair<std::size_t, std::size_t> range;
+            auto arr = get_values_for_key(&tag_struct, action.key == "" ? "" : (std::string(".") + action.key), range, check_read_only);
+            for(auto &k : arr) {
+                if(k.get_type() != Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
+                    edit_error("%s is not an array", k.get_member_name());
+                }
+                
+                std::size_t iterations = range.second - range.first + 1;
+                if(k.get_array_size() - iterations < k.get_array_minimum_size()) {
+                    edit_error("%s's minimum size of %zu exceeded", k.get_member_name(), k.get_array_maximum_size());
+                }
+                k.delete_objects_in_array(range.first, iterations);
+            }
+            break;
+        }
+        case ActionType::ACTION_TYPE_MOVE: {
+            modified = true;
+            std::pair<std::size_t, std::size_t> range;
+            auto arr = get_values_for_key(&tag_struct, action.key == "" ? "" : (std::string(".") + action.key), range, check_read_only);
+            for(auto &k : arr) {
+                if(k.get_type() != Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
+                    edit_error("%s is not an array", k.get_member_name());
+                }
+                
+                std::size_t to = action.position == SIZE_MAX ? k.get_array_size() : action.position;
+                std::size_t iterations = range.second - range.first + 1;
+                if(to == range.first) {
+                    continue; // we can ignore if it's trying to swap itself
+                }
+                k.swap_objects_in_array(range.first, to, iterations);
+            }
+            break;
+        }
+        case ActionType::ACTION_TYPE_COPY: {
+            modified = true;
+            std::pair<std::size_t, std::size_t> range;
+            auto arr = get_values_for_key(&tag_struct, action.key == "" ? "" : (std::string(".") + action.key), range, check_read_only);
+            for(auto &k : arr) {
+                if(k.get_type() != Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
+                    edit_error("%s is not an array", k.get_member_name());
+                }
+                
+                std::size_t to = action.position == SIZE_MAX ? k.get_array_size() : action.position;
+                std::size_t iterations = range.second - range.first + 1;
+                
+                if(iterations + k.get_array_size() > k.get_array_maximum_size()) {
+                    edit_error("%s's maximum size of %zu exceeded", k.get_member_name(), k.get_array_maximum_size());
+                }
+                
+                k.duplicate_objects_in_array(range.first, to, iterations);
+            }
+            break;
+        }
+        default:
+            eprintf_error("Unimplemented");
+            std::exit(EXIT_FAILURE);
+    }
+    
+    return modified;
+}
+
+struct ScriptRecord {
+    std::string tag_path;
+    std::vector<Actions> actions;
+};
+
+// Split a script line into words; double quotes group words together, and \" and \\ can be used inside of them
+static bool split_script_line(const std::string &line, std::vector<std::string> &words) {
+    words.clear();
+    auto *c = line.c_str();
+    
+    while(true) {
+        for(; *c == ' ' || *c == '\t' || *c == '\r'; c++);
+        if(*c == 0 || *c == '#') {
+            return true;
+        }
+        
+        std::string word;
+        if(*c == '"') {
+            for(c++; *c != '"'; c++) {
+                if(*c == 0) {
+                    return false;
+                }
+                if(*c == '\\' && (c[1] == '"' || c[1] == '\\')) {
+                    c++;
+                }
+                word += *c;
+            }
+            c++;
+        }
+        else {
+            for(; *c != 0 && *c != ' ' && *c != '\t' && *c != '\r'; c++) {
+                word += *c;
+            }
+        }
+        words.emplace_back(std::move(word));
+    }
+}
+
+static std::size_t parse_script_number(const std::string &word, bool allow_end) {
+    if(allow_end && word == "end") {
+        return SIZE_MAX;
+    }
+    
+    std::size_t length;
+    auto number = std::stoul(word, &length);
+    if(length != word.size()) {
+        throw std::exception();
+    }
+    return number;
+}
+
+// Read a script, grouping the edits by tag in the order the tags first appear; every error is printed
+static std::optional<std::vector<ScriptRecord>> read_script(std::istream &stream, const std::string &script_name, const std::filesystem::path &tags) {
+    std::vector<ScriptRecord> records;
+    std::map<std::filesystem::path, std::size_t> record_indices;
+    std::map<std::string, std::vector<std::size_t>> case_folded_record_indices;
+    ScriptRecord *current = nullptr;
+    
+    std::string line;
+    std::vector<std::string> words;
+    std::size_t line_number = 0;
+    bool errors = false;
+    
+    while(std::getline(stream, line)) {
+        line_number++;
+        
+        if(!split_script_line(line, words)) {
+            eprintf_error("%s:%zu: Unterminated quote", script_name.c_str(), line_number);
+            errors = true;
+            continue;
+        }
+        if(words.empty()) {
+            continue;
+        }
+        
+        struct Operation {
+            const char *name;
+            std::size_t argument_count;
+            ActionType type;
+        };
+        static constexpr const Operation operations[] = {
+            { "get", 1, ActionType::ACTION_TYPE_GET },
+            { "set", 2, ActionType::ACTION_TYPE_SET },
+            { "count", 1, ActionType::ACTION_TYPE_COUNT },
+            { "insert", 3, ActionType::ACTION_TYPE_INSERT },
+            { "copy", 2, ActionType::ACTION_TYPE_COPY },
+            { "move", 2, ActionType::ACTION_TYPE_MOVE },
+            { "erase", 1, ActionType::ACTION_TYPE_DELETE }
+        };
+        
+        auto &name = words[0];
+        auto argument_count = words.size() - 1;
+        
+        // Start (or continue) a tag's edits
+        if(name == "tag") {
+            if(argument_count != 1) {
+                eprintf_error("%s:%zu: Expected 1 argument for tag but got %zu", script_name.c_str(), line_number, argument_count);
+                errors = true;
+                current = nullptr;
+                continue;
+            }
+            
+            // The same tag may be written different ways; paths that resolve to the same file share one record, and the first way it's written is used to open it
+            auto tag_path = File::halo_path_to_preferred_path(File::remove_duplicate_slashes(words[1]));
+            std::error_code ec;
+            auto key = std::filesystem::weakly_canonical(tags / tag_path, ec);
+            if(ec) {
+                key = (tags / tag_path).lexically_normal();
+            }
+            auto [index, inserted] = record_indices.try_emplace(key, records.size());
+            if(inserted) {
+                // Paths that only differ in case may still be the same file if the filesystem is case-insensitive
+                auto case_folded_key = key.string();
+                for(auto &c : case_folded_key) {
+                    c = std::tolower(c);
+                }
+                auto &case_folded_indices = case_folded_record_indices[case_folded_key];
+                for(auto r : case_folded_indices) {
+                    if(std::filesystem::equivalent(tags / records[r].tag_path, key, ec) && !ec) {
+                        index->second = r;
+                        break;
+                    }
+                }
+                if(index->second == records.size()) {
+                    case_folded_indices.emplace_back(records.size());
+                    records.emplace_back(ScriptRecord { tag_path, {} });
+                }
+            }
+            current = &records[index->second];
+            continue;
+        }
+        
+        const Operation *operation = nullptr;
+        for(auto &o : operations) {
+            if(name == o.name) {
+                operation = &o;
+                break;
+            }
+        }
+        
+        if(operation == nullptr) {
+            eprintf_error("%s:%zu: Unknown operation %s", script_name.c_str(), line_number, name.c_str());
+            errors = true;
+            continue;
+        }
+        if(argument_count != operation->argument_count) {
+            eprintf_error("%s:%zu: Expected %zu argument%s for %s but got %zu", script_name.c_str(), line_number, operation->argument_count, operation->argument_count == 1 ? "" : "s", operation->name, argument_count);
+            errors = true;
+            continue;
+        }
+        if(current == nullptr) {
+            eprintf_error("%s:%zu: Expected a tag before %s", script_name.c_str(), line_number, operation->name);
+            errors = true;
+            continue;
+        }
+        
+        Actions action = { operation->type, words[1], {}, 0, 0, line_number };
+        try {
+            switch(operation->type) {
+                case ActionType::ACTION_TYPE_SET:
+                    action.value = words[2];
+                    break;
+                case ActionType::ACTION_TYPE_INSERT:
+                    action.count = parse_script_number(words[2], false);
+                    action.position = parse_script_number(words[3], true);
+                    break;
+                case ActionType::ACTION_TYPE_COPY:
+                case ActionType::ACTION_TYPE_MOVE:
+                    action.position = parse_script_number(words[2], true);
+                    break;
+                default:
+                    break;
+            }
+        }
+        catch(std::exception &) {
+            eprintf_error("%s:%zu: Expected a valid count/position", script_name.c_str(), line_number);
+            errors = true;
+            continue;
+        }
+        
+        current->actions.emplace_back(std::move(action));
+    }
+    
+    if(errors) {
+        return std::nullopt;
+    }
+    return records;
+}
+
+struct ScriptResult {
+    bool success = false;
+    std::vector<std::string> output;
+    std::vector<std::string> errors;
+};
+
+// Parse the tag once, do all of its edits in order, and save it once if anything changed. Nothing is saved if an edit fails.
+static ScriptResult run_script_record(const ScriptRecord &record, const std::filesystem::path &tags, bool check_read_only, const std::string &script_name) {
+    ScriptResult result;
+    auto file_path = tags / record.tag_path;
+    
+    auto file = File::open_file(file_path);
+    if(!file.has_value()) {
+        result.errors.emplace_back(std::string("Failed to read ") + file_path.string());
+        return result;
+    }
+    
+    std::unique_ptr<Parser::ParserStruct> tag_struct;
+    try {
+        tag_struct = Parser::ParserStruct::parse_hek_tag_file(file->data(), file->size());
+    }
+    catch (std::exception &e) {
+        result.errors.emplace_back(std::string("Failed to parse ") + file_path.string() + ": " + e.what());
+        return result;
+    }
+    
+    auto tag_class = reinterpret_cast<const HEK::TagFileHeader *>(file->data())->tag_fourcc;
+    bool modified = false;
+    
+    for(auto &i : record.actions) {
+        try {
+            if(apply_action(*tag_struct, tag_class, i, check_read_only, result.output)) {
+                modified = true;
+            }
+        }
+        catch (std::exception &e) {
+            result.errors.emplace_back(script_name + ":" + std::to_string(i.line) + ": " + e.what());
+            result.errors.emplace_back(std::string("Failed to edit ") + file_path.string() + "; it was not saved");
+            return result;
+        }
+    }
+    
+    if(modified) {
+        bool can_save = true;
+        try {
+            can_save = File::split_tag_class_extension(file_path.string()).value().fourcc == tag_class;
+        }
+        catch(std::exception &) {
+            can_save = false;
+        }
+        
+        if(!can_save) {
+            result.errors.emplace_back(std::string("Cannot save: ") + file_path.string() + " does not have the correct ." + HEK::tag_fourcc_to_extension(tag_class) + " extension");
+            return result;
+        }
+        
+        if(!File::save_file(file_path, tag_struct->generate_hek_tag_data(tag_class))) {
+            result.errors.emplace_back(std::string("Unable to write to ") + file_path.string());
+            return result;
+        }
+    }
+    
+    result.success = true;
+    return result;
+}
+
+static int run_script(const std::vector<ScriptRecord> &records, const std::filesystem::path &tags, bool check_read_only, std::size_t max_threads, const std::string &script_name) {
+    // Tags are edited in parallel, but their output is printed in the order they are in the script
+    std::vector<std::optional<ScriptResult>> results(records.size());
+    std::size_t next_to_print = 0;
+    std::size_t count = 0;
+    std::mutex mutex;
+    
+    for_each_in_parallel(records.size(), max_threads, [&](std::size_t r) {
+        auto result = run_script_record(records[r], tags, check_read_only, script_name);
+        
+        std::scoped_lock lock(mutex);
+        results[r] = std::move(result);
+        
+        for(; next_to_print < results.size() && results[next_to_print].has_value(); next_to_print++) {
+            auto &printed = *results[next_to_print];
+            for(auto &i : printed.output) {
+                std::puts(i.c_str());
+            }
+            for(auto &i : printed.errors) {
+                eprintf_error("%s", i.c_str());
+            }
+            if(printed.success) {
+                count++;
+            }
+            
+            // We don't need it anymore
+            printed.output.clear();
+            printed.errors.clear();
+        }
+    });
+    
+    auto total = records.size();
+    auto error_count = total - count;
+    if(error_count > 0) {
+        oprintf_success_warn("Edited %zu out of %zu tag%s (%zu error%s)", count, total, total == 1 ? "" : "s", error_count, error_count == 1 ? "" : "s");
+        return EXIT_FAILURE;
+    }
+    else {
+        oprintf_success("Edited %zu out of %zu tag%s", count, total, total == 1 ? "" : "s");
+        return EXIT_SUCCESS;
+    }
+}
+
 int main(int argc, char * const *argv) {
     set_up_color_term();
     
@@ -782,11 +1209,13 @@ int main(int argc, char * const *argv) {
         CommandLineOption("move", 'M', 2, "Swap the selected structs with the structs at the given index or \"end\" if the end of the array. The regions must not intersect.", "<key> <pos>"),
         CommandLineOption("erase", 'E', 1, "Delete the selected struct(s).", "<key>"),
         CommandLineOption("copy", 'c', 2, "Copy the selected struct(s) to the given index or \"end\" if the end of the array.", "<key> <pos>"),
-        CommandLineOption("no-safeguards", 'n', 0, "Allow all tag data to be edited (proceed at your own risk)")
+        CommandLineOption("no-safeguards", 'n', 0, "Allow all tag data to be edited (proceed at your own risk)"),
+        CommandLineOption("script", 's', 1, "Do the edits in a script file (or \"-\" for stdin). Each tag is opened and saved once, and tags are edited in parallel.", "<file>"),
+        CommandLineOption("threads", 'j', 1, "Set the number of threads to use for editing tags with --script. Default: CPU thread count", "<#>")
     };
 
     static constexpr char DESCRIPTION[] = "Edit tags via command-line.";
-    static constexpr char USAGE[] = "[options] <-b <expr>|tag.class>";
+    static constexpr char USAGE[] = "[options] <-b <expr>|-s <file>|tag.class>";
 
     struct EditOptions {
         std::filesystem::path tags = "tags";
@@ -798,6 +1227,8 @@ int main(int argc, char * const *argv) {
         bool view_checksum = false;
         std::vector<std::string> batch, batch_exclude;
         std::optional<std::variant<std::string, std::filesystem::path>> overwrite_path;
+        std::optional<std::string> script;
+        std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
     } edit_options;
 
     auto remaining_arguments = CommandLineOption::parse_arguments<EditOptions &>(argc, argv, options, USAGE, DESCRIPTION, 0, 1, edit_options, [](char opt, const std::vector<const char *> &arguments, auto &edit_options) {
@@ -877,9 +1308,53 @@ int main(int argc, char * const *argv) {
                     std::exit(EXIT_FAILURE);
                 }
                 break;
+            case 's':
+                edit_options.script = arguments[0];
+                break;
+            case 'j':
+                try {
+                    int threads = std::stoi(arguments[0]);
+                    if(threads < 1) {
+                        throw std::exception();
+                    }
+                    edit_options.max_threads = static_cast<std::size_t>(threads);
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid number of threads %s", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
         }
     });
     
+    // Scripts have their own tags and edits
+    if(edit_options.script.has_value()) {
+        if(!remaining_arguments.empty() || !edit_options.batch.empty() || !edit_options.batch_exclude.empty() || !edit_options.actions.empty() || edit_options.new_tag || edit_options.overwrite_path.has_value() || edit_options.verify_checksum || edit_options.view_checksum) {
+            eprintf_error("--script cannot be used with a tag path, batching, or other edits.");
+            return EXIT_FAILURE;
+        }
+        
+        auto &script = *edit_options.script;
+        std::optional<std::vector<ScriptRecord>> records;
+        if(script == "-") {
+            records = read_script(std::cin, "<stdin>", edit_options.tags);
+        }
+        else {
+            std::ifstream stream(script);
+            if(!stream.is_open()) {
+                eprintf_error("Failed to read %s", script.c_str());
+                return EXIT_FAILURE;
+            }
+            records = read_script(stream, script, edit_options.tags);
+        }
+        
+        if(!records.has_value()) {
+            return EXIT_FAILURE;
+        }
+        
+        return run_script(*records, edit_options.tags, edit_options.check_read_only, edit_options.max_threads, script == "-" ? "<stdin>" : script);
+    }
+    
     auto use_batching = !(edit_options.batch.empty() && edit_options.batch_exclude.empty());
     if(use_batching != remaining_arguments.empty()) {
         eprintf_error("Expected batching or a tag path but not both.");
@@ -956,128 +1431,17 @@ int main(int argc, char * const *argv) {
         std::vector<std::string> output;
         bool should_save = edit_options.new_tag; // by default only save if making a new tag. this will be set to true if --set, --insert, --copy, --move, or --delete are used too
         
-        for(auto &i : edit_options.actions) {
-            switch(i.type) {
-                case ActionType::ACTION_TYPE_LIST: {
-                    list_everything(populate_struct(*Parser::ParserStruct::generate_base_struct(tag_class)), output, false);
-                    break;
-                }
-                case ActionType::ACTION_TYPE_LIST_ALL_VALUES: {
-                    list_everything(*tag_struct, output, true);
-                    break;
-                }
-                case ActionType::ACTION_TYPE_GET: {
-                    std::string bitfield;
-                    auto arr = get_values_for_key(tag_struct.get(), i.key == "" ? "" : (std::string(".") + i.key), bitfield, false);
-                    for(auto &k : arr) {
-                        output.emplace_back(get_value(k, bitfield));
-                    }
-                    break;
-                }
-                case ActionType::ACTION_TYPE_SET: {
-                    std::string bitfield;
-                    should_save = true;
-                    auto arr = get_values_for_key(tag_struct.get(), i.key == "" ? "" : (std::string(".") + i.key), bitfield, edit_options.check_read_only);
-                    for(auto &k : arr) {
-                        set_value(k, i.value, bitfield);
-                    }
-                    break;
-                }
-                case ActionType::ACTION_TYPE_COUNT: {
-                    auto arr = get_values_for_key(tag_struct.get(), i.key == "" ? "" : (std::string(".") + i.key), false);
-                    for(auto &k : arr) {
-                        if(k.get_type() == Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
-                            output.emplace_back(std::to_string(k.get_array_size()));
-                        }
-                        else {
-                            eprintf_error("%s is not an array", k.get_member_name());
-                            throw std::exception();
-                        }
-                    }
-                    break;
-                }
-                case ActionType::ACTION_TYPE_INSERT: {
-                    should_save = true;
-                    auto arr = get_values_for_key(tag_struct.get(), i.key == "" ? "" : (std::string(".") + i.key), edit_options.check_read_only);
-                    for(auto &k : arr) {
-                        if(k.get_type() != Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
-                            eprintf_error("%s is not an array", k.get_member_name());
-                            throw std::exception();
-                        }
-                        
-                        if(i.count + k.get_array_size() > k.get_array_maximum_size()) {
-                            eprintf_error("%s's maximum size of %zu exceeded", k.get_member_name(), k.get_array_maximum_size());
-                            throw std::exception();
-                        }
-                        k.insert_objects_in_array(i.position == SIZE_MAX ? k.get_array_size() : i.position, i.count);
-                    }
-                    break;
-                }
-                case ActionType::ACTION_TYPE_DELETE: {
-                    should_save = true;
-                    std::pair<std::size_t, std::size_t> range;
-                    auto arr = get_values_for_key(tag_struct.get(), i.key == "" ? "" : (std::string(".") + i.key), range, edit_options.check_read_only);
-                    for(auto &k : arr) {
-                        if(k.get_type() != Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
-                            eprintf_error("%s is not an array", k.get_member_name());
-                            throw std::exception();
-                        }
-                        
-                        std::size_t iterations = range.second - range.first + 1;
-                        if(k.get_array_size() - iterations < k.get_array_minimum_size()) {
-                            eprintf_error("%s's minimum size of %zu exceeded", k.get_member_name(), k.get_array_maximum_size());
-                            throw std::exception();
-                        }
-                        k.delete_objects_in_array(range.first, iterations);
-                    }
-                    break;
-                }
-                case ActionType::ACTION_TYPE_MOVE: {
-                    should_save = true;
-                    std::pair<std::size_t, std::size_t> range;
-                    auto arr = get_values_for_key(tag_struct.get(), i.key == "" ? "" : (std::string(".") + i.key), range, edit_options.check_read_only);
-                    for(auto &k : arr) {
-                        if(k.get_type() != Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
-                            eprintf_error("%s is not an array", k.get_member_name());
-                            throw std::exception();
-                        }
-                        
-                        std::size_t to = i.position == SIZE_MAX ? k.get_array_size() : i.position;
-                        std::size_t iterations = range.second - range.first + 1;
-                        if(to == range.first) {
-                            continue; // we can ignore if it's trying to swap itself
-                        }
-                        k.swap_objects_in_array(range.first, to, iterations);
-                    }
-                    break;
-                }
-                case ActionType::ACTION_TYPE_COPY: {
+        try {
+            for(auto &i : edit_options.actions) {
+                if(apply_action(*tag_struct, tag_class, i, edit_options.check_read_only, output)) {
                     should_save = true;
-                    std::pair<std::size_t, std::size_t> range;
-                    auto arr = get_values_for_key(tag_struct.get(), i.key == "" ? "" : (std::string(".") + i.key), range, edit_options.check_read_only);
-                    for(auto &k : arr) {
-                        if(k.get_type() != Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE) {
-                            eprintf_error("%s is not an array", k.get_member_name());
-                            throw std::exception();
-                        }
-                        
-                        std::size_t to = i.position == SIZE_MAX ? k.get_array_size() : i.position;
-                        std::size_t iterations = range.second - range.first + 1;
-                        
-                        if(iterations + k.get_array_size() > k.get_array_maximum_size()) {
-                            eprintf_error("%s's maximum size of %zu exceeded", k.get_member_name(), k.get_array_maximum_size());
-                            throw std::exception();
-                        }
-                        
-                        k.duplicate_objects_in_array(range.first, to, iterations);
-                    }
-                    break;
                 }
-                default:
-                    eprintf_error("Unimplemented");
-                    std::exit(EXIT_FAILURE);
             }
         }
+        catch (std::exception &e) {
+            eprintf_error("Failed to edit %s: %s", file_path.string().c_str(), e.what());
+            return false;
+        }
         
         for(auto &i : output) {
             std::puts(i.c_str());
@@ -165,7 +165,7 @@ namespace Invader::EditQt {
         }
 
         // Set up the scroll area and widgets
-        auto values = std::vector<Parser::ParserStructValue>(this->parser_data->get_values());
+        auto values = this->parser_data->get_values();
         this->scroll_widget = new QScrollArea();
         this->setCentralWidget(this->scroll_widget);
         this->main_widget = new TagEditorEditWidgetView(nullptr, values, this, true, extra_widget_panel);
@@ -174,7 +174,7 @@ namespace Invader::EditQt {
         // Goto menu (goto top level reflexives)
         auto *goto_menu = bar->addMenu("Goto");
         goto_menu->setEnabled(false);
-        for(auto &v : values) {
+        for(auto v : values) {
             auto type = v.get_type();
             if(type == Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE || type == Parser::ParserStructValue::ValueType::VALUE_TYPE_GROUP_START) {
                 goto_menu->addAction(new GotoAction(v.get_name(), this));
@@ -19,7 +19,7 @@ namespace Invader::EditQt {
         return -1;
     }
     
-    TagEditorEditWidgetView::TagEditorEditWidgetView(QWidget *parent, const std::vector<Parser::ParserStructValue> &values, TagEditorWindow *editor_window, bool primary, QWidget *extra_widget) : QFrame(parent), values(values), editor_window(editor_window) {
+    TagEditorEditWidgetView::TagEditorEditWidgetView(QWidget *parent, const Parser::ParserStructValues &values, TagEditorWindow *editor_window, bool primary, QWidget *extra_widget) : QFrame(parent), values(values.begin(), values.end()), editor_window(editor_window) {
         auto *vbox_layout = new QVBoxLayout();
         vbox_layout->setContentsMargins(0, 0, 0, 0);
         vbox_layout->setSpacing(0);
@@ -21,7 +21,7 @@ namespace Invader::EditQt {
          * @param primary       is the primary widget of the window
          * @param extra_widget  optional additional widget to add
          */
-        TagEditorEditWidgetView(QWidget *parent, const std::vector<Parser::ParserStructValue> &values, TagEditorWindow *editor_window, bool primary, QWidget *extra_widget = nullptr);
+        TagEditorEditWidgetView(QWidget *parent, const Parser::ParserStructValues &values, TagEditorWindow *editor_window, bool primary, QWidget *extra_widget = nullptr);
         
         /**
          * Get the y offset of the given item
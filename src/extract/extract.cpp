@@ -11,6 +11,7 @@
 #include <invader/build/build_workload.hpp>
 #include <invader/tag/parser/parser.hpp>
 #include <regex>
+#include <thread>
 
 int main(int argc, const char **argv) {
     set_up_color_term();
@@ -30,6 +31,7 @@ int main(int argc, const char **argv) {
         bool overwrite = false;
         bool non_mp_globals = false;
         bool ignore_resource_maps = false;
+        std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
     } extract_options;
 
     // Command line options
@@ -42,7 +44,8 @@ int main(int argc, const char **argv) {
         CommandLineOption("ignore-resources", 'G', 0, "Ignore resource maps."),
         CommandLineOption("search", 's', 1, "Search for tags (* and ? are wildcards) and extract these. Use multiple times for multiple queries. If unspecified, all tags will be extracted.", "<expr>"),
         CommandLineOption("search-exclude", 'e', 1, "Search for tags (* and ? are wildcards) and ignore these. Use multiple times for multiple queries. This takes precedence over --search.", "<expr>"),
-        CommandLineOption("non-mp-globals", 'n', 0, "Enable extraction of non-multiplayer .globals")
+        CommandLineOption("non-mp-globals", 'n', 0, "Enable extraction of non-multiplayer .globals"),
+        CommandLineOption("threads", 'j', 1, "Set the number of threads to use for extracting tags in parallel. Default: CPU thread count")
     };
 
     static constexpr char DESCRIPTION[] = "Extract data from cache files.";
@@ -79,6 +82,18 @@ int main(int argc, const char **argv) {
             case 'e':
                 extract_options.search_queries_exclude.emplace_back(File::preferred_path_to_halo_path(args[0]));
                 break;
+            case 'j':
+                try {
+                    extract_options.max_threads = std::stoi(args[0]);
+                    if(extract_options.max_threads < 1) {
+                        throw std::exception();
+                    }
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid number of threads %s\n", args[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
             case 'i':
                 Invader::show_version_info();
                 std::exit(EXIT_SUCCESS);
@@ -180,5 +195,5 @@ int main(int argc, const char **argv) {
         return EXIT_FAILURE;
     }
 
-    ExtractionWorkload::extract_map(*map, *extract_options.tags_directory, extract_options.search_queries, extract_options.search_queries_exclude, extract_options.recursive, extract_options.overwrite, extract_options.non_mp_globals);
+    ExtractionWorkload::extract_map(*map, *extract_options.tags_directory, extract_options.search_queries, extract_options.search_queries_exclude, extract_options.recursive, extract_options.overwrite, extract_options.non_mp_globals, ErrorHandler::ReportingLevel::REPORTING_LEVEL_ALL, extract_options.max_threads);
 }
@@ -1,13 +1,45 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <chrono>
 #include <regex>
-#include <invader/build/build_workload.hpp>
+#include <thread>
 #include <invader/extract/extraction.hpp>
 #include <invader/tag/hek/header.hpp>
 #include <invader/tag/parser/parser.hpp>
 
 namespace Invader {
-    void ExtractionWorkload::extract_map(const Map &map, const std::string &tags, const std::vector<std::string> &queries, const std::vector<std::string> &queries_exclude, bool recursive, bool overwrite, bool non_mp_globals, ReportingLevel reporting_level) {
+    // Get every dependency referenced in a tag (and its reflexives) that isn't empty
+    static std::vector<const Parser::Dependency *> get_dependencies(const Parser::ParserStruct &tag_struct) {
+        std::vector<const Parser::Dependency *> dependencies;
+        
+        auto recursively_get_dependencies = [&dependencies](const Parser::ParserStruct &st, auto &recursively_get_dependencies) -> void {
+            for(auto v : st.get_values()) {
+                switch(v.get_type()) {
+                    case Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE: {
+                        auto count = v.get_array_size();
+                        for(std::size_t i = 0; i < count; i++) {
+                            recursively_get_dependencies(v.get_object_in_array(i), recursively_get_dependencies);
+                        }
+                        break;
+                    }
+                    case Parser::ParserStructValue::ValueType::VALUE_TYPE_DEPENDENCY: {
+                        auto &dep = v.get_dependency();
+                        if(!dep.path.empty()) {
+                            dependencies.emplace_back(&dep);
+                        }
+                        break;
+                    }
+                    default: break;
+                }
+            }
+        };
+        
+        recursively_get_dependencies(tag_struct, recursively_get_dependencies);
+        
+        return dependencies;
+    }
+    
+    void ExtractionWorkload::extract_map(const Map &map, const std::string &tags, const std::vector<std::string> &queries, const std::vector<std::string> &queries_exclude, bool recursive, bool overwrite, bool non_mp_globals, ReportingLevel reporting_level, std::size_t max_threads) {
         // There's no need to extract recursively if we're extracting all tags
         if(queries.size() == 0) {
             recursive = false;
@@ -15,7 +47,7 @@ namespace Invader {
         
         ExtractionWorkload workload(map, reporting_level);
         auto start = std::chrono::steady_clock::now();
-        auto success = workload.perform_extraction(queries, queries_exclude, tags, recursive, overwrite, non_mp_globals);
+        auto success = workload.perform_extraction(queries, queries_exclude, tags, recursive, overwrite, non_mp_globals, max_threads < 1 ? 1 : max_threads);
         auto matched = workload.matched_tags.size();
         auto warnings = workload.get_warnings();
         auto errors = workload.get_errors();
@@ -47,20 +79,19 @@ namespace Invader {
         }
     }
     
-    std::size_t ExtractionWorkload::perform_extraction(const std::vector<std::string> &queries, const std::vector<std::string> &queries_exclude, const std::filesystem::path &tags, bool recursive, bool overwrite, bool non_mp_globals) {
+    std::size_t ExtractionWorkload::perform_extraction(const std::vector<std::string> &queries, const std::vector<std::string> &queries_exclude, const std::filesystem::path &tags, bool recursive, bool overwrite, bool non_mp_globals, std::size_t max_threads) {
         // Set these variables up
         auto *map = &this->map;
         auto type = map->get_type();
         auto tag_count = map->get_tag_count();
         std::vector<bool> extracted_tags(tag_count);
-        std::deque<std::size_t> all_tags_to_extract;
+        std::vector<std::size_t> all_tags_to_extract;
         auto &workload = *this;
         auto engine = map->get_cache_version();
 
-        auto extract_tag = [&extracted_tags, &map, &tags, &all_tags_to_extract, &type, &recursive, &overwrite, &non_mp_globals, &workload, &engine](std::size_t tag_index) -> bool {
-            // Do it
-            extracted_tags[tag_index] = true;
-
+        // This is run on worker threads. Errors in parsing the tag data are reported to thread_workload (like it was a
+        // separate tag being extracted), while everything else is reported to this workload.
+        auto extract_tag = [&map, &tags, &type, &recursive, &overwrite, &non_mp_globals, &workload, &engine](std::size_t tag_index, ExtractionWorkload &thread_workload, std::vector<std::size_t> &dependencies) -> bool {
             // Get the tag path
             const auto &tag = map->get_tag(tag_index);
             if(!tag.data_is_available()) {
@@ -95,22 +126,18 @@ namespace Invader {
             // Get the tag data
             std::vector<std::byte> new_tag;
             try {
-                new_tag = Invader::ExtractionWorkload::extract_single_tag(tag);
+                auto parsed = thread_workload.extract_tag(tag_index);
+                if(!parsed.has_value()) {
+                    throw InvalidTagDataException();
+                }
+                new_tag = (*parsed)->generate_hek_tag_data(tag.get_tag_fourcc());
 
                 // If we're recursive, we want to also get that stuff, too
                 if(recursive) {
-                    auto tag_compiled = BuildWorkload::compile_single_tag(new_tag.data(), new_tag.size(), std::vector<std::filesystem::path>(), false);
-                    std::vector<std::pair<const std::string *, Invader::TagFourCC>> dependencies;
-                    for(auto &s : tag_compiled.structs) {
-                        for(auto &d : s.dependencies) {
-                            auto &tag = tag_compiled.tags[d.tag_index];
-                            dependencies.emplace_back(&tag.path, tag.tag_fourcc);
-                        }
-                    }
-                    for(auto &d : dependencies) {
-                        auto tag_index = map->find_tag(d.first->c_str(), d.second);
-                        if(tag_index.has_value() && extracted_tags[*tag_index] == false) {
-                            all_tags_to_extract.push_back(*tag_index);
+                    for(auto *d : get_dependencies(**parsed)) {
+                        auto dependency_index = map->find_tag(d->path.c_str(), d->tag_fourcc);
+                        if(dependency_index.has_value()) {
+                            dependencies.push_back(*dependency_index);
                         }
                     }
                 }
@@ -217,16 +244,7 @@ namespace Invader {
         }
 
         else {
-            for(std::size_t t = 0; t < tag_count; t++) {
-                // Get the full path
-                const auto &tag = map->get_tag(t);
-                auto full_tag_path = tag.get_path() + "." + HEK::tag_fourcc_to_extension(tag.get_tag_fourcc());
-                
-                // Match it
-                if(File::path_matches(full_tag_path.c_str(), queries, queries_exclude)) {
-                    all_tags_to_extract.emplace_back(t);
-                }    
-            }
+            all_tags_to_extract = map->search_tags(queries, queries_exclude);
 
             if(all_tags_to_extract.empty()) {
                 workload.report_error(ErrorType::ERROR_TYPE_ERROR, "No tags were found with the given search parameter(s).");
@@ -234,34 +252,79 @@ namespace Invader {
             }
         }
 
-        // Extract tags
+        // Extract tags, one pass at a time. Each pass is split across threads, and any dependencies found that weren't
+        // already queued make up the next pass.
+        for(auto t : all_tags_to_extract) {
+            extracted_tags[t] = true;
+        }
+        
         std::size_t total = 0;
         std::size_t extracted = 0;
         while(all_tags_to_extract.size() > 0) {
-            std::size_t tag = all_tags_to_extract[0];
-            all_tags_to_extract.erase(all_tags_to_extract.begin());
-            if(extracted_tags[tag]) {
-                continue;
-            }
-            const auto &tag_map = map->get_tag(tag);
-            auto path_dot = File::TagFilePath(File::halo_path_to_preferred_path(tag_map.get_path()), tag_map.get_tag_fourcc());
+            std::vector<std::vector<std::size_t>> dependencies_found(all_tags_to_extract.size());
+            std::mutex thread_mutex;
+            std::vector<std::thread> threads;
+            std::size_t next_tag = 0;
+            std::size_t thread_count = std::min(max_threads, all_tags_to_extract.size());
+            threads.reserve(thread_count);
             
-            // Do it!
-            bool result;
-            try {
-                result = extract_tag(tag);
-            }
-            catch(std::exception &e) {
-                eprintf_error("Error while extracting %s: %s", path_dot.join().c_str(), e.what());
-                result = false;
+            auto extract_worker = [](auto *all_tags_to_extract, auto *dependencies_found, std::size_t *next_tag, std::mutex *thread_mutex, std::size_t *extracted, auto *extract_tag, ExtractionWorkload *workload) {
+                ExtractionWorkload thread_workload(workload->map, ReportingLevel::REPORTING_LEVEL_ALL);
+                
+                while(true) {
+                    thread_mutex->lock();
+                    std::size_t this_index = *next_tag;
+                    if(this_index == all_tags_to_extract->size()) {
+                        thread_mutex->unlock();
+                        return;
+                    }
+                    (*next_tag)++;
+                    thread_mutex->unlock();
+                    
+                    std::size_t tag = (*all_tags_to_extract)[this_index];
+                    const auto &tag_map = workload->map.get_tag(tag);
+                    auto path_dot = File::TagFilePath(File::halo_path_to_preferred_path(tag_map.get_path()), tag_map.get_tag_fourcc());
+                    
+                    // Do it!
+                    bool result;
+                    try {
+                        result = (*extract_tag)(tag, thread_workload, (*dependencies_found)[this_index]);
+                    }
+                    catch(std::exception &e) {
+                        std::lock_guard<std::mutex> lock(workload->output_mutex);
+                        eprintf_error("Error while extracting %s: %s", path_dot.join().c_str(), e.what());
+                        result = false;
+                    }
+                    
+                    std::lock_guard<std::mutex> lock(workload->output_mutex);
+                    if(result) {
+                        oprintf_success("Extracted %s", path_dot.join().c_str());
+                        (*extracted)++;
+                    }
+                    else {
+                        oprintf("Skipped %s\n", path_dot.join().c_str());
+                    }
+                }
+            };
+            
+            for(std::size_t i = 0; i < thread_count; i++) {
+                threads.emplace_back(extract_worker, &all_tags_to_extract, &dependencies_found, &next_tag, &thread_mutex, &extracted, &extract_tag, this);
             }
-            if(result) {
-                oprintf_success("Extracted %s", path_dot.join().c_str());
-                extracted++;
+            for(auto &i : threads) {
+                i.join();
             }
-            else {
-                oprintf("Skipped %s\n", path_dot.join().c_str());
+            
+            // Queue up anything new
+            std::vector<std::size_t> next_pass;
+            for(auto &dependencies : dependencies_found) {
+                for(auto d : dependencies) {
+                    if(!extracted_tags[d]) {
+                        extracted_tags[d] = true;
+                        next_pass.push_back(d);
+                    }
+                }
             }
+            all_tags_to_extract = std::move(next_pass);
         }
         
         this->matched_tags.reserve(total);
@@ -274,6 +337,11 @@ namespace Invader {
         return extracted;
     }
     
+    void ExtractionWorkload::report_error(ErrorType type, const char *error, std::optional<std::size_t> tag_index) {
+        std::lock_guard<std::mutex> lock(this->output_mutex);
+        ErrorHandler::report_error(type, error, tag_index);
+    }
+    
     ExtractionWorkload::ExtractionWorkload(const Map &map, ReportingLevel reporting_level) : ErrorHandler(reporting_level), map(map) {
         auto &paths = this->get_tag_paths();
         auto tag_count = map.get_tag_count();
@@ -2,16 +2,31 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include <invader/file/file.hpp>
+#include <invader/file/tag_index.hpp>
 #include <invader/error.hpp>
 #include <invader/printf.hpp>
+#include "list_directory.hpp"
 
 #include <cstdio>
+#include <cerrno>
 #include <filesystem>
 #include <cstring>
 #include <climits>
+#include <algorithm>
+#include <condition_variable>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
 
 namespace Invader::File {
     std::optional<std::vector<std::byte>> open_file(const std::filesystem::path &path) {
@@ -73,6 +88,93 @@ namespace Invader::File {
         return file_data;
     }
 
+    std::optional<MemoryMappedFile> MemoryMappedFile::map_file(const std::filesystem::path &path) {
+        MemoryMappedFile file;
+
+        #ifdef _WIN32
+        HANDLE handle = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(handle != INVALID_HANDLE_VALUE) {
+            LARGE_INTEGER size;
+            if(GetFileSizeEx(handle, &size) && size.QuadPart > 0) {
+                HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if(mapping != nullptr) {
+                    auto *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    if(view != nullptr) {
+                        file.file_data = reinterpret_cast<const std::byte *>(view);
+                        file.file_size = static_cast<std::size_t>(size.QuadPart);
+                        file.mapped = true;
+                    }
+                    CloseHandle(mapping); // the view keeps the mapping alive
+                }
+            }
+            CloseHandle(handle);
+        }
+        #else
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if(fd >= 0) {
+            struct stat st;
+            if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+                auto *view = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if(view != MAP_FAILED) {
+                    file.file_data = reinterpret_cast<const std::byte *>(view);
+                    file.file_size = static_cast<std::size_t>(st.st_size);
+                    file.mapped = true;
+                }
+            }
+            close(fd); // the mapping stays valid after closing
+        }
+        #endif
+
+        // Empty files can't be mapped, and some filesystems can't map at all, so just read it
+        if(!file.mapped) {
+            auto data = open_file(path);
+            if(!data.has_value()) {
+                return std::nullopt;
+            }
+            file.fallback = std::move(*data);
+            file.file_data = file.fallback.data();
+            file.file_size = file.fallback.size();
+        }
+
+        return file;
+    }
+
+    void MemoryMappedFile::unmap() noexcept {
+        if(this->mapped) {
+            #ifdef _WIN32
+            UnmapViewOfFile(this->file_data);
+            #else
+            munmap(const_cast<std::byte *>(this->file_data), this->file_size);
+            #endif
+        }
+        this->file_data = nullptr;
+        this->file_size = 0;
+        this->mapped = false;
+        this->fallback.clear();
+    }
+
+    MemoryMappedFile::MemoryMappedFile(MemoryMappedFile &&move) noexcept {
+        *this = std::move(move);
+    }
+
+    MemoryMappedFile &MemoryMappedFile::operator=(MemoryMappedFile &&move) noexcept {
+        if(this != &move) {
+            this->unmap();
+            this->mapped = move.mapped;
+            this->file_size = move.file_size;
+            this->fallback = std::move(move.fallback);
+            this->file_data = this->mapped ? move.file_data : this->fallback.data();
+            move.file_data = nullptr;
+            move.file_size = 0;
+            move.mapped = false;
+        }
+        return *this;
+    }
+
+    MemoryMappedFile::~MemoryMappedFile() {
+        this->unmap();
+    }
+
     bool save_file(const std::filesystem::path &path, const std::vector<std::byte> &data) {
         // Open the file
         auto path_string = path.string();
@@ -92,6 +194,90 @@ namespace Invader::File {
         std::fclose(f);
         return true;
     }
+
+    bool save_file_atomically(const std::filesystem::path &path, const std::vector<std::byte> &data) {
+        // Replace the file a symlink points to rather than the symlink itself
+        std::error_code ec;
+        auto target = std::filesystem::canonical(path, ec);
+        bool exists = !ec;
+        if(!exists) {
+            target = path;
+        }
+
+        auto temp_path = target;
+        temp_path += ".tmp";
+        if(!save_file(temp_path, data)) {
+            std::filesystem::remove(temp_path, ec);
+            return false;
+        }
+
+        // Keep the permissions of the file being replaced
+        if(exists) {
+            auto permissions = std::filesystem::status(target, ec).permissions();
+            if(!ec) {
+                std::filesystem::permissions(temp_path, permissions, ec);
+            }
+        }
+
+        std::filesystem::rename(temp_path, target, ec);
+        if(ec) {
+            eprintf("Error: Failed to replace %s: %s\n", target.string().c_str(), ec.message().c_str());
+            std::filesystem::remove(temp_path, ec);
+            return false;
+        }
+        return true;
+    }
+    
+    bool copy_file(const std::filesystem::path &from, const std::filesystem::path &to) {
+        #ifdef __linux__
+        // Let the kernel copy it (and share the blocks if the filesystem supports it) rather than reading it in
+        int from_fd = open(from.string().c_str(), O_RDONLY);
+        if(from_fd >= 0) {
+            struct stat st;
+            if(fstat(from_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+                int to_fd = open(to.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+                if(to_fd < 0) {
+                    eprintf("Error: Failed to open %s for writing.\n", to.string().c_str());
+                    close(from_fd);
+                    return false;
+                }
+
+                off_t remaining = st.st_size;
+                bool unsupported = false;
+                while(remaining > 0) {
+                    auto copied = copy_file_range(from_fd, nullptr, to_fd, nullptr, static_cast<std::size_t>(remaining), 0);
+                    if(copied <= 0) {
+                        // Nothing has been written yet if copying across filesystems isn't supported, so fall back below
+                        unsupported = copied < 0 && remaining == st.st_size && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP);
+                        break;
+                    }
+                    remaining -= copied;
+                }
+
+                close(to_fd);
+                close(from_fd);
+                if(remaining == 0) {
+                    return true;
+                }
+                if(!unsupported) {
+                    eprintf("Error: Failed to copy %s to %s.\n", from.string().c_str(), to.string().c_str());
+                    return false;
+                }
+            }
+            else {
+                close(from_fd);
+            }
+        }
+        #endif
+
+        std::error_code ec;
+        std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing, ec);
+        if(ec) {
+            eprintf("Error: Failed to copy %s to %s: %s\n", from.string().c_str(), to.string().c_str(), ec.message().c_str());
+            return false;
+        }
+        return true;
+    }
     
     std::optional<std::filesystem::path> tag_path_to_file_path(const std::string &tag_path, const std::vector<std::filesystem::path> &tags) {
         for(auto &i : tags) {
@@ -289,9 +475,68 @@ namespace Invader::File {
         }
     }
 
-    std::vector<TagFile> load_virtual_tag_folder(const std::vector<std::filesystem::path> &tags, bool filter_duplicates, std::pair<std::mutex, std::size_t> *status, std::size_t *errors) {
-        std::vector<TagFile> all_tags;
+    void list_directory(const std::filesystem::path &dir, std::vector<DirectoryEntry> &entries) {
+        #ifdef _WIN32
+        // win32 implementation because Windows I/O is AWFUL
+        WIN32_FIND_DATA find_data;
+        HANDLE file = FindFirstFileA((dir / "*").string().c_str(), &find_data);
+        if(file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("failed to open directory");
+        }
+        
+        do {
+            if(std::strcmp(find_data.cFileName, ".") != 0 && std::strcmp(find_data.cFileName, "..") != 0) {
+                entries.emplace_back(DirectoryEntry { find_data.cFileName, (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 });
+            }
+        }
+        while(FindNextFileA(file, &find_data));
+        
+        FindClose(file);
+        #else
+        // readdir() gets entries from the kernel in batches (getdents), and d_type lets us skip a stat for most entries
+        DIR *d = opendir(dir.string().c_str());
+        if(d == nullptr) {
+            throw std::runtime_error(std::strerror(errno));
+        }
         
+        while(auto *entry = readdir(d)) {
+            if(std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            
+            switch(entry->d_type) {
+                case DT_DIR:
+                    entries.emplace_back(DirectoryEntry { entry->d_name, true });
+                    break;
+                case DT_REG:
+                    entries.emplace_back(DirectoryEntry { entry->d_name, false });
+                    break;
+                    
+                // Symlinks are followed, and some filesystems don't give us a type at all, so stat these
+                case DT_LNK:
+                case DT_UNKNOWN: {
+                    struct stat s;
+                    if(fstatat(dirfd(d), entry->d_name, &s, 0) == 0) {
+                        if(S_ISDIR(s.st_mode)) {
+                            entries.emplace_back(DirectoryEntry { entry->d_name, true });
+                        }
+                        else if(S_ISREG(s.st_mode)) {
+                            entries.emplace_back(DirectoryEntry { entry->d_name, false });
+                        }
+                    }
+                    break;
+                }
+                    
+                default:
+                    break;
+            }
+        }
+        
+        closedir(d);
+        #endif
+    }
+
+    std::vector<TagFile> load_virtual_tag_folder(const std::vector<std::filesystem::path> &tags, bool filter_duplicates, std::pair<std::mutex, std::size_t> *status, std::size_t *errors) {
         std::size_t new_errors = 0;
 
         std::pair<std::mutex, std::size_t> status_r;
@@ -302,135 +547,191 @@ namespace Invader::File {
         status->second = 0;
         status->first.unlock();
         
-        #define maybe_iterate_directories(file_path, ...) try { \
-            iterate_directories(__VA_ARGS__); \
-        } \
-        catch(std::exception &e) { \
-            eprintf_error("Error listing %s: %s", file_path.string().c_str(), e.what()); \
-            new_errors++; \
-        }
+        // A directory that still needs to be listed
+        struct PendingDirectory {
+            std::filesystem::path path;
+            std::string tag_path; // relative to the tags directory, including a trailing separator unless it is the tags directory
+            std::size_t priority;
+            int depth;
+        };
         
-        // win32 implementation because Windows I/O is AWFUL
-        #ifdef _WIN32
-        auto iterate_directories = [&all_tags, &status, &new_errors](const std::filesystem::path &dir, auto &iterate_directories, int depth, std::size_t priority, const std::vector<std::filesystem::path> &main_dir) -> void {
-            if(++depth == 256) {
-                return;
+        struct DirectoryQueue {
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::vector<PendingDirectory> pending;
+            std::size_t busy = 0;
+            std::size_t *errors;
+            std::pair<std::mutex, std::size_t> *status;
+        } queue;
+        queue.errors = &new_errors;
+        queue.status = status;
+        
+        // Go through each directory, using its index if it has one
+        std::vector<TagFile> indexed_tags;
+        std::size_t dir_count = tags.size();
+        for(std::size_t i = 0; i < dir_count; i++) {
+            auto d = std::filesystem::path(remove_trailing_slashes(tags[i].string()));
+            if(!TagIndex::exists(d)) {
+                queue.pending.emplace_back(PendingDirectory { d, std::string(), i, 0 });
+                continue;
             }
             
-            WIN32_FIND_DATA find_data;
-            HANDLE file = FindFirstFileA((dir / "*").string().c_str(), &find_data);
-            bool found = file != nullptr;
+            TagIndex index(d);
+            try {
+                index.refresh(false);
+            }
+            catch(std::exception &e) {
+                eprintf_error("Error listing %s: %s", d.string().c_str(), e.what());
+                new_errors++;
+                continue;
+            }
+            
+            try {
+                index.save();
+            }
+            catch(std::exception &e) {
+                eprintf_warn("Failed to update the tag index for %s: %s", d.string().c_str(), e.what());
+            }
             
-            std::size_t tags_found = 0;
+            for(auto &t : index.get_tags()) {
+                auto &file = indexed_tags.emplace_back();
+                file.full_path = d / t.tag_path;
+                file.tag_fourcc = t.tag_fourcc;
+                file.tag_directory = i;
+                file.tag_path = t.tag_path;
+            }
             
-            while(found) {
-                if(std::strcmp(find_data.cFileName, ".") != 0 && std::strcmp(find_data.cFileName, "..") != 0) {
-                    auto file_path = dir / find_data.cFileName;
-                    if(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                        maybe_iterate_directories(file_path, file_path, iterate_directories, depth, priority, main_dir);
-                    }
-                    else {
-                        auto extension = file_path.extension().string();
-                        auto tag_fourcc = HEK::tag_extension_to_fourcc(extension.c_str() + 1);
-
-                        // First, make sure it's valid
+            status->first.lock();
+            status->second += index.get_tags().size();
+            status->first.unlock();
+        }
+        
+        // Directories are listed by several threads at once since most of the time is spent waiting on the filesystem
+        auto iterate_directories = [](DirectoryQueue *queue, std::vector<TagFile> *tags_found) {
+            std::vector<DirectoryEntry> entries;
+            std::unique_lock<std::mutex> lock(queue->mutex);
+            
+            while(true) {
+                // Wait for a directory, or finish when nobody's listing one that could add more
+                queue->condition.wait(lock, [&queue]() { return !queue->pending.empty() || queue->busy == 0; });
+                if(queue->pending.empty()) {
+                    return;
+                }
+                
+                auto dir = std::move(queue->pending.back());
+                queue->pending.pop_back();
+                queue->busy++;
+                lock.unlock();
+                
+                entries.clear();
+                std::vector<PendingDirectory> subdirectories;
+                std::size_t tag_count = 0;
+                
+                try {
+                    list_directory(dir.path, entries);
+                    
+                    for(auto &e : entries) {
+                        if(e.directory) {
+                            if(dir.depth + 1 < 256) {
+                                subdirectories.emplace_back(PendingDirectory { dir.path / e.name, dir.tag_path + e.name + SYSTEM_PATH_SEPARATOR, dir.priority, dir.depth + 1 });
+                            }
+                            continue;
+                        }
+                        
+                        // First, make sure it's valid (no extension or a hidden file with no extension is not a tag)
+                        auto extension = e.name.rfind('.');
+                        if(extension == std::string::npos || extension == 0) {
+                            continue;
+                        }
+                        auto tag_fourcc = HEK::tag_extension_to_fourcc(e.name.c_str() + extension + 1);
                         if(tag_fourcc == HEK::TagFourCC::TAG_FOURCC_NULL || tag_fourcc == HEK::TagFourCC::TAG_FOURCC_NONE) {
-                            goto spaghetti_next_tag;
+                            continue;
                         }
-
+                        
                         // Next, add it
-                        TagFile file;
-                        file.full_path = file_path;
+                        auto &file = tags_found->emplace_back();
+                        file.full_path = dir.path / e.name;
                         file.tag_fourcc = tag_fourcc;
-                        file.tag_directory = priority;
-                        file.tag_path = Invader::File::file_path_to_tag_path(file_path.string(), main_dir).value();
-                        all_tags.emplace_back(std::move(file));
-                        
-                        tags_found++;
+                        file.tag_directory = dir.priority;
+                        file.tag_path = dir.tag_path + e.name;
+                        tag_count++;
                     }
                 }
+                catch(std::exception &e) {
+                    std::lock_guard<std::mutex> error_lock(queue->mutex);
+                    eprintf_error("Error listing %s: %s", dir.path.string().c_str(), e.what());
+                    (*queue->errors)++;
+                }
                 
-                spaghetti_next_tag:
-                found = FindNextFileA(file, &find_data);
-            }
-            
-            // Update the find count
-            if(tags_found) {
-                status->first.lock();
-                status->second += tags_found;
-                status->first.unlock();
-            }
-        };
-        #else
-        auto iterate_directories = [&all_tags, &status, &new_errors](const std::filesystem::path &dir, auto &iterate_directories, int depth, std::size_t priority, const std::vector<std::filesystem::path> &main_dir) -> void {
-            if(++depth == 256) {
-                return;
-            }
-            
-            std::size_t tags_found = 0;
-
-            for(auto &d : std::filesystem::directory_iterator(dir)) {
-                auto file_path = d.path();
-                
-                if(d.is_directory()) {
-                    maybe_iterate_directories(file_path, d, iterate_directories, depth, priority, main_dir);
+                // Update the find count
+                if(tag_count) {
+                    queue->status->first.lock();
+                    queue->status->second += tag_count;
+                    queue->status->first.unlock();
                 }
-                else if(file_path.has_extension() && std::filesystem::is_regular_file(file_path)) {
-                    auto extension = file_path.extension().string();
-                    auto tag_fourcc = HEK::tag_extension_to_fourcc(extension.c_str() + 1);
-
-                    // First, make sure it's valid
-                    if(tag_fourcc == HEK::TagFourCC::TAG_FOURCC_NULL || tag_fourcc == HEK::TagFourCC::TAG_FOURCC_NONE) {
-                        continue;
-                    }
-
-                    // Next, add it
-                    TagFile file;
-                    file.full_path = file_path;
-                    file.tag_fourcc = tag_fourcc;
-                    file.tag_directory = priority;
-                    file.tag_path = Invader::File::file_path_to_tag_path(file_path.string(), main_dir).value();
-                    all_tags.emplace_back(std::move(file));
-                    tags_found++;
+                
+                lock.lock();
+                for(auto &s : subdirectories) {
+                    queue->pending.emplace_back(std::move(s));
                 }
-            }
-            
-            // Update the find count
-            if(tags_found) {
-                status->first.lock();
-                status->second += tags_found;
-                status->first.unlock();
+                queue->busy--;
+                queue->condition.notify_all();
             }
         };
-        #endif
-
-        // Go through each directory
-        std::size_t dir_count = tags.size();
-        for(std::size_t i = 0; i < dir_count; i++) {
-            auto d = std::filesystem::path(remove_trailing_slashes(tags[i].string()));
-            maybe_iterate_directories(d, d, iterate_directories, 0, i, std::vector<std::filesystem::path>(&d, &d + 1));
+        
+        std::size_t thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+        std::vector<std::vector<TagFile>> thread_tags(thread_count);
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count);
+        for(std::size_t t = 0; t < thread_count; t++) {
+            threads.emplace_back(iterate_directories, &queue, &thread_tags[t]);
+        }
+        for(auto &t : threads) {
+            t.join();
         }
         
-        // Remove duplicates
+        std::vector<TagFile> all_tags = std::move(indexed_tags);
+        std::size_t total_tags = all_tags.size();
+        for(auto &t : thread_tags) {
+            total_tags += t.size();
+        }
+        all_tags.reserve(total_tags);
+        for(auto &t : thread_tags) {
+            all_tags.insert(all_tags.end(), std::make_move_iterator(t.begin()), std::make_move_iterator(t.end()));
+        }
+        
+        // Sort so the order doesn't depend on which thread found what, with higher priority directories first
+        std::sort(all_tags.begin(), all_tags.end(), [](const TagFile &a, const TagFile &b) {
+            if(a.tag_directory != b.tag_directory) {
+                return a.tag_directory < b.tag_directory;
+            }
+            return a.tag_path < b.tag_path;
+        });
+        
+        // Remove duplicates (the tag path includes the extension, so the class doesn't need to be checked, and since we
+        // sorted by priority, the first one we find is the one we keep)
         if(filter_duplicates) {
-            for(std::size_t i = 0; i < all_tags.size(); i++) {
-                for(std::size_t j = 0; j < i; j++) {
-                    auto &tagi = all_tags[i];
-                    auto &tagj = all_tags[j];
-                    
-                    if(tagi.tag_fourcc == tagj.tag_fourcc && tagi.tag_path == tagj.tag_path) {
-                        if(tagi.tag_directory > tagj.tag_directory) {
-                            all_tags.erase(all_tags.begin() + i);
-                        }
-                        else {
-                            all_tags.erase(all_tags.begin() + j);
-                        }
-                        
-                        i--;
-                        break;
+            std::unordered_set<std::string_view> tags_kept;
+            tags_kept.reserve(all_tags.size());
+            
+            // Find what to keep before moving anything since the set points to the paths
+            std::vector<bool> keep;
+            keep.reserve(all_tags.size());
+            for(auto &t : all_tags) {
+                keep.push_back(tags_kept.emplace(t.tag_path).second);
+            }
+            tags_kept.clear();
+            
+            std::size_t kept_count = 0;
+            for(std::size_t t = 0; t < all_tags.size(); t++) {
+                if(keep[t]) {
+                    if(kept_count != t) {
+                        all_tags[kept_count] = std::move(all_tags[t]);
                     }
+                    kept_count++;
                 }
             }
+            all_tags.resize(kept_count);
         }
         
         // Change error count if errors was specified
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef INVADER__FILE__LIST_DIRECTORY_HPP
+#define INVADER__FILE__LIST_DIRECTORY_HPP
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace Invader::File {
+    /**
+     * Entry in a directory; anything that isn't a regular file or a directory (after following symlinks) is skipped
+     */
+    struct DirectoryEntry {
+        /** File name */
+        std::string name;
+
+        /** Whether or not this is a directory */
+        bool directory;
+    };
+
+    /**
+     * List the files and directories in a directory, not including "." and ".."
+     * @param dir     directory to list
+     * @param entries vector to append the entries to
+     * @throws        std::exception if the directory can't be read
+     */
+    void list_directory(const std::filesystem::path &dir, std::vector<DirectoryEntry> &entries);
+}
+
+#endif
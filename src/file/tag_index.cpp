@@ -0,0 +1,483 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include <invader/file/tag_index.hpp>
+#include <invader/printf.hpp>
+#include <invader/tag/parser/parser_struct.hpp>
+#include "list_directory.hpp"
+#include "../util/fnv1a.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace Invader::File {
+    static constexpr const char INDEX_MAGIC[8] = { 'I', 'N', 'V', 'T', 'A', 'G', 'I', 'X' };
+    static constexpr std::uint32_t INDEX_VERSION = 1;
+
+    // Anything modified this close to when the index was saved (in nanoseconds) is checked again since filesystem
+    // timestamps are not always precise enough to tell if it was modified again afterwards
+    static constexpr std::int64_t INDEX_RACY_WINDOW = 2000000000;
+
+    static bool get_modified_and_size(const std::filesystem::path &path, std::int64_t &modified, std::uint64_t &size) {
+        #ifdef _WIN32
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(path, ec);
+        if(ec) {
+            return false;
+        }
+        size = std::filesystem::is_directory(path, ec) ? 0 : std::filesystem::file_size(path, ec);
+        if(ec) {
+            return false;
+        }
+        modified = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+        #else
+        struct stat s;
+        if(stat(path.string().c_str(), &s) != 0) {
+            return false;
+        }
+        size = static_cast<std::uint64_t>(s.st_size);
+        #ifdef __APPLE__
+        modified = static_cast<std::int64_t>(s.st_mtimespec.tv_sec) * 1000000000 + s.st_mtimespec.tv_nsec;
+        #else
+        modified = static_cast<std::int64_t>(s.st_mtim.tv_sec) * 1000000000 + s.st_mtim.tv_nsec;
+        #endif
+        #endif
+        return true;
+    }
+
+    static HEK::TagFourCC tag_fourcc_of_file_name(const std::string &name) noexcept {
+        // No extension or a hidden file with no extension is not a tag
+        auto extension = name.rfind('.');
+        if(extension == std::string::npos || extension == 0) {
+            return HEK::TagFourCC::TAG_FOURCC_NULL;
+        }
+        auto tag_fourcc = HEK::tag_extension_to_fourcc(name.c_str() + extension + 1);
+        return tag_fourcc == HEK::TagFourCC::TAG_FOURCC_NONE ? HEK::TagFourCC::TAG_FOURCC_NULL : tag_fourcc;
+    }
+
+    // Tag classes with no tag references, so tags of these classes don't need to be read
+    static bool can_reference_tags(HEK::TagFourCC fourcc) noexcept {
+        return !(
+            fourcc == HEK::TagFourCC::TAG_FOURCC_NULL ||
+            fourcc == HEK::TagFourCC::TAG_FOURCC_BITMAP ||
+            fourcc == HEK::TagFourCC::TAG_FOURCC_CAMERA_TRACK ||
+            fourcc == HEK::TagFourCC::TAG_FOURCC_HUD_MESSAGE_TEXT ||
+            fourcc == HEK::TagFourCC::TAG_FOURCC_PHYSICS ||
+            fourcc == HEK::TagFourCC::TAG_FOURCC_SOUND_ENVIRONMENT ||
+            fourcc == HEK::TagFourCC::TAG_FOURCC_UNICODE_STRING_LIST ||
+            fourcc == HEK::TagFourCC::TAG_FOURCC_WIND
+        );
+    }
+
+    // Everything in the index is little endian
+    class IndexWriter {
+    public:
+        std::vector<std::byte> data;
+
+        template <typename T> void write_integer(T value) {
+            auto v = static_cast<std::uint64_t>(value);
+            for(std::size_t i = 0; i < sizeof(T); i++) {
+                this->data.emplace_back(static_cast<std::byte>(v >> (i * 8)));
+            }
+        }
+
+        void write_string(const std::string &string) {
+            this->write_integer(static_cast<std::uint32_t>(string.size()));
+            auto *bytes = reinterpret_cast<const std::byte *>(string.data());
+            this->data.insert(this->data.end(), bytes, bytes + string.size());
+        }
+    };
+
+    class IndexReader {
+    public:
+        const std::byte *data;
+        std::size_t size;
+        std::size_t offset = 0;
+
+        template <typename T> T read_integer() {
+            this->check(sizeof(T));
+            std::uint64_t v = 0;
+            for(std::size_t i = 0; i < sizeof(T); i++) {
+                v |= static_cast<std::uint64_t>(this->data[this->offset++]) << (i * 8);
+            }
+            return static_cast<T>(v);
+        }
+
+        std::string read_string() {
+            auto length = this->read_integer<std::uint32_t>();
+            this->check(length);
+            std::string string(reinterpret_cast<const char *>(this->data + this->offset), length);
+            this->offset += length;
+            return string;
+        }
+
+        void check(std::size_t length) const {
+            if(length > this->size - this->offset) {
+                throw std::out_of_range("index is truncated");
+            }
+        }
+    };
+
+    bool TagIndex::exists(const std::filesystem::path &tags_directory) {
+        std::error_code ec;
+        return std::filesystem::is_regular_file(tags_directory / FILE_NAME, ec);
+    }
+
+    std::vector<TagFilePath> TagIndex::read_dependencies(const std::byte *tag_data, std::size_t tag_data_size) {
+        std::vector<Parser::DependencyView> found;
+        Parser::ParserStruct::scan_hek_tag_file_dependencies(tag_data, tag_data_size, found);
+
+        std::vector<TagFilePath> dependencies;
+        dependencies.reserve(found.size());
+        for(auto &d : found) {
+            dependencies.emplace_back(File::remove_duplicate_slashes(std::string(d.path)), d.tag_fourcc);
+        }
+        return dependencies;
+    }
+
+    bool TagIndex::is_unchanged(std::int64_t old_modified, std::int64_t new_modified) const noexcept {
+        return old_modified == new_modified && new_modified < this->index_modified - INDEX_RACY_WINDOW;
+    }
+
+    const TagIndex::IndexedTag *TagIndex::find_tag(const std::string &tag_path) const noexcept {
+        auto tag = this->tag_lookup.find(tag_path);
+        return tag == this->tag_lookup.end() ? nullptr : &this->tags[tag->second];
+    }
+
+    const TagIndex::IndexedTag *TagIndex::find_unchanged_tag(const std::string &tag_path) const {
+        auto *tag = this->find_tag(tag_path);
+        if(!tag || !tag->dependencies_read) {
+            return nullptr;
+        }
+
+        std::int64_t modified;
+        std::uint64_t size;
+        if(!get_modified_and_size(this->tags_directory / tag_path, modified, size) || tag->size != size || !this->is_unchanged(tag->modified, modified)) {
+            return nullptr;
+        }
+        return tag;
+    }
+
+    const std::vector<std::size_t> *TagIndex::find_referencing_tags(const TagFilePath &tag) {
+        if(!this->referencing_tags_built) {
+            this->referencing_tags.clear();
+            for(std::size_t t = 0; t < this->tags.size(); t++) {
+                auto &indexed_tag = this->tags[t];
+                if(!indexed_tag.dependencies_read) {
+                    continue;
+                }
+                for(auto &d : indexed_tag.dependencies) {
+                    auto &referencing = this->referencing_tags[d];
+
+                    // A tag can reference the same tag more than once
+                    if(referencing.empty() || referencing.back() != t) {
+                        referencing.emplace_back(t);
+                    }
+                }
+            }
+            this->referencing_tags_built = true;
+        }
+
+        auto referencing = this->referencing_tags.find(tag);
+        return referencing == this->referencing_tags.end() ? nullptr : &referencing->second;
+    }
+
+    void TagIndex::refresh(bool read_dependencies) {
+        std::unordered_map<std::string, IndexedDirectory> new_directories;
+        std::vector<IndexedTag> new_tags;
+        std::vector<DirectoryEntry> entries;
+        bool changed = false;
+
+        // Find all tags, only listing directories that were modified
+        auto iterate_directories = [this, &new_directories, &new_tags, &entries, &changed](const std::string &relative_path, auto &iterate_directories, int depth) -> void {
+            if(++depth == 256) {
+                return;
+            }
+
+            auto path = relative_path.empty() ? this->tags_directory : this->tags_directory / relative_path;
+            std::int64_t modified;
+            std::uint64_t size;
+            if(!get_modified_and_size(path, modified, size)) {
+                throw std::runtime_error("failed to query " + path.string());
+            }
+
+            IndexedDirectory directory;
+            auto old_directory = this->directories.find(relative_path);
+            if(old_directory != this->directories.end() && this->is_unchanged(old_directory->second.modified, modified)) {
+                directory = std::move(old_directory->second);
+            }
+            else {
+                entries.clear();
+                list_directory(path, entries);
+                for(auto &e : entries) {
+                    if(e.directory) {
+                        directory.directories.emplace_back(std::move(e.name));
+                    }
+                    else if(tag_fourcc_of_file_name(e.name) != HEK::TagFourCC::TAG_FOURCC_NULL) {
+                        directory.files.emplace_back(std::move(e.name));
+                    }
+                }
+                directory.modified = modified;
+                changed = true;
+            }
+
+            for(auto &f : directory.files) {
+                auto &tag = new_tags.emplace_back();
+                tag.tag_path = relative_path + f;
+                tag.tag_fourcc = tag_fourcc_of_file_name(f);
+            }
+
+            for(auto &d : directory.directories) {
+                try {
+                    iterate_directories(relative_path + d + static_cast<char>(INVADER_PREFERRED_PATH_SEPARATOR), iterate_directories, depth);
+                }
+                catch(std::exception &e) {
+                    eprintf_warn("Failed to index %s: %s", (path / d).string().c_str(), e.what());
+                }
+            }
+
+            new_directories[relative_path] = std::move(directory);
+        };
+        iterate_directories(std::string(), iterate_directories, 0);
+        changed = changed || new_directories.size() != this->directories.size() || new_tags.size() != this->tags.size();
+
+        // If we're only listing tags, keep what we had for the ones we already had; they'll be checked when they're read
+        if(!read_dependencies) {
+            for(auto &tag : new_tags) {
+                auto *old_tag = this->find_tag(tag.tag_path);
+                if(old_tag) {
+                    tag = *old_tag;
+                }
+                else {
+                    changed = true;
+                }
+            }
+        }
+
+        // Otherwise, check each tag, reading the ones that are new or modified
+        else {
+            std::mutex tag_mutex;
+            std::size_t next_tag = 0;
+
+            auto check_tags = [](TagIndex *index, std::vector<IndexedTag> *new_tags, std::mutex *tag_mutex, std::size_t *next_tag) {
+                while(true) {
+                    tag_mutex->lock();
+                    auto t = (*next_tag)++;
+                    tag_mutex->unlock();
+                    if(t >= new_tags->size()) {
+                        return;
+                    }
+
+                    auto &tag = (*new_tags)[t];
+                    auto full_path = index->tags_directory / tag.tag_path;
+                    std::int64_t modified = 0;
+                    std::uint64_t size = 0;
+                    bool exists = get_modified_and_size(full_path, modified, size);
+
+                    // Keep what we had before if it's unchanged. If it changed, keep the hash and dependencies anyway since
+                    // they can be reused if the contents turn out to be the same.
+                    auto *old_tag = index->find_tag(tag.tag_path);
+                    bool unchanged = false;
+                    if(old_tag) {
+                        unchanged = exists && old_tag->size == size && index->is_unchanged(old_tag->modified, modified);
+                        auto tag_path = std::move(tag.tag_path);
+                        tag = *old_tag;
+                        tag.tag_path = std::move(tag_path);
+                        tag.dependencies_read = tag.dependencies_read && unchanged;
+                    }
+                    tag.size = size;
+                    tag.modified = modified;
+
+                    if(tag.dependencies_read) {
+                        continue;
+                    }
+
+                    tag.dependencies_read = true;
+                    if(exists && !can_reference_tags(tag.tag_fourcc)) {
+                        tag.hash = 0;
+                        tag.invalid = false;
+                        tag.dependencies.clear();
+                        continue;
+                    }
+
+                    auto data = exists ? File::open_file(full_path) : std::nullopt;
+                    if(!data.has_value()) {
+                        tag.hash = 0;
+                        tag.invalid = true;
+                        tag.dependencies.clear();
+                        continue;
+                    }
+
+                    auto hash = fnv1a(data->data(), data->size());
+                    if(old_tag && old_tag->hash == hash) {
+                        continue;
+                    }
+
+                    tag.hash = hash;
+                    try {
+                        tag.dependencies = TagIndex::read_dependencies(data->data(), data->size());
+                        tag.invalid = false;
+                    }
+                    catch(std::exception &) {
+                        tag.dependencies.clear();
+                        tag.invalid = true;
+                    }
+                }
+            };
+
+            std::size_t thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+            std::vector<std::thread> threads;
+            threads.reserve(thread_count);
+            for(std::size_t t = 0; t < thread_count; t++) {
+                threads.emplace_back(check_tags, this, &new_tags, &tag_mutex, &next_tag);
+            }
+            for(auto &t : threads) {
+                t.join();
+            }
+
+            for(std::size_t t = 0; t < new_tags.size() && !changed; t++) {
+                auto &tag = new_tags[t];
+                auto *old_tag = this->find_tag(tag.tag_path);
+                changed = !old_tag || old_tag->size != tag.size || old_tag->modified != tag.modified || old_tag->hash != tag.hash || old_tag->dependencies_read != tag.dependencies_read || old_tag->invalid != tag.invalid || old_tag->dependencies != tag.dependencies;
+            }
+        }
+
+        this->changed = this->changed || changed;
+        this->directories = std::move(new_directories);
+        this->tags = std::move(new_tags);
+        this->referencing_tags_built = false;
+        this->tag_lookup.clear();
+        this->tag_lookup.reserve(this->tags.size());
+        for(std::size_t t = 0; t < this->tags.size(); t++) {
+            this->tag_lookup.emplace(this->tags[t].tag_path, t);
+        }
+    }
+
+    void TagIndex::save() {
+        if(!this->changed && TagIndex::exists(this->tags_directory)) {
+            return;
+        }
+
+        IndexWriter writer;
+        writer.data.insert(writer.data.end(), reinterpret_cast<const std::byte *>(INDEX_MAGIC), reinterpret_cast<const std::byte *>(INDEX_MAGIC) + sizeof(INDEX_MAGIC));
+        writer.write_integer(INDEX_VERSION);
+
+        writer.write_integer(static_cast<std::uint32_t>(this->directories.size()));
+        for(auto &d : this->directories) {
+            writer.write_string(d.first);
+            writer.write_integer(d.second.modified);
+            writer.write_integer(static_cast<std::uint32_t>(d.second.directories.size()));
+            for(auto &s : d.second.directories) {
+                writer.write_string(s);
+            }
+            writer.write_integer(static_cast<std::uint32_t>(d.second.files.size()));
+            for(auto &f : d.second.files) {
+                writer.write_string(f);
+            }
+        }
+
+        writer.write_integer(static_cast<std::uint32_t>(this->tags.size()));
+        for(auto &t : this->tags) {
+            writer.write_string(t.tag_path);
+            writer.write_integer(static_cast<std::uint32_t>(t.tag_fourcc));
+            writer.write_integer(t.size);
+            writer.write_integer(t.modified);
+            writer.write_integer(t.hash);
+            writer.write_integer(static_cast<std::uint8_t>((t.dependencies_read ? 1 : 0) | (t.invalid ? 2 : 0)));
+            writer.write_integer(static_cast<std::uint32_t>(t.dependencies.size()));
+            for(auto &d : t.dependencies) {
+                writer.write_string(d.path);
+                writer.write_integer(static_cast<std::uint32_t>(d.fourcc));
+            }
+        }
+
+        auto index_path = this->tags_directory / FILE_NAME;
+        if(!File::save_file_atomically(index_path, writer.data)) {
+            throw std::runtime_error("failed to write " + index_path.string());
+        }
+
+        std::uint64_t size;
+        if(!get_modified_and_size(index_path, this->index_modified, size)) {
+            this->index_modified = 0;
+        }
+        this->changed = false;
+    }
+
+    void TagIndex::load() {
+        auto index_path = this->tags_directory / FILE_NAME;
+        if(!TagIndex::exists(this->tags_directory)) {
+            return;
+        }
+
+        std::uint64_t size;
+        auto data = File::open_file(index_path);
+        if(!data.has_value() || !get_modified_and_size(index_path, this->index_modified, size)) {
+            return;
+        }
+
+        try {
+            IndexReader reader = { data->data(), data->size() };
+            reader.check(sizeof(INDEX_MAGIC));
+            if(std::memcmp(data->data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+                throw std::runtime_error("not an index");
+            }
+            reader.offset += sizeof(INDEX_MAGIC);
+            if(reader.read_integer<std::uint32_t>() != INDEX_VERSION) {
+                throw std::runtime_error("unsupported index version");
+            }
+
+            auto directory_count = reader.read_integer<std::uint32_t>();
+            for(std::uint32_t d = 0; d < directory_count; d++) {
+                auto path = reader.read_string();
+                auto &directory = this->directories[path];
+                directory.modified = reader.read_integer<std::int64_t>();
+                auto subdirectory_count = reader.read_integer<std::uint32_t>();
+                for(std::uint32_t s = 0; s < subdirectory_count; s++) {
+                    directory.directories.emplace_back(reader.read_string());
+                }
+                auto file_count = reader.read_integer<std::uint32_t>();
+                for(std::uint32_t f = 0; f < file_count; f++) {
+                    directory.files.emplace_back(reader.read_string());
+                }
+            }
+
+            auto tag_count = reader.read_integer<std::uint32_t>();
+            for(std::uint32_t t = 0; t < tag_count; t++) {
+                auto &tag = this->tags.emplace_back();
+                tag.tag_path = reader.read_string();
+                tag.tag_fourcc = static_cast<HEK::TagFourCC>(reader.read_integer<std::uint32_t>());
+                tag.size = reader.read_integer<std::uint64_t>();
+                tag.modified = reader.read_integer<std::int64_t>();
+                tag.hash = reader.read_integer<std::uint64_t>();
+                auto flags = reader.read_integer<std::uint8_t>();
+                tag.dependencies_read = flags & 1;
+                tag.invalid = flags & 2;
+                auto dependency_count = reader.read_integer<std::uint32_t>();
+                for(std::uint32_t d = 0; d < dependency_count; d++) {
+                    auto path = reader.read_string();
+                    tag.dependencies.emplace_back(path, static_cast<HEK::TagFourCC>(reader.read_integer<std::uint32_t>()));
+                }
+                this->tag_lookup.emplace(tag.tag_path, t);
+            }
+        }
+        catch(std::exception &) {
+            // Start over if it's no good
+            this->directories.clear();
+            this->tags.clear();
+            this->tag_lookup.clear();
+            this->referencing_tags_built = false;
+            this->index_modified = 0;
+        }
+    }
+
+    TagIndex::TagIndex(const std::filesystem::path &tags_directory) : tags_directory(tags_directory) {
+        this->load();
+    }
+}
@@ -16,6 +16,7 @@ set(INVADER_PARSER_FILES
     "${CMAKE_CURRENT_BINARY_DIR}/parser-normalize.cpp"
     "${CMAKE_CURRENT_BINARY_DIR}/parser-read-hek-file.cpp"
     "${CMAKE_CURRENT_BINARY_DIR}/parser-scan-padding.cpp"
+    "${CMAKE_CURRENT_BINARY_DIR}/parser-scan-dependencies.cpp"
     "${CMAKE_CURRENT_BINARY_DIR}/bitfield.cpp"
     "${CMAKE_CURRENT_BINARY_DIR}/enum.cpp"
 )
@@ -42,6 +43,7 @@ set(INVADER_SOURCE_FILES
     "${CMAKE_CURRENT_BINARY_DIR}/parser-normalize.cpp"
     "${CMAKE_CURRENT_BINARY_DIR}/parser-read-hek-file.cpp"
     "${CMAKE_CURRENT_BINARY_DIR}/parser-scan-padding.cpp"
+    "${CMAKE_CURRENT_BINARY_DIR}/parser-scan-dependencies.cpp"
     "${CMAKE_CURRENT_BINARY_DIR}/bitfield.cpp"
     "${CMAKE_CURRENT_BINARY_DIR}/enum.cpp"
 
@@ -55,6 +57,7 @@ set(INVADER_SOURCE_FILES
     src/sound/sound_reader_ogg.cpp
     src/sound/sound_reader_wav.cpp
     src/sound/sound_reader_xbox_adpcm.cpp
+    src/sound/sound_resampler.cpp
     src/sound/adpcm_xq/adpcm-lib.c
 
     src/error.cpp
@@ -66,6 +69,7 @@ set(INVADER_SOURCE_FILES
     src/map/map.cpp
     src/map/tag.cpp
     src/file/file.cpp
+    src/file/tag_index.cpp
     src/build/build_workload.cpp
     src/build/build_workload_dedupe.cpp
     src/bitmap/swizzle.cpp
@@ -75,6 +79,7 @@ set(INVADER_SOURCE_FILES
     src/bitmap/sprite.cpp
     src/error_handler/error_handler.cpp
     src/model/jms.cpp
+    src/model/triangle_strip.cpp
     src/compress/compression.cpp
     src/tag/hek/header.cpp
     src/tag/hek/class/bitmap.cpp
@@ -2,84 +2,45 @@
 
 #include <invader/file/file.hpp>
 #include <invader/build/build_workload.hpp>
-#include <invader/map/map.hpp>
+#include <invader/tag/hek/header.hpp>
+#include <invader/tag/hek/class/model_collision_geometry.hpp>
+#include <invader/tag/parser/compile/scenario_structure_bsp.hpp>
+#include <invader/bitmap/bitmap_encode.hpp>
+#include <invader/bitmap/pixel.hpp>
 
 #include <cstdio>
 #include <cstdlib>
 #include <map>
+#include <unordered_map>
 
 using namespace Invader;
 
-static constexpr const std::size_t MESH_FORMAT_VERSION = 1;
+using namespace Invader::Lightmap;
 
-struct ExportedVertex {
-    float x, y, z;
-    float i, j, k;
-};
-
-struct ExportedTriangle {
-    std::size_t material;
-    std::size_t a, b, c;
-};
-
-const char *ExportedMaterialTypeStr[] = {
-    "opaque",
-    "invisible"
-};
-
-enum ExportedMaterialType {
-    EXPORTED_MATERIAL_TYPE_OPAQUE,
-    EXPORTED_MATERIAL_TYPE_INVISIBLE
-};
-
-struct ExportedMaterial {
-    std::string path;
-    ExportedMaterialType type;
-    float power;
-    float emission_red, emission_green, emission_blue;
-};
-
-struct ExportedLightmap {
-    std::size_t first_triangle_index;
-    std::size_t triangle_count;
-};
-
-struct ExportedModel {
-    std::string path;
-    std::vector<ExportedMaterial> materials;
-    std::vector<ExportedTriangle> triangles;
-    std::vector<ExportedVertex> vertices;
-    std::vector<ExportedLightmap> lightmaps;
-};
-
-struct ExportedSkyLight {
-    float power;
-    float red, green, blue;
-    float yaw, pitch;
-};
-
-struct ExportedSky {
-    std::string path;
-    std::vector<ExportedSkyLight> lights;
-    float outdoor_power;
-    float outdoor_red, outdoor_green, outdoor_blue;
-    float indoor_power;
-    float indoor_red, indoor_green, indoor_blue;
-};
+// Open a tag, exiting if it can't be found or read
+static std::vector<std::byte> open_tag(const std::string &path, HEK::TagFourCC fourcc, const std::vector<std::filesystem::path> &tags_directories) {
+    try {
+        return BuildWorkload::open_tag_file(File::TagFilePath(path, fourcc), tags_directories);
+    }
+    catch(std::exception &) {
+        std::exit(EXIT_FAILURE);
+    }
+}
 
-struct ExportedObject {
-    std::size_t model;
-    float x;
-    float y;
-    float z;
-    float yaw;
-    float pitch;
-    float roll;
-};
+template<typename T> static auto parse_tag(const std::string &path, HEK::TagFourCC fourcc, const std::vector<std::filesystem::path> &tags_directories) {
+    auto tag_data = open_tag(path, fourcc, tags_directories);
+    try {
+        return T::parse_hek_tag_file(tag_data.data(), tag_data.size());
+    }
+    catch(std::exception &e) {
+        eprintf_error("Failed to parse %s.%s: %s", File::halo_path_to_preferred_path(path).c_str(), HEK::tag_fourcc_to_extension(fourcc), e.what());
+        std::exit(EXIT_FAILURE);
+    }
+}
 
-static std::size_t add_shader_to_materials(const Tag &tag, std::vector<ExportedMaterial> &materials) {
-    auto fourcc = tag.get_tag_fourcc();
-    auto full_path = tag.get_path() + "." + HEK::tag_fourcc_to_extension(fourcc);
+static std::size_t add_shader_to_materials(const Parser::Dependency &shader_reference, std::vector<ExportedMaterial> &materials, const std::vector<std::filesystem::path> &tags_directories) {
+    auto fourcc = shader_reference.tag_fourcc;
+    auto full_path = shader_reference.path + "." + HEK::tag_fourcc_to_extension(fourcc);
     auto mat_count = materials.size();
     for(std::size_t m = 0; m < mat_count; m++) {
         if(materials[m].path == full_path) {
@@ -87,8 +48,26 @@ static std::size_t add_shader_to_materials(const Tag &tag, std::vector<ExportedM
         }
     }
     
-    // Get the shader of fun
-    auto &shader = tag.get_base_struct<HEK::Shader>();
+    if(shader_reference.path.empty()) {
+        eprintf_error("A shader reference is null");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    // Get the shader of fun; every shader class starts with the same fields, so we only need to read those
+    auto shader_data = open_tag(shader_reference.path, fourcc, tags_directories);
+    const HEK::Shader<HEK::BigEndian> *shader_ptr;
+    try {
+        HEK::TagFileHeader::validate_header(reinterpret_cast<const HEK::TagFileHeader *>(shader_data.data()), shader_data.size(), fourcc);
+        if(shader_data.size() < sizeof(HEK::TagFileHeader) + sizeof(*shader_ptr)) {
+            throw OutOfBoundsException();
+        }
+        shader_ptr = reinterpret_cast<const HEK::Shader<HEK::BigEndian> *>(shader_data.data() + sizeof(HEK::TagFileHeader));
+    }
+    catch(std::exception &e) {
+        eprintf_error("Failed to parse %s: %s", File::halo_path_to_preferred_path(full_path).c_str(), e.what());
+        std::exit(EXIT_FAILURE);
+    }
+    HEK::Shader<HEK::NativeEndian> shader = *shader_ptr;
     bool opaque = fourcc == HEK::TagFourCC::TAG_FOURCC_SHADER_MODEL || fourcc == HEK::TagFourCC::TAG_FOURCC_SHADER_ENVIRONMENT;
     
     // Add the material
@@ -107,33 +86,45 @@ static std::size_t add_shader_to_materials(const Tag &tag, std::vector<ExportedM
     return mat_count;
 }
 
-static ExportedModel read_bsp(const Tag &tag, std::vector<ExportedMaterial> &materials_arr, std::vector<ExportedSky> &skies_arr) {
+// Decompress the vertices of any material that only has compressed vertices, since only uncompressed vertices are read
+static void decompress_bsp_vertices(Parser::ScenarioStructureBSP &bsp) {
+    for(auto &lightmap : bsp.lightmaps) {
+        for(auto &material : lightmap.materials) {
+            if(material.uncompressed_vertices.empty() && !material.compressed_vertices.empty() && !Parser::regenerate_missing_bsp_vertices(material, true)) {
+                eprintf_error("Failed to decompress BSP vertices");
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+static ExportedModel read_bsp(const Parser::ScenarioStructureBSP &bsp, const std::string &path, const Parser::Scenario &scenario, std::vector<ExportedMaterial> &materials_arr, std::vector<ExportedSky> &skies_arr, const std::vector<std::filesystem::path> &tags_directories) {
     ExportedModel exported_model;
-    exported_model.path = tag.get_path() + "." + HEK::tag_fourcc_to_extension(tag.get_tag_fourcc());
-    
-    auto &base_struct = tag.get_base_struct<HEK::ScenarioStructureBSP>();
-    
-    std::size_t triangle_count = base_struct.surfaces.count;
-    const Parser::ScenarioStructureBSPSurface::struct_little *triangles = reinterpret_cast<const Parser::ScenarioStructureBSPSurface::struct_little *>(tag.data(base_struct.surfaces.pointer, sizeof(*triangles) * triangle_count));
+    exported_model.path = path;
     
-    std::size_t lightmaps_count = base_struct.lightmaps.count;
-    const Parser::ScenarioStructureBSPLightmap::struct_little *lightmaps = reinterpret_cast<const Parser::ScenarioStructureBSPLightmap::struct_little *>(tag.data(base_struct.lightmaps.pointer, sizeof(*lightmaps) * lightmaps_count));
+    auto &triangles = bsp.surfaces;
+    std::size_t triangle_count = triangles.size();
     
-    auto &map = tag.get_map();
-    
-    for(std::size_t l = 0; l < lightmaps_count; l++) {
-        auto &lightmap = lightmaps[l];
-        std::size_t materials_count = lightmap.materials.count;
-        const Parser::ScenarioStructureBSPMaterial::struct_little *materials = reinterpret_cast<const Parser::ScenarioStructureBSPMaterial::struct_little *>(tag.data(lightmap.materials.pointer, sizeof(*materials) * materials_count));
+    for(auto &lightmap : bsp.lightmaps) {
         auto first_triangle_index_this_lightmap = exported_model.triangles.size();
         
         // Go through each lightmap
-        for(std::size_t m = 0; m < materials_count; m++) {
-            auto &material = materials[m];
+        for(auto &material : lightmap.materials) {
             std::size_t rendered_vertices_count = material.rendered_vertices_count;
-            const Parser::ScenarioStructureBSPMaterialUncompressedRenderedVertex::struct_little *uncompressed_vertices = reinterpret_cast<const Parser::ScenarioStructureBSPMaterialUncompressedRenderedVertex::struct_little *>(tag.data(material.uncompressed_vertices.pointer, sizeof(*uncompressed_vertices) * rendered_vertices_count));
+            const Parser::ScenarioStructureBSPMaterialUncompressedRenderedVertex::struct_little *uncompressed_vertices = reinterpret_cast<decltype(uncompressed_vertices)>(material.uncompressed_vertices.data());
+            if(material.uncompressed_vertices.size() < sizeof(*uncompressed_vertices) * rendered_vertices_count) {
+                eprintf_error("BSP uncompressed vertices size is wrong");
+                std::exit(EXIT_FAILURE);
+            }
             
-            std::size_t material_index = add_shader_to_materials(map.get_tag(material.shader.tag_id.read().index), materials_arr);
+            std::size_t initial_surface = material.surfaces;
+            std::size_t surface_count = material.surface_count;
+            if(initial_surface > triangle_count || triangle_count - initial_surface < surface_count) {
+                eprintf_error("BSP surfaces are out of bounds");
+                std::exit(EXIT_FAILURE);
+            }
+            
+            std::size_t material_index = add_shader_to_materials(material.shader, materials_arr, tags_directories);
             std::size_t offset = exported_model.vertices.size();
             for(std::size_t v = 0; v < rendered_vertices_count; v++) {
                 auto &vertex = exported_model.vertices.emplace_back();
@@ -146,9 +137,6 @@ static ExportedModel read_bsp(const Tag &tag, std::vector<ExportedMaterial> &mat
                 vertex.k = uv.normal.k;
             }
             
-            std::size_t initial_surface = material.surfaces;
-            std::size_t surface_count = material.surface_count;
-            
             for(std::size_t t = 0; t < surface_count; t++) {
                 auto &triangle = exported_model.triangles.emplace_back();
                 auto &surface = triangles[t + initial_surface];
@@ -168,46 +156,43 @@ static ExportedModel read_bsp(const Tag &tag, std::vector<ExportedMaterial> &mat
         }
     }
     
-    // Clusters
-    std::size_t cluster_count = base_struct.clusters.count;
-    const Parser::ScenarioStructureBSPCluster::struct_little *clusters = reinterpret_cast<const Parser::ScenarioStructureBSPCluster::struct_little *>(tag.data(base_struct.clusters.pointer, sizeof(*clusters) * cluster_count));
-    auto &scenario_tag = map.get_tag(map.get_scenario_tag_id());
-    auto &scenario_tag_struct = scenario_tag.get_base_struct<HEK::Scenario>();
-    
     std::map<std::size_t, bool> sky_tag_added;
     
     // Go through each cluster. Add all skyboxes
-    for(std::size_t c = 0; c < cluster_count; c++) {
-        std::size_t sky = clusters[c].sky.read();
+    for(auto &cluster : bsp.clusters) {
+        std::size_t sky = cluster.sky;
         if(sky == NULL_INDEX || sky_tag_added[sky]) {
             continue;
         }
+        if(sky >= scenario.skies.size()) {
+            eprintf_error("BSP cluster has an out-of-bounds sky index");
+            std::exit(EXIT_FAILURE);
+        }
         
         sky_tag_added[sky] = true;
-        auto &sky_in_array = skies_arr.emplace_back();
+        auto &sky_reference = scenario.skies[sky].sky;
+        if(sky_reference.path.empty()) {
+            continue;
+        }
         
         // Add the sky
-        auto &sky_entry = scenario_tag.get_struct_from_reflexive(scenario_tag_struct.skies, sky);
-        auto &sky_tag = map.get_tag(sky_entry.sky.tag_id.read().index);
-        auto &sky_tag_struct = sky_tag.get_base_struct<HEK::Sky>();
-        sky_in_array.path = sky_tag.get_path() + "." + HEK::tag_fourcc_to_extension(sky_tag.get_tag_fourcc());
+        auto sky_tag = parse_tag<Parser::Sky>(sky_reference.path, sky_reference.tag_fourcc, tags_directories);
+        auto &sky_in_array = skies_arr.emplace_back();
+        sky_in_array.path = sky_reference.path + "." + HEK::tag_fourcc_to_extension(sky_reference.tag_fourcc);
         
-        sky_in_array.outdoor_power = sky_tag_struct.outdoor_ambient_radiosity_power;
-        sky_in_array.outdoor_red = sky_tag_struct.outdoor_ambient_radiosity_color.red;
-        sky_in_array.outdoor_green = sky_tag_struct.outdoor_ambient_radiosity_color.green;
-        sky_in_array.outdoor_blue = sky_tag_struct.outdoor_ambient_radiosity_color.blue;
+        sky_in_array.outdoor_power = sky_tag.outdoor_ambient_radiosity_power;
+        sky_in_array.outdoor_red = sky_tag.outdoor_ambient_radiosity_color.red;
+        sky_in_array.outdoor_green = sky_tag.outdoor_ambient_radiosity_color.green;
+        sky_in_array.outdoor_blue = sky_tag.outdoor_ambient_radiosity_color.blue;
         
-        sky_in_array.indoor_power = sky_tag_struct.indoor_ambient_radiosity_power;
-        sky_in_array.indoor_red = sky_tag_struct.indoor_ambient_radiosity_color.red;
-        sky_in_array.indoor_green = sky_tag_struct.indoor_ambient_radiosity_color.green;
-        sky_in_array.indoor_blue = sky_tag_struct.indoor_ambient_radiosity_color.blue;
+        sky_in_array.indoor_power = sky_tag.indoor_ambient_radiosity_power;
+        sky_in_array.indoor_red = sky_tag.indoor_ambient_radiosity_color.red;
+        sky_in_array.indoor_green = sky_tag.indoor_ambient_radiosity_color.green;
+        sky_in_array.indoor_blue = sky_tag.indoor_ambient_radiosity_color.blue;
         
         // Add these lights
-        std::size_t light_count = sky_tag_struct.lights.count;
-        auto *lights = sky_tag.resolve_reflexive(sky_tag_struct.lights);
-        for(std::size_t l = 0; l < light_count; l++) {
+        for(auto &light_being_added : sky_tag.lights) {
             auto &light_to_add = sky_in_array.lights.emplace_back();
-            auto &light_being_added = lights[l];
             light_to_add.power = light_being_added.power;
             light_to_add.red = light_being_added.color.red;
             light_to_add.green = light_being_added.color.green;
@@ -220,46 +205,28 @@ static ExportedModel read_bsp(const Tag &tag, std::vector<ExportedMaterial> &mat
     return exported_model;
 }
 
-template<typename GeometryStruct, typename PartStruct, typename ModelStruct> static ExportedModel read_model(const Tag &tag, const ModelStruct &base_struct, std::vector<ExportedMaterial> &materials) {
+template<typename ModelStruct> static ExportedModel read_model(const ModelStruct &model, const std::string &path, std::vector<ExportedMaterial> &materials, const std::vector<std::filesystem::path> &tags_directories) {
     ExportedModel exported_model;
-    exported_model.path = tag.get_path() + "." + HEK::tag_fourcc_to_extension(tag.get_tag_fourcc());
-    
-    // Are we doing memes?
-    // bool use_local_nodes = tag.get_tag_fourcc() == HEK::TagFourCC::TAG_FOURCC_GBXMODEL && (base_struct.flags & HEK::ModelFlagsFlag::MODEL_FLAGS_FLAG_PARTS_HAVE_LOCAL_NODES);
+    exported_model.path = path;
     
     // Add all materials first
-    std::size_t shader_count = base_struct.shaders.count.read();
-    const Parser::ModelShaderReference::struct_little *shaders = reinterpret_cast<decltype(shaders)>(tag.data(base_struct.shaders.pointer, sizeof(*shaders) * shader_count));
-    
     std::map<std::size_t, std::size_t> material_map; // map local shader A to material B
-    for(std::size_t s = 0; s < shader_count; s++) {
-        material_map[s] = add_shader_to_materials(tag.get_map().get_tag(shaders[s].shader.tag_id.read().index), materials);
+    for(std::size_t s = 0; s < model.shaders.size(); s++) {
+        material_map[s] = add_shader_to_materials(model.shaders[s].shader, materials, tags_directories);
     }
     
-    // Hold geometry information
-    std::size_t geometry_count = base_struct.geometries.count.read();
-    const GeometryStruct *geometries = reinterpret_cast<decltype(geometries)>(tag.data(base_struct.geometries.pointer, sizeof(*geometries) * geometry_count));
-    
     // Did we add this stuff already? (in case the model was deduped on generation, we don't *need* to add the same geometry over and over then)
     std::map<HEK::Index, bool> added_already;
     added_already[NULL_INDEX] = true;
     
-    auto model_data_offset = tag.get_map().get_model_data_offset();
-    auto model_index_offset = model_data_offset + tag.get_map().get_model_index_offset();
-    
     // Next, add the geometries
-    std::size_t region_count = base_struct.regions.count.read();
-    const Parser::ModelRegion::struct_little *regions = reinterpret_cast<const Parser::ModelRegion::struct_little *>(tag.data(base_struct.regions.pointer, sizeof(*regions) * region_count));
-    for(std::size_t r = 0; r < region_count; r++) {
-        auto &region = regions[r];
-        std::size_t permutation_count = region.permutations.count.read();
-        const Parser::ModelRegionPermutation::struct_little *permutations = reinterpret_cast<decltype(permutations)>(tag.data(region.permutations.pointer, sizeof(*permutations) * permutation_count));
-        if(permutation_count == 0) {
+    for(auto &region : model.regions) {
+        if(region.permutations.empty()) {
             continue;
         }
         
         // First permutation
-        auto &permutation = permutations[0];
+        auto &permutation = region.permutations[0];
         
         // Check if we added this already!
         auto &super_high_added = added_already[permutation.super_high];
@@ -269,23 +236,19 @@ template<typename GeometryStruct, typename PartStruct, typename ModelStruct> sta
         super_high_added = true;
         
         // Get the geometry
-        auto &geometry = geometries[permutation.super_high];
-        std::size_t part_count = geometry.parts.count.read();
-        const PartStruct *parts = reinterpret_cast<const PartStruct *>(tag.data(geometry.parts.pointer, sizeof(*parts) * part_count));
+        if(permutation.super_high >= model.geometries.size()) {
+            eprintf_error("%s has an out-of-bounds geometry index", File::halo_path_to_preferred_path(path).c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        auto &geometry = model.geometries[permutation.super_high];
         
         // Go through each part. Add it!
-        for(std::size_t a = 0; a < part_count; a++) {
-            const auto &part = parts[a];
-            // const std::uint8_t *local_nodes = use_local_nodes ? reinterpret_cast<const Parser::GBXModelGeometryPart::struct_little *>(&part)->local_node_indices : nullptr;
-            
-            auto vertex_count = static_cast<std::size_t>(part.vertex_count);
-            const Parser::ModelVertexUncompressed::struct_little *vertices = reinterpret_cast<decltype(vertices)>(tag.get_map().get_data_at_offset(model_data_offset + part.vertex_offset, vertex_count * sizeof(*vertices)));
-            
+        for(auto &part : geometry.parts) {
+            auto &vertices = part.uncompressed_vertices;
             std::size_t offset = exported_model.vertices.size();
             
             // Add vertices
-            for(std::size_t v = 0; v < vertex_count; v++) {
-                auto &vertex = vertices[v];
+            for(auto &vertex : vertices) {
                 auto &vertex_added = exported_model.vertices.emplace_back();
                 vertex_added.x = vertex.position.x;
                 vertex_added.y = vertex.position.y;
@@ -295,9 +258,16 @@ template<typename GeometryStruct, typename PartStruct, typename ModelStruct> sta
                 vertex_added.k = vertex.normal.k;
             }
             
-            // Now indices
-            auto triangle_count = static_cast<std::size_t>(part.triangle_count);
-            const HEK::LittleEndian<HEK::Index> *triangles = reinterpret_cast<decltype(triangles)>(tag.get_map().get_data_at_offset(model_index_offset + part.triangle_offset, (triangle_count + 2) * sizeof(*triangles)));
+            // Now indices, which are stored as a triangle strip
+            std::vector<HEK::Index> triangles;
+            triangles.reserve(part.triangles.size() * 3);
+            for(auto &t : part.triangles) {
+                triangles.emplace_back(t.vertex0_index);
+                triangles.emplace_back(t.vertex1_index);
+                triangles.emplace_back(t.vertex2_index);
+            }
+            
+            auto triangle_count = triangles.size() < 2 ? 0 : triangles.size() - 2;
             bool flipped = false;
             auto material = material_map[part.shader_index];
             
@@ -309,6 +279,10 @@ template<typename GeometryStruct, typename PartStruct, typename ModelStruct> sta
                 if(triangles[t+0] == NULL_INDEX || triangles[t+1] == NULL_INDEX || triangles[t+2] == NULL_INDEX) {
                     continue;
                 }
+                if(triangles[t+0] >= vertices.size() || triangles[t+1] >= vertices.size() || triangles[t+2] >= vertices.size()) {
+                    eprintf_error("%s has an out-of-bounds vertex index", File::halo_path_to_preferred_path(path).c_str());
+                    std::exit(EXIT_FAILURE);
+                }
                 
                 // Let's add it
                 auto &triangle = exported_model.triangles.emplace_back();
@@ -323,402 +297,198 @@ template<typename GeometryStruct, typename PartStruct, typename ModelStruct> sta
     return exported_model;
 }
 
-std::string Invader::Lightmap::export_lightmap_mesh(const char *scenario, const char *bsp_name, const std::vector<std::filesystem::path> &tags_directories) {
+UnbakedMesh Invader::Lightmap::export_lightmap_mesh(const char *scenario, const char *bsp_name, const std::vector<std::filesystem::path> &tags_directories) {
     BuildWorkload::BuildParameters parameters;
     parameters.verbosity = BuildWorkload::BuildParameters::BuildVerbosity::BUILD_VERBOSITY_QUIET;
     parameters.tags_directories = tags_directories;
-    parameters.use_tags_for_script_data = true;
     parameters.scenario = scenario;
-    parameters.details.build_compress = false;
     
-    std::vector<std::string> lines;
-    std::vector<ExportedMaterial> materials;
-    std::vector<ExportedModel> models;
-    std::vector<ExportedModel> bsps;
-    std::vector<ExportedObject> objects;
-    std::vector<ExportedSky> skies;
-    
-#define ADD_LINE(...) lines.emplace_back(__VA_ARGS__)
+    UnbakedMesh mesh;
+    auto &materials = mesh.materials;
+    auto &models = mesh.models;
+    auto &bsps = mesh.bsps;
+    auto &objects = mesh.objects;
+    auto &skies = mesh.skies;
     
+    // Only the scenario (with its child scenarios merged into it, like when building), the BSP, and what they use are read, rather than building the whole map
+    std::optional<Parser::Scenario> scenario_tag;
     try {
-        auto map = Map::map_with_move(BuildWorkload::compile_map(parameters));
-        auto &scenario_tag = map.get_tag(map.get_scenario_tag_id());
-        auto &scenario_struct = scenario_tag.get_base_struct<HEK::Scenario>();
-        
-        // Find the BSP
-        std::optional<std::size_t> bsp_index;
-        std::size_t bsp_count = scenario_struct.structure_bsps.count;
-        const Parser::ScenarioBSP::struct_little *scenario_bsps = reinterpret_cast<decltype(scenario_bsps)>(scenario_tag.data(scenario_struct.structure_bsps.pointer, sizeof(*scenario_bsps) * bsp_count));
-        for(std::size_t b = 0; b < bsp_count; b++) {
-            auto tag_id = scenario_bsps[b].structure_bsp.tag_id.read();
-            if(tag_id.is_null()) {
-                continue;
-            }
-            
-            // Find the tag name
-            auto &bsp_tag = map.get_tag(tag_id.index);
-            const char *bsp_tag_name = bsp_tag.get_path().c_str();
-            for(const char *q = bsp_tag_name; *q; q++) {
-                if(*q == '\\') {
-                    bsp_tag_name = q + 1;
-                }
-            }
-            
-            // Do it
-            if(std::strcmp(bsp_tag_name, bsp_name) == 0) {
-                bsp_index = b;
-                bsps.emplace_back(read_bsp(bsp_tag, materials, skies)); // add the BSP
-                break;
-            }
-        }
-        
-        // Did we get it?
-        if(!bsp_index.has_value()) {
-            eprintf_error("No such BSP %s referenced by the scenario", bsp_name);
-            throw std::exception();
-        }
-        
-        // Now add all the sceneries in the BSP
-        std::uint16_t bsp_bit = 1 << *bsp_index;
-        
-        // Start getting scenery
-        std::size_t scenery_count = scenario_struct.scenery.count;
-        std::size_t scenery_palette_count = scenario_struct.scenery_palette.count;
-        if(scenery_count && scenery_palette_count) {
-            std::map<std::size_t, std::optional<std::size_t>> model_tag_id_to_exported_model_id;
-            
-            const Parser::ScenarioScenery::struct_little *scenery = reinterpret_cast<decltype(scenery)>(scenario_tag.data(scenario_struct.scenery.pointer, sizeof(*scenery) * scenery_count));
-            const Parser::ScenarioSceneryPalette::struct_little *scenery_palette = reinterpret_cast<decltype(scenery_palette)>(scenario_tag.data(scenario_struct.scenery_palette.pointer, sizeof(*scenery_palette) * scenery_palette_count));
-            
-            for(std::size_t s = 0; s < scenery_count; s++) {
-                auto &scenery_entry = scenery[s];
-                if(scenery_entry.bsp_indices & bsp_bit) {
-                    // Is the type set?
-                    auto type = scenery_entry.type.read();
-                    if(type == NULL_INDEX) {
-                        continue;
-                    }
-                    
-                    // Is the palette entry valid? If not... how did the map even compile? We check for that. Anyway, skip if not.
-                    auto scenery_tag_id = scenery_palette[type].name.tag_id.read();
-                    if(scenery_tag_id.is_null()) {
-                        continue;
-                    }
-                    
-                    // Check the model of the scenery
-                    auto &scenery_tag = map.get_tag(scenery_tag_id.index);
-                    auto &scenery_base_struct = scenery_tag.get_base_struct<HEK::Scenery>();
-                    auto model_tag_id = scenery_base_struct.model.tag_id.read();
-                    if(model_tag_id.is_null()) {
-                        continue;
-                    }
-                    
-                    // Add the model if we haven't already
-                    auto &model_id = model_tag_id_to_exported_model_id[model_tag_id.index];
-                    if(!model_id.has_value()) {
-                        model_id = models.size();
-                        auto &model_tag = map.get_tag(model_tag_id.index);
-                        
-                        switch(model_tag.get_tag_fourcc()) {
-                            case HEK::TagFourCC::TAG_FOURCC_GBXMODEL:
-                                models.emplace_back(read_model<Parser::GBXModelGeometry::struct_little, Parser::GBXModelGeometryPart::struct_little>(model_tag, model_tag.get_base_struct<HEK::GBXModel>(), materials));
-                                break;
-                            case HEK::TagFourCC::TAG_FOURCC_MODEL:
-                                models.emplace_back(read_model<Parser::ModelGeometry::struct_little, Parser::ModelGeometryPart::struct_little>(model_tag, model_tag.get_base_struct<HEK::Model>(), materials));
-                                break;
-                            default:
-                                std::fprintf(stderr, "Unknown model fourcc");
-                                throw std::exception();
-                        }
-                    }
-                    
-                    // Add the Add the object now
-                    auto &object = objects.emplace_back();
-                    object.model = *model_id;
-                    object.x = scenery_entry.position.x.read();
-                    object.y = scenery_entry.position.y.read();
-                    object.z = scenery_entry.position.z.read();
-                    object.yaw = scenery_entry.rotation.yaw.read();
-                    object.pitch = scenery_entry.rotation.pitch.read();
-                    object.roll = scenery_entry.rotation.roll.read();
-                }
-            }
-        }
+        scenario_tag = BuildWorkload::load_scenario(parameters);
     }
-    catch (std::exception &e) {
-        eprintf_error("Failed to build/parse map: %s", e.what());
+    catch(std::exception &e) {
+        eprintf_error("Failed to read scenario: %s", e.what());
         std::exit(EXIT_FAILURE);
     }
     
-    auto float_to_str = [](const auto &f) -> std::string {
-        std::string fstr = std::to_string(f);
-        
-        while(fstr[fstr.size() - 1] == '0') {
-            fstr.resize(fstr.size() - 1);
-        }
-        if(fstr[fstr.size() - 1] == '.') {
-            fstr.resize(fstr.size() - 1);
+    // Find the BSP
+    std::optional<std::size_t> bsp_index;
+    std::optional<Parser::ScenarioStructureBSP> bsp_tag;
+    std::size_t bsp_count = scenario_tag->structure_bsps.size();
+    for(std::size_t b = 0; b < bsp_count; b++) {
+        auto &bsp_reference = scenario_tag->structure_bsps[b].structure_bsp;
+        if(bsp_reference.path.empty()) {
+            continue;
         }
         
-        return fstr;
-    };
-    
-    // Put the version in it
-    ADD_LINE("version 1 unbaked");
-    
-    // Check skies
-    if(skies.size() > 1) {
-        eprintf_error("Only 1 sky per BSP is currently allowed maximum for this operation");
-        std::exit(EXIT_FAILURE);
-    }
-    
-    // Add skies
-    for(auto &s : skies) {
-        ADD_LINE(std::string("sky \"") + s.path + "\" " + float_to_str(s.outdoor_power) + " " + float_to_str(s.outdoor_red) + " " + float_to_str(s.outdoor_green) + " " + float_to_str(s.outdoor_blue) + " {");
-        for(auto &l : s.lights) {
-            ADD_LINE(std::string(" light ") + float_to_str(l.power) + " " + float_to_str(l.red) + " " + float_to_str(l.green) + " " + float_to_str(l.blue) + " " + float_to_str(l.yaw) + " " + float_to_str(l.pitch));
+        // Do it
+        if(File::base_name(bsp_reference.path) == bsp_name) {
+            bsp_index = b;
+            bsp_tag = parse_tag<Parser::ScenarioStructureBSP>(bsp_reference.path, bsp_reference.tag_fourcc, tags_directories);
+            decompress_bsp_vertices(*bsp_tag);
+            bsps.emplace_back(read_bsp(*bsp_tag, bsp_reference.path + "." + HEK::tag_fourcc_to_extension(bsp_reference.tag_fourcc), *scenario_tag, materials, skies, tags_directories)); // add the BSP
+            break;
         }
-        ADD_LINE("}");
     }
     
-    // Add materials
-    for(auto &mat : materials) {
-        ADD_LINE(std::string("material \"") + mat.path + "\" " + ExportedMaterialTypeStr[mat.type] + " " + float_to_str(mat.power) + " rgb " + float_to_str(mat.emission_red) + " " + float_to_str(mat.emission_green) + " " + float_to_str(mat.emission_blue)); // todo: add image sampling (base64 of pixel data maybe - `image <base64>` vs `rgb <red> <green> <blue>`)
+    // Did we get it?
+    if(!bsp_index.has_value()) {
+        eprintf_error("No such BSP %s referenced by the scenario", bsp_name);
+        std::exit(EXIT_FAILURE);
     }
     
-    // Add models
-    auto write_model = [&lines, &float_to_str](auto &m) {
-        ADD_LINE(std::string(m.lightmaps.size() ? "scenario_structure_bsp" : "model") + " \"" + m.path + "\" {");
-        for(auto &v : m.vertices) {
-            ADD_LINE(std::string(" vertex ") + float_to_str(v.x) + " " + float_to_str(v.y) + " " + float_to_str(v.z));
-        }
-        for(auto &t : m.triangles) {
-            ADD_LINE(std::string(" triangle ") + std::to_string(t.a) + " " + std::to_string(t.b) + " " + std::to_string(t.c) + " " + std::to_string(t.material));
-        }
-        for(auto &l : m.lightmaps) {
-            ADD_LINE(std::string(" lightmap ") + std::to_string(l.first_triangle_index) + " " + std::to_string(l.triangle_count));
-        }
-        ADD_LINE("}");
+    // Objects are in the BSP if their position or bounding sphere center is inside of it, just like when building. Only the BSP tree is needed for this.
+    std::vector<HEK::ModelCollisionGeometryBSP3DNode<HEK::LittleEndian>> bsp3d_nodes;
+    std::vector<HEK::ModelCollisionGeometryBSPPlane<HEK::LittleEndian>> planes;
+    HEK::BSPData bsp_data;
+    if(!bsp_tag->collision_bsp.empty()) {
+        auto &collision_bsp = bsp_tag->collision_bsp[0];
+        bsp3d_nodes.reserve(collision_bsp.bsp3d_nodes.size());
+        for(auto &n : collision_bsp.bsp3d_nodes) {
+            auto &node = bsp3d_nodes.emplace_back();
+            node.plane = n.plane;
+            node.back_child = n.back_child;
+            node.front_child = n.front_child;
+        }
+        planes.reserve(collision_bsp.planes.size());
+        for(auto &p : collision_bsp.planes) {
+            planes.emplace_back().plane = p.plane;
+        }
+        bsp_data.bsp3d_nodes = bsp3d_nodes.data();
+        bsp_data.bsp3d_node_count = bsp3d_nodes.size();
+        bsp_data.planes = planes.data();
+        bsp_data.plane_count = planes.size();
+    }
+    
+    // Start getting scenery
+    auto &scenery = scenario_tag->scenery;
+    auto &scenery_palette = scenario_tag->scenery_palette;
+    
+    struct SceneryModel {
+        std::optional<std::string> model_path;
+        HEK::Point3D<HEK::NativeEndian> bounding_offset;
     };
+    struct ModelInfo {
+        std::unique_ptr<Parser::ParserStruct> model_tag;
+        HEK::Point3D<HEK::NativeEndian> default_translation = {};
+        std::optional<std::size_t> exported_model;
+    };
+    std::map<std::size_t, SceneryModel> scenery_models; // map scenery palette entry to its model
+    std::map<std::string, ModelInfo> model_info; // map model path to the model
     
-    for(auto &m : bsps) {
-        write_model(m);
-    }
-    
-    for(auto &m : models) {
-        write_model(m);
-    }
-    
-    // Add objects
-    for(auto &o : objects) {
-        ADD_LINE(std::string("object ") + std::to_string(o.model) + " " + float_to_str(o.x) + " " + float_to_str(o.y) + " " + float_to_str(o.z) + " " + float_to_str(o.yaw) + " " + float_to_str(o.pitch) + " " + float_to_str(o.roll));
-    }
-    
-#undef ADD_LINE
-
-    // Concatenate into a string
-    std::string str;
-    for(auto &l : lines) {
-        str += std::move(l) + "\n";
-    }
-    return str;
-}
-
-struct ImportedBSPVertex {
-    float u, v;
-};
-
-struct ImportedBSPTriangle {
-    std::size_t vertices[3];
-};
-
-struct ImportedBSPLightmap {
-    std::size_t first_triangle, triangle_count;
-    std::string image_filename;
-};
-
-struct ImportedBSP {
-    std::string path;
-    std::vector<ImportedBSPVertex> vertices;
-    std::vector<ImportedBSPTriangle> triangles;
-    std::vector<ImportedBSPLightmap> lightmaps;
-};
-    
-void Invader::Lightmap::import_lightmap_mesh(const std::string &mesh_data, const std::filesystem::path &mesh_path, const char *scenario, const char *bsp_name, const std::vector<std::filesystem::path> &tags_directories) {
-    auto size = mesh_data.size();
-    auto *data = mesh_data.data();
-    auto *data_end = data + size;
-    
-    const char *token_start = nullptr;
-    std::vector<std::string> tokens;
-    bool in_quote = false;
-    
-    // Split whitespace
-    for(const char *a = data; a < data_end; a++) {
-        bool whitespace = !in_quote && (*a == ' ' || *a == '\n' || *a == '\t' || *a == '\r');
-        if(whitespace) {
-            if(!token_start) {
+    for(auto &scenery_entry : scenery) {
+        // Is the type set?
+        std::size_t type = scenery_entry.type;
+        if(type == NULL_INDEX || type >= scenery_palette.size()) {
+            continue;
+        }
+        
+        // Find the model of the scenery, if we haven't already
+        auto scenery_model_it = scenery_models.find(type);
+        if(scenery_model_it == scenery_models.end()) {
+            scenery_model_it = scenery_models.emplace(type, SceneryModel {}).first;
+            auto &scenery_model = scenery_model_it->second;
+            
+            auto &scenery_reference = scenery_palette[type].name;
+            if(scenery_reference.path.empty()) {
                 continue;
             }
-            else {
-                auto &str = tokens.emplace_back(token_start, a);
-                
-                // Remove quotes from string
-                for(std::size_t t = 0; t < str.size(); t++) {
-                    if(str[t] == '"') {
-                        str.erase(str.begin() + t);
-                        t--;
-                    }
-                }
-                
-                token_start = nullptr;
+            
+            auto scenery_tag = parse_tag<Parser::Scenery>(scenery_reference.path, scenery_reference.tag_fourcc, tags_directories);
+            auto &model_reference = scenery_tag.model;
+            if(model_reference.path.empty()) {
                 continue;
             }
+            
+            // Read the model if we haven't already
+            auto model_path = model_reference.path + "." + HEK::tag_fourcc_to_extension(model_reference.tag_fourcc);
+            auto model_it = model_info.find(model_path);
+            if(model_it == model_info.end()) {
+                auto &model = model_info[model_path];
+                model.model_tag = parse_tag<Parser::ParserStruct>(model_reference.path, model_reference.tag_fourcc, tags_directories);
+                if(auto *gbxmodel = dynamic_cast<const Parser::GBXModel *>(model.model_tag.get()); gbxmodel && !gbxmodel->nodes.empty()) {
+                    model.default_translation = gbxmodel->nodes[0].default_translation;
+                }
+                else if(auto *xbox_model = dynamic_cast<const Parser::Model *>(model.model_tag.get()); xbox_model && !xbox_model->nodes.empty()) {
+                    model.default_translation = xbox_model->nodes[0].default_translation;
+                }
+                model_it = model_info.find(model_path);
+            }
+            
+            scenery_model.model_path = model_path;
+            scenery_model.bounding_offset = scenery_tag.bounding_offset + model_it->second.default_translation;
         }
         
-        if(!token_start) {
-            token_start = a;
+        auto &scenery_model = scenery_model_it->second;
+        if(!scenery_model.model_path.has_value()) {
+            continue;
         }
         
-        if(*a == '"') {
-            in_quote = !in_quote;
-        }
-    }
-    
-    // If we still are in the middle of a token, error
-    if(in_quote) {
-        eprintf_error("Failed to parse %s: Unterminated quote", mesh_path.string().c_str());
-        std::exit(EXIT_FAILURE);
-    }
-    if(token_start || (data_end != data && data_end[-1] != '\n')) {
-        eprintf_error("Failed to parse %s: It does not end with a newline", mesh_path.string().c_str());
-        std::exit(EXIT_FAILURE);
-    }
-    
-    // Is it empty
-    if(tokens.empty()) {
-        eprintf_error("Failed to parse %s: No tokens were read", mesh_path.string().c_str());
-        std::exit(EXIT_FAILURE);
-    }
-    
-    std::size_t next_token = 0;
-    auto extract_next_token = [&next_token, &tokens]() -> std::optional<std::string> {
-        if(next_token == tokens.size()) {
-            return std::nullopt;
+        // Is it in the BSP?
+        if(bsp3d_nodes.empty()) {
+            continue;
         }
-        else {
-            return tokens[next_token++];
+        HEK::Point3D<HEK::LittleEndian> position = scenery_entry.position;
+        HEK::Point3D<HEK::LittleEndian> offset_position = scenery_entry.position + rotate_vector(scenery_model.bounding_offset, euler_to_matrix(scenery_entry.rotation));
+        try {
+            if(!bsp_data.check_if_point_inside_bsp(position) && !bsp_data.check_if_point_inside_bsp(offset_position)) {
+                continue;
+            }
         }
-    };
-    
-    // Version
-    if(extract_next_token() != "version") {
-        eprintf_error("Input mesh does not start with a version");
-        std::exit(EXIT_FAILURE);
-    }
-    if(extract_next_token() != std::to_string(MESH_FORMAT_VERSION)) {
-        eprintf_error("Input mesh does not have a supported version");
-        std::exit(EXIT_FAILURE);
-    }
-    if(extract_next_token() != "baked") {
-        eprintf_error("Input mesh is not baked");
-        std::exit(EXIT_FAILURE);
-    }
-    
-    // Hold the format here
-    std::optional<std::size_t> format_length, format_bpp;
-    std::vector<ImportedBSP> bsps;
-    
-    while(true) {
-        auto command_maybe = extract_next_token();
-        if(!command_maybe.has_value()) {
-            break; // done
+        catch(std::exception &) {
+            eprintf_error("Failed to check if scenery is inside of the BSP");
+            std::exit(EXIT_FAILURE);
         }
-        auto &command = *command_maybe;
         
-        // Format
-        if(command == "format") {
-            try {
-                format_length = std::stoul(extract_next_token().value());
-                format_bpp = std::stoul(extract_next_token().value());
-            }
-            catch(...) {
-                eprintf_error("Invalid format specified.");
-                std::exit(EXIT_FAILURE);
+        // Add the model if we haven't already
+        auto &model = model_info[*scenery_model.model_path];
+        if(!model.exported_model.has_value()) {
+            if(auto *gbxmodel = dynamic_cast<const Parser::GBXModel *>(model.model_tag.get())) {
+                models.emplace_back(read_model(*gbxmodel, *scenery_model.model_path, materials, tags_directories));
             }
-        }
-        // BSP
-        else if(command == "scenario_structure_bsp") {
-            try {
-                auto &bsp = bsps.emplace_back();
-                bsp.path = extract_next_token().value();
-                
-                // Block
-                if(extract_next_token() != "{") {
-                    throw std::exception();
-                }
-                
-                while(true) {
-                    auto subcommand_maybe = extract_next_token();
-                    if(!subcommand_maybe.has_value()) {
-                        throw std::exception();
-                    }
-                    auto &subcommand = *subcommand_maybe;
-                    
-                    // Done
-                    if(subcommand == "}") {
-                        break;
-                    }
-                    else if(subcommand == "vertex") {
-                        try {
-                            bsp.vertices.emplace_back() = { std::stof(extract_next_token().value()), std::stof(extract_next_token().value()) };
-                        }
-                        catch(...) {
-                            eprintf_error("Invalid vertex specified.");
-                            std::exit(EXIT_FAILURE);
-                        }
-                    }
-                    else if(subcommand == "triangle") {
-                        try {
-                            bsp.triangles.emplace_back() = { std::stoul(extract_next_token().value()), std::stoul(extract_next_token().value()), std::stoul(extract_next_token().value()) };
-                        }
-                        catch(...) {
-                            eprintf_error("Invalid triangle specified.");
-                            std::exit(EXIT_FAILURE);
-                        }
-                    }
-                    else if(subcommand == "lightmap") {
-                        try {
-                            bsp.lightmaps.emplace_back() = { std::stoul(extract_next_token().value()), std::stoul(extract_next_token().value()), extract_next_token().value() };
-                        }
-                        catch(...) {
-                            eprintf_error("Invalid lightmap specified.");
-                            std::exit(EXIT_FAILURE);
-                        }
-                    }
-                    else {
-                        eprintf_error("Unknown %s command %s", command.c_str(), subcommand.c_str());
-                        std::exit(EXIT_FAILURE);
-                    }
-                }
+            else if(auto *xbox_model = dynamic_cast<const Parser::Model *>(model.model_tag.get())) {
+                models.emplace_back(read_model(*xbox_model, *scenery_model.model_path, materials, tags_directories));
             }
-            catch(...) {
-                eprintf_error("Invalid BSP specified.");
+            else {
+                eprintf_error("Unknown model fourcc");
                 std::exit(EXIT_FAILURE);
             }
+            model.exported_model = models.size() - 1;
+            model.model_tag.reset(); // we don't need it anymore
         }
-        else {
-            eprintf_error("Unrecognized command \"%s\"", command.c_str());
-            std::exit(EXIT_FAILURE);
-        }
+        
+        // Add the Add the object now
+        auto &object = objects.emplace_back();
+        object.model = *model.exported_model;
+        object.x = scenery_entry.position.x;
+        object.y = scenery_entry.position.y;
+        object.z = scenery_entry.position.z;
+        object.yaw = scenery_entry.rotation.yaw;
+        object.pitch = scenery_entry.rotation.pitch;
+        object.roll = scenery_entry.rotation.roll;
     }
     
-    // Check the format
-    if(!format_length.has_value() || !format_bpp.has_value()) {
-        eprintf_error("Input mesh does not specify a format.");
+    // Check skies
+    if(skies.size() > 1) {
+        eprintf_error("Only 1 sky per BSP is currently allowed maximum for this operation");
         std::exit(EXIT_FAILURE);
     }
     
+    return mesh;
+}
+
+GeneratedLightmapTag Invader::Lightmap::generate_lightmap_mesh_tag(const BakedMesh &mesh, const char *scenario, const char *bsp_name, const std::vector<std::filesystem::path> &tags_directories) {
+    auto &bsps = mesh.bsps;
+    
     if(bsps.empty()) {
         eprintf_error("Input mesh does have any BSPs.");
         std::exit(EXIT_FAILURE);
@@ -818,6 +588,7 @@ void Invader::Lightmap::import_lightmap_mesh(const std::string &mesh_data, const
         eprintf_error("Failed to parse scenario tag: %s", e.what());
         std::exit(EXIT_FAILURE);
     }
+    decompress_bsp_vertices(*scenario_bsp);
     
     // UVs
     auto *uvs = bsp.vertices.data();
@@ -831,6 +602,17 @@ void Invader::Lightmap::import_lightmap_mesh(const std::string &mesh_data, const
         std::exit(EXIT_FAILURE);
     }
     
+    using RenderedVertex = Parser::ScenarioStructureBSPMaterialUncompressedRenderedVertex::struct_little;
+    using LightmapVertex = Parser::ScenarioStructureBSPMaterialUncompressedLightmapVertex::struct_little;
+    
+    // Every triangle corner used to get its own vertex; count those so we can say how much was saved
+    std::size_t corner_count = 0;
+    std::size_t welded_count = 0;
+    
+    std::unordered_map<VertexKey, HEK::Index, VertexKeyHash> welded_vertices; // rendered vertex index and the bits of a lightmap UV
+    std::vector<std::uint32_t> welded_rendered_vertices;
+    std::vector<const ImportedBSPVertex *> welded_lightmap_vertices;
+    
     // Go through each one!
     for(auto &lm : scenario_bsp->lightmaps) {
         if(lm.bitmap == NULL_INDEX) {
@@ -842,12 +624,9 @@ void Invader::Lightmap::import_lightmap_mesh(const std::string &mesh_data, const
         }
         
         for(auto &mat : lm.materials) {
-            std::vector<Parser::ScenarioStructureBSPMaterialUncompressedRenderedVertex::struct_little> uncompressed_vertices_duped;
-            std::vector<Parser::ScenarioStructureBSPMaterialUncompressedLightmapVertex::struct_little> uncompressed_lightmap_vertices_duped;
-            
-            auto &rendered_vertices_count = mat.rendered_vertices_count;
-            auto *uncompressed_vertices = reinterpret_cast<decltype(uncompressed_vertices_duped.data())>(mat.uncompressed_vertices.data());
-            auto expected_size = sizeof(uncompressed_vertices_duped[0]) * rendered_vertices_count;
+            auto rendered_vertices_count = mat.rendered_vertices_count;
+            auto *uncompressed_vertices = reinterpret_cast<const RenderedVertex *>(mat.uncompressed_vertices.data());
+            auto expected_size = sizeof(*uncompressed_vertices) * rendered_vertices_count;
             if(mat.uncompressed_vertices.size() < expected_size) {
                 eprintf_error("BSP uncompressed vertices size is wrong");
                 std::exit(EXIT_FAILURE);
@@ -860,45 +639,208 @@ void Invader::Lightmap::import_lightmap_mesh(const std::string &mesh_data, const
                 eprintf_error("BSP surfaces are out of bounds");
                 std::exit(EXIT_FAILURE);
             }
+            if(last_surface > bsp.triangles.size()) {
+                eprintf_error("BSP mismatch: Incorrect number of triangles");
+                std::exit(EXIT_FAILURE);
+            }
             
             auto *triangles = bsp_surfaces + first_surface;
             auto *triangles_end = bsp_surfaces + last_surface;
             auto *imported_triangles = tris + first_surface;
             
-            for(auto *t = triangles; t < triangles_end; t++, imported_triangles++) {
-                // Blow it up
-                auto dupe_it_all_to_hell = [&uncompressed_vertices_duped, &uncompressed_vertices, &rendered_vertices_count, &uncompressed_lightmap_vertices_duped, &uvs](HEK::Index &index, std::size_t vertex_index) {
-                    if(index >= rendered_vertices_count) {
-                        eprintf_error("BSP surface vertices are out of bounds");
+            // Corners that use the same rendered vertex and the same lightmap UV share one vertex
+            std::size_t material_corner_count = static_cast<std::size_t>(mat.surface_count) * 3;
+            welded_vertices.clear();
+            welded_vertices.reserve(material_corner_count);
+            welded_rendered_vertices.clear();
+            welded_rendered_vertices.reserve(material_corner_count);
+            welded_lightmap_vertices.clear();
+            welded_lightmap_vertices.reserve(material_corner_count);
+            
+            auto weld = [&](HEK::Index &index, std::size_t vertex_index) {
+                if(index >= rendered_vertices_count) {
+                    eprintf_error("BSP surface vertices are out of bounds");
+                    std::exit(EXIT_FAILURE);
+                }
+                
+                auto &uv = uvs[vertex_index];
+                VertexKey key = { index, float_bits(uv.u), float_bits(uv.v) };
+                auto [iterator, added] = welded_vertices.try_emplace(key, static_cast<HEK::Index>(welded_rendered_vertices.size()));
+                if(added) {
+                    if(welded_rendered_vertices.size() >= NULL_INDEX) {
+                        eprintf_error("BSP material has too many vertices (%zu >= %zu)", welded_rendered_vertices.size(), static_cast<std::size_t>(NULL_INDEX));
                         std::exit(EXIT_FAILURE);
                     }
-                    uncompressed_vertices_duped.emplace_back(uncompressed_vertices[index]);
-                    index = uncompressed_vertices_duped.size() - 1;
-                    
-                    auto &lm_vertex = uncompressed_lightmap_vertices_duped.emplace_back();
-                    lm_vertex.normal.i = 1.0F;
-                    lm_vertex.normal.j = 0.0F;
-                    lm_vertex.normal.k = 0.0F;
-                    lm_vertex.texture_coords.x = uvs[vertex_index].u;
-                    lm_vertex.texture_coords.y = uvs[vertex_index].v;
-                };
+                    welded_rendered_vertices.emplace_back(index);
+                    welded_lightmap_vertices.emplace_back(&uv);
+                }
+                index = iterator->second;
+            };
+            
+            for(auto *t = triangles; t < triangles_end; t++, imported_triangles++) {
+                weld(t->vertex0_index, imported_triangles->vertices[0]);
+                weld(t->vertex1_index, imported_triangles->vertices[1]);
+                weld(t->vertex2_index, imported_triangles->vertices[2]);
+            }
+            
+            // Write both arrays into one buffer that is allocated once
+            std::size_t vertex_count = welded_rendered_vertices.size();
+            std::vector<std::byte> vertices(vertex_count * (sizeof(RenderedVertex) + sizeof(LightmapVertex)));
+            auto *rendered_vertices = reinterpret_cast<RenderedVertex *>(vertices.data());
+            auto *lightmap_vertices = reinterpret_cast<LightmapVertex *>(rendered_vertices + vertex_count);
+            
+            for(std::size_t v = 0; v < vertex_count; v++) {
+                rendered_vertices[v] = uncompressed_vertices[welded_rendered_vertices[v]];
                 
-                // Do this
-                dupe_it_all_to_hell(t->vertex0_index, imported_triangles->vertices[0]);
-                dupe_it_all_to_hell(t->vertex1_index, imported_triangles->vertices[1]);
-                dupe_it_all_to_hell(t->vertex2_index, imported_triangles->vertices[2]);
+                auto &lm_vertex = lightmap_vertices[v];
+                lm_vertex.normal.i = 1.0F;
+                lm_vertex.normal.j = 0.0F;
+                lm_vertex.normal.k = 0.0F;
+                lm_vertex.texture_coords.x = welded_lightmap_vertices[v]->u;
+                lm_vertex.texture_coords.y = welded_lightmap_vertices[v]->v;
             }
             
-            // Insert the stuff
-            mat.rendered_vertices_count = uncompressed_vertices_duped.size();
+            mat.rendered_vertices_count = vertex_count;
             mat.rendered_vertices_offset = 0;
-            mat.uncompressed_vertices = std::vector<std::byte>(reinterpret_cast<std::byte *>(uncompressed_vertices_duped.data()), reinterpret_cast<std::byte *>(uncompressed_vertices_duped.data() + mat.rendered_vertices_count));
+            mat.lightmap_vertices_count = vertex_count;
+            mat.lightmap_vertices_offset = vertex_count * sizeof(RenderedVertex);
+            mat.uncompressed_vertices = std::move(vertices);
+            mat.compressed_vertices.clear(); // these no longer match the welded vertices; invader-bludgeon can regenerate them
             
-            mat.lightmap_vertices_count = uncompressed_lightmap_vertices_duped.size();
-            mat.lightmap_vertices_offset = mat.uncompressed_vertices.size();
-            mat.uncompressed_vertices.insert(mat.uncompressed_vertices.end(), reinterpret_cast<std::byte *>(uncompressed_lightmap_vertices_duped.data()), reinterpret_cast<std::byte *>(uncompressed_lightmap_vertices_duped.data() + mat.lightmap_vertices_count));
+            corner_count += material_corner_count;
+            welded_count += vertex_count;
         }
     }
     
-    File::save_file(*bsp_path_file, scenario_bsp->generate_hek_tag_data(HEK::TagFourCC::TAG_FOURCC_SCENARIO_STRUCTURE_BSP));
+    std::size_t vertex_size = sizeof(RenderedVertex) + sizeof(LightmapVertex);
+    oprintf("Welded %zu triangle corner%s into %zu vert%s (%zu fewer vert%s, %zu fewer bytes)\n",
+            corner_count, corner_count == 1 ? "" : "s",
+            welded_count, welded_count == 1 ? "ex" : "ices",
+            corner_count - welded_count, corner_count - welded_count == 1 ? "ex" : "ices",
+            (corner_count - welded_count) * vertex_size);
+    
+    return GeneratedLightmapTag { *bsp_path, *bsp_path_file, scenario_bsp->generate_hek_tag_data(HEK::TagFourCC::TAG_FOURCC_SCENARIO_STRUCTURE_BSP) };
+}
+
+GeneratedLightmapTag Invader::Lightmap::generate_lightmap_images_tag(const BakedLightmaps &lightmaps, const std::vector<std::filesystem::path> &tags_directories) {
+    auto &images = lightmaps.images;
+    auto &bsps = lightmaps.mesh.bsps;
+    if(bsps.size() != 1) {
+        eprintf_error("Baked lightmaps must be for exactly 1 BSP");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    // The BSP says which of its lightmaps bitmap's bitmaps each lightmap uses
+    auto bsp_path = File::split_tag_class_extension(bsps[0].path);
+    if(!bsp_path.has_value()) {
+        eprintf_error("Invalid BSP tag path %s", bsps[0].path.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    auto scenario_bsp = parse_tag<Parser::ScenarioStructureBSP>(bsp_path->path, bsp_path->fourcc, tags_directories);
+    auto &bitmap_reference = scenario_bsp.lightmaps_bitmap;
+    if(bitmap_reference.path.empty()) {
+        eprintf_error("%s does not reference a lightmaps bitmap to put the baked lightmaps in", File::halo_path_to_preferred_path(bsps[0].path).c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    
+    File::TagFilePath bitmap_path(bitmap_reference.path, HEK::TagFourCC::TAG_FOURCC_BITMAP);
+    auto bitmap_tag = parse_tag<Parser::Bitmap>(bitmap_path.path, bitmap_path.fourcc, tags_directories);
+    auto &bitmap_data = bitmap_tag.bitmap_data;
+    
+    // Match each image with its bitmap the same way the mesh was exported (every lightmap with a bitmap, in order)
+    std::vector<const BakedLightmapImage *> bitmap_images(bitmap_data.size(), nullptr);
+    std::size_t image_index = 0;
+    for(auto &lm : scenario_bsp.lightmaps) {
+        if(lm.bitmap == NULL_INDEX) {
+            continue;
+        }
+        if(image_index >= images.size()) {
+            eprintf_error("BSP mismatch: Incorrect number of lightmaps");
+            std::exit(EXIT_FAILURE);
+        }
+        
+        // A lightmap may use the next bitmap if the bitmap tag doesn't have it yet
+        std::size_t bitmap_index = lm.bitmap;
+        if(bitmap_index == bitmap_data.size()) {
+            bitmap_data.emplace_back();
+            bitmap_images.emplace_back(nullptr);
+        }
+        else if(bitmap_index > bitmap_data.size()) {
+            eprintf_error("BSP lightmap bitmap index #%zu is out of bounds", bitmap_index);
+            std::exit(EXIT_FAILURE);
+        }
+        else if(bitmap_images[bitmap_index] != nullptr) {
+            eprintf_error("BSP lightmap bitmap index #%zu is used by more than one lightmap", bitmap_index);
+            std::exit(EXIT_FAILURE);
+        }
+        bitmap_images[bitmap_index] = &images[image_index++];
+    }
+    if(image_index != images.size()) {
+        eprintf_error("BSP mismatch: Incorrect number of lightmaps");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    // Rebuild the pixel data, keeping the pixels of any bitmap that wasn't baked
+    std::vector<std::byte> processed_pixel_data;
+    std::vector<Pixel> pixels;
+    for(std::size_t b = 0; b < bitmap_data.size(); b++) {
+        auto &data = bitmap_data[b];
+        auto *image = bitmap_images[b];
+        std::size_t offset = processed_pixel_data.size();
+        
+        if(image == nullptr) {
+            std::size_t old_offset = data.pixel_data_offset;
+            std::size_t old_size = data.pixel_data_size;
+            if(old_offset > bitmap_tag.processed_pixel_data.size() || bitmap_tag.processed_pixel_data.size() - old_offset < old_size) {
+                eprintf_error("Bitmap #%zu of the lightmaps bitmap has out-of-bounds pixel data", b);
+                std::exit(EXIT_FAILURE);
+            }
+            auto *old_pixels = bitmap_tag.processed_pixel_data.data() + old_offset;
+            processed_pixel_data.insert(processed_pixel_data.end(), old_pixels, old_pixels + old_size);
+        }
+        else {
+            if(image->width > UINT16_MAX || image->height > UINT16_MAX) {
+                eprintf_error("Baked lightmap #%zu is too large (%zux%zu)", b, image->width, image->height);
+                std::exit(EXIT_FAILURE);
+            }
+            
+            // The baker writes RGBA; bitmaps are BGRA
+            std::size_t pixel_count = image->width * image->height;
+            pixels.resize(pixel_count);
+            for(std::size_t p = 0; p < pixel_count; p++) {
+                auto *rgba = image->pixels.data() + p * 4;
+                pixels[p] = Pixel { rgba[2], rgba[1], rgba[0], 0xFF };
+            }
+            auto encoded = BitmapEncode::encode_bitmap(reinterpret_cast<const std::byte *>(pixels.data()), HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_X8R8G8B8, image->width, image->height);
+            processed_pixel_data.insert(processed_pixel_data.end(), encoded.begin(), encoded.end());
+            
+            data.bitmap_class = HEK::TagFourCC::TAG_FOURCC_BITMAP;
+            data.width = static_cast<std::uint16_t>(image->width);
+            data.height = static_cast<std::uint16_t>(image->height);
+            data.depth = 1;
+            data.type = HEK::BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE;
+            data.format = HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_X8R8G8B8;
+            data.flags = HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_POWER_OF_TWO_DIMENSIONS; // this flag does not actually mean "power-of-two" but rather "not an interface bitmap"
+            data.mipmap_count = 0;
+        }
+        
+        data.pixel_data_offset = static_cast<std::uint32_t>(offset);
+        data.pixel_data_size = static_cast<std::uint32_t>(processed_pixel_data.size() - offset);
+    }
+    bitmap_tag.processed_pixel_data = std::move(processed_pixel_data);
+    
+    auto bitmap_file = File::tag_path_to_file_path(bitmap_path, tags_directories);
+    if(!bitmap_file.has_value()) {
+        eprintf_error("Cannot find tag %s", File::halo_path_to_preferred_path(bitmap_path.join()).c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    return GeneratedLightmapTag { bitmap_path.join(), *bitmap_file, bitmap_tag.generate_hek_tag_data(HEK::TagFourCC::TAG_FOURCC_BITMAP) };
+}
+
+void Invader::Lightmap::save_lightmap_tag(const GeneratedLightmapTag &tag) {
+    if(!File::save_file(tag.file_path, tag.tag_data)) {
+        eprintf_error("Failed to save %s", File::halo_path_to_preferred_path(tag.tag_path).c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    oprintf("Saved %s\n", File::halo_path_to_preferred_path(tag.tag_path).c_str());
 }
@@ -5,9 +5,23 @@
 #include <string>
 #include <filesystem>
 
+#include "mesh.hpp"
+#include "bake.hpp"
+
 namespace Invader::Lightmap {
-    std::string export_lightmap_mesh(const char *scenario, const char *bsp_name, const std::vector<std::filesystem::path> &tags_directories);
-    void import_lightmap_mesh(const std::string &mesh_data, const std::filesystem::path &mesh_path, const char *scenario, const char *bsp_name, const std::vector<std::filesystem::path> &tags_directories);
+    /**
+     * Tag data that was generated but not saved yet, so every tag that goes together can be validated before any of them are saved
+     */
+    struct GeneratedLightmapTag {
+        std::string tag_path;
+        std::filesystem::path file_path;
+        std::vector<std::byte> tag_data;
+    };
+    
+    UnbakedMesh export_lightmap_mesh(const char *scenario, const char *bsp_name, const std::vector<std::filesystem::path> &tags_directories);
+    GeneratedLightmapTag generate_lightmap_mesh_tag(const BakedMesh &mesh, const char *scenario, const char *bsp_name, const std::vector<std::filesystem::path> &tags_directories);
+    GeneratedLightmapTag generate_lightmap_images_tag(const BakedLightmaps &lightmaps, const std::vector<std::filesystem::path> &tags_directories);
+    void save_lightmap_tag(const GeneratedLightmapTag &tag);
 }
 
 #endif
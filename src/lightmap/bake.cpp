@@ -0,0 +1,1234 @@
+#include "bake.hpp"
+
+#include <invader/printf.hpp>
+#include <invader/hek/data_type.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+using namespace Invader;
+using namespace Invader::Lightmap;
+
+// Charts are padded by this many texels on each side so filtering doesn't blend them together
+static constexpr const std::size_t CHART_PADDING = 2;
+
+// Triangles are added to a chart if they face within about 25 degrees of the chart's first triangle
+static constexpr const float CHART_NORMAL_THRESHOLD = 0.9F;
+
+// Texels are baked in square tiles of this many texels on each side
+static constexpr const std::size_t TILE_SIZE = 16;
+
+// Rays start this far off of surfaces so they don't hit the surface they start on
+static constexpr const float RAY_OFFSET = 0.0005F;
+
+static constexpr const std::size_t BVH_BIN_COUNT = 16;
+static constexpr const std::size_t BVH_LEAF_SIZE = 4;
+static constexpr const std::size_t BVH_MAX_LEAF_SIZE = 16;
+static constexpr const std::size_t BVH_MAX_DEPTH = 64;
+
+static constexpr const std::uint32_t NO_INDEX = std::numeric_limits<std::uint32_t>::max();
+static constexpr const float PI = 3.14159265358979323846F;
+
+namespace {
+    struct Vector {
+        float x = 0.0F;
+        float y = 0.0F;
+        float z = 0.0F;
+
+        Vector operator+(const Vector &other) const noexcept {
+            return { this->x + other.x, this->y + other.y, this->z + other.z };
+        }
+        Vector operator-(const Vector &other) const noexcept {
+            return { this->x - other.x, this->y - other.y, this->z - other.z };
+        }
+        Vector operator*(const Vector &other) const noexcept {
+            return { this->x * other.x, this->y * other.y, this->z * other.z };
+        }
+        Vector operator*(float scale) const noexcept {
+            return { this->x * scale, this->y * scale, this->z * scale };
+        }
+        Vector &operator+=(const Vector &other) noexcept {
+            return *this = *this + other;
+        }
+        float operator[](std::size_t axis) const noexcept {
+            return axis == 0 ? this->x : axis == 1 ? this->y : this->z;
+        }
+    };
+
+    float dot(const Vector &a, const Vector &b) noexcept {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    Vector cross(const Vector &a, const Vector &b) noexcept {
+        return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    }
+
+    Vector minimum(const Vector &a, const Vector &b) noexcept {
+        return { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) };
+    }
+
+    Vector maximum(const Vector &a, const Vector &b) noexcept {
+        return { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) };
+    }
+
+    // Returns a zero vector if the vector has no length
+    Vector normalize(const Vector &vector) noexcept {
+        float length = std::sqrt(dot(vector, vector));
+        if(!(length > 0.0F)) {
+            return {};
+        }
+        return vector * (1.0F / length);
+    }
+
+    // Make two vectors perpendicular to a unit vector and each other (Duff et al., "Building an Orthonormal Basis, Revisited")
+    void make_basis(const Vector &normal, Vector &tangent, Vector &bitangent) noexcept {
+        float sign = std::copysign(1.0F, normal.z);
+        float a = -1.0F / (sign + normal.z);
+        float b = normal.x * normal.y * a;
+        tangent = { 1.0F + sign * normal.x * normal.x * a, sign * b, -sign * normal.x };
+        bitangent = { b, sign + normal.y * normal.y * a, -normal.y };
+    }
+
+    // Half of the surface area of a box
+    float half_area(const Vector &min, const Vector &max) noexcept {
+        auto size = max - min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    // PCG32; every texel gets its own seed so the result doesn't depend on which thread baked it
+    class Random {
+    public:
+        explicit Random(std::uint64_t seed) noexcept {
+            this->next_int();
+            this->state += seed;
+            this->next_int();
+        }
+
+        std::uint32_t next_int() noexcept {
+            auto old = this->state;
+            this->state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+            auto xorshifted = static_cast<std::uint32_t>(((old >> 18) ^ old) >> 27);
+            auto rotation = static_cast<std::uint32_t>(old >> 59);
+            return (xorshifted >> rotation) | (xorshifted << ((0U - rotation) & 31));
+        }
+
+        // Get a number from 0 (inclusive) to 1 (exclusive)
+        float next_float() noexcept {
+            return static_cast<float>(this->next_int() >> 8) * (1.0F / 16777216.0F);
+        }
+
+    private:
+        std::uint64_t state = 0;
+    };
+
+    struct SceneTriangle {
+        Vector v0;
+        Vector edge1;
+        Vector edge2;
+        Vector normal;
+        std::uint32_t material;
+    };
+
+    struct BVHNode {
+        Vector min;
+        Vector max;
+
+        // If count is 0, this is the left child, and the right child comes after it; otherwise it is the first triangle
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    struct Hit {
+        float distance;
+        std::uint32_t triangle;
+    };
+
+    // Bounding volume hierarchy built with the surface area heuristic, using bins rather than trying every split
+    class BVH {
+    public:
+        explicit BVH(const std::vector<SceneTriangle> &scene_triangles);
+
+        bool closest(const Vector &origin, const Vector &direction, Hit &hit) const noexcept {
+            return this->traverse<false>(origin, direction, std::numeric_limits<float>::infinity(), &hit);
+        }
+
+        bool occluded(const Vector &origin, const Vector &direction, float max_distance) const noexcept {
+            return this->traverse<true>(origin, direction, max_distance, nullptr);
+        }
+
+        const SceneTriangle &triangle(std::uint32_t index) const noexcept {
+            return this->triangles[index];
+        }
+
+        std::size_t node_count() const noexcept {
+            return this->nodes.size();
+        }
+
+    private:
+        std::vector<SceneTriangle> triangles;
+        std::vector<BVHNode> nodes;
+
+        template<bool any_hit> bool traverse(const Vector &origin, const Vector &direction, float max_distance, Hit *hit) const noexcept;
+    };
+
+    BVH::BVH(const std::vector<SceneTriangle> &scene_triangles) {
+        auto triangle_count = scene_triangles.size();
+        if(triangle_count == 0) {
+            return;
+        }
+
+        std::vector<Vector> mins(triangle_count), maxs(triangle_count), centroids(triangle_count);
+        std::vector<std::uint32_t> indices(triangle_count);
+        for(std::size_t t = 0; t < triangle_count; t++) {
+            auto &triangle = scene_triangles[t];
+            auto v1 = triangle.v0 + triangle.edge1;
+            auto v2 = triangle.v0 + triangle.edge2;
+            mins[t] = minimum(triangle.v0, minimum(v1, v2));
+            maxs[t] = maximum(triangle.v0, maximum(v1, v2));
+            centroids[t] = (mins[t] + maxs[t]) * 0.5F;
+            indices[t] = static_cast<std::uint32_t>(t);
+        }
+
+        struct PendingNode {
+            std::uint32_t node;
+            std::uint32_t first;
+            std::uint32_t count;
+            std::size_t depth;
+        };
+
+        this->nodes.reserve(triangle_count * 2);
+        this->nodes.emplace_back();
+        std::vector<PendingNode> pending_nodes = { { 0, 0, static_cast<std::uint32_t>(triangle_count), 0 } };
+
+        constexpr float INF = std::numeric_limits<float>::infinity();
+
+        while(!pending_nodes.empty()) {
+            auto pending = pending_nodes.back();
+            pending_nodes.pop_back();
+
+            auto *begin = indices.data() + pending.first;
+            auto *end = begin + pending.count;
+
+            Vector bounds_min = { INF, INF, INF }, bounds_max = { -INF, -INF, -INF };
+            Vector centroid_min = bounds_min, centroid_max = bounds_max;
+            for(auto *t = begin; t < end; t++) {
+                bounds_min = minimum(bounds_min, mins[*t]);
+                bounds_max = maximum(bounds_max, maxs[*t]);
+                centroid_min = minimum(centroid_min, centroids[*t]);
+                centroid_max = maximum(centroid_max, centroids[*t]);
+            }
+
+            auto &node = this->nodes[pending.node];
+            node.min = bounds_min;
+            node.max = bounds_max;
+            node.first = pending.first;
+            node.count = pending.count;
+
+            if(pending.count <= BVH_LEAF_SIZE || pending.depth >= BVH_MAX_DEPTH) {
+                continue;
+            }
+
+            // Split along the axis the centroids are spread out the most on
+            auto extent = centroid_max - centroid_min;
+            std::size_t axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+            if(!(extent[axis] > 0.0F)) {
+                continue; // every centroid is in the same spot, so there is nothing to split
+            }
+
+            struct Bin {
+                Vector min = { INF, INF, INF };
+                Vector max = { -INF, -INF, -INF };
+                std::uint32_t count = 0;
+            } bins[BVH_BIN_COUNT];
+
+            float bin_scale = BVH_BIN_COUNT / extent[axis];
+            auto bin_of = [&centroids, &centroid_min, &bin_scale, &axis](std::uint32_t t) {
+                return std::min(BVH_BIN_COUNT - 1, static_cast<std::size_t>((centroids[t][axis] - centroid_min[axis]) * bin_scale));
+            };
+
+            for(auto *t = begin; t < end; t++) {
+                auto &bin = bins[bin_of(*t)];
+                bin.count++;
+                bin.min = minimum(bin.min, mins[*t]);
+                bin.max = maximum(bin.max, maxs[*t]);
+            }
+
+            // Find the cost of splitting after each bin
+            float right_cost[BVH_BIN_COUNT] = {};
+            Vector accumulated_min = { INF, INF, INF }, accumulated_max = { -INF, -INF, -INF };
+            std::uint32_t accumulated_count = 0;
+            for(std::size_t b = BVH_BIN_COUNT - 1; b > 0; b--) {
+                accumulated_min = minimum(accumulated_min, bins[b].min);
+                accumulated_max = maximum(accumulated_max, bins[b].max);
+                accumulated_count += bins[b].count;
+                right_cost[b - 1] = accumulated_count == 0 ? 0.0F : half_area(accumulated_min, accumulated_max) * accumulated_count;
+            }
+
+            float best_cost = INF;
+            std::size_t best_bin = 0;
+            accumulated_min = { INF, INF, INF };
+            accumulated_max = { -INF, -INF, -INF };
+            accumulated_count = 0;
+            for(std::size_t b = 0; b < BVH_BIN_COUNT - 1; b++) {
+                accumulated_min = minimum(accumulated_min, bins[b].min);
+                accumulated_max = maximum(accumulated_max, bins[b].max);
+                accumulated_count += bins[b].count;
+                float cost = (accumulated_count == 0 ? 0.0F : half_area(accumulated_min, accumulated_max) * accumulated_count) + right_cost[b];
+                if(cost < best_cost) {
+                    best_cost = cost;
+                    best_bin = b;
+                }
+            }
+
+            // Keep it as a leaf if splitting doesn't help
+            if(best_cost >= half_area(bounds_min, bounds_max) * pending.count && pending.count <= BVH_MAX_LEAF_SIZE) {
+                continue;
+            }
+
+            auto *middle = std::partition(begin, end, [&bin_of, &best_bin](std::uint32_t t) { return bin_of(t) <= best_bin; });
+            if(middle == begin || middle == end) {
+                middle = begin + pending.count / 2;
+                std::nth_element(begin, middle, end, [&centroids, &axis](std::uint32_t a, std::uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+            }
+            auto left_count = static_cast<std::uint32_t>(middle - begin);
+
+            auto left = static_cast<std::uint32_t>(this->nodes.size());
+            this->nodes.emplace_back();
+            this->nodes.emplace_back();
+            this->nodes[pending.node].first = left;
+            this->nodes[pending.node].count = 0;
+
+            pending_nodes.push_back({ left, pending.first, left_count, pending.depth + 1 });
+            pending_nodes.push_back({ left + 1, pending.first + left_count, pending.count - left_count, pending.depth + 1 });
+        }
+
+        // Put the triangles in the order the leaves expect
+        this->triangles.reserve(triangle_count);
+        for(auto t : indices) {
+            this->triangles.emplace_back(scene_triangles[t]);
+        }
+    }
+
+    bool intersect_box(const BVHNode &node, const Vector &origin, const Vector &inverse_direction, float max_distance, float &entry) noexcept {
+        float x1 = (node.min.x - origin.x) * inverse_direction.x;
+        float x2 = (node.max.x - origin.x) * inverse_direction.x;
+        float y1 = (node.min.y - origin.y) * inverse_direction.y;
+        float y2 = (node.max.y - origin.y) * inverse_direction.y;
+        float z1 = (node.min.z - origin.z) * inverse_direction.z;
+        float z2 = (node.max.z - origin.z) * inverse_direction.z;
+
+        float near = std::max(std::max(std::min(x1, x2), std::min(y1, y2)), std::min(z1, z2));
+        float far = std::min(std::min(std::max(x1, x2), std::max(y1, y2)), std::max(z1, z2));
+
+        entry = near;
+        return far >= std::max(near, 0.0F) && near < max_distance;
+    }
+
+    // Möller-Trumbore
+    bool intersect_triangle(const SceneTriangle &triangle, const Vector &origin, const Vector &direction, float max_distance, float &distance) noexcept {
+        auto p = cross(direction, triangle.edge2);
+        float determinant = dot(triangle.edge1, p);
+        if(determinant == 0.0F) {
+            return false;
+        }
+        float inverse_determinant = 1.0F / determinant;
+
+        auto s = origin - triangle.v0;
+        float u = dot(s, p) * inverse_determinant;
+        if(u < 0.0F || u > 1.0F) {
+            return false;
+        }
+
+        auto q = cross(s, triangle.edge1);
+        float v = dot(direction, q) * inverse_determinant;
+        if(v < 0.0F || u + v > 1.0F) {
+            return false;
+        }
+
+        float t = dot(triangle.edge2, q) * inverse_determinant;
+        if(!(t > 0.0F) || t >= max_distance) {
+            return false;
+        }
+
+        distance = t;
+        return true;
+    }
+
+    template<bool any_hit> bool BVH::traverse(const Vector &origin, const Vector &direction, float max_distance, Hit *hit) const noexcept {
+        if(this->nodes.empty()) {
+            return false;
+        }
+
+        Vector inverse_direction = { 1.0F / direction.x, 1.0F / direction.y, 1.0F / direction.z };
+        float entry;
+        if(!intersect_box(this->nodes[0], origin, inverse_direction, max_distance, entry)) {
+            return false;
+        }
+
+        // The tree is never deeper than BVH_MAX_DEPTH, and at most one node is pushed per level
+        std::uint32_t stack[BVH_MAX_DEPTH + 1];
+        std::size_t stack_size = 0;
+        std::uint32_t node_index = 0;
+        bool found = false;
+
+        while(true) {
+            auto &node = this->nodes[node_index];
+
+            if(node.count > 0) {
+                auto *triangle = this->triangles.data() + node.first;
+                auto *triangle_end = triangle + node.count;
+                for(; triangle < triangle_end; triangle++) {
+                    float distance;
+                    if(intersect_triangle(*triangle, origin, direction, max_distance, distance)) {
+                        if constexpr(any_hit) {
+                            return true;
+                        }
+                        else {
+                            max_distance = distance;
+                            hit->distance = distance;
+                            hit->triangle = static_cast<std::uint32_t>(triangle - this->triangles.data());
+                            found = true;
+                        }
+                    }
+                }
+            }
+            else {
+                // Visit the nearer child first
+                float left_entry, right_entry;
+                bool left = intersect_box(this->nodes[node.first], origin, inverse_direction, max_distance, left_entry);
+                bool right = intersect_box(this->nodes[node.first + 1], origin, inverse_direction, max_distance, right_entry);
+
+                if(left && right) {
+                    bool left_first = left_entry <= right_entry;
+                    stack[stack_size++] = left_first ? node.first + 1 : node.first;
+                    node_index = left_first ? node.first : node.first + 1;
+                    continue;
+                }
+                else if(left) {
+                    node_index = node.first;
+                    continue;
+                }
+                else if(right) {
+                    node_index = node.first + 1;
+                    continue;
+                }
+            }
+
+            if(stack_size == 0) {
+                break;
+            }
+            node_index = stack[--stack_size];
+        }
+
+        return found;
+    }
+
+    struct SkyLight {
+        Vector direction; // toward the light
+        Vector color;
+    };
+
+    // Anything needed to figure out how much light reaches a point
+    class Lighting {
+    public:
+        Lighting(const BVH &bvh, const UnbakedMesh &mesh, const BakeParameters &parameters) : bvh(bvh), bounces(parameters.bounces), reflectance(parameters.reflectance) {
+            if(!mesh.skies.empty()) {
+                auto &sky = mesh.skies[0];
+                this->outdoor_ambient = Vector { sky.outdoor_red, sky.outdoor_green, sky.outdoor_blue } * sky.outdoor_power;
+                this->indoor_ambient = Vector { sky.indoor_red, sky.indoor_green, sky.indoor_blue } * sky.indoor_power;
+                for(auto &light : sky.lights) {
+                    auto &added = this->lights.emplace_back();
+                    added.direction = {
+                        std::cos(light.pitch) * std::cos(light.yaw),
+                        std::cos(light.pitch) * std::sin(light.yaw),
+                        std::sin(light.pitch)
+                    };
+                    added.color = Vector { light.red, light.green, light.blue } * light.power;
+                }
+            }
+
+            this->emission.reserve(mesh.materials.size());
+            for(auto &material : mesh.materials) {
+                this->emission.emplace_back(Vector { material.emission_red, material.emission_green, material.emission_blue } * material.power);
+            }
+        }
+
+        // Light from the sky's lights hitting a point (origin should already be off of the surface)
+        Vector direct(const Vector &origin, const Vector &surface_normal, const Vector &shading_normal, std::size_t &rays) const noexcept {
+            Vector light_received;
+            for(auto &light : this->lights) {
+                float cosine = dot(shading_normal, light.direction);
+                if(cosine <= 0.0F || dot(surface_normal, light.direction) <= 0.0F) {
+                    continue;
+                }
+                rays++;
+                if(!this->bvh.occluded(origin, light.direction, std::numeric_limits<float>::infinity())) {
+                    light_received += light.color * cosine;
+                }
+            }
+            return light_received;
+        }
+
+        // Light coming back along a ray, bouncing it off of what it hits until it runs out of bounces
+        Vector trace(Vector origin, Vector direction, Random &random, std::size_t &rays) const noexcept {
+            Vector light_received;
+            Vector throughput = { 1.0F, 1.0F, 1.0F };
+
+            for(std::size_t bounce = 0;; bounce++) {
+                Hit hit;
+                rays++;
+                if(!this->bvh.closest(origin, direction, hit)) {
+                    light_received += throughput * this->outdoor_ambient;
+                    break;
+                }
+
+                // If we hit the back of something, we're looking at the inside of something, and no light comes from there
+                auto &triangle = this->bvh.triangle(hit.triangle);
+                if(dot(direction, triangle.normal) >= 0.0F) {
+                    break;
+                }
+
+                light_received += throughput * this->emission[triangle.material];
+                if(bounce >= this->bounces) {
+                    break;
+                }
+
+                origin = origin + direction * hit.distance + triangle.normal * RAY_OFFSET;
+                throughput = throughput * this->reflectance;
+                light_received += throughput * this->direct(origin, triangle.normal, triangle.normal, rays);
+                direction = cosine_direction(triangle.normal, random);
+            }
+
+            return light_received;
+        }
+
+        // Light hitting a texel, gathered with stratified rays
+        Vector gather(const Vector &position, const Vector &surface_normal, const Vector &shading_normal, std::size_t samples_per_side, Random &random, std::size_t &rays) const noexcept {
+            auto origin = position + surface_normal * RAY_OFFSET;
+            auto light_received = this->direct(origin, surface_normal, shading_normal, rays) + this->indoor_ambient;
+
+            Vector tangent, bitangent;
+            make_basis(surface_normal, tangent, bitangent);
+
+            Vector indirect;
+            float stratum = 1.0F / static_cast<float>(samples_per_side);
+            for(std::size_t y = 0; y < samples_per_side; y++) {
+                for(std::size_t x = 0; x < samples_per_side; x++) {
+                    float u1 = (static_cast<float>(y) + random.next_float()) * stratum;
+                    float u2 = (static_cast<float>(x) + random.next_float()) * stratum;
+                    indirect += this->trace(origin, cosine_direction(surface_normal, tangent, bitangent, u1, u2), random, rays);
+                }
+            }
+
+            return light_received + indirect * (stratum * stratum);
+        }
+
+    private:
+        const BVH &bvh;
+        std::vector<SkyLight> lights;
+        std::vector<Vector> emission;
+        Vector outdoor_ambient;
+        Vector indoor_ambient;
+        std::size_t bounces;
+        float reflectance;
+
+        static Vector cosine_direction(const Vector &normal, const Vector &tangent, const Vector &bitangent, float u1, float u2) noexcept {
+            float radius = std::sqrt(u1);
+            float angle = 2.0F * PI * u2;
+            float height = std::sqrt(std::max(0.0F, 1.0F - u1));
+            return tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle)) + normal * height;
+        }
+
+        static Vector cosine_direction(const Vector &normal, Random &random) noexcept {
+            Vector tangent, bitangent;
+            make_basis(normal, tangent, bitangent);
+            float u1 = random.next_float();
+            float u2 = random.next_float();
+            return cosine_direction(normal, tangent, bitangent, u1, u2);
+        }
+    };
+
+    // A group of connected triangles that face about the same way, flattened onto a plane and given its own spot in the lightmap
+    struct Chart {
+        std::vector<std::uint32_t> triangles;
+        Vector axis_u;
+        Vector axis_v;
+        float min_u, min_v, max_u, max_v;
+
+        // Placement in the lightmap in texels, including padding
+        std::size_t x = 0, y = 0, width = 0, height = 0;
+    };
+
+    Vector vertex_position(const ExportedVertex &vertex) noexcept {
+        return { vertex.x, vertex.y, vertex.z };
+    }
+
+    Vector triangle_normal(const ExportedModel &model, const ExportedTriangle &triangle) noexcept {
+        auto a = vertex_position(model.vertices[triangle.a]);
+        auto b = vertex_position(model.vertices[triangle.b]);
+        auto c = vertex_position(model.vertices[triangle.c]);
+        return normalize(cross(b - a, c - a));
+    }
+
+    std::vector<Chart> make_charts(const ExportedModel &bsp, const ExportedLightmap &lightmap) {
+        auto first_triangle = lightmap.first_triangle_index;
+        auto triangle_count = lightmap.triangle_count;
+
+        // Vertices are duplicated between materials, so find triangles' neighbors by their vertices' positions
+        std::unordered_map<VertexKey, std::uint32_t, VertexKeyHash> position_ids;
+        position_ids.reserve(triangle_count * 3);
+        auto position_id = [&position_ids, &bsp](std::size_t vertex_index) {
+            auto &vertex = bsp.vertices[vertex_index];
+            VertexKey key = { float_bits(vertex.x), float_bits(vertex.y), float_bits(vertex.z) };
+            return position_ids.try_emplace(key, static_cast<std::uint32_t>(position_ids.size())).first->second;
+        };
+
+        // Sort every edge so edges shared by exactly two triangles end up next to each other
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> edges;
+        edges.reserve(triangle_count * 3);
+        std::vector<Vector> normals(triangle_count);
+        for(std::size_t t = 0; t < triangle_count; t++) {
+            auto &triangle = bsp.triangles[first_triangle + t];
+            normals[t] = triangle_normal(bsp, triangle);
+
+            std::uint32_t ids[3] = { position_id(triangle.a), position_id(triangle.b), position_id(triangle.c) };
+            for(std::uint32_t e = 0; e < 3; e++) {
+                auto a = ids[e];
+                auto b = ids[(e + 1) % 3];
+                if(a == b) {
+                    continue;
+                }
+                auto key = (static_cast<std::uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+                edges.emplace_back(key, static_cast<std::uint32_t>(t * 3 + e));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        std::vector<std::array<std::uint32_t, 3>> neighbors(triangle_count, { NO_INDEX, NO_INDEX, NO_INDEX });
+        for(std::size_t e = 0; e < edges.size();) {
+            std::size_t run_end = e + 1;
+            while(run_end < edges.size() && edges[run_end].first == edges[e].first) {
+                run_end++;
+            }
+            if(run_end - e == 2) {
+                auto a = edges[e].second, b = edges[e + 1].second;
+                neighbors[a / 3][a % 3] = b / 3;
+                neighbors[b / 3][b % 3] = a / 3;
+            }
+            e = run_end;
+        }
+
+        // Flood fill charts from each triangle not in a chart yet
+        std::vector<Chart> charts;
+        std::vector<bool> in_chart(triangle_count, false);
+        std::vector<std::uint32_t> queue;
+        for(std::size_t seed = 0; seed < triangle_count; seed++) {
+            if(in_chart[seed]) {
+                continue;
+            }
+
+            auto &chart = charts.emplace_back();
+            auto chart_normal = normals[seed];
+            if(dot(chart_normal, chart_normal) == 0.0F) {
+                chart_normal = { 0.0F, 0.0F, 1.0F };
+            }
+            make_basis(chart_normal, chart.axis_u, chart.axis_v);
+
+            in_chart[seed] = true;
+            queue.assign(1, static_cast<std::uint32_t>(seed));
+            while(!queue.empty()) {
+                auto t = queue.back();
+                queue.pop_back();
+                chart.triangles.emplace_back(static_cast<std::uint32_t>(first_triangle + t));
+                for(auto n : neighbors[t]) {
+                    if(n != NO_INDEX && !in_chart[n] && dot(normals[n], chart_normal) >= CHART_NORMAL_THRESHOLD) {
+                        in_chart[n] = true;
+                        queue.emplace_back(n);
+                    }
+                }
+            }
+
+            chart.min_u = chart.min_v = std::numeric_limits<float>::infinity();
+            chart.max_u = chart.max_v = -std::numeric_limits<float>::infinity();
+            for(auto t : chart.triangles) {
+                auto &triangle = bsp.triangles[t];
+                for(auto vertex : { triangle.a, triangle.b, triangle.c }) {
+                    auto position = vertex_position(bsp.vertices[vertex]);
+                    float u = dot(position, chart.axis_u);
+                    float v = dot(position, chart.axis_v);
+                    chart.min_u = std::min(chart.min_u, u);
+                    chart.max_u = std::max(chart.max_u, u);
+                    chart.min_v = std::min(chart.min_v, v);
+                    chart.max_v = std::max(chart.max_v, v);
+                }
+            }
+        }
+
+        return charts;
+    }
+
+    // Pack charts into rows from tallest to shortest, returning false if they don't fit
+    bool pack_charts(std::vector<Chart> &charts, std::vector<std::uint32_t> &order, float scale, std::size_t length) {
+        for(auto &chart : charts) {
+            chart.width = static_cast<std::size_t>(std::ceil((chart.max_u - chart.min_u) * scale)) + 1 + CHART_PADDING * 2;
+            chart.height = static_cast<std::size_t>(std::ceil((chart.max_v - chart.min_v) * scale)) + 1 + CHART_PADDING * 2;
+        }
+
+        std::sort(order.begin(), order.end(), [&charts](std::uint32_t a, std::uint32_t b) {
+            return charts[a].height != charts[b].height ? charts[a].height > charts[b].height : a < b;
+        });
+
+        std::size_t x = 0, y = 0, row_height = 0;
+        for(auto c : order) {
+            auto &chart = charts[c];
+            if(chart.width > length) {
+                return false;
+            }
+            if(x + chart.width > length) {
+                y += row_height;
+                x = 0;
+                row_height = 0;
+            }
+            if(y + chart.height > length) {
+                return false;
+            }
+            chart.x = x;
+            chart.y = y;
+            x += chart.width;
+            row_height = std::max(row_height, chart.height);
+        }
+
+        return true;
+    }
+
+    struct Texel {
+        Vector position;
+        Vector surface_normal;
+        Vector shading_normal;
+        bool covered = false;
+    };
+
+    // Charts of one lightmap, already packed
+    struct LightmapLayout {
+        std::vector<Chart> charts;
+    };
+
+    // Find the texels covered by each triangle, storing where they are in the world
+    void rasterize_lightmap(const ExportedModel &bsp, const LightmapLayout &layout, std::size_t length, const std::vector<Vector> &texel_coordinates, const std::vector<std::uint32_t> &uv_indices, std::vector<Texel> &texels) {
+        texels.assign(length * length, Texel {});
+
+        for(auto &chart : layout.charts) {
+            for(auto t : chart.triangles) {
+                auto &triangle = bsp.triangles[t];
+                const ExportedVertex *vertices[3] = { &bsp.vertices[triangle.a], &bsp.vertices[triangle.b], &bsp.vertices[triangle.c] };
+                const Vector *coordinates[3] = { &texel_coordinates[uv_indices[t * 3]], &texel_coordinates[uv_indices[t * 3 + 1]], &texel_coordinates[uv_indices[t * 3 + 2]] };
+                auto surface_normal = triangle_normal(bsp, triangle);
+
+                auto set_texel = [&](std::size_t x, std::size_t y, float w0, float w1, float w2) {
+                    auto &texel = texels[x + y * length];
+                    if(texel.covered) {
+                        return;
+                    }
+                    texel.covered = true;
+                    texel.position = vertex_position(*vertices[0]) * w0 + vertex_position(*vertices[1]) * w1 + vertex_position(*vertices[2]) * w2;
+                    texel.surface_normal = surface_normal;
+                    texel.shading_normal = normalize(Vector { vertices[0]->i, vertices[0]->j, vertices[0]->k } * w0 + Vector { vertices[1]->i, vertices[1]->j, vertices[1]->k } * w1 + Vector { vertices[2]->i, vertices[2]->j, vertices[2]->k } * w2);
+                    if(dot(texel.shading_normal, texel.shading_normal) == 0.0F) {
+                        texel.shading_normal = surface_normal;
+                    }
+                };
+
+                auto &a = *coordinates[0], &b = *coordinates[1], &c = *coordinates[2];
+                float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+                bool covered_any = false;
+
+                if(area != 0.0F && dot(surface_normal, surface_normal) != 0.0F) {
+                    auto to_texel = [&length](float coordinate) {
+                        return static_cast<std::size_t>(std::clamp(coordinate, 0.0F, static_cast<float>(length - 1)));
+                    };
+                    auto min_x = to_texel(std::floor(std::min({ a.x, b.x, c.x }) - 0.5F));
+                    auto max_x = to_texel(std::ceil(std::max({ a.x, b.x, c.x }) - 0.5F));
+                    auto min_y = to_texel(std::floor(std::min({ a.y, b.y, c.y }) - 0.5F));
+                    auto max_y = to_texel(std::ceil(std::max({ a.y, b.y, c.y }) - 0.5F));
+
+                    float inverse_area = 1.0F / area;
+                    for(std::size_t y = min_y; y <= max_y; y++) {
+                        for(std::size_t x = min_x; x <= max_x; x++) {
+                            float px = static_cast<float>(x) + 0.5F;
+                            float py = static_cast<float>(y) + 0.5F;
+                            float w0 = ((c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x)) * inverse_area;
+                            float w1 = ((a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x)) * inverse_area;
+                            float w2 = 1.0F - w0 - w1;
+                            constexpr float EDGE_TOLERANCE = -0.0001F;
+                            if(w0 >= EDGE_TOLERANCE && w1 >= EDGE_TOLERANCE && w2 >= EDGE_TOLERANCE) {
+                                set_texel(x, y, w0, w1, w2);
+                                covered_any = true;
+                            }
+                        }
+                    }
+                }
+
+                // Triangles too thin to cover a texel's center still get the texel their center is in
+                if(!covered_any) {
+                    auto center = (a + b + c) * (1.0F / 3.0F);
+                    auto x = static_cast<std::size_t>(std::clamp(center.x, 0.0F, static_cast<float>(length - 1)));
+                    auto y = static_cast<std::size_t>(std::clamp(center.y, 0.0F, static_cast<float>(length - 1)));
+                    set_texel(x, y, 1.0F / 3.0F, 1.0F / 3.0F, 1.0F / 3.0F);
+                }
+            }
+        }
+    }
+
+    // Hands out tiles to threads. Each thread starts with a contiguous run of tiles and takes from the front of it, and
+    // threads that run out take from the back of another thread's run.
+    class TileScheduler {
+    public:
+        TileScheduler(std::size_t tile_count, std::size_t worker_count) : queues(worker_count) {
+            for(std::size_t w = 0; w < worker_count; w++) {
+                for(std::size_t t = tile_count * w / worker_count; t < tile_count * (w + 1) / worker_count; t++) {
+                    this->queues[w].tiles.emplace_back(t);
+                }
+            }
+        }
+
+        std::optional<std::size_t> next(std::size_t worker) {
+            auto queue_count = this->queues.size();
+            for(std::size_t q = 0; q < queue_count; q++) {
+                auto &queue = this->queues[(worker + q) % queue_count];
+                std::scoped_lock lock(queue.mutex);
+                if(queue.tiles.empty()) {
+                    continue;
+                }
+                std::size_t tile;
+                if(q == 0) {
+                    tile = queue.tiles.front();
+                    queue.tiles.pop_front();
+                }
+                else {
+                    tile = queue.tiles.back();
+                    queue.tiles.pop_back();
+                }
+                return tile;
+            }
+            return std::nullopt;
+        }
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::size_t> tiles;
+        };
+        std::vector<Queue> queues;
+    };
+
+    class ProgressReporter {
+    public:
+        explicit ProgressReporter(std::size_t total) noexcept : total(total), start(std::chrono::steady_clock::now()) {}
+
+        std::atomic<std::size_t> done = 0;
+
+        void report() {
+            auto percent = this->total == 0 ? 100 : this->done * 100 / this->total;
+            if(percent < this->next_percent) {
+                return;
+            }
+            this->next_percent = percent / 10 * 10 + 10;
+            oprintf("Baked %3zu%% of %zu texels (%.1f seconds)\n", static_cast<std::size_t>(percent), this->total, this->elapsed());
+            std::fflush(stdout);
+        }
+
+        double elapsed() const noexcept {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - this->start).count();
+        }
+
+    private:
+        std::size_t total;
+        std::size_t next_percent = 10;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // Spread the color of covered texels into uncovered texels next to them so filtering at chart edges doesn't pull in black
+    void dilate(std::vector<Vector> &colors, std::vector<bool> &covered, std::size_t length, std::size_t iterations) {
+        std::vector<std::size_t> added;
+        for(std::size_t i = 0; i < iterations; i++) {
+            added.clear();
+            for(std::size_t y = 0; y < length; y++) {
+                for(std::size_t x = 0; x < length; x++) {
+                    if(covered[x + y * length]) {
+                        continue;
+                    }
+
+                    Vector sum;
+                    std::size_t count = 0;
+                    for(std::size_t ny = (y == 0 ? 0 : y - 1); ny <= std::min(y + 1, length - 1); ny++) {
+                        for(std::size_t nx = (x == 0 ? 0 : x - 1); nx <= std::min(x + 1, length - 1); nx++) {
+                            if(covered[nx + ny * length]) {
+                                sum += colors[nx + ny * length];
+                                count++;
+                            }
+                        }
+                    }
+                    if(count > 0) {
+                        colors[x + y * length] = sum * (1.0F / static_cast<float>(count));
+                        added.emplace_back(x + y * length);
+                    }
+                }
+            }
+            for(auto a : added) {
+                covered[a] = true;
+            }
+        }
+    }
+}
+
+std::optional<BakeQuality> Invader::Lightmap::BakeQuality_from_string(const char *quality) noexcept {
+    if(std::strcmp(quality, "draft") == 0) {
+        return BakeQuality::BAKE_QUALITY_DRAFT;
+    }
+    else if(std::strcmp(quality, "medium") == 0) {
+        return BakeQuality::BAKE_QUALITY_MEDIUM;
+    }
+    else if(std::strcmp(quality, "high") == 0) {
+        return BakeQuality::BAKE_QUALITY_HIGH;
+    }
+    else if(std::strcmp(quality, "final") == 0) {
+        return BakeQuality::BAKE_QUALITY_FINAL;
+    }
+    return std::nullopt;
+}
+
+BakeParameters Invader::Lightmap::bake_parameters_for_quality(BakeQuality quality) noexcept {
+    BakeParameters parameters;
+    switch(quality) {
+        case BakeQuality::BAKE_QUALITY_DRAFT:
+            parameters.lightmap_length = 256;
+            parameters.texels_per_unit = 4.0F;
+            parameters.samples = 16;
+            parameters.bounces = 1;
+            break;
+        case BakeQuality::BAKE_QUALITY_MEDIUM:
+            parameters.lightmap_length = 512;
+            parameters.texels_per_unit = 8.0F;
+            parameters.samples = 64;
+            parameters.bounces = 2;
+            break;
+        case BakeQuality::BAKE_QUALITY_HIGH:
+            parameters.lightmap_length = 1024;
+            parameters.texels_per_unit = 16.0F;
+            parameters.samples = 256;
+            parameters.bounces = 3;
+            break;
+        case BakeQuality::BAKE_QUALITY_FINAL:
+            parameters.lightmap_length = 1024;
+            parameters.texels_per_unit = 32.0F;
+            parameters.samples = 1024;
+            parameters.bounces = 4;
+            break;
+    }
+    return parameters;
+}
+
+BakedLightmaps Invader::Lightmap::bake_lightmap_mesh(const UnbakedMesh &mesh, const BakeParameters &parameters) {
+    if(mesh.bsps.size() != 1) {
+        eprintf_error("Only 1 BSP can be baked at a time");
+        std::exit(EXIT_FAILURE);
+    }
+
+    auto &bsp = mesh.bsps[0];
+    auto length = parameters.lightmap_length;
+    auto thread_count = std::max<std::size_t>(parameters.threads, 1);
+    auto samples_per_side = std::max<std::size_t>(static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(parameters.samples)))), 1);
+
+    // Bounds check everything first
+    auto check_model = [&mesh](const ExportedModel &model) {
+        for(auto &t : model.triangles) {
+            if(t.a >= model.vertices.size() || t.b >= model.vertices.size() || t.c >= model.vertices.size() || t.material >= mesh.materials.size()) {
+                eprintf_error("%s has an out-of-bounds triangle", model.path.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        for(auto &l : model.lightmaps) {
+            if(l.first_triangle_index > model.triangles.size() || model.triangles.size() - l.first_triangle_index < l.triangle_count) {
+                eprintf_error("%s has an out-of-bounds lightmap", model.path.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    };
+    check_model(bsp);
+    for(auto &model : mesh.models) {
+        check_model(model);
+    }
+    for(auto &object : mesh.objects) {
+        if(object.model >= mesh.models.size()) {
+            eprintf_error("An object has an out-of-bounds model");
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    // Put the BSP and every object into one BVH. Invisible materials don't block or bounce light.
+    std::vector<SceneTriangle> scene_triangles;
+    auto add_triangle = [&scene_triangles, &mesh](const Vector &a, const Vector &b, const Vector &c, std::size_t material) {
+        if(mesh.materials[material].type == ExportedMaterialType::EXPORTED_MATERIAL_TYPE_INVISIBLE) {
+            return;
+        }
+        auto &triangle = scene_triangles.emplace_back();
+        triangle.v0 = a;
+        triangle.edge1 = b - a;
+        triangle.edge2 = c - a;
+        triangle.normal = normalize(cross(triangle.edge1, triangle.edge2));
+        triangle.material = static_cast<std::uint32_t>(material);
+    };
+
+    for(auto &t : bsp.triangles) {
+        add_triangle(vertex_position(bsp.vertices[t.a]), vertex_position(bsp.vertices[t.b]), vertex_position(bsp.vertices[t.c]), t.material);
+    }
+    for(auto &object : mesh.objects) {
+        HEK::Euler3D<HEK::NativeEndian> rotation;
+        rotation.yaw = object.yaw;
+        rotation.pitch = object.pitch;
+        rotation.roll = object.roll;
+        auto matrix = HEK::euler_to_matrix(rotation);
+        Vector position = { object.x, object.y, object.z };
+
+        auto &model = mesh.models[object.model];
+        auto transform = [&model, &matrix, &position](std::size_t vertex_index) {
+            auto &vertex = model.vertices[vertex_index];
+            HEK::Vector3D<HEK::NativeEndian> model_position;
+            model_position.i = vertex.x;
+            model_position.j = vertex.y;
+            model_position.k = vertex.z;
+            auto rotated = HEK::rotate_vector(model_position, matrix);
+            return Vector { rotated.i, rotated.j, rotated.k } + position;
+        };
+        for(auto &t : model.triangles) {
+            add_triangle(transform(t.a), transform(t.b), transform(t.c), t.material);
+        }
+    }
+
+    BVH bvh(scene_triangles);
+    oprintf("Built a BVH with %zu node%s for %zu triangle%s\n", bvh.node_count(), bvh.node_count() == 1 ? "" : "s", scene_triangles.size(), scene_triangles.size() == 1 ? "" : "s");
+    scene_triangles = {};
+
+    Lighting lighting(bvh, mesh, parameters);
+
+    BakedLightmaps result;
+    result.mesh.format_length = length;
+    result.mesh.format_bpp = 32;
+    auto &baked_bsp = result.mesh.bsps.emplace_back();
+    baked_bsp.path = bsp.path;
+    baked_bsp.triangle_storage.resize(bsp.triangles.size());
+
+    // Triangles that aren't in a lightmap use a placeholder vertex
+    std::vector<bool> triangle_in_lightmap(bsp.triangles.size(), false);
+
+    // Chart and pack each lightmap, giving every chart its own copy of its vertices
+    std::vector<LightmapLayout> layouts;
+    std::vector<Vector> texel_coordinates; // position of each baked vertex in texels
+    std::vector<std::uint32_t> uv_indices(bsp.triangles.size() * 3, NO_INDEX);
+    std::vector<std::uint32_t> vertex_chart(bsp.vertices.size(), NO_INDEX);
+    std::vector<std::uint32_t> vertex_uv(bsp.vertices.size(), NO_INDEX);
+    std::uint32_t chart_id = 0;
+
+    // Charts with no area are 1 texel wide plus padding; anything with area is at least 2
+    auto max_charts_per_row = length / (2 + CHART_PADDING * 2);
+    for(std::size_t l = 0; l < bsp.lightmaps.size(); l++) {
+        auto &lightmap = bsp.lightmaps[l];
+        auto &layout = layouts.emplace_back();
+        layout.charts = make_charts(bsp, lightmap);
+
+        auto &charts = layout.charts;
+        if(charts.size() > max_charts_per_row * max_charts_per_row) {
+            eprintf_error("Lightmap %zu has too many surfaces (%zu) to fit in a %zux%zu lightmap", l, charts.size(), length, length);
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Lower the scale until everything fits, starting from about where it would if the charts were perfectly packed
+        double area = 0.0;
+        for(auto &chart : charts) {
+            area += static_cast<double>(chart.max_u - chart.min_u) * static_cast<double>(chart.max_v - chart.min_v);
+        }
+        float scale = parameters.texels_per_unit;
+        if(area > 0.0) {
+            scale = std::min(scale, static_cast<float>(std::sqrt(static_cast<double>(length * length) / area)));
+        }
+
+        std::vector<std::uint32_t> order(charts.size());
+        for(std::size_t c = 0; c < order.size(); c++) {
+            order[c] = static_cast<std::uint32_t>(c);
+        }
+        while(!pack_charts(charts, order, scale, length)) {
+            scale *= 0.95F;
+        }
+
+        // Get the UVs
+        for(auto &chart : charts) {
+            for(auto t : chart.triangles) {
+                auto &triangle = bsp.triangles[t];
+                triangle_in_lightmap[t] = true;
+
+                std::size_t corners[3] = { triangle.a, triangle.b, triangle.c };
+                for(std::size_t corner = 0; corner < 3; corner++) {
+                    auto v = corners[corner];
+                    if(vertex_chart[v] != chart_id) {
+                        vertex_chart[v] = chart_id;
+                        vertex_uv[v] = static_cast<std::uint32_t>(texel_coordinates.size());
+
+                        auto position = vertex_position(bsp.vertices[v]);
+                        auto &coordinate = texel_coordinates.emplace_back();
+                        coordinate.x = static_cast<float>(chart.x + CHART_PADDING) + 0.5F + (dot(position, chart.axis_u) - chart.min_u) * scale;
+                        coordinate.y = static_cast<float>(chart.y + CHART_PADDING) + 0.5F + (dot(position, chart.axis_v) - chart.min_v) * scale;
+                    }
+                    uv_indices[t * 3 + corner] = vertex_uv[v];
+                }
+            }
+            chart_id++;
+        }
+
+        auto &baked_lightmap = baked_bsp.lightmaps.emplace_back();
+        baked_lightmap.first_triangle = lightmap.first_triangle_index;
+        baked_lightmap.triangle_count = lightmap.triangle_count;
+    }
+
+    baked_bsp.vertex_storage.reserve(texel_coordinates.size() + 1);
+    for(auto &coordinate : texel_coordinates) {
+        baked_bsp.vertex_storage.push_back({ coordinate.x / static_cast<float>(length), coordinate.y / static_cast<float>(length) });
+    }
+    for(std::size_t t = 0; t < bsp.triangles.size(); t++) {
+        auto &baked_triangle = baked_bsp.triangle_storage[t];
+        for(std::size_t corner = 0; corner < 3; corner++) {
+            if(!triangle_in_lightmap[t]) {
+                if(baked_bsp.vertex_storage.size() == texel_coordinates.size()) {
+                    baked_bsp.vertex_storage.push_back({ 0.0F, 0.0F });
+                }
+                baked_triangle.vertices[corner] = static_cast<std::uint32_t>(texel_coordinates.size());
+            }
+            else {
+                baked_triangle.vertices[corner] = uv_indices[t * 3 + corner];
+            }
+        }
+    }
+    baked_bsp.vertices = baked_bsp.vertex_storage;
+    baked_bsp.triangles = baked_bsp.triangle_storage;
+
+    // Rasterize every lightmap first so progress can be reported for the whole BSP, keeping the texels to bake them
+    std::vector<std::vector<Texel>> lightmap_texels(layouts.size());
+    std::size_t total_texels = 0;
+    for(std::size_t l = 0; l < layouts.size(); l++) {
+        auto &texels = lightmap_texels[l];
+        rasterize_lightmap(bsp, layouts[l], length, texel_coordinates, uv_indices, texels);
+        total_texels += static_cast<std::size_t>(std::count_if(texels.begin(), texels.end(), [](const Texel &texel) { return texel.covered; }));
+    }
+
+    oprintf("Baking %zu lightmap%s (%zu texel%s) with %zu ray%s per texel, %zu bounce%s, and %zu thread%s\n",
+            layouts.size(), layouts.size() == 1 ? "" : "s",
+            total_texels, total_texels == 1 ? "" : "s",
+            samples_per_side * samples_per_side, samples_per_side * samples_per_side == 1 ? "" : "s",
+            parameters.bounces, parameters.bounces == 1 ? "" : "s",
+            thread_count, thread_count == 1 ? "" : "s");
+    std::fflush(stdout);
+
+    ProgressReporter progress(total_texels);
+    std::atomic<std::size_t> total_rays = 0;
+    auto tiles_per_side = (length + TILE_SIZE - 1) / TILE_SIZE;
+
+    for(std::size_t l = 0; l < layouts.size(); l++) {
+        auto &texels = lightmap_texels[l];
+
+        // Only tiles with something in them need to be baked
+        std::vector<std::size_t> tiles;
+        for(std::size_t tile = 0; tile < tiles_per_side * tiles_per_side; tile++) {
+            auto tile_x = (tile % tiles_per_side) * TILE_SIZE;
+            auto tile_y = (tile / tiles_per_side) * TILE_SIZE;
+            bool any_covered = false;
+            for(std::size_t y = tile_y; y < std::min(tile_y + TILE_SIZE, length) && !any_covered; y++) {
+                for(std::size_t x = tile_x; x < std::min(tile_x + TILE_SIZE, length) && !any_covered; x++) {
+                    any_covered = texels[x + y * length].covered;
+                }
+            }
+            if(any_covered) {
+                tiles.emplace_back(tile);
+            }
+        }
+
+        std::vector<Vector> colors(length * length);
+        TileScheduler scheduler(tiles.size(), thread_count);
+        std::atomic<std::size_t> workers_done = 0;
+
+        auto work = [&, l](std::size_t worker) {
+            std::size_t rays = 0;
+            while(auto tile_index = scheduler.next(worker)) {
+                auto tile = tiles[*tile_index];
+                auto tile_x = (tile % tiles_per_side) * TILE_SIZE;
+                auto tile_y = (tile / tiles_per_side) * TILE_SIZE;
+                std::size_t baked = 0;
+                for(std::size_t y = tile_y; y < std::min(tile_y + TILE_SIZE, length); y++) {
+                    for(std::size_t x = tile_x; x < std::min(tile_x + TILE_SIZE, length); x++) {
+                        auto index = x + y * length;
+                        auto &texel = texels[index];
+                        if(!texel.covered) {
+                            continue;
+                        }
+                        Random random((static_cast<std::uint64_t>(l) << 40) | index);
+                        colors[index] = lighting.gather(texel.position, texel.surface_normal, texel.shading_normal, samples_per_side, random, rays);
+                        baked++;
+                    }
+                }
+                progress.done += baked;
+            }
+            total_rays += rays;
+            workers_done++;
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count);
+        for(std::size_t w = 0; w < thread_count; w++) {
+            threads.emplace_back(work, w);
+        }
+        while(workers_done < thread_count) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            progress.report();
+        }
+        for(auto &t : threads) {
+            t.join();
+        }
+
+        // Fill in the padding and write the image
+        std::vector<bool> covered(length * length);
+        for(std::size_t t = 0; t < texels.size(); t++) {
+            covered[t] = texels[t].covered;
+        }
+        dilate(colors, covered, length, CHART_PADDING * 2);
+        texels = {}; // we don't need these anymore
+
+        auto &image = result.images.emplace_back();
+        image.width = length;
+        image.height = length;
+        image.pixels.resize(length * length * 4);
+        auto to_byte = [](float value) {
+            return static_cast<std::uint8_t>(std::clamp(value, 0.0F, 1.0F) * 255.0F + 0.5F);
+        };
+        for(std::size_t t = 0; t < colors.size(); t++) {
+            auto *pixel = image.pixels.data() + t * 4;
+            pixel[0] = to_byte(colors[t].x);
+            pixel[1] = to_byte(colors[t].y);
+            pixel[2] = to_byte(colors[t].z);
+            pixel[3] = 0xFF;
+        }
+    }
+
+    progress.report();
+    auto seconds = progress.elapsed();
+    oprintf("Traced %zu rays in %.1f seconds (%.2f million rays per second)\n", total_rays.load(), seconds, seconds > 0.0 ? total_rays.load() / seconds / 1000000.0 : 0.0);
+
+    return result;
+}
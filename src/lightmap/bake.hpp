@@ -0,0 +1,79 @@
+#ifndef INVADER__LIGHTMAP__BAKE_HPP
+#define INVADER__LIGHTMAP__BAKE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <optional>
+
+#include "mesh.hpp"
+
+namespace Invader::Lightmap {
+    enum BakeQuality {
+        BAKE_QUALITY_DRAFT,
+        BAKE_QUALITY_MEDIUM,
+        BAKE_QUALITY_HIGH,
+        BAKE_QUALITY_FINAL
+    };
+
+    struct BakeParameters {
+        /** Width and height of each lightmap in texels */
+        std::size_t lightmap_length = 512;
+
+        /** Texels per world unit; this is lowered if a lightmap's surfaces don't fit */
+        float texels_per_unit = 8.0F;
+
+        /** Rays gathered per texel; this is rounded up to a square number so the rays can be stratified */
+        std::size_t samples = 64;
+
+        /** Number of times light is bounced off of surfaces */
+        std::size_t bounces = 2;
+
+        /** Fraction of the light that surfaces reflect (meshes do not have surface colors) */
+        float reflectance = 0.5F;
+
+        /** Number of threads to bake with */
+        std::size_t threads = 1;
+    };
+
+    /**
+     * Get the quality from a string
+     * @param  quality quality string ("draft", "medium", "high", or "final")
+     * @return         quality if valid
+     */
+    std::optional<BakeQuality> BakeQuality_from_string(const char *quality) noexcept;
+
+    /**
+     * Get the parameters for a quality preset
+     * @param quality quality
+     * @return        parameters (using one thread)
+     */
+    BakeParameters bake_parameters_for_quality(BakeQuality quality) noexcept;
+
+    struct BakedLightmapImage {
+        std::size_t width = 0;
+        std::size_t height = 0;
+
+        /** 8-bit RGBA pixels, row by row from the top */
+        std::vector<std::uint8_t> pixels;
+    };
+
+    struct BakedLightmaps {
+        /** Lightmap UVs for the BSP; image filenames are left empty */
+        BakedMesh mesh;
+
+        /** One image for each of the BSP's lightmaps */
+        std::vector<BakedLightmapImage> images;
+    };
+
+    /**
+     * Bake the BSP's lightmaps on the CPU. The BSP and objects cast shadows and bounce light, and the sky's lights and
+     * ambient radiosity as well as emissive materials light it.
+     * @param mesh       mesh to bake
+     * @param parameters parameters to bake with
+     * @return           lightmap UVs and images
+     */
+    BakedLightmaps bake_lightmap_mesh(const UnbakedMesh &mesh, const BakeParameters &parameters);
+}
+
+#endif
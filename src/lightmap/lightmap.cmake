@@ -8,6 +8,8 @@ if(${INVADER_LIGHTMAP})
     add_executable(invader-lightmap
         src/lightmap/lightmap.cpp
         src/lightmap/actions.cpp
+        src/lightmap/mesh.cpp
+        src/lightmap/bake.cpp
     )
 
     target_link_libraries(invader-lightmap invader ${INVADER_CRT_NOGLOB})
@@ -4,6 +4,7 @@
 #include <climits>
 #include <vector>
 #include <optional>
+#include <thread>
 
 #include "../command_line_option.hpp"
 #include <invader/printf.hpp>
@@ -11,10 +12,12 @@
 #include <invader/version.hpp>
 
 #include "actions.hpp"
+#include "bake.hpp"
 
 enum LightmapMode {
     LIGHTMAP_EXPORT,
-    LIGHTMAP_IMPORT
+    LIGHTMAP_IMPORT,
+    LIGHTMAP_BAKE
 };
 
 int main(int argc, const char **argv) {
@@ -28,6 +31,9 @@ int main(int argc, const char **argv) {
         //std::filesystem::path data = "data";
         bool filesystem_path = false;
         std::filesystem::path data = "data";
+        MeshFormat format = MeshFormat::MESH_FORMAT_TEXT;
+        BakeQuality quality = BakeQuality::BAKE_QUALITY_MEDIUM;
+        std::size_t threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
         
         std::optional<LightmapMode> mode;
     } shadowmouse_options;
@@ -38,10 +44,14 @@ int main(int argc, const char **argv) {
         CommandLineOption::from_preset(CommandLineOption::PRESET_COMMAND_LINE_OPTION_DATA),
         CommandLineOption::from_preset(CommandLineOption::PRESET_COMMAND_LINE_OPTION_TAGS_MULTIPLE),
         CommandLineOption("export-mesh", 'E', 0, "Export a lightmap mesh to be imported and baked using an external program."),
-        CommandLineOption("import-mesh", 'I', 0, "Import a lightmap mesh that was baked.")
+        CommandLineOption("import-mesh", 'I', 0, "Import a lightmap mesh that was baked. Text and binary meshes are both accepted."),
+        CommandLineOption("binary", 'b', 0, "Export the lightmap mesh in the binary format rather than as text."),
+        CommandLineOption("bake", 'B', 0, "Bake lightmaps on the CPU and import them without using an external program. The lightmaps are written into the BSP's lightmaps bitmap tag."),
+        CommandLineOption("quality", 'q', 1, "Set the quality to bake lightmaps with. Can be: draft, medium, high, or final. Default: medium", "<quality>"),
+        CommandLineOption("threads", 'j', 1, "Set the number of threads to bake lightmaps with. Default: CPU thread count", "<#>")
     };
 
-    static constexpr char DESCRIPTION[] = "Generate meshes to bake lightmaps using Blender's Cycles renderer.";
+    static constexpr char DESCRIPTION[] = "Generate meshes to bake lightmaps using Blender's Cycles renderer, or bake lightmaps on the CPU.";
     static constexpr char USAGE[] = "<options> <scenario-path> <bsp-name>";
 
     auto remaining_arguments = Invader::CommandLineOption::parse_arguments<LightmapOptions &>(argc, argv, options, USAGE, DESCRIPTION, 2, 2, shadowmouse_options, [](char opt, const auto &args, LightmapOptions &shadowmouse_options) {
@@ -61,6 +71,34 @@ int main(int argc, const char **argv) {
             case 'P':
                 shadowmouse_options.filesystem_path = true;
                 break;
+            case 'b':
+                shadowmouse_options.format = MeshFormat::MESH_FORMAT_BINARY;
+                break;
+            case 'B':
+                shadowmouse_options.mode = LightmapMode::LIGHTMAP_BAKE;
+                break;
+            case 'q': {
+                auto quality = BakeQuality_from_string(args[0]);
+                if(!quality.has_value()) {
+                    eprintf_error("Unknown quality %s (should be \"draft\", \"medium\", \"high\", or \"final\")", args[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                shadowmouse_options.quality = *quality;
+                break;
+            }
+            case 'j':
+                try {
+                    int threads = std::stoi(args[0]);
+                    if(threads < 1) {
+                        throw std::exception();
+                    }
+                    shadowmouse_options.threads = static_cast<std::size_t>(threads);
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid number of threads %s", args[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
             case 'i':
                 show_version_info();
                 std::exit(EXIT_SUCCESS);
@@ -101,10 +139,8 @@ int main(int argc, const char **argv) {
     
     switch(*shadowmouse_options.mode) {
         case LightmapMode::LIGHTMAP_EXPORT: {
-            auto output = export_lightmap_mesh(scenario_tag.c_str(), bsp_name.c_str(), shadowmouse_options.tags);
-            auto *data = reinterpret_cast<const std::byte *>(output.c_str());
-            auto *data_end = data + output.size();
-            if(!File::save_file(mesh_file, std::vector<std::byte>(data, data_end))) {
+            auto mesh = export_lightmap_mesh(scenario_tag.c_str(), bsp_name.c_str(), shadowmouse_options.tags);
+            if(!File::save_file(mesh_file, write_unbaked_mesh(mesh, shadowmouse_options.format))) {
                 eprintf_error("Failed to save %s", mesh_file.string().c_str());
                 return EXIT_FAILURE;
             }
@@ -112,9 +148,22 @@ int main(int argc, const char **argv) {
             break;
         }
         case LightmapMode::LIGHTMAP_IMPORT: {
-            auto input_bytes = Invader::File::open_file(mesh_file).value();
-            auto input = std::string(reinterpret_cast<const char *>(input_bytes.data()), input_bytes.size());
-            import_lightmap_mesh(input, mesh_file, scenario_tag.c_str(), bsp_name.c_str(), shadowmouse_options.tags);
+            auto mesh = read_baked_mesh(mesh_file);
+            save_lightmap_tag(generate_lightmap_mesh_tag(mesh, scenario_tag.c_str(), bsp_name.c_str(), shadowmouse_options.tags));
+            break;
+        }
+        case LightmapMode::LIGHTMAP_BAKE: {
+            auto mesh = export_lightmap_mesh(scenario_tag.c_str(), bsp_name.c_str(), shadowmouse_options.tags);
+            auto parameters = bake_parameters_for_quality(shadowmouse_options.quality);
+            parameters.threads = shadowmouse_options.threads;
+            auto baked = bake_lightmap_mesh(mesh, parameters);
+            
+            // Generate both tags before saving either so neither is touched if the other fails
+            auto bitmap_tag = generate_lightmap_images_tag(baked, shadowmouse_options.tags);
+            auto bsp_tag = generate_lightmap_mesh_tag(baked.mesh, scenario_tag.c_str(), bsp_name.c_str(), shadowmouse_options.tags);
+            save_lightmap_tag(bitmap_tag);
+            save_lightmap_tag(bsp_tag);
+            oprintf_success("Baked %zu lightmap%s", baked.images.size(), baked.images.size() == 1 ? "" : "s");
             break;
         }
     }
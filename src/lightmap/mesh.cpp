@@ -0,0 +1,641 @@
+#include "mesh.hpp"
+
+#include <invader/printf.hpp>
+#include <invader/hek/endian.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+using namespace Invader;
+using namespace Invader::Lightmap;
+
+static const char *EXPORTED_MATERIAL_TYPE_STR[] = {
+    "opaque",
+    "invisible"
+};
+
+namespace {
+    // Appends the text form to the output
+    class MeshTextWriter {
+    public:
+        MeshTextWriter(std::vector<std::byte> &output) noexcept : output(output) {}
+
+        void write(std::string_view string) {
+            auto *data = reinterpret_cast<const std::byte *>(string.data());
+            this->output.insert(this->output.end(), data, data + string.size());
+        }
+
+        void write_quoted(std::string_view string) {
+            this->write("\"");
+            this->write(string);
+            this->write("\"");
+        }
+
+        void write_integer(std::size_t value) {
+            char buffer[32];
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            this->write(std::string_view(buffer, result.ptr - buffer));
+        }
+
+        // Write the number with up to 6 decimal places, removing trailing zeroes (and the decimal point if nothing is left after it)
+        void write_float(float value) {
+            char buffer[512];
+            auto *end = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, 6).ptr;
+
+            auto *decimal_point = std::find(buffer, end, '.');
+            if(decimal_point != end) {
+                while(end[-1] == '0') {
+                    end--;
+                }
+                if(end[-1] == '.') {
+                    end--;
+                }
+            }
+
+            this->write(std::string_view(buffer, end - buffer));
+        }
+
+        // Write each number with a space before it
+        template <typename... Args> void write_floats(Args... values) {
+            ((this->write(" "), this->write_float(values)), ...);
+        }
+
+    private:
+        std::vector<std::byte> &output;
+    };
+
+    // Appends the binary form to the output
+    class MeshBinaryWriter {
+    public:
+        MeshBinaryWriter(std::vector<std::byte> &output) noexcept : output(output) {}
+
+        void write_u32(std::size_t value) {
+            if(value > UINT32_MAX) {
+                eprintf_error("Mesh is too large to write in the binary format (%zu > %u)", value, UINT32_MAX);
+                std::exit(EXIT_FAILURE);
+            }
+            HEK::LittleEndian<std::uint32_t> value_le = static_cast<std::uint32_t>(value);
+            this->output.insert(this->output.end(), value_le.value, value_le.value + sizeof(value_le.value));
+        }
+
+        template <typename... Args> void write_f32(Args... values) {
+            auto write_one = [this](float value) {
+                HEK::LittleEndian<float> value_le = value;
+                this->output.insert(this->output.end(), value_le.value, value_le.value + sizeof(value_le.value));
+            };
+            (write_one(values), ...);
+        }
+
+        void write_string(std::string_view string) {
+            this->write_u32(string.size());
+            auto *data = reinterpret_cast<const std::byte *>(string.data());
+            this->output.insert(this->output.end(), data, data + string.size());
+            this->output.resize(this->output.size() + (4 - string.size() % 4) % 4);
+        }
+
+        // Start a record, returning where its size goes
+        std::size_t begin_record(MeshRecordType type) {
+            this->write_u32(type);
+            auto size_offset = this->output.size();
+            this->write_u32(0);
+            return size_offset;
+        }
+
+        void end_record(std::size_t size_offset) {
+            HEK::LittleEndian<std::uint32_t> size = static_cast<std::uint32_t>(this->output.size() - size_offset - sizeof(std::uint32_t));
+            std::copy(size.value, size.value + sizeof(size.value), this->output.begin() + size_offset);
+        }
+
+    private:
+        std::vector<std::byte> &output;
+    };
+
+    // Reads tokens straight out of the buffer without copying it. Tokens are separated by whitespace, and quoted tokens can have whitespace in them.
+    class MeshTokenizer {
+    public:
+        MeshTokenizer(const char *begin, const char *end, const std::filesystem::path &path) noexcept : cursor(begin), end(end), path(path) {}
+
+        std::optional<std::string_view> next_token() {
+            while(this->cursor != this->end && is_space(*this->cursor)) {
+                if(*this->cursor == '\n') {
+                    this->line++;
+                }
+                this->cursor++;
+            }
+            if(this->cursor == this->end) {
+                return std::nullopt;
+            }
+
+            this->token_line = this->line;
+
+            // Quoted tokens go up to the next quote
+            if(*this->cursor == '"') {
+                const char *token_start = this->cursor + 1;
+                const char *token_end = std::find(token_start, this->end, '"');
+                if(token_end == this->end) {
+                    this->fail("Unterminated quote");
+                }
+                this->line += std::count(token_start, token_end, '\n');
+                this->cursor = token_end + 1;
+                if(this->cursor != this->end && !is_space(*this->cursor)) {
+                    this->fail("Expected whitespace after a quote");
+                }
+                return std::string_view(token_start, token_end - token_start);
+            }
+
+            const char *token_start = this->cursor;
+            while(this->cursor != this->end && !is_space(*this->cursor)) {
+                if(*this->cursor == '"') {
+                    this->fail("Unexpected quote");
+                }
+                this->cursor++;
+            }
+            return std::string_view(token_start, this->cursor - token_start);
+        }
+
+        std::string_view expect_token(const char *what) {
+            auto token = this->next_token();
+            if(!token.has_value()) {
+                this->fail(what);
+            }
+            return *token;
+        }
+
+        float next_float(const char *what) {
+            auto token = this->expect_token(what);
+            float value = 0.0F;
+            auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+            if(result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+                this->fail(what);
+            }
+            return value;
+        }
+
+        std::size_t next_size(const char *what) {
+            auto token = this->expect_token(what);
+            std::size_t value = 0;
+            auto result = std::from_chars(token.data(), token.data() + token.size(), value, 10);
+            if(result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+                this->fail(what);
+            }
+            return value;
+        }
+
+        [[noreturn]] void fail(const std::string &what) {
+            eprintf_error("Failed to parse %s on line %zu: %s", this->path.string().c_str(), this->token_line, what.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+
+    private:
+        const char *cursor;
+        const char *end;
+        const std::filesystem::path &path;
+        std::size_t line = 1;
+        std::size_t token_line = 1;
+
+        static bool is_space(char c) noexcept {
+            return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+        }
+    };
+
+    // Reads the binary form. Arrays are used in place.
+    class MeshBinaryReader {
+    public:
+        MeshBinaryReader(const std::byte *begin, const std::byte *end, const std::filesystem::path &path) noexcept : cursor(begin), end(end), path(path) {}
+
+        bool at_end() const noexcept {
+            return this->cursor == this->end;
+        }
+
+        std::size_t remaining() const noexcept {
+            return this->end - this->cursor;
+        }
+
+        const std::byte *read_bytes(std::size_t size, const char *what) {
+            if(size > this->remaining()) {
+                this->fail(what);
+            }
+            auto *bytes = this->cursor;
+            this->cursor += size;
+            return bytes;
+        }
+
+        std::uint32_t read_u32(const char *what) {
+            return reinterpret_cast<const HEK::LittleEndian<std::uint32_t> *>(this->read_bytes(sizeof(std::uint32_t), what))->read();
+        }
+
+        float read_f32(const char *what) {
+            return reinterpret_cast<const HEK::LittleEndian<float> *>(this->read_bytes(sizeof(float), what))->read();
+        }
+
+        std::string_view read_string(const char *what) {
+            std::size_t length = this->read_u32(what);
+            auto *characters = reinterpret_cast<const char *>(this->read_bytes(length, what));
+            this->read_bytes((4 - length % 4) % 4, what);
+            return std::string_view(characters, length);
+        }
+
+        // Everything is 4-byte aligned, so arrays of 32-bit values can be used directly on little endian hosts; on big
+        // endian hosts, each value is swapped into storage instead
+        template <typename T> std::span<const T> read_array(std::size_t count, std::vector<T> &storage, const char *what) {
+            static_assert(sizeof(T) % sizeof(std::uint32_t) == 0 && alignof(T) == alignof(std::uint32_t));
+            if(count > this->remaining() / sizeof(T)) {
+                this->fail(what);
+            }
+            auto *bytes = this->read_bytes(count * sizeof(T), what);
+            if constexpr(std::endian::native == std::endian::little) {
+                return std::span<const T>(reinterpret_cast<const T *>(bytes), count);
+            }
+            else {
+                storage.resize(count);
+                auto *words = reinterpret_cast<const HEK::LittleEndian<std::uint32_t> *>(bytes);
+                auto *output = reinterpret_cast<std::byte *>(storage.data());
+                for(std::size_t w = 0; w < count * sizeof(T) / sizeof(std::uint32_t); w++) {
+                    std::uint32_t word = words[w].read();
+                    std::memcpy(output + w * sizeof(word), &word, sizeof(word));
+                }
+                return storage;
+            }
+        }
+
+        // Read a record, returning its type and a reader for its contents
+        std::pair<std::uint32_t, MeshBinaryReader> read_record() {
+            auto type = this->read_u32("Truncated record");
+            auto size = this->read_u32("Truncated record");
+            if(size % 4 != 0) {
+                this->fail("Record size is not a multiple of 4");
+            }
+            auto *contents = this->read_bytes(size, "Record is out of bounds");
+            return { type, MeshBinaryReader(contents, contents + size, this->path) };
+        }
+
+        [[noreturn]] void fail(const char *what) {
+            eprintf_error("Failed to parse %s: %s", this->path.string().c_str(), what);
+            std::exit(EXIT_FAILURE);
+        }
+
+    private:
+        const std::byte *cursor;
+        const std::byte *end;
+        const std::filesystem::path &path;
+    };
+}
+
+static std::vector<std::byte> write_unbaked_mesh_text(const UnbakedMesh &mesh) {
+    std::vector<std::byte> output;
+
+    // Vertices and triangles are by far the biggest part, at around 30-40 characters each
+    std::size_t expected_size = 4096;
+    for(auto *models : { &mesh.bsps, &mesh.models }) {
+        for(auto &m : *models) {
+            expected_size += m.vertices.size() * 40 + m.triangles.size() * 32;
+        }
+    }
+    output.reserve(expected_size);
+
+    MeshTextWriter writer(output);
+
+    // Put the version in it
+    writer.write("version ");
+    writer.write_integer(MESH_FORMAT_VERSION);
+    writer.write(" unbaked\n");
+
+    // Add skies
+    for(auto &s : mesh.skies) {
+        writer.write("sky ");
+        writer.write_quoted(s.path);
+        writer.write_floats(s.outdoor_power, s.outdoor_red, s.outdoor_green, s.outdoor_blue);
+        writer.write(" {\n");
+        for(auto &l : s.lights) {
+            writer.write(" light");
+            writer.write_floats(l.power, l.red, l.green, l.blue, l.yaw, l.pitch);
+            writer.write("\n");
+        }
+        writer.write("}\n");
+    }
+
+    // Add materials
+    for(auto &mat : mesh.materials) {
+        writer.write("material ");
+        writer.write_quoted(mat.path);
+        writer.write(" ");
+        writer.write(EXPORTED_MATERIAL_TYPE_STR[mat.type]);
+        writer.write_floats(mat.power);
+        writer.write(" rgb");
+        writer.write_floats(mat.emission_red, mat.emission_green, mat.emission_blue); // todo: add image sampling (base64 of pixel data maybe - `image <base64>` vs `rgb <red> <green> <blue>`)
+        writer.write("\n");
+    }
+
+    // Add models
+    auto write_model = [&writer](const ExportedModel &m, const char *type) {
+        writer.write(type);
+        writer.write(" ");
+        writer.write_quoted(m.path);
+        writer.write(" {\n");
+        for(auto &v : m.vertices) {
+            writer.write(" vertex");
+            writer.write_floats(v.x, v.y, v.z);
+            writer.write("\n");
+        }
+        for(auto &t : m.triangles) {
+            writer.write(" triangle ");
+            writer.write_integer(t.a);
+            writer.write(" ");
+            writer.write_integer(t.b);
+            writer.write(" ");
+            writer.write_integer(t.c);
+            writer.write(" ");
+            writer.write_integer(t.material);
+            writer.write("\n");
+        }
+        for(auto &l : m.lightmaps) {
+            writer.write(" lightmap ");
+            writer.write_integer(l.first_triangle_index);
+            writer.write(" ");
+            writer.write_integer(l.triangle_count);
+            writer.write("\n");
+        }
+        writer.write("}\n");
+    };
+
+    for(auto &m : mesh.bsps) {
+        write_model(m, "scenario_structure_bsp");
+    }
+
+    for(auto &m : mesh.models) {
+        write_model(m, "model");
+    }
+
+    // Add objects
+    for(auto &o : mesh.objects) {
+        writer.write("object ");
+        writer.write_integer(o.model);
+        writer.write_floats(o.x, o.y, o.z, o.yaw, o.pitch, o.roll);
+        writer.write("\n");
+    }
+
+    return output;
+}
+
+static std::vector<std::byte> write_unbaked_mesh_binary(const UnbakedMesh &mesh) {
+    std::vector<std::byte> output;
+
+    std::size_t expected_size = 4096;
+    for(auto *models : { &mesh.bsps, &mesh.models }) {
+        for(auto &m : *models) {
+            expected_size += m.vertices.size() * sizeof(float) * 6 + m.triangles.size() * sizeof(std::uint32_t) * 4 + m.lightmaps.size() * sizeof(std::uint32_t) * 2;
+        }
+    }
+    output.reserve(expected_size);
+
+    MeshBinaryWriter writer(output);
+    auto *magic = reinterpret_cast<const std::byte *>(MESH_BINARY_MAGIC);
+    output.insert(output.end(), magic, magic + sizeof(MESH_BINARY_MAGIC));
+    writer.write_u32(MESH_FORMAT_VERSION);
+    writer.write_u32(0); // unbaked
+
+    for(auto &s : mesh.skies) {
+        auto record = writer.begin_record(MeshRecordType::MESH_RECORD_TYPE_SKY);
+        writer.write_string(s.path);
+        writer.write_f32(s.outdoor_power, s.outdoor_red, s.outdoor_green, s.outdoor_blue);
+        writer.write_f32(s.indoor_power, s.indoor_red, s.indoor_green, s.indoor_blue);
+        writer.write_u32(s.lights.size());
+        for(auto &l : s.lights) {
+            writer.write_f32(l.power, l.red, l.green, l.blue, l.yaw, l.pitch);
+        }
+        writer.end_record(record);
+    }
+
+    for(auto &mat : mesh.materials) {
+        auto record = writer.begin_record(MeshRecordType::MESH_RECORD_TYPE_MATERIAL);
+        writer.write_string(mat.path);
+        writer.write_u32(mat.type);
+        writer.write_f32(mat.power, mat.emission_red, mat.emission_green, mat.emission_blue);
+        writer.end_record(record);
+    }
+
+    auto write_model = [&writer](const ExportedModel &m, MeshRecordType type) {
+        auto record = writer.begin_record(type);
+        writer.write_string(m.path);
+        writer.write_u32(m.vertices.size());
+        writer.write_u32(m.triangles.size());
+        writer.write_u32(m.lightmaps.size());
+        for(auto &v : m.vertices) {
+            writer.write_f32(v.x, v.y, v.z, v.i, v.j, v.k);
+        }
+        for(auto &t : m.triangles) {
+            writer.write_u32(t.a);
+            writer.write_u32(t.b);
+            writer.write_u32(t.c);
+            writer.write_u32(t.material);
+        }
+        for(auto &l : m.lightmaps) {
+            writer.write_u32(l.first_triangle_index);
+            writer.write_u32(l.triangle_count);
+        }
+        writer.end_record(record);
+    };
+
+    for(auto &m : mesh.bsps) {
+        write_model(m, MeshRecordType::MESH_RECORD_TYPE_BSP);
+    }
+
+    for(auto &m : mesh.models) {
+        write_model(m, MeshRecordType::MESH_RECORD_TYPE_MODEL);
+    }
+
+    for(auto &o : mesh.objects) {
+        auto record = writer.begin_record(MeshRecordType::MESH_RECORD_TYPE_OBJECT);
+        writer.write_u32(o.model);
+        writer.write_f32(o.x, o.y, o.z, o.yaw, o.pitch, o.roll);
+        writer.end_record(record);
+    }
+
+    return output;
+}
+
+std::vector<std::byte> Invader::Lightmap::write_unbaked_mesh(const UnbakedMesh &mesh, MeshFormat format) {
+    switch(format) {
+        case MeshFormat::MESH_FORMAT_TEXT:
+            return write_unbaked_mesh_text(mesh);
+        case MeshFormat::MESH_FORMAT_BINARY:
+            return write_unbaked_mesh_binary(mesh);
+    }
+    std::terminate();
+}
+
+static void read_baked_mesh_text(BakedMesh &mesh, const std::filesystem::path &path) {
+    auto *data = reinterpret_cast<const char *>(mesh.file->data());
+    auto *data_end = data + mesh.file->size();
+
+    if(data_end != data && data_end[-1] != '\n') {
+        eprintf_error("Failed to parse %s: It does not end with a newline", path.string().c_str());
+        std::exit(EXIT_FAILURE);
+    }
+
+    MeshTokenizer tokenizer(data, data_end, path);
+
+    // Version
+    auto version = tokenizer.next_token();
+    if(!version.has_value()) {
+        eprintf_error("Failed to parse %s: No tokens were read", path.string().c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    if(*version != "version") {
+        tokenizer.fail("Input mesh does not start with a version");
+    }
+    if(tokenizer.next_size("Input mesh does not have a supported version") != MESH_FORMAT_VERSION) {
+        tokenizer.fail("Input mesh does not have a supported version");
+    }
+    if(tokenizer.next_token() != "baked") {
+        tokenizer.fail("Input mesh is not baked");
+    }
+
+    std::optional<std::size_t> format_length, format_bpp;
+
+    while(true) {
+        auto command_maybe = tokenizer.next_token();
+        if(!command_maybe.has_value()) {
+            break; // done
+        }
+        auto &command = *command_maybe;
+
+        // Format
+        if(command == "format") {
+            format_length = tokenizer.next_size("Invalid format specified");
+            format_bpp = tokenizer.next_size("Invalid format specified");
+        }
+        // BSP
+        else if(command == "scenario_structure_bsp") {
+            auto &bsp = mesh.bsps.emplace_back();
+            bsp.path = tokenizer.expect_token("Invalid BSP specified");
+
+            // Block
+            if(tokenizer.next_token() != "{") {
+                tokenizer.fail("Invalid BSP specified");
+            }
+
+            while(true) {
+                auto subcommand = tokenizer.expect_token("Invalid BSP specified");
+
+                // Done
+                if(subcommand == "}") {
+                    break;
+                }
+                else if(subcommand == "vertex") {
+                    auto u = tokenizer.next_float("Invalid vertex specified");
+                    auto v = tokenizer.next_float("Invalid vertex specified");
+                    bsp.vertex_storage.emplace_back() = { u, v };
+                }
+                else if(subcommand == "triangle") {
+                    auto &triangle = bsp.triangle_storage.emplace_back();
+                    for(auto &vertex : triangle.vertices) {
+                        auto index = tokenizer.next_size("Invalid triangle specified");
+                        if(index > UINT32_MAX) {
+                            tokenizer.fail("Invalid triangle specified");
+                        }
+                        vertex = static_cast<std::uint32_t>(index);
+                    }
+                }
+                else if(subcommand == "lightmap") {
+                    auto &lightmap = bsp.lightmaps.emplace_back();
+                    lightmap.first_triangle = tokenizer.next_size("Invalid lightmap specified");
+                    lightmap.triangle_count = tokenizer.next_size("Invalid lightmap specified");
+                    lightmap.image_filename = tokenizer.expect_token("Invalid lightmap specified");
+                }
+                else {
+                    tokenizer.fail("Unknown " + std::string(command) + " command " + std::string(subcommand));
+                }
+            }
+
+            bsp.vertices = bsp.vertex_storage;
+            bsp.triangles = bsp.triangle_storage;
+        }
+        else {
+            tokenizer.fail("Unrecognized command \"" + std::string(command) + "\"");
+        }
+    }
+
+    if(!format_length.has_value() || !format_bpp.has_value()) {
+        eprintf_error("Input mesh does not specify a format.");
+        std::exit(EXIT_FAILURE);
+    }
+
+    mesh.format_length = *format_length;
+    mesh.format_bpp = *format_bpp;
+}
+
+static void read_baked_mesh_binary(BakedMesh &mesh, const std::filesystem::path &path) {
+    auto *data = mesh.file->data();
+    MeshBinaryReader reader(data + sizeof(MESH_BINARY_MAGIC), data + mesh.file->size(), path);
+
+    if(reader.read_u32("Missing version") != MESH_FORMAT_VERSION) {
+        reader.fail("Input mesh does not have a supported version");
+    }
+    if(reader.read_u32("Missing baked flag") != 1) {
+        reader.fail("Input mesh is not baked");
+    }
+
+    bool format_read = false;
+
+    while(!reader.at_end()) {
+        auto [type, record] = reader.read_record();
+        switch(type) {
+            case MeshRecordType::MESH_RECORD_TYPE_FORMAT:
+                mesh.format_length = record.read_u32("Invalid format specified");
+                mesh.format_bpp = record.read_u32("Invalid format specified");
+                format_read = true;
+                break;
+            case MeshRecordType::MESH_RECORD_TYPE_BSP: {
+                auto &bsp = mesh.bsps.emplace_back();
+                bsp.path = record.read_string("Invalid BSP specified");
+                std::size_t vertex_count = record.read_u32("Invalid BSP specified");
+                std::size_t triangle_count = record.read_u32("Invalid BSP specified");
+                std::size_t lightmap_count = record.read_u32("Invalid BSP specified");
+                bsp.vertices = record.read_array(vertex_count, bsp.vertex_storage, "Invalid vertex specified");
+                bsp.triangles = record.read_array(triangle_count, bsp.triangle_storage, "Invalid triangle specified");
+                if(lightmap_count > record.remaining() / (sizeof(std::uint32_t) * 3)) {
+                    record.fail("Invalid lightmap specified");
+                }
+                bsp.lightmaps.reserve(lightmap_count);
+                for(std::size_t l = 0; l < lightmap_count; l++) {
+                    auto &lightmap = bsp.lightmaps.emplace_back();
+                    lightmap.first_triangle = record.read_u32("Invalid lightmap specified");
+                    lightmap.triangle_count = record.read_u32("Invalid lightmap specified");
+                    lightmap.image_filename = record.read_string("Invalid lightmap specified");
+                }
+                break;
+            }
+            default:
+                break; // skip anything we don't know about
+        }
+    }
+
+    if(!format_read) {
+        eprintf_error("Input mesh does not specify a format.");
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+BakedMesh Invader::Lightmap::read_baked_mesh(const std::filesystem::path &path) {
+    BakedMesh mesh;
+    mesh.file = File::MemoryMappedFile::map_file(path);
+    if(!mesh.file.has_value()) {
+        eprintf_error("Failed to read %s", path.string().c_str());
+        std::exit(EXIT_FAILURE);
+    }
+
+    // Binary meshes start with the magic; text meshes start with "version"
+    if(mesh.file->size() >= sizeof(MESH_BINARY_MAGIC) && std::memcmp(mesh.file->data(), MESH_BINARY_MAGIC, sizeof(MESH_BINARY_MAGIC)) == 0) {
+        read_baked_mesh_binary(mesh, path);
+    }
+    else {
+        read_baked_mesh_text(mesh, path);
+    }
+
+    return mesh;
+}
@@ -0,0 +1,214 @@
+#ifndef INVADER__LIGHTMAP__MESH_HPP
+#define INVADER__LIGHTMAP__MESH_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <span>
+#include <optional>
+#include <filesystem>
+
+#include <invader/file/file.hpp>
+#include "../util/fnv1a.hpp"
+
+namespace Invader::Lightmap {
+    static constexpr const std::uint32_t MESH_FORMAT_VERSION = 1;
+
+    /**
+     * Binary meshes start with this, followed by the version and whether or not the mesh is baked as 32-bit little
+     * endian integers. After that are records, each having a 32-bit type (see MeshRecordType), a 32-bit size of what
+     * follows it, and then its contents. Everything is 32-bit little endian floats or integers, and strings are a
+     * length followed by the characters, padded with zeroes to a multiple of 4 bytes. Records of types that are not
+     * known are skipped.
+     */
+    static constexpr const char MESH_BINARY_MAGIC[8] = { 'i', 'n', 'v', 'l', 'm', 'e', 's', 'h' };
+
+    static constexpr std::uint32_t mesh_record_type(const char (&name)[5]) {
+        return static_cast<std::uint32_t>(name[0]) | (static_cast<std::uint32_t>(name[1]) << 8) | (static_cast<std::uint32_t>(name[2]) << 16) | (static_cast<std::uint32_t>(name[3]) << 24);
+    }
+
+    enum MeshRecordType : std::uint32_t {
+        /** Baked: lightmap length and bits per pixel */
+        MESH_RECORD_TYPE_FORMAT = mesh_record_type("frmt"),
+
+        /** Unbaked: path, outdoor power and color, indoor power and color, light count, then each light's power, color, yaw, and pitch */
+        MESH_RECORD_TYPE_SKY = mesh_record_type("sky "),
+
+        /** Unbaked: path, type, power, and color */
+        MESH_RECORD_TYPE_MATERIAL = mesh_record_type("matl"),
+
+        /**
+         * Unbaked: path, vertex count, triangle count, lightmap count, then each vertex's position and normal, each
+         * triangle's vertices and material, and each lightmap's first triangle and triangle count.
+         *
+         * Baked: path, vertex count, triangle count, lightmap count, then each vertex's UV, each triangle's vertices,
+         * and each lightmap's first triangle, triangle count, and image filename.
+         */
+        MESH_RECORD_TYPE_BSP = mesh_record_type("sbsp"),
+
+        /** Unbaked: same as a BSP */
+        MESH_RECORD_TYPE_MODEL = mesh_record_type("mode"),
+
+        /** Unbaked: model index, position, yaw, pitch, and roll */
+        MESH_RECORD_TYPE_OBJECT = mesh_record_type("obje")
+    };
+
+    /**
+     * Three 32-bit values for looking up vertices in a hash table, such as the bits of a position, or a vertex index and
+     * the bits of a UV
+     */
+    using VertexKey = std::array<std::uint32_t, 3>;
+
+    struct VertexKeyHash {
+        std::size_t operator()(const VertexKey &key) const noexcept {
+            return static_cast<std::size_t>(fnv1a(key.data(), sizeof(key)));
+        }
+    };
+
+    /**
+     * Get the bits of a float for a VertexKey
+     * @param value value
+     * @return      bits of the value, with -0.0 giving the same bits as 0.0 since they compare the same with ==
+     */
+    inline std::uint32_t float_bits(float value) noexcept {
+        value += 0.0F; // turns -0.0 into 0.0
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    enum MeshFormat {
+        MESH_FORMAT_TEXT,
+        MESH_FORMAT_BINARY
+    };
+
+    struct ExportedVertex {
+        float x, y, z;
+        float i, j, k;
+    };
+
+    struct ExportedTriangle {
+        std::size_t material;
+        std::size_t a, b, c;
+    };
+
+    enum ExportedMaterialType {
+        EXPORTED_MATERIAL_TYPE_OPAQUE,
+        EXPORTED_MATERIAL_TYPE_INVISIBLE
+    };
+
+    struct ExportedMaterial {
+        std::string path;
+        ExportedMaterialType type;
+        float power;
+        float emission_red, emission_green, emission_blue;
+    };
+
+    struct ExportedLightmap {
+        std::size_t first_triangle_index;
+        std::size_t triangle_count;
+    };
+
+    struct ExportedModel {
+        std::string path;
+        std::vector<ExportedMaterial> materials;
+        std::vector<ExportedTriangle> triangles;
+        std::vector<ExportedVertex> vertices;
+        std::vector<ExportedLightmap> lightmaps;
+    };
+
+    struct ExportedSkyLight {
+        float power;
+        float red, green, blue;
+        float yaw, pitch;
+    };
+
+    struct ExportedSky {
+        std::string path;
+        std::vector<ExportedSkyLight> lights;
+        float outdoor_power;
+        float outdoor_red, outdoor_green, outdoor_blue;
+        float indoor_power;
+        float indoor_red, indoor_green, indoor_blue;
+    };
+
+    struct ExportedObject {
+        std::size_t model;
+        float x;
+        float y;
+        float z;
+        float yaw;
+        float pitch;
+        float roll;
+    };
+
+    /**
+     * Everything needed to bake a BSP's lightmaps
+     */
+    struct UnbakedMesh {
+        std::vector<ExportedSky> skies;
+        std::vector<ExportedMaterial> materials;
+        std::vector<ExportedModel> bsps;
+        std::vector<ExportedModel> models;
+        std::vector<ExportedObject> objects;
+    };
+
+    struct ImportedBSPVertex {
+        float u, v;
+    };
+
+    struct ImportedBSPTriangle {
+        std::uint32_t vertices[3];
+    };
+
+    struct ImportedBSPLightmap {
+        std::size_t first_triangle, triangle_count;
+        std::string image_filename;
+    };
+
+    struct ImportedBSP {
+        std::string path;
+
+        /** Lightmap UVs; this points into the mapped binary mesh or vertex_storage */
+        std::span<const ImportedBSPVertex> vertices;
+
+        /** Triangles; this points into the mapped binary mesh or triangle_storage */
+        std::span<const ImportedBSPTriangle> triangles;
+
+        std::vector<ImportedBSPLightmap> lightmaps;
+
+        std::vector<ImportedBSPVertex> vertex_storage;
+        std::vector<ImportedBSPTriangle> triangle_storage;
+    };
+
+    /**
+     * A baked mesh. BSPs may point into the file, so this cannot be copied.
+     */
+    struct BakedMesh {
+        std::optional<File::MemoryMappedFile> file;
+        std::size_t format_length = 0;
+        std::size_t format_bpp = 0;
+        std::vector<ImportedBSP> bsps;
+    };
+
+    /**
+     * Write an unbaked mesh
+     * @param mesh   mesh to write
+     * @param format format to write it in
+     * @return       file data
+     */
+    std::vector<std::byte> write_unbaked_mesh(const UnbakedMesh &mesh, MeshFormat format);
+
+    /**
+     * Read a baked mesh, detecting whether it is text or binary. Binary meshes are used in place where possible.
+     * @param path path to the mesh
+     * @return     baked mesh
+     */
+    BakedMesh read_baked_mesh(const std::filesystem::path &path);
+}
+
+#endif
@@ -1,6 +1,10 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include "../util/assert.hpp"
+#include "../util/fnv1a.hpp"
+
+#include <algorithm>
+#include <cstring>
 
 #include <invader/hek/map.hpp>
 #include <invader/tag/hek/definition.hpp>
@@ -268,6 +272,7 @@ namespace Invader {
         }
 
         this->populate_tag_array();
+        this->build_path_index();
     }
     
     std::uint32_t Map::get_crc32() const noexcept {
@@ -612,13 +617,142 @@ namespace Invader {
         return !reasons.empty();
     }
 
+    // Lowercase the character and use backslashes for directory separators
+    static inline char normalize_path_character(char c) noexcept {
+        if(c == '/' || c == INVADER_PREFERRED_PATH_SEPARATOR) {
+            return '\\';
+        }
+        if(c >= 'A' && c <= 'Z') {
+            return c - 'A' + 'a';
+        }
+        return c;
+    }
+    
+    static std::string normalize_path(const char *path, TagFourCC tag_fourcc) {
+        std::string normalized;
+        for(const char *c = path; *c; c++) {
+            normalized += normalize_path_character(*c);
+        }
+        normalized += '.';
+        normalized += HEK::tag_fourcc_to_extension(tag_fourcc);
+        return normalized;
+    }
+    
+    // FNV-1a of the path, followed by the class
+    static std::uint32_t hash_path(const char *path, std::size_t length, TagFourCC tag_fourcc) noexcept {
+        auto fourcc = static_cast<std::uint32_t>(tag_fourcc);
+        return fnv1a<std::uint32_t>(&fourcc, sizeof(fourcc), fnv1a<std::uint32_t>(path, length));
+    }
+    
+    // Probe the table until we find a tag that is_equal() accepts or an empty slot (linear probing)
+    template <typename Table, typename Equal> static auto &probe_path_table(Table &table, std::uint32_t hash, const Equal &is_equal) {
+        std::size_t mask = table.size() - 1;
+        for(std::size_t i = hash & mask;; i = (i + 1) & mask) {
+            auto &slot = table[i];
+            if(slot.tag_index == 0 || (slot.hash == hash && is_equal(slot.tag_index - 1))) {
+                return slot;
+            }
+        }
+    }
+    
+    void Map::build_path_index() {
+        auto &index = this->path_index;
+        index = {};
+        auto tag_count = this->tags.size();
+        
+        // Keep the table at most half full
+        std::size_t table_size = 16;
+        while(table_size < tag_count * 2) {
+            table_size *= 2;
+        }
+        index.exact.assign(table_size, PathIndexSlot {});
+        index.normalized_paths.reserve(tag_count);
+        index.sorted.reserve(tag_count);
+        
+        for(std::size_t t = 0; t < tag_count; t++) {
+            auto &tag = this->tags[t];
+            auto &path = tag.get_path();
+            auto fourcc = tag.get_tag_fourcc();
+            index.normalized_paths.emplace_back(normalize_path(path.c_str(), fourcc));
+            index.sorted.emplace_back(static_cast<std::uint32_t>(t));
+            
+            // Only the first tag with a given path is kept, as with a linear search
+            auto exact_hash = hash_path(path.data(), path.size(), fourcc);
+            auto &exact_slot = probe_path_table(index.exact, exact_hash, [this, &path, &fourcc](std::size_t other) {
+                return this->tags[other].get_tag_fourcc() == fourcc && this->tags[other].get_path() == path;
+            });
+            if(exact_slot.tag_index == 0) {
+                exact_slot = { exact_hash, static_cast<std::uint32_t>(t + 1) };
+            }
+        }
+        
+        std::sort(index.sorted.begin(), index.sorted.end(), [&index](std::uint32_t a, std::uint32_t b) {
+            return index.normalized_paths[a] < index.normalized_paths[b];
+        });
+    }
+    
     std::optional<std::size_t> Map::find_tag(const char *tag_path, TagFourCC tag_fourcc) const noexcept {
-        for(auto &tag : tags) {
-            if(tag.get_tag_fourcc() == tag_fourcc && tag.get_path() == tag_path) {
-                return &tag - tags.data();
+        auto &index = this->path_index;
+        if(index.exact.empty()) {
+            return std::nullopt;
+        }
+        auto &slot = probe_path_table(index.exact, hash_path(tag_path, std::strlen(tag_path), tag_fourcc), [this, &tag_path, &tag_fourcc](std::size_t other) {
+            return this->tags[other].get_tag_fourcc() == tag_fourcc && this->tags[other].get_path() == tag_path;
+        });
+        if(slot.tag_index == 0) {
+            return std::nullopt;
+        }
+        return slot.tag_index - 1;
+    }
+    
+    std::vector<std::size_t> Map::search_tags(const std::vector<std::string> &queries, const std::vector<std::string> &queries_exclude) const {
+        std::vector<std::size_t> matches;
+        auto tag_count = this->tags.size();
+        
+        auto tag_matches = [this, &queries, &queries_exclude](std::size_t t) {
+            auto &tag = this->tags[t];
+            auto full_tag_path = tag.get_path() + "." + HEK::tag_fourcc_to_extension(tag.get_tag_fourcc());
+            return File::path_matches(full_tag_path.c_str(), queries, queries_exclude);
+        };
+        
+        // Everything that isn't excluded
+        if(queries.empty()) {
+            for(std::size_t t = 0; t < tag_count; t++) {
+                if(tag_matches(t)) {
+                    matches.emplace_back(t);
+                }
             }
+            return matches;
         }
-        return std::nullopt;
+        
+        // Everything before the first wildcard in a query has to match exactly (apart from directory separators), so
+        // only tags that start with that need to be tested
+        auto &index = this->path_index;
+        std::vector<bool> tested(tag_count);
+        for(auto &q : queries) {
+            std::string prefix;
+            for(char c : q) {
+                if(c == '*' || c == '?') {
+                    break;
+                }
+                prefix += normalize_path_character(c);
+            }
+            
+            auto first = std::lower_bound(index.sorted.begin(), index.sorted.end(), prefix, [&index](std::uint32_t t, const std::string &prefix) {
+                return index.normalized_paths[t] < prefix;
+            });
+            for(auto i = first; i != index.sorted.end() && index.normalized_paths[*i].compare(0, prefix.size(), prefix) == 0; i++) {
+                if(!tested[*i]) {
+                    tested[*i] = true;
+                    if(tag_matches(*i)) {
+                        matches.emplace_back(*i);
+                    }
+                }
+            }
+        }
+        
+        std::sort(matches.begin(), matches.end());
+        return matches;
     }
 
     Map::Map(Map &&move) {
@@ -630,8 +764,9 @@ namespace Invader {
         this->load_map();
         this->compressed = move.compressed;
         
-        // Clear tags from old version
+        // Clear tags from old version (and the index into them)
         move.tags.clear();
+        move.path_index = {};
     }
 
     std::byte *Map::get_internal_asset(std::size_t offset, std::size_t minimum_size) {
@@ -1,367 +1,580 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
-#include <sstream>
+#include <algorithm>
 #include <stdexcept>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <climits>
+#include <unordered_map>
 #include <invader/model/jms.hpp>
+#include <invader/file/file.hpp>
+#include "../util/fnv1a.hpp"
 
 namespace Invader {
-#define SET_CURSOR const char *cursor = next_character(string);
-#define SET_END    if(end != nullptr) { \
-                       *end = cursor; \
-                   }
-                
     static const char CRLF[] = "\r\n";
     static const char TAB[] = "\t";
     static const constexpr std::uint32_t JMS_VERSION = 8200;
     
-    static std::string precise_double_str(const double value) {
-        // Get it to 8 digits
-        std::ostringstream out;
-        auto decimal_point = std::use_facet<std::numpunct<char>>(out.getloc()).decimal_point();
-        out.precision(10);
-        out << std::fixed << value;
-        auto str = out.str();
-        
-        // Remove potential commas to decimals
-        auto decimal_point_location = str.find_first_of(decimal_point);
-        if(decimal_point_location != std::string::npos) {
-            str[decimal_point_location] = '.';
-        }
-        else {
-            decimal_point_location = 1;
-        }
-        
-        // Remove trailing zeroes
-        std::size_t n = str.size() - 1;
-        while(n > decimal_point_location && str[n] == '0') {
-            n--;
-        }
-        
-        // Only remove decimal if needed. Otherwise, add one so we remove the 0 instead.
-        if(str[n] != '.') {
-            n++;
-        }
-        
-        // Done
-        str.resize(n);
-        
-        return str;
-    }
-    
-    // Skip to the next character that can be read
-    static const char *next_character(const char *string) {
-        if(string) {
-            while(*string == '\r' || *string == '\t' || *string == '\n') {
-                string++;
+    namespace {
+        // Reads tokens straight out of the buffer without copying it. The buffer ends at end or a null character, whichever is first.
+        class JMSReader {
+        public:
+            JMSReader(const char *begin, const char *end) noexcept : cursor(begin), end(end) {}
+            
+            const char *position() const noexcept {
+                return this->cursor;
             }
-            if(*string == 0) {
-                throw std::invalid_argument("no character afterwards");
+            
+            std::size_t remaining() const noexcept {
+                return this->end == nullptr ? SIZE_MAX : static_cast<std::size_t>(this->end - this->cursor);
             }
-            return string;
-        }
+            
+            // Skip to the next character that can be read
+            void next_character() {
+                while(!this->at_end() && (*this->cursor == '\r' || *this->cursor == '\t' || *this->cursor == '\n')) {
+                    this->cursor++;
+                }
+                if(this->at_end()) {
+                    throw std::invalid_argument("no character afterwards");
+                }
+            }
+            
+            // Read up to the next tab or line break
+            std::string_view next_token() {
+                this->next_character();
+                const char *end_of_token = this->cursor;
+                while(end_of_token != this->end && *end_of_token && *end_of_token != '\r' && *end_of_token != '\n' && *end_of_token != '\t') {
+                    end_of_token++;
+                }
+                std::string_view token(this->cursor, end_of_token - this->cursor);
+                this->cursor = end_of_token;
+                return token;
+            }
+            
+            std::string next_string(bool limit_31_characters) {
+                auto token = this->next_token();
+                if(limit_31_characters && token.size() > 31) {
+                    throw std::out_of_range(std::string("maximum string length (") + std::to_string(token.size()) + " > 31) exceeded");
+                }
+                
+                // Strings get lowercased
+                std::string value(token);
+                for(auto &c : value) {
+                    c = std::tolower(c);
+                }
+                return value;
+            }
+            
+            float next_float() {
+                float value = 0.0F;
+                auto [number, number_end] = this->number_bounds();
+                auto result = std::from_chars(number, number_end, value);
+                if(result.ec == std::errc::result_out_of_range) {
+                    // Let strtof decide what to round this to
+                    std::string number_copy(number, number_end);
+                    value = std::strtof(number_copy.c_str(), nullptr);
+                }
+                else if(result.ec != std::errc()) {
+                    this->throw_not_a_number("a number");
+                }
+                this->cursor = result.ptr;
+                return value;
+            }
+            
+            std::int32_t next_int32() {
+                // Read it as a long and then truncate it, since that's what strtol did
+                long value = 0;
+                auto [number, number_end] = this->number_bounds();
+                auto result = std::from_chars(number, number_end, value, 10);
+                if(result.ec == std::errc::result_out_of_range) {
+                    value = *number == '-' ? LONG_MIN : LONG_MAX;
+                }
+                else if(result.ec != std::errc()) {
+                    this->throw_not_a_number("an integer");
+                }
+                this->cursor = result.ptr;
+                return static_cast<std::int32_t>(value);
+            }
+            
+            std::uint32_t next_uint32() {
+                return static_cast<std::uint32_t>(this->next_int32());
+            }
+            
+        private:
+            const char *cursor;
+            const char *end;
+            
+            bool at_end() const noexcept {
+                return this->cursor == this->end || *this->cursor == 0;
+            }
+            
+            static bool is_space(char c) noexcept {
+                return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+            }
+            
+            // Find where the next number starts and ends, skipping whitespace and a plus sign like strtof/strtol do
+            std::pair<const char *, const char *> number_bounds() {
+                this->next_character();
+                const char *number = this->cursor;
+                while(number != this->end && is_space(*number)) {
+                    number++;
+                }
+                if(number != this->end && *number == '+' && number + 1 != this->end && number[1] != '-') {
+                    number++;
+                }
+                const char *number_end = number;
+                while(number_end != this->end && *number_end && !is_space(*number_end)) {
+                    number_end++;
+                }
+                return { number, number_end };
+            }
+            
+            [[noreturn]] void throw_not_a_number(const char *what) {
+                auto token = this->next_string(false);
+                throw std::invalid_argument("cannot convert string `" + token + "` to " + what);
+            }
+        };
         
-        throw std::invalid_argument("null string given");
+        // Appends everything to one string
+        class JMSWriter {
+        public:
+            JMSWriter(std::string &output) noexcept : output(output) {}
+            
+            void write(std::string_view string) {
+                this->output.append(string);
+            }
+            
+            void write_integer(std::int64_t value) {
+                char buffer[32];
+                auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+                this->output.append(buffer, result.ptr);
+            }
+            
+            // Write the number with up to 10 decimal places, removing trailing zeroes (and the decimal point if nothing is left after it)
+            void write_float(double value) {
+                char buffer[512];
+                auto *end = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, 10).ptr;
+                
+                auto *decimal_point = std::find(buffer, end, '.');
+                if(decimal_point != end) {
+                    while(end - 1 > decimal_point && end[-1] == '0') {
+                        end--;
+                    }
+                    if(end - 1 == decimal_point) {
+                        end--;
+                    }
+                }
+                
+                this->output.append(buffer, end);
+            }
+            
+            void write_vector(const HEK::Vector3D<HEK::NativeEndian> &vector) {
+                this->write_float(vector.i.read());
+                this->write(TAB);
+                this->write_float(vector.j.read());
+                this->write(TAB);
+                this->write_float(vector.k.read());
+            }
+            
+            void write_vector(const HEK::Point3D<HEK::NativeEndian> &vector) {
+                this->write_float(vector.x.read());
+                this->write(TAB);
+                this->write_float(vector.y.read());
+                this->write(TAB);
+                this->write_float(vector.z.read());
+            }
+            
+            void write_vector(const HEK::Point2D<HEK::NativeEndian> &vector) {
+                this->write_float(vector.x.read());
+                this->write(TAB);
+                this->write_float(vector.y.read());
+            }
+            
+            void write_vector(const HEK::Quaternion<HEK::NativeEndian> &vector) {
+                this->write_float(vector.i.read());
+                this->write(TAB);
+                this->write_float(vector.j.read());
+                this->write(TAB);
+                this->write_float(vector.k.read());
+                this->write(TAB);
+                this->write_float(vector.w.read());
+            }
+            
+        private:
+            std::string &output;
+        };
     }
     
-    static std::string string_from_string(const char *&string, bool limit_31_characters) {
-        string = next_character(string);
-        const char *end_of_string = string;
-        while(*end_of_string && *end_of_string != '\r' && *end_of_string != '\n' && *end_of_string != '\t') {
-            end_of_string++;
-        }
-        
-        if(limit_31_characters && end_of_string - string > 31) {
-            throw std::out_of_range(std::string("maximum string length (") + std::to_string(end_of_string - string) + " > 31) exceeded");
-        }
-        
-        // Make a substring out of this
-        std::string value = std::string(string, end_of_string);
-        
-        // Strings get lowercased
-        for(auto &c : value) {
-            c = std::tolower(c);
-        }
-        
-        // Set pointer to end of this string
-        string = end_of_string;
-        
-        // Done!
-        return value;
+    static HEK::Quaternion<HEK::NativeEndian> quaternion_from_string(JMSReader &reader) {
+        HEK::Quaternion<HEK::NativeEndian> v;
+        v.i = reader.next_float();
+        v.j = reader.next_float();
+        v.k = reader.next_float();
+        v.w = reader.next_float();
+        return v;
     }
     
-    static float read_next_float(const char *&string) {
-        string = next_character(string);
-        auto *old_str = string;
-        float value = std::strtof(string, const_cast<char **>(&string));
-        if(old_str == string) {
-            auto string_copy = string;
-            throw std::invalid_argument("cannot convert string `" + string_from_string(string_copy, false) + "` to a number");
-        }
-        return value;
+    static HEK::Vector3D<HEK::NativeEndian> vector3d_from_string(JMSReader &reader) {
+        HEK::Vector3D<HEK::NativeEndian> v;
+        v.i = reader.next_float();
+        v.j = reader.next_float();
+        v.k = reader.next_float();
+        return v;
     }
     
-    static std::int32_t read_next_int32(const char *&string) {
-        string = next_character(string);
-        auto *old_str = string;
-        std::int32_t value = std::strtol(string, const_cast<char **>(&string), 10);
-        if(old_str == string) {
-            auto string_copy = string;
-            throw std::invalid_argument("cannot convert string `" + string_from_string(string_copy, false) + "` to an integer");
-        }
-        return value;
+    static HEK::Point2D<HEK::NativeEndian> point2d_from_string(JMSReader &reader) {
+        HEK::Point2D<HEK::NativeEndian> v;
+        v.x = reader.next_float();
+        v.y = reader.next_float();
+        return v;
+    }
+    
+    static HEK::Point3D<HEK::NativeEndian> point3d_from_string(JMSReader &reader) {
+        HEK::Point3D<HEK::NativeEndian> v;
+        v.x = reader.next_float();
+        v.y = reader.next_float();
+        v.z = reader.next_float();
+        return v;
     }
     
-    static std::uint32_t read_next_uint32(const char *&string) {
-        std::uint32_t value = static_cast<std::uint32_t>(read_next_int32(string));
-        return value;
+    static JMS::Node read_node(JMSReader &reader) {
+        JMS::Node n;
+        n.name = reader.next_string(true);
+        n.first_child = reader.next_uint32();
+        n.sibling_node = reader.next_uint32();
+        n.rotation = quaternion_from_string(reader);
+        n.position = point3d_from_string(reader) / 100.0F;
+        return n;
+    }
+    static void write_node(JMSWriter &writer, const JMS::Node &node) {
+        writer.write(node.name);
+        writer.write(CRLF);
+        writer.write_integer(static_cast<std::int16_t>(node.first_child));
+        writer.write(CRLF);
+        writer.write_integer(static_cast<std::int16_t>(node.sibling_node));
+        writer.write(CRLF);
+        writer.write_vector(node.rotation);
+        writer.write(CRLF);
+        writer.write_vector(node.position * 100.0F);
     }
     
-    template <typename T> static std::string array_to_string(const std::vector<T> &vector) {
-        std::string rval = std::to_string(vector.size()) + CRLF;
-        for(auto &i : vector) {
-            rval += i.string() + CRLF;
-        }
-        return rval;
+    static JMS::Material read_material(JMSReader &reader) {
+        JMS::Material m;
+        m.name = reader.next_string(false);
+        m.tif_path = reader.next_string(false);
+        return m;
+    }
+    static void write_material(JMSWriter &writer, const JMS::Material &material) {
+        writer.write(material.name);
+        writer.write(CRLF);
+        writer.write(material.tif_path);
     }
     
-    template <typename T> static std::vector<T> array_from_string(const char *&string) {
-        std::vector<T> arr;
-        auto count = read_next_uint32(string);
-        arr.reserve(count);
-        for(std::size_t i = 0; i < count; i++) {
-            arr.emplace_back(T::from_string(string, &string));
-        }
-        return arr;
+    static JMS::Marker read_marker(JMSReader &reader) {
+        JMS::Marker m;
+        m.name = reader.next_string(true);
+        m.region = reader.next_uint32();
+        m.node = reader.next_uint32();
+        m.rotation = quaternion_from_string(reader);
+        m.position = point3d_from_string(reader) / 100.0F;
+        m.radius = reader.next_float();
+        return m;
+    }
+    static void write_marker(JMSWriter &writer, const JMS::Marker &marker) {
+        writer.write(marker.name);
+        writer.write(CRLF);
+        writer.write_integer(static_cast<std::int16_t>(marker.region));
+        writer.write(CRLF);
+        writer.write_integer(static_cast<std::int16_t>(marker.node));
+        writer.write(CRLF);
+        writer.write_vector(marker.rotation);
+        writer.write(CRLF);
+        writer.write_vector(marker.position * 100.0F);
+        writer.write(CRLF);
+        writer.write_float(marker.radius);
     }
     
-    static std::string vector_to_string(const HEK::Vector3D<HEK::NativeEndian> &vector) {
-        return precise_double_str(vector.i.read()) + TAB + precise_double_str(vector.j.read()) + TAB + precise_double_str(vector.k.read());
+    static JMS::Region read_region(JMSReader &reader) {
+        JMS::Region r;
+        r.name = reader.next_string(true);
+        return r;
+    }
+    static void write_region(JMSWriter &writer, const JMS::Region &region) {
+        writer.write(region.name);
+        writer.write(CRLF);
     }
     
-    static std::string vector_to_string(const HEK::Point3D<HEK::NativeEndian> &vector) {
-        return precise_double_str(vector.x.read()) + TAB + precise_double_str(vector.y.read()) + TAB + precise_double_str(vector.z.read());
+    static JMS::Vertex read_vertex(JMSReader &reader) {
+        JMS::Vertex v;
+        v.node0 = reader.next_uint32();
+        v.position = point3d_from_string(reader) / 100.0F;
+        v.normal = vector3d_from_string(reader).normalize();
+        v.node1 = reader.next_uint32();
+        v.node1_weight = reader.next_float();
+        v.texture_coordinates = point2d_from_string(reader);
+        v.texture_coordinates.y = 1.0F - v.texture_coordinates.y; // this is flipped for some reason
+        reader.next_float();
+        return v;
+    }
+    static void write_vertex(JMSWriter &writer, const JMS::Vertex &vertex) {
+        auto modified_texture_coordinates = vertex.texture_coordinates;
+        modified_texture_coordinates.y = 1.0F - modified_texture_coordinates.y;
+        
+        writer.write_integer(static_cast<std::int16_t>(vertex.node0));
+        writer.write(CRLF);
+        writer.write_vector(vertex.position * 100.0F);
+        writer.write(CRLF);
+        writer.write_vector(vertex.normal);
+        writer.write(CRLF);
+        writer.write_integer(static_cast<std::int16_t>(vertex.node1));
+        writer.write(CRLF);
+        writer.write_float(vertex.node1_weight);
+        writer.write(CRLF);
+        writer.write_vector(modified_texture_coordinates);
+        writer.write(TAB);
+        writer.write("0");
     }
     
-    static std::string vector_to_string(const HEK::Point2D<HEK::NativeEndian> &vector) {
-        return precise_double_str(vector.x.read()) + TAB + precise_double_str(vector.y.read());
+    static JMS::Triangle read_triangle(JMSReader &reader) {
+        JMS::Triangle t;
+        t.region = reader.next_uint32();
+        t.shader = reader.next_uint32();
+        t.vertices[0] = reader.next_uint32();
+        t.vertices[2] = reader.next_uint32();
+        t.vertices[1] = reader.next_uint32();
+        return t;
+    }
+    static void write_triangle(JMSWriter &writer, const JMS::Triangle &triangle) {
+        writer.write_integer(static_cast<std::int16_t>(triangle.region));
+        writer.write(CRLF);
+        writer.write_integer(static_cast<std::int16_t>(triangle.shader));
+        writer.write(CRLF);
+        writer.write_integer(static_cast<std::int16_t>(triangle.vertices[0]));
+        writer.write(TAB);
+        writer.write_integer(static_cast<std::int16_t>(triangle.vertices[2]));
+        writer.write(TAB);
+        writer.write_integer(static_cast<std::int16_t>(triangle.vertices[1]));
     }
     
-    static std::string vector_to_string(const HEK::Quaternion<HEK::NativeEndian> &vector) {
-        return precise_double_str(vector.i.read()) + TAB + precise_double_str(vector.j.read())+ TAB + precise_double_str(vector.k.read())+ TAB + precise_double_str(vector.w.read());
+    template <typename T> static std::vector<T> array_from_string(JMSReader &reader, T (*read)(JMSReader &)) {
+        std::vector<T> arr;
+        auto count = reader.next_uint32();
+        
+        // Every element takes at least a few characters, so don't trust counts that are bigger than what's left
+        arr.reserve(std::min<std::size_t>(count, reader.remaining() / 2));
+        for(std::size_t i = 0; i < count; i++) {
+            arr.emplace_back(read(reader));
+        }
+        return arr;
     }
     
-    static HEK::Quaternion<HEK::NativeEndian> quaternion_from_string(const char *&string) {
-        HEK::Quaternion<HEK::NativeEndian> v;
-        v.i = read_next_float(string);
-        v.j = read_next_float(string);
-        v.k = read_next_float(string);
-        v.w = read_next_float(string);
-        return v;
+    template <typename T> static void array_to_string(JMSWriter &writer, const std::vector<T> &vector, void (*write)(JMSWriter &, const T &)) {
+        writer.write_integer(vector.size());
+        writer.write(CRLF);
+        for(auto &i : vector) {
+            write(writer, i);
+            writer.write(CRLF);
+        }
     }
     
-    static HEK::Vector3D<HEK::NativeEndian> vector3d_from_string(const char *&string) {
-        HEK::Vector3D<HEK::NativeEndian> v;
-        v.i = read_next_float(string);
-        v.j = read_next_float(string);
-        v.k = read_next_float(string);
-        return v;
+    // Read a single element, and set end to where we stopped reading
+    template <typename T> static T element_from_string(const char *string, const char **end, T (*read)(JMSReader &)) {
+        if(string == nullptr) {
+            throw std::invalid_argument("null string given");
+        }
+        JMSReader reader(string, nullptr);
+        auto element = read(reader);
+        if(end != nullptr) {
+            *end = reader.position();
+        }
+        return element;
     }
     
-    static HEK::Point2D<HEK::NativeEndian> point2d_from_string(const char *&string) {
-        HEK::Point2D<HEK::NativeEndian> v;
-        v.x = read_next_float(string);
-        v.y = read_next_float(string);
-        return v;
+    template <typename T> static std::string element_to_string(const T &element, void (*write)(JMSWriter &, const T &)) {
+        std::string output;
+        JMSWriter writer(output);
+        write(writer, element);
+        return output;
     }
     
-    static HEK::Point3D<HEK::NativeEndian> point3d_from_string(const char *&string) {
-        HEK::Point3D<HEK::NativeEndian> v;
-        v.x = read_next_float(string);
-        v.y = read_next_float(string);
-        v.z = read_next_float(string);
-        return v;
+    static JMS jms_from_reader(JMSReader &reader) {
+        auto version = reader.next_int32();
+        if(version != JMS_VERSION) {
+            throw std::invalid_argument("invalid version");
+        }
+        
+        // Build our JMS struct
+        JMS jms;
+        jms.node_list_checksum = reader.next_uint32(); // skip
+        jms.nodes = array_from_string(reader, read_node);
+        jms.materials = array_from_string(reader, read_material);
+        jms.markers = array_from_string(reader, read_marker);
+        jms.regions = array_from_string(reader, read_region);
+        jms.vertices = array_from_string(reader, read_vertex);
+        jms.triangles = array_from_string(reader, read_triangle);
+        return jms;
     }
     
     JMS JMS::from_string(const char *string, const char **end) {
-        try {
-            SET_CURSOR
-            auto version = read_next_int32(cursor);
-            if(version != JMS_VERSION) {
-                throw std::invalid_argument("invalid version");
-            }
-            
-            // Build our JMS struct
-            JMS jms;
-            jms.node_list_checksum = read_next_uint32(cursor); // skip
-            jms.nodes = array_from_string<Node>(cursor);
-            jms.materials = array_from_string<Material>(cursor);
-            jms.markers = array_from_string<Marker>(cursor);
-            jms.regions = array_from_string<Region>(cursor);
-            jms.vertices = array_from_string<Vertex>(cursor);
-            jms.triangles = array_from_string<Triangle>(cursor);
-            SET_END
-            return jms;
+        if(string == nullptr) {
+            throw std::invalid_argument("null string given");
         }
-        catch (std::exception &) {
-            throw;
+        JMSReader reader(string, nullptr);
+        auto jms = jms_from_reader(reader);
+        if(end != nullptr) {
+            *end = reader.position();
         }
+        return jms;
     }
+    
+    JMS JMS::from_string(std::string_view string) {
+        JMSReader reader(string.data(), string.data() + string.size());
+        return jms_from_reader(reader);
+    }
+    
+    JMS JMS::from_file(const std::filesystem::path &path) {
+        auto file = File::MemoryMappedFile::map_file(path);
+        if(!file.has_value()) {
+            throw std::invalid_argument("cannot read " + path.string());
+        }
+        return from_string(std::string_view(reinterpret_cast<const char *>(file->data()), file->size()));
+    }
+    
     std::string JMS::string() const {
         std::string r;
         
-        r += std::to_string(JMS_VERSION) + CRLF;
-        r += std::to_string(this->node_list_checksum) + CRLF;
-        r += array_to_string(this->nodes);
-        r += array_to_string(this->materials);
-        r += array_to_string(this->markers);
-        r += array_to_string(this->regions);
-        r += array_to_string(this->vertices);
-        r += array_to_string(this->triangles);
+        // Vertices are by far the biggest part, at roughly 100-150 characters each
+        r.reserve(256 + this->nodes.size() * 128 + this->markers.size() * 128 + this->vertices.size() * 160 + this->triangles.size() * 32);
+        
+        JMSWriter writer(r);
+        writer.write_integer(JMS_VERSION);
+        writer.write(CRLF);
+        writer.write_integer(this->node_list_checksum);
+        writer.write(CRLF);
+        array_to_string(writer, this->nodes, write_node);
+        array_to_string(writer, this->materials, write_material);
+        array_to_string(writer, this->markers, write_marker);
+        array_to_string(writer, this->regions, write_region);
+        array_to_string(writer, this->vertices, write_vertex);
+        array_to_string(writer, this->triangles, write_triangle);
         
         return r;
     }
     
-    JMS::Marker JMS::Marker::from_string(const char *string, const char **end) {
-        SET_CURSOR
-        Marker m;
-        m.name = string_from_string(cursor, true);
-        m.region = read_next_uint32(cursor);
-        m.node = read_next_uint32(cursor);
-        m.rotation = quaternion_from_string(cursor);
-        m.position = point3d_from_string(cursor) / 100.0F;
-        m.radius = read_next_float(cursor);
-        SET_END
-        return m;
-    }
-    std::string JMS::Marker::string() const {
-        return this->name + CRLF +
-               std::to_string(static_cast<std::int16_t>(this->region)) + CRLF +
-               std::to_string(static_cast<std::int16_t>(this->node)) + CRLF +
-               vector_to_string(this->rotation) + CRLF +
-               vector_to_string(this->position * 100.0F) + CRLF +
-               precise_double_str(this->radius);
-    }
-    
     JMS::Node JMS::Node::from_string(const char *string, const char **end) {
-        SET_CURSOR
-        Node n;
-        n.name = string_from_string(cursor, true);
-        n.first_child = read_next_uint32(cursor);
-        n.sibling_node = read_next_uint32(cursor);
-        n.rotation = quaternion_from_string(cursor);
-        n.position = point3d_from_string(cursor) / 100.0F;
-        SET_END
-        return n;
+        return element_from_string(string, end, read_node);
     }
     std::string JMS::Node::string() const {
-        return this->name + CRLF +
-               std::to_string(static_cast<std::int16_t>(this->first_child)) + CRLF +
-               std::to_string(static_cast<std::int16_t>(this->sibling_node)) + CRLF +
-               vector_to_string(this->rotation) + CRLF +
-               vector_to_string(this->position * 100.0F);
+        return element_to_string(*this, write_node);
     }
     
     JMS::Material JMS::Material::from_string(const char *string, const char **end) {
-        SET_CURSOR
-        Material m;
-        m.name = string_from_string(cursor, false);
-        m.tif_path = string_from_string(cursor, false);
-        
-        SET_END
-        return m;
+        return element_from_string(string, end, read_material);
     }
     std::string JMS::Material::string() const {
-        return this->name + CRLF + this->tif_path;
+        return element_to_string(*this, write_material);
+    }
+    
+    JMS::Marker JMS::Marker::from_string(const char *string, const char **end) {
+        return element_from_string(string, end, read_marker);
+    }
+    std::string JMS::Marker::string() const {
+        return element_to_string(*this, write_marker);
     }
     
     JMS::Region JMS::Region::from_string(const char *string, const char **end) {
-        SET_CURSOR
-        Region r;
-        r.name = string_from_string(cursor, true);
-        SET_END
-        return r;
+        return element_from_string(string, end, read_region);
     }
     std::string JMS::Region::string() const {
-        return this->name + CRLF;
+        return element_to_string(*this, write_region);
     }
     
     JMS::Vertex JMS::Vertex::from_string(const char *string, const char **end) {
-        SET_CURSOR
-        Vertex v;
-        v.node0 = read_next_uint32(cursor);
-        v.position = point3d_from_string(cursor) / 100.0F;
-        v.normal = vector3d_from_string(cursor).normalize();
-        v.node1 = read_next_uint32(cursor);
-        v.node1_weight = read_next_float(cursor);
-        v.texture_coordinates = point2d_from_string(cursor);
-        v.texture_coordinates.y = 1.0F - v.texture_coordinates.y; // this is flipped for some reason
-        read_next_float(cursor);
-        SET_END
-        return v;
+        return element_from_string(string, end, read_vertex);
     }
     std::string JMS::Vertex::string() const {
-        auto modified_texture_coordinates = this->texture_coordinates;
-        modified_texture_coordinates.y = 1.0F - modified_texture_coordinates.y;
-        
-        return std::to_string(static_cast<std::int16_t>(this->node0)) + CRLF +
-               vector_to_string(this->position * 100.0F) + CRLF +
-               vector_to_string(this->normal) + CRLF +
-               std::to_string(static_cast<std::int16_t>(this->node1)) + CRLF +
-               precise_double_str(this->node1_weight) + CRLF +
-               vector_to_string(modified_texture_coordinates) + TAB + "0";
+        return element_to_string(*this, write_vertex);
     }
     
     JMS::Triangle JMS::Triangle::from_string(const char *string, const char **end) {
-        SET_CURSOR
-        Triangle t;
-        t.region = read_next_uint32(cursor);
-        t.shader = read_next_uint32(cursor);
-        t.vertices[0] = read_next_uint32(cursor);
-        t.vertices[2] = read_next_uint32(cursor);
-        t.vertices[1] = read_next_uint32(cursor);
-        
-        SET_END
-        return t;
+        return element_from_string(string, end, read_triangle);
     }
     std::string JMS::Triangle::string() const {
-        return std::to_string(static_cast<std::int16_t>(this->region)) + CRLF +
-               std::to_string(static_cast<std::int16_t>(this->shader)) + CRLF +
-               std::to_string(static_cast<std::int16_t>(this->vertices[0])) + TAB +
-               std::to_string(static_cast<std::int16_t>(this->vertices[2])) + TAB +
-               std::to_string(static_cast<std::int16_t>(this->vertices[1]));
+        return element_to_string(*this, write_triangle);
     }
     
-    void JMS::optimize() {
-        // Here we go
-        auto erase_vertex = [](JMS *jms, std::size_t vertex, std::size_t new_vertex = 0) {
-            jms->vertices.erase(jms->vertices.begin() + vertex);
-                    
-            // Go through each triangle and associate the triangles with the new vertex if they use the old one
-            // Or decrease their index by 1 if they reference a vertex after it
-            for(auto &t : jms->triangles) {
-                for(auto &t2 : t.vertices) {
-                    if(t2 == vertex) {
-                        t2 = new_vertex;
-                    }
-                    else if(t2 > vertex) {
-                        t2--;
-                    }
-                }
+    namespace {
+        // Every attribute of a vertex, either as the raw bits of each float or snapped to a grid when welding
+        using VertexKey = std::array<std::int64_t, 11>;
+        
+        struct VertexKeyHash {
+            std::size_t operator()(const VertexKey &key) const noexcept {
+                return static_cast<std::size_t>(fnv1a(key.data(), sizeof(key)));
+            }
+        };
+    }
+    
+    std::size_t JMS::optimize(float weld_threshold) {
+        auto component = [&weld_threshold](float value) -> std::int64_t {
+            if(weld_threshold > 0.0F) {
+                return std::llround(value / weld_threshold);
             }
+            
+            // Adding zero turns -0.0 into 0.0 so they compare the same like they do with ==
+            value += 0.0F;
+            std::uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
         };
         
-        // Optimize vertices by deduping
-        for(std::size_t v = 0; v < this->vertices.size(); v++) {
-            for(std::size_t v2 = v + 1; v2 < this->vertices.size(); v2++) {
-                // If it's the same, we can optimize it
-                if(this->vertices[v] == this->vertices[v2]) {
-                    // Delete vertex if needed
-                    erase_vertex(this, v2, v);
-                    
-                    // Decrement
-                    v2--;
+        auto vertex_count = this->vertices.size();
+        std::unordered_map<VertexKey, std::uint32_t, VertexKeyHash> unique_vertices;
+        unique_vertices.reserve(vertex_count);
+        
+        std::vector<std::uint32_t> new_indices(vertex_count);
+        std::vector<Vertex> new_vertices;
+        new_vertices.reserve(vertex_count);
+        
+        // Keep the first of each vertex, in order, and point the duplicates to it
+        for(std::size_t v = 0; v < vertex_count; v++) {
+            auto &vertex = this->vertices[v];
+            VertexKey key = {
+                vertex.node0,
+                vertex.node1,
+                component(vertex.position.x),
+                component(vertex.position.y),
+                component(vertex.position.z),
+                component(vertex.normal.i),
+                component(vertex.normal.j),
+                component(vertex.normal.k),
+                component(vertex.node1_weight),
+                component(vertex.texture_coordinates.x),
+                component(vertex.texture_coordinates.y)
+            };
+            
+            auto [iterator, added] = unique_vertices.try_emplace(key, static_cast<std::uint32_t>(new_vertices.size()));
+            if(added) {
+                new_vertices.emplace_back(vertex);
+            }
+            new_indices[v] = iterator->second;
+        }
+        
+        // Triangles with out-of-bounds indices are left alone so they can be caught later
+        for(auto &t : this->triangles) {
+            for(auto &t2 : t.vertices) {
+                if(t2 < vertex_count) {
+                    t2 = new_indices[t2];
+                }
+                else {
+                    t2 = t2 - vertex_count + new_vertices.size();
                 }
             }
         }
+        
+        std::size_t removed = vertex_count - new_vertices.size();
+        this->vertices = std::move(new_vertices);
+        return removed;
     }
 }
@@ -3,14 +3,17 @@
 #include <vector>
 #include <cstring>
 #include <regex>
-#include <list>
 #include <cmath>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
 
 #include <invader/version.hpp>
 #include <invader/printf.hpp>
 #include <invader/file/file.hpp>
 #include "../command_line_option.hpp"
 #include <invader/model/jms.hpp>
+#include <invader/model/triangle_strip.hpp>
 #include <invader/tag/parser/parser.hpp>
 #include <invader/tag/parser/compile/model.hpp>
 
@@ -24,7 +27,175 @@ const char *MODEL_EXTENSIONS[] = {
     ".gbxmodel"
 };
 
-template <typename T, Invader::HEK::TagFourCC fourcc> std::vector<std::byte> make_model_tag(const std::filesystem::path &path, const std::vector<std::filesystem::path> &tags, const Invader::JMSMap &map) {
+// Maps JMS vertex indices to part vertex indices
+static constexpr std::uint32_t VERTEX_NOT_IN_PART = UINT32_MAX;
+
+// Build one part out of the given triangles of a JMS. This only touches the part and all_vertices_here_indexed, so parts can be built on separate threads.
+template <typename GeometryPart> static void make_geometry_part(GeometryPart &part, const Invader::JMS &jms, const std::vector<std::uint32_t> &triangles_here, std::vector<std::uint32_t> &all_vertices_here_indexed, std::size_t &triangle_count, std::size_t &strip_index_count) {
+    using namespace Invader;
+    
+    // Isolate all triangles
+    std::vector<JMS::Triangle> all_triangles_here;
+    all_triangles_here.reserve(triangles_here.size());
+    for(auto ti : triangles_here) {
+        all_triangles_here.emplace_back(jms.triangles[ti]);
+    }
+    
+    // Isolate all vertices and set the new indices as we go (these were bounds checked when the triangles were sorted into parts)
+    if(all_vertices_here_indexed.size() < jms.vertices.size()) {
+        all_vertices_here_indexed.resize(jms.vertices.size(), VERTEX_NOT_IN_PART);
+    }
+    std::vector<JMS::Vertex> all_vertices_here;
+    for(auto &t : all_triangles_here) {
+        for(auto &v : t.vertices) {
+            // Add the vertex if it's new. Note the index of it
+            auto &index_here = all_vertices_here_indexed[v];
+            if(index_here == VERTEX_NOT_IN_PART) {
+                index_here = static_cast<std::uint32_t>(all_vertices_here.size());
+                all_vertices_here.emplace_back(jms.vertices[v]);
+            }
+            v = index_here;
+        }
+    }
+    
+    // Clear what we set for the next part
+    for(auto ti : triangles_here) {
+        for(auto v : jms.triangles[ti].vertices) {
+            all_vertices_here_indexed[v] = VERTEX_NOT_IN_PART;
+        }
+    }
+    
+    // Add all vertices
+    for(auto &v : all_vertices_here) {
+        auto &vm = part.uncompressed_vertices.emplace_back();
+        vm.position = v.position;
+        vm.normal = v.normal;
+        vm.texture_coords = v.texture_coordinates;
+        vm.node0_index = v.node0;
+        vm.node0_weight = 1.0F - v.node1_weight;
+        vm.node1_index = v.node1;
+        vm.node1_weight = v.node1_weight;
+    }
+    
+    // Calculate binormal/tangent (most of this is from the MEK @ https://github.com/Sigmmma/reclaimer/blob/e9900716d1962f4a172f517791c2f6b7900898c5/reclaimer/model/jms.py - thanks MosesofEgypt!)
+    for(auto &t : all_triangles_here) {
+        static constexpr const std::size_t range = sizeof(t.vertices) / sizeof(*t.vertices);
+        static_assert(range == 3);
+        
+        for(std::size_t v = 0; v < range; v++) {
+            // Get our vertices, binormal, and tangent
+            auto &vertex0 = part.uncompressed_vertices[t.vertices[(v + 0) % range]];
+            auto &vertex1 = part.uncompressed_vertices[t.vertices[(v + 1) % range]];
+            auto &vertex2 = part.uncompressed_vertices[t.vertices[(v + 2) % range]];
+            
+            auto &b = vertex0.binormal;
+            auto &t = vertex0.tangent;
+            
+            // Subtract the x/y/z from the other two vertices
+            float x1 = vertex1.position.x - vertex0.position.x;
+            float x2 = vertex2.position.x - vertex0.position.x;
+            float y1 = vertex1.position.y - vertex0.position.y;
+            float y2 = vertex2.position.y - vertex0.position.y;
+            float z1 = vertex1.position.z - vertex0.position.z;
+            float z2 = vertex2.position.z - vertex0.position.z;
+            
+            // Do the same thing with the texture coordinates
+            float u1 = vertex1.texture_coords.x - vertex0.texture_coords.x;
+            float u2 = vertex2.texture_coords.x - vertex0.texture_coords.x;
+            
+            // Since it's flipped, subtract v from 1 to flip it back.
+            float v1 = (1.0F - vertex1.texture_coords.y) - (1.0F - vertex0.texture_coords.y);
+            float v2 = (1.0F - vertex2.texture_coords.y) - (1.0F - vertex0.texture_coords.y);
+            
+            float r = u1 * v2 - u2 * v1;
+            if(r == 0) {
+                continue;
+            }
+            
+            r = 1.0 / r;
+            
+            // Binormal
+            float bi = -(u1 * x2 - u2 * x1) * r;
+            float bj = -(u1 * y2 - u2 * y1) * r;
+            float bk = -(u1 * z2 - u2 * z1) * r;
+            float b_len = std::sqrt(bi*bi + bj*bj + bk*bk);
+            
+            // Tangent
+            float ti = (v2 * x1 - v1 * x2) * r;
+            float tj = (v2 * y1 - v1 * y2) * r;
+            float tk = (v2 * z1 - v1 * z2) * r;
+            float t_len = std::sqrt(ti*ti + tj*tj + tk*tk);
+            
+            if(b_len > 0) {
+                b.i = b.i + bi / b_len;
+                b.j = b.j + bj / b_len;
+                b.k = b.k + bk / b_len;
+            }
+            
+            if(t_len > 0) {
+                t.i = t.i + ti / t_len;
+                t.j = t.j + tj / t_len;
+                t.k = t.k + tk / t_len;
+            }
+        }
+    }
+    
+    // Normalize vectors
+    for(auto &v : part.uncompressed_vertices) {
+        v.binormal = v.binormal.normalize();
+        v.tangent = v.tangent.normalize();
+    }
+    
+    // Now let's... do this horrible monstrosity, triangle strips!
+    //
+    // Basically, triangles in Halo are stored like this:
+    //
+    // A B C D          A          B          C          D
+    // 0 1 2 3 4 5 6 = (0, 1, 2); (1, 3, 2); (2, 3, 4); (3, 5, 4); (4, 5, 6)
+    //
+    // It can save lots of space, but only if everything is nicely sequenced like this.
+    // If not, you can lose space by having to add degenerate triangles.
+    // On average, it saves a decent amount of space... as far as 16-bit integers go at least.
+    //
+    // Order the triangles for the vertex cache first so the strips come out in a cache-friendly order.
+    std::vector<TriangleStrip::Triangle> strip_triangles;
+    strip_triangles.reserve(all_triangles_here.size());
+    for(auto &t : all_triangles_here) {
+        strip_triangles.push_back({ t.vertices[0], t.vertices[1], t.vertices[2] });
+    }
+    auto vertex_count_here = part.uncompressed_vertices.size();
+    strip_triangles = TriangleStrip::optimize_vertex_cache(strip_triangles, vertex_count_here);
+    auto triangle_man = TriangleStrip::generate_triangle_strip(strip_triangles, vertex_count_here);
+    
+    // Put the vertices in the order the strip uses them
+    auto vertex_order = TriangleStrip::reorder_vertices(triangle_man, vertex_count_here);
+    auto old_vertices = std::move(part.uncompressed_vertices);
+    part.uncompressed_vertices.clear();
+    part.uncompressed_vertices.reserve(vertex_count_here);
+    for(auto v : vertex_order) {
+        part.uncompressed_vertices.emplace_back(std::move(old_vertices[v]));
+    }
+    
+    // Add triangle count
+    triangle_count = strip_triangles.size();
+    strip_index_count = triangle_man.size();
+    
+    // Add null's
+    while(triangle_man.size() % 3 > 0) {
+        triangle_man.emplace_back(NULL_INDEX);
+    }
+    
+    // Add the triangles
+    part.triangles.resize(triangle_man.size() / 3);
+    std::size_t q = 0;
+    for(auto &t : part.triangles) {
+        t.vertex0_index = triangle_man[q++];
+        t.vertex1_index = triangle_man[q++];
+        t.vertex2_index = triangle_man[q++];
+    }
+}
+
+template <typename T, Invader::HEK::TagFourCC fourcc> std::vector<std::byte> make_model_tag(const std::filesystem::path &path, const std::vector<std::filesystem::path> &tags, const Invader::JMSMap &map, float weld_threshold, std::size_t max_threads) {
     using namespace Invader;
     
     // Load the tag if possible
@@ -96,12 +267,13 @@ template <typename T, Invader::HEK::TagFourCC fourcc> std::vector<std::byte> mak
     
     // Get regions and shaders
     std::vector<std::string> regions;
+    std::size_t vertices_welded = 0;
     
     for(auto &jms : map) {
         auto jms_data_copy = jms.second;
         
         // Optimize
-        jms_data_copy.optimize();
+        vertices_welded += jms_data_copy.optimize(weld_threshold);
         
         // Do bounds checking for nodes and regions
         auto region_count = jms_data_copy.regions.size();
@@ -381,6 +553,9 @@ template <typename T, Invader::HEK::TagFourCC fourcc> std::vector<std::byte> mak
     
     
     // List permutations
+    if(vertices_welded > 0) {
+        oprintf("Welded %zu duplicate vert%s\n", vertices_welded, vertices_welded == 1 ? "ex" : "ices");
+    }
     auto permutation_count = permutations.size();
     oprintf("Found %zu permutation%s:\n",permutation_count, permutation_count == 1 ? "" : "s");
     for(auto &p : permutations) {
@@ -473,7 +648,29 @@ template <typename T, Invader::HEK::TagFourCC fourcc> std::vector<std::byte> mak
         std::strncpy(region.name.string, i.c_str(), sizeof(region.name.string) - 1);
     }
     
-    std::size_t triangle_count = 0;
+    using Geometry = typename std::remove_pointer<decltype(model_tag->geometries.data())>::type;
+    using GeometryPart = typename decltype(Geometry::parts)::value_type;
+    
+    // Each geometry is one region of one LoD of a permutation
+    struct GeometryJob {
+        std::size_t region;
+        std::size_t permutation;
+        LoD lod;
+        std::size_t first_part;
+        std::size_t part_count;
+    };
+    
+    // Each part is one shader of a geometry
+    struct PartJob {
+        const JMS *jms;
+        std::vector<std::uint32_t> triangles;
+        GeometryPart part;
+        std::size_t triangle_count = 0;
+        std::size_t strip_index_count = 0;
+    };
+    
+    std::vector<GeometryJob> geometry_jobs;
+    std::vector<PartJob> part_jobs;
     
     // Go through each permutation now
     for(auto &i : permutations) {
@@ -483,18 +680,33 @@ template <typename T, Invader::HEK::TagFourCC fourcc> std::vector<std::byte> mak
             // Set the checksum value
             model_tag->node_list_checksum = jms.node_list_checksum;
             
-            // Find all regions this encompasses
+            // Sort the triangles into parts by region and then shader in one pass, keeping the order each one first appears in
             std::vector<std::size_t> regions_we_are_in;
-            for(auto &t : jms.triangles) {
-                bool in_it = false;
-                for(auto &r : regions_we_are_in) {
-                    if(r == t.region) {
-                        in_it = true;
+            std::vector<std::vector<std::size_t>> shaders_we_use(region_count);
+            std::vector<std::vector<std::vector<std::uint32_t>>> part_triangles(region_count);
+            std::unordered_map<std::uint32_t, std::size_t> part_indices;
+            
+            auto jms_vertex_count = jms.vertices.size();
+            auto jms_triangle_count = jms.triangles.size();
+            for(std::size_t ti = 0; ti < jms_triangle_count; ti++) {
+                auto &t = jms.triangles[ti];
+                for(auto v : t.vertices) {
+                    if(v >= jms_vertex_count) {
+                        eprintf_error("Vertex index out of bounds");
+                        std::exit(EXIT_FAILURE);
                     }
                 }
-                if(!in_it) {
-                    regions_we_are_in.emplace_back(t.region);
+                
+                auto key = (static_cast<std::uint32_t>(t.region) << 16) | t.shader;
+                auto [part_index, added] = part_indices.try_emplace(key, shaders_we_use[t.region].size());
+                if(added) {
+                    if(shaders_we_use[t.region].empty()) {
+                        regions_we_are_in.emplace_back(t.region);
+                    }
+                    shaders_we_use[t.region].emplace_back(t.shader);
+                    part_triangles[t.region].emplace_back();
                 }
+                part_triangles[t.region][part_index->second].emplace_back(static_cast<std::uint32_t>(ti));
             }
             
             // Go through each region now...
@@ -535,300 +747,106 @@ template <typename T, Invader::HEK::TagFourCC fourcc> std::vector<std::byte> mak
                     }
                 }
                 
-                // Instantiate our new geometry
-                typename std::remove_pointer<decltype(model_tag->geometries.data())>::type geometry;
-                
-                // Now for the shader indices
-                std::vector<std::size_t> shaders_we_use;
-                for(auto &t : jms.triangles) {
-                    if(t.region == r) {
-                        bool shader_in_it = false;
-                        for(auto &s : shaders_we_use) {
-                            if(s == t.shader) {
-                                shader_in_it = true;
-                                break;
-                            }
-                        }
-                        if(!shader_in_it) {
-                            shaders_we_use.emplace_back(t.shader);
-                        }
-                    }
-                }
-                
-                // Go through each shader. Add a part thing
-                for(auto &s : shaders_we_use) {
-                    auto &part = geometry.parts.emplace_back();
-                    part.prev_filthy_part_index = ~0;
-                    part.next_filthy_part_index = ~0;
-                    part.shader_index = s;
-                    
-                    // Isolate all triangles
-                    std::vector<JMS::Triangle> all_triangles_here;
-                    for(auto &t : jms.triangles) {
-                        if(t.region == r && t.shader == s) {
-                            all_triangles_here.emplace_back(t);
-                        }
-                    }
-                    
-                    // Isolate all vertices
-                    std::map<std::size_t, std::size_t> all_vertices_here_indexed;
-                    std::vector<JMS::Vertex> all_vertices_here;
-                    for(auto &t : all_triangles_here) {
-                        for(auto &v : t.vertices) {
-                            // Add the vertex. Note the index of it
-                            if(all_vertices_here_indexed.find(v) == all_vertices_here_indexed.end()) {
-                                if(v >= jms.vertices.size()) {
-                                    eprintf_error("Vertex index out of bounds");
-                                    std::exit(EXIT_FAILURE);
-                                }
-                                
-                                all_vertices_here_indexed[v] = all_vertices_here.size();
-                                all_vertices_here.emplace_back(jms.vertices[v]);
-                            }
-                        }
-                    }
-                    
-                    // Set the vertices now
-                    for(auto &t : all_triangles_here) {
-                        for(auto &v : t.vertices) {
-                            v = all_vertices_here_indexed[v];
-                        }
-                    }
-                    
-                    // Add all vertices
-                    for(auto &v : all_vertices_here) {
-                        auto &vm = part.uncompressed_vertices.emplace_back();
-                        vm.position = v.position;
-                        vm.normal = v.normal;
-                        vm.texture_coords = v.texture_coordinates;
-                        vm.node0_index = v.node0;
-                        vm.node0_weight = 1.0F - v.node1_weight;
-                        vm.node1_index = v.node1;
-                        vm.node1_weight = v.node1_weight;
-                    }
-                    
-                    // Calculate binormal/tangent (most of this is from the MEK @ https://github.com/Sigmmma/reclaimer/blob/e9900716d1962f4a172f517791c2f6b7900898c5/reclaimer/model/jms.py - thanks MosesofEgypt!)
-                    for(auto &t : all_triangles_here) {
-                        static constexpr const std::size_t range = sizeof(t.vertices) / sizeof(*t.vertices);
-                        static_assert(range == 3);
-                        
-                        for(std::size_t v = 0; v < range; v++) {
-                            // Get our vertices, binormal, and tangent
-                            auto &vertex0 = part.uncompressed_vertices[t.vertices[(v + 0) % range]];
-                            auto &vertex1 = part.uncompressed_vertices[t.vertices[(v + 1) % range]];
-                            auto &vertex2 = part.uncompressed_vertices[t.vertices[(v + 2) % range]];
-                            
-                            auto &b = vertex0.binormal;
-                            auto &t = vertex0.tangent;
-                            
-                            // Subtract the x/y/z from the other two vertices
-                            float x1 = vertex1.position.x - vertex0.position.x;
-                            float x2 = vertex2.position.x - vertex0.position.x;
-                            float y1 = vertex1.position.y - vertex0.position.y;
-                            float y2 = vertex2.position.y - vertex0.position.y;
-                            float z1 = vertex1.position.z - vertex0.position.z;
-                            float z2 = vertex2.position.z - vertex0.position.z;
-                            
-                            // Do the same thing with the texture coordinates
-                            float u1 = vertex1.texture_coords.x - vertex0.texture_coords.x;
-                            float u2 = vertex2.texture_coords.x - vertex0.texture_coords.x;
-                            
-                            // Since it's flipped, subtract v from 1 to flip it back.
-                            float v1 = (1.0F - vertex1.texture_coords.y) - (1.0F - vertex0.texture_coords.y);
-                            float v2 = (1.0F - vertex2.texture_coords.y) - (1.0F - vertex0.texture_coords.y);
-                            
-                            float r = u1 * v2 - u2 * v1;
-                            if(r == 0) {
-                                continue;
-                            }
-                            
-                            r = 1.0 / r;
-                            
-                            // Binormal
-                            float bi = -(u1 * x2 - u2 * x1) * r;
-                            float bj = -(u1 * y2 - u2 * y1) * r;
-                            float bk = -(u1 * z2 - u2 * z1) * r;
-                            float b_len = std::sqrt(bi*bi + bj*bj + bk*bk);
-                            
-                            // Tangent
-                            float ti = (v2 * x1 - v1 * x2) * r;
-                            float tj = (v2 * y1 - v1 * y2) * r;
-                            float tk = (v2 * z1 - v1 * z2) * r;
-                            float t_len = std::sqrt(ti*ti + tj*tj + tk*tk);
-                            
-                            if(b_len > 0) {
-                                b.i = b.i + bi / b_len;
-                                b.j = b.j + bj / b_len;
-                                b.k = b.k + bk / b_len;
-                            }
-                            
-                            if(t_len > 0) {
-                                t.i = t.i + ti / t_len;
-                                t.j = t.j + tj / t_len;
-                                t.k = t.k + tk / t_len;
-                            }
-                        }
-                    }
-                    
-                    // Normalize vectors
-                    for(auto &v : part.uncompressed_vertices) {
-                        v.binormal = v.binormal.normalize();
-                        v.tangent = v.tangent.normalize();
-                    }
-                    
-                    // Now let's... do this horrible monstrosity, triangle strips!
-                    //
-                    // Basically, triangles in Halo are stored like this:
-                    //
-                    // A B C D          A          B          C          D
-                    // 0 1 2 3 4 5 6 = (0, 1, 2); (1, 3, 2); (2, 3, 4); (3, 5, 4); (4, 5, 6)
-                    //
-                    // It can save lots of space, but only if everything is nicely sequenced like this.
-                    // If not, you can lose space by having to add degenerate triangles.
-                    // On average, it saves a decent amount of space... as far as 16-bit integers go at least.
-                    
-                    // Add the first triangle
-                    std::vector<std::uint32_t> triangle_man = { all_triangles_here[0].vertices[0], all_triangles_here[0].vertices[1], all_triangles_here[0].vertices[2] };
-                    
-                    // Our remaining triangles
-                    std::list<JMS::Triangle> remaining_triangles = std::list<JMS::Triangle>(all_triangles_here.begin() + 1, all_triangles_here.end());
-                    
-                    // Add the rest
-                    while(remaining_triangles.size() > 0) {
-                        bool normals_flipped = (triangle_man.size() % 2) == 1;
-                        
-                        HEK::Index current_triangle[3] = {};
-                        auto a_index = 0;
-                        
-                        auto b_index = normals_flipped ? 2 : 1;
-                        auto c_index = normals_flipped ? 1 : 2;
-                        
-                        auto a_index_next = a_index;
-                        auto b_index_next = c_index;
-                        auto c_index_next = b_index;
-                        
-                        auto &a = current_triangle[a_index];
-                        auto &b = current_triangle[b_index];
-                        
-                        a = triangle_man[triangle_man.size() - 2];
-                        b = triangle_man[triangle_man.size() - 1];
-                        
-                        // Let's try to find a triangle that can simply go next with only one index
-                        bool triangle_found = false;
-                        for(auto rt = remaining_triangles.begin(); rt != remaining_triangles.end(); rt++) {
-                            // ABC ; BDC -> A B C D
-                            if(rt->vertices[a_index] == a && rt->vertices[b_index] == b) {
-                                triangle_found = true;
-                                triangle_man.emplace_back(rt->vertices[c_index]);
-                                remaining_triangles.erase(rt);
-                                break;
-                            }
-                        }
-                        if(triangle_found) {
-                            continue;
-                        }
-                        
-                        // Try a triangle that can go next but requires two indices
-                        for(auto rt = remaining_triangles.begin(); rt != remaining_triangles.end(); rt++) {
-                            // ABC ; CBD -> A B C B D
-                            if(rt->vertices[a_index_next] == b && rt->vertices[b_index_next] == a) {
-                                triangle_man.emplace_back(rt->vertices[b_index_next]);
-                                triangle_man.emplace_back(rt->vertices[c_index_next]);
-                                triangle_found = true;
-                                remaining_triangles.erase(rt);
-                                break;
-                            }
-                        }
-                        if(triangle_found) {
-                            continue;
-                        }
-                        
-                        // Try a triangle that can go next but requires three indices
-                        for(auto rt = remaining_triangles.begin(); rt != remaining_triangles.end(); rt++) {
-                            // ABC ; CDE -> A B C C E D
-                            if(rt->vertices[a_index] == b) {
-                                triangle_man.emplace_back(b);
-                                triangle_man.emplace_back(rt->vertices[b_index]);
-                                triangle_man.emplace_back(rt->vertices[c_index]);
-                                triangle_found = true;
-                                remaining_triangles.erase(rt);
-                                break;
-                            }
-                        }
-                        if(triangle_found) {
-                            continue;
-                        }
-                        
-                        // Last resort - Guarantees we can get the triangle in place but requires five indices
-                        // ABC; DEF -> A B C C D D F E
-                        triangle_man.emplace_back(b);
-                        auto first_triangle = *remaining_triangles.begin();
-                        remaining_triangles.erase(remaining_triangles.begin());
-                        triangle_man.emplace_back(first_triangle.vertices[a_index]);
-                        triangle_man.emplace_back(first_triangle.vertices[a_index]);
-                        triangle_man.emplace_back(first_triangle.vertices[b_index]);
-                        triangle_man.emplace_back(first_triangle.vertices[c_index]);
-                    }
-                    
-                    // Add triangle count
-                    if(triangle_man.size() > 2) {
-                        triangle_count += triangle_man.size() - 2;
-                    }
-                    
-                    // Add null's
-                    while(triangle_man.size() % 3 > 0) {
-                        triangle_man.emplace_back(NULL_INDEX);
-                    }
-                    
-                    // Add the triangles
-                    part.triangles.resize(triangle_man.size() / 3);
-                    std::size_t q = 0;
-                    for(auto &t : part.triangles) {
-                        t.vertex0_index = triangle_man[q++];
-                        t.vertex1_index = triangle_man[q++];
-                        t.vertex2_index = triangle_man[q++];
-                    }
-                }
-                
-                // See if we've already made this exact geometry before
-                std::size_t new_geometry_index;
-                for(new_geometry_index = 0; new_geometry_index < model_tag->geometries.size(); new_geometry_index++) {
-                    if(model_tag->geometries[new_geometry_index] == geometry) {
-                        break; // found a duplicate
-                    }
+                // Queue up a part for each shader. These get built afterwards.
+                auto part_count = shaders_we_use[r].size();
+                geometry_jobs.push_back({ r, permutation_index, lod.first, part_jobs.size(), part_count });
+                for(std::size_t pi = 0; pi < part_count; pi++) {
+                    auto &job = part_jobs.emplace_back();
+                    job.jms = &jms;
+                    job.triangles = std::move(part_triangles[r][pi]);
+                    job.part.prev_filthy_part_index = ~0;
+                    job.part.next_filthy_part_index = ~0;
+                    job.part.shader_index = shaders_we_use[r][pi];
                 }
-                
-                // If we didn't find it, we have to add it then
-                if(new_geometry_index == model_tag->geometries.size()) {
-                    model_tag->geometries.emplace_back(geometry);
-                }
-                
-                // Set the index
-                switch(lod.first) {
-                    case LoD::LOD_SUPERHIGH:
-                        p.super_high = new_geometry_index;
-                        break;
-                    case LoD::LOD_HIGH:
-                        p.high = new_geometry_index;
-                        break;
-                    case LoD::LOD_MEDIUM:
-                        p.medium = new_geometry_index;
-                        break;
-                    case LoD::LOD_LOW:
-                        p.low = new_geometry_index;
-                        break;
-                    case LoD::LOD_SUPERLOW:
-                        p.super_low = new_geometry_index;
-                        break;
-                    default:
-                        eprintf_error("Eep!");
-                        std::terminate();
-                }
-                
             }
         }
     }
     
+    // Build the parts. These are independent of each other, so spread them out over several threads.
+    auto part_worker = [](std::vector<PartJob> *part_jobs, std::size_t *part_index, std::mutex *part_mutex) {
+        std::vector<std::uint32_t> all_vertices_here_indexed;
+        while(true) {
+            part_mutex->lock();
+            std::size_t this_index = *part_index;
+            if(this_index == part_jobs->size()) {
+                part_mutex->unlock();
+                return;
+            }
+            (*part_index)++;
+            part_mutex->unlock();
+            
+            auto &job = (*part_jobs)[this_index];
+            make_geometry_part(job.part, *job.jms, job.triangles, all_vertices_here_indexed, job.triangle_count, job.strip_index_count);
+        }
+    };
+    
+    std::mutex part_mutex;
+    std::size_t part_index = 0;
+    std::vector<std::thread> threads;
+    auto thread_count = std::min(max_threads, part_jobs.size());
+    threads.reserve(thread_count);
+    for(std::size_t t = 0; t < thread_count; t++) {
+        threads.emplace_back(part_worker, &part_jobs, &part_index, &part_mutex);
+    }
+    for(auto &t : threads) {
+        t.join();
+    }
+    
+    std::size_t triangle_count = 0;
+    std::size_t list_index_count = 0;
+    std::size_t strip_index_count = 0;
+    
+    // Assemble the geometries in the same order we queued them up in so the output doesn't depend on how the threads were scheduled
+    for(auto &g : geometry_jobs) {
+        Geometry geometry;
+        geometry.parts.reserve(g.part_count);
+        for(std::size_t pi = 0; pi < g.part_count; pi++) {
+            auto &job = part_jobs[g.first_part + pi];
+            triangle_count += job.triangle_count;
+            list_index_count += job.triangle_count * 3;
+            strip_index_count += job.strip_index_count;
+            geometry.parts.emplace_back(std::move(job.part));
+        }
+        
+        // See if we've already made this exact geometry before
+        std::size_t new_geometry_index;
+        for(new_geometry_index = 0; new_geometry_index < model_tag->geometries.size(); new_geometry_index++) {
+            if(model_tag->geometries[new_geometry_index] == geometry) {
+                break; // found a duplicate
+            }
+        }
+        
+        // If we didn't find it, we have to add it then
+        if(new_geometry_index == model_tag->geometries.size()) {
+            model_tag->geometries.emplace_back(std::move(geometry));
+        }
+        
+        auto &p = model_tag->regions[g.region].permutations[g.permutation];
+        
+        // Set the index
+        switch(g.lod) {
+            case LoD::LOD_SUPERHIGH:
+                p.super_high = new_geometry_index;
+                break;
+            case LoD::LOD_HIGH:
+                p.high = new_geometry_index;
+                break;
+            case LoD::LOD_MEDIUM:
+                p.medium = new_geometry_index;
+                break;
+            case LoD::LOD_LOW:
+                p.low = new_geometry_index;
+                break;
+            case LoD::LOD_SUPERLOW:
+                p.super_low = new_geometry_index;
+                break;
+            default:
+                eprintf_error("Eep!");
+                std::terminate();
+        }
+    }
+    
+
     // Get everything
     std::vector<Invader::File::TagFile> all_tags_shaders;
     std::vector<std::filesystem::path> all_shader_dirs;
@@ -1000,7 +1018,7 @@ template <typename T, Invader::HEK::TagFourCC fourcc> std::vector<std::byte> mak
     }
     
     oprintf("Total: %zu vertices (%0.03f KiB uncompressed; %0.03f KiB compressed)\n", vertex_count, vertex_size_uncompressed / 1024.0F, vertex_size_compressed / 1024.0F);
-    oprintf("       %zu triangle strips (%0.03f KiB)\n", triangle_count, triangle_count * sizeof(HEK::Index) / 1024.0F);
+    oprintf("       %zu triangles (%zu indices as a list -> %zu indices as strips, %0.03f KiB)\n", triangle_count, list_index_count, strip_index_count, strip_index_count * sizeof(HEK::Index) / 1024.0F);
     oprintf("Output: %s, %0.03f KiB\n", HEK::tag_fourcc_to_extension(fourcc), rval.size() / 1024.0F);
     
     return rval;
@@ -1017,6 +1035,8 @@ int main(int argc, const char **argv) {
         std::vector<std::filesystem::path> tags;
         std::filesystem::path data = "data";
         bool filesystem_path = false;
+        float weld_threshold = 0.0F;
+        std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
     } model_options;
 
     const CommandLineOption options[] {
@@ -1025,6 +1045,8 @@ int main(int argc, const char **argv) {
         CommandLineOption::from_preset(CommandLineOption::PRESET_COMMAND_LINE_OPTION_DATA),
         CommandLineOption::from_preset(CommandLineOption::PRESET_COMMAND_LINE_OPTION_TAGS_MULTIPLE),
         CommandLineOption("type", 'T', 1, "Specify the type of model. Can be: model, gbxmodel", "<type>"),
+        CommandLineOption("weld-threshold", 'w', 1, "Also merge vertices whose attributes all round to the same multiple of this value, rather than only identical vertices. Default: 0", "<t>"),
+        CommandLineOption("threads", 'j', 1, "Set the number of threads to use for building geometry parts in parallel. Default: CPU thread count"),
     };
 
     static constexpr char DESCRIPTION[] = "Compile a model tag.";
@@ -1056,6 +1078,32 @@ int main(int argc, const char **argv) {
             case 't':
                 model_options.tags.emplace_back(args[0]);
                 break;
+            case 'w':
+                try {
+                    model_options.weld_threshold = std::stof(args[0]);
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid weld threshold %s", args[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                if(!(model_options.weld_threshold >= 0.0F)) {
+                    eprintf_error("Weld threshold must be 0 or greater");
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 'j':
+                try {
+                    int threads = std::stoi(args[0]);
+                    if(threads < 1) {
+                        throw std::exception();
+                    }
+                    model_options.max_threads = static_cast<std::size_t>(threads);
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid number of threads %s", args[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
         }
     });
     
@@ -1126,12 +1174,6 @@ int main(int argc, const char **argv) {
             }
             if(extension == ".jms" && i.is_regular_file()) {
                 try {
-                    auto file = File::open_file(path);
-                    if(!file.has_value()) {
-                        eprintf_error("Failed to read %s", path.string().c_str());
-                        return EXIT_FAILURE;
-                    }
-                    
                     // Lowercase model name
                     auto model_name = path.filename().replace_extension().string();
                     for(char &c : model_name) {
@@ -1139,7 +1181,7 @@ int main(int argc, const char **argv) {
                     }
                     
                     // Add it
-                    jms_files.emplace(model_name, JMS::from_string(std::string(reinterpret_cast<const char *>(file->data()), file->size()).c_str()));
+                    jms_files.emplace(model_name, JMS::from_file(path));
                 }
                 catch(std::exception &e) {
                     eprintf_error("Failed to parse %s: %s", path.string().c_str(), e.what());
@@ -1165,10 +1207,10 @@ int main(int argc, const char **argv) {
     
     switch(*model_options.type) {
         case ModelType::MODEL_TYPE_MODEL:
-            tag_data = make_model_tag<Parser::Model, TagFourCC::TAG_FOURCC_MODEL>(file_path, model_options.tags, jms_files);
+            tag_data = make_model_tag<Parser::Model, TagFourCC::TAG_FOURCC_MODEL>(file_path, model_options.tags, jms_files, model_options.weld_threshold, model_options.max_threads);
             break;
         case ModelType::MODEL_TYPE_GBXMODEL:
-            tag_data = make_model_tag<Parser::GBXModel, TagFourCC::TAG_FOURCC_GBXMODEL>(file_path, model_options.tags, jms_files);
+            tag_data = make_model_tag<Parser::GBXModel, TagFourCC::TAG_FOURCC_GBXMODEL>(file_path, model_options.tags, jms_files, model_options.weld_threshold, model_options.max_threads);
             break;
         default:
             std::terminate();
@@ -0,0 +1,421 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <invader/model/triangle_strip.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Invader::TriangleStrip {
+    static constexpr std::uint32_t NO_TRIANGLE = std::numeric_limits<std::uint32_t>::max();
+
+    // List of triangles that use each vertex, stored contiguously
+    struct VertexTriangles {
+        std::vector<std::uint32_t> offsets;
+        std::vector<std::uint32_t> triangles;
+
+        VertexTriangles(const std::vector<Triangle> &triangles, std::size_t vertex_count) : offsets(vertex_count + 1) {
+            for(auto &t : triangles) {
+                for(auto v : t) {
+                    this->offsets[v + 1]++;
+                }
+            }
+            for(std::size_t v = 0; v < vertex_count; v++) {
+                this->offsets[v + 1] += this->offsets[v];
+            }
+            this->triangles.resize(this->offsets[vertex_count]);
+
+            auto cursor = this->offsets;
+            std::uint32_t triangle_count = static_cast<std::uint32_t>(triangles.size());
+            for(std::uint32_t t = 0; t < triangle_count; t++) {
+                for(auto v : triangles[t]) {
+                    this->triangles[cursor[v]++] = t;
+                }
+            }
+        }
+
+        const std::uint32_t *begin(std::uint32_t vertex) const noexcept {
+            return this->triangles.data() + this->offsets[vertex];
+        }
+
+        const std::uint32_t *end(std::uint32_t vertex) const noexcept {
+            return this->triangles.data() + this->offsets[vertex + 1];
+        }
+
+        std::size_t count(std::uint32_t vertex) const noexcept {
+            return this->offsets[vertex + 1] - this->offsets[vertex];
+        }
+    };
+
+    // Scoring from "Linear-Speed Vertex Cache Optimisation" by Tom Forsyth
+    static constexpr std::size_t CACHE_SIZE = 32;
+    static constexpr float CACHE_DECAY_POWER = 1.5F;
+    static constexpr float LAST_TRIANGLE_SCORE = 0.75F;
+    static constexpr float VALENCE_BOOST_SCALE = 2.0F;
+    static constexpr float VALENCE_BOOST_POWER = 0.5F;
+
+    static float vertex_score(int cache_position, std::size_t remaining_triangles) noexcept {
+        if(remaining_triangles == 0) {
+            return -1.0F;
+        }
+
+        float score = 0.0F;
+        if(cache_position >= 0) {
+            if(cache_position < 3) {
+                score = LAST_TRIANGLE_SCORE;
+            }
+            else {
+                score = std::pow(1.0F - static_cast<float>(cache_position - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+            }
+        }
+
+        return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining_triangles), -VALENCE_BOOST_POWER);
+    }
+
+    std::vector<Triangle> optimize_vertex_cache(const std::vector<Triangle> &triangles, std::size_t vertex_count) {
+        std::size_t triangle_count = triangles.size();
+        if(triangle_count == 0) {
+            return {};
+        }
+
+        VertexTriangles vertex_triangles(triangles, vertex_count);
+
+        std::vector<std::size_t> remaining(vertex_count);
+        std::vector<int> cache_position(vertex_count, -1);
+        std::vector<float> score(vertex_count);
+        for(std::uint32_t v = 0; v < vertex_count; v++) {
+            remaining[v] = vertex_triangles.count(v);
+            score[v] = vertex_score(-1, remaining[v]);
+        }
+
+        std::vector<bool> added(triangle_count, false);
+        std::vector<float> triangle_score(triangle_count);
+        for(std::size_t t = 0; t < triangle_count; t++) {
+            auto &tri = triangles[t];
+            triangle_score[t] = score[tri[0]] + score[tri[1]] + score[tri[2]];
+        }
+
+        std::vector<Triangle> output;
+        output.reserve(triangle_count);
+
+        std::vector<std::uint32_t> cache, new_cache;
+        cache.reserve(CACHE_SIZE + 3);
+        new_cache.reserve(CACHE_SIZE + 3);
+
+        std::uint32_t best = static_cast<std::uint32_t>(std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin());
+        std::size_t cursor = 0;
+
+        while(output.size() < triangle_count) {
+            // If nothing in the cache is usable, take the next triangle we haven't added yet
+            if(best == NO_TRIANGLE) {
+                while(added[cursor]) {
+                    cursor++;
+                }
+                best = static_cast<std::uint32_t>(cursor);
+            }
+
+            auto &tri = triangles[best];
+            added[best] = true;
+            output.emplace_back(tri);
+
+            // Put this triangle's vertices at the front of the cache
+            new_cache.clear();
+            for(auto v : tri) {
+                if(std::find(new_cache.begin(), new_cache.end(), v) == new_cache.end()) {
+                    new_cache.emplace_back(v);
+                }
+                remaining[v]--;
+            }
+            for(auto v : cache) {
+                if(std::find(new_cache.begin(), new_cache.end(), v) == new_cache.end()) {
+                    new_cache.emplace_back(v);
+                }
+            }
+
+            // Anything pushed out of the cache loses its cache score
+            for(std::size_t c = CACHE_SIZE; c < new_cache.size(); c++) {
+                auto v = new_cache[c];
+                cache_position[v] = -1;
+                score[v] = vertex_score(-1, remaining[v]);
+            }
+            if(new_cache.size() > CACHE_SIZE) {
+                new_cache.resize(CACHE_SIZE);
+            }
+            std::swap(cache, new_cache);
+
+            for(std::size_t c = 0; c < cache.size(); c++) {
+                auto v = cache[c];
+                cache_position[v] = static_cast<int>(c);
+                score[v] = vertex_score(static_cast<int>(c), remaining[v]);
+            }
+
+            // Rescore everything touching the cache and find the best candidate
+            best = NO_TRIANGLE;
+            float best_score = -1.0F;
+            for(auto v : cache) {
+                for(auto *t = vertex_triangles.begin(v); t != vertex_triangles.end(v); t++) {
+                    if(added[*t]) {
+                        continue;
+                    }
+                    auto &candidate = triangles[*t];
+                    float s = score[candidate[0]] + score[candidate[1]] + score[candidate[2]];
+                    triangle_score[*t] = s;
+                    if(s > best_score) {
+                        best_score = s;
+                        best = *t;
+                    }
+                }
+            }
+        }
+
+        return output;
+    }
+
+    namespace {
+        // Directed edges (a -> b) of every triangle, sorted so neighbors can be found with a binary search
+        class EdgeTable {
+        public:
+            EdgeTable(const std::vector<Triangle> &triangles) {
+                std::uint32_t triangle_count = static_cast<std::uint32_t>(triangles.size());
+                this->edges.reserve(triangle_count * 3);
+                for(std::uint32_t t = 0; t < triangle_count; t++) {
+                    auto &tri = triangles[t];
+                    for(std::size_t i = 0; i < 3; i++) {
+                        this->edges.emplace_back(key(tri[i], tri[(i + 1) % 3]), t);
+                    }
+                }
+                std::sort(this->edges.begin(), this->edges.end());
+            }
+
+            // Find a triangle with the directed edge a -> b that is not marked
+            std::uint32_t find(std::uint32_t a, std::uint32_t b, const std::vector<std::uint32_t> &marks, std::uint32_t pass) const noexcept {
+                auto k = key(a, b);
+                for(auto i = std::lower_bound(this->edges.begin(), this->edges.end(), std::pair(k, std::uint32_t())); i != this->edges.end() && i->first == k; i++) {
+                    auto mark = marks[i->second];
+                    if(mark != USED && mark != pass) {
+                        return i->second;
+                    }
+                }
+                return NO_TRIANGLE;
+            }
+
+            static constexpr std::uint32_t UNUSED = 0;
+            static constexpr std::uint32_t USED = 1;
+
+        private:
+            std::vector<std::pair<std::uint64_t, std::uint32_t>> edges;
+
+            static std::uint64_t key(std::uint32_t a, std::uint32_t b) noexcept {
+                return (static_cast<std::uint64_t>(a) << 32) | b;
+            }
+        };
+    }
+
+    // Get the vertex of the triangle that follows the directed edge a -> b
+    static std::uint32_t third_vertex(const Triangle &triangle, std::uint32_t a, std::uint32_t b) noexcept {
+        for(std::size_t i = 0; i < 3; i++) {
+            if(triangle[i] == a && triangle[(i + 1) % 3] == b) {
+                return triangle[(i + 2) % 3];
+            }
+        }
+        return triangle[0];
+    }
+
+    // Extend a strip as far as it goes, marking every triangle taken with the given mark and adding it to taken
+    static void extend_strip(std::vector<std::uint32_t> &strip, std::vector<std::uint32_t> &taken, const std::vector<Triangle> &triangles, const EdgeTable &edges, std::vector<std::uint32_t> &marks, std::uint32_t mark) {
+        while(true) {
+            std::size_t n = strip.size();
+            auto a = strip[n - 2];
+            auto b = strip[n - 1];
+
+            // Even triangles are (a, b, x), so the next triangle shares a -> b; odd triangles are (a, x, b), so b -> a
+            bool even = ((n - 2) % 2) == 0;
+            auto next = even ? edges.find(a, b, marks, mark) : edges.find(b, a, marks, mark);
+            if(next == NO_TRIANGLE) {
+                return;
+            }
+
+            marks[next] = mark;
+            taken.emplace_back(next);
+            strip.emplace_back(even ? third_vertex(triangles[next], a, b) : third_vertex(triangles[next], b, a));
+        }
+    }
+
+    // Number of indices needed to join a strip starting with first_vertex onto the end of the output
+    static std::size_t join_cost(const std::vector<std::uint32_t> &output, std::uint32_t first_vertex) noexcept {
+        if(output.empty()) {
+            return 0;
+        }
+
+        // The next strip has to start on an even triangle so its winding is kept
+        bool even = (output.size() % 2) == 0;
+        if(output.back() == first_vertex) {
+            return even ? 0 : 1;
+        }
+        else {
+            return even ? 2 : 3;
+        }
+    }
+
+    static void join_strip(std::vector<std::uint32_t> &output, const std::vector<std::uint32_t> &strip) {
+        if(!output.empty()) {
+            auto last = output.back();
+            auto first = strip[0];
+            bool even = (output.size() % 2) == 0;
+
+            // A B C | C D E -> A B C C D E (the first index of the new strip makes the degenerates)
+            if(last == first) {
+                if(!even) {
+                    output.emplace_back(last);
+                }
+            }
+
+            // A B C | D E F -> A B C C D D E F (plus one more D if needed to keep the winding)
+            else {
+                output.emplace_back(last);
+                output.emplace_back(first);
+                if(!even) {
+                    output.emplace_back(first);
+                }
+            }
+        }
+
+        output.insert(output.end(), strip.begin(), strip.end());
+    }
+
+    std::vector<std::uint32_t> generate_triangle_strip(const std::vector<Triangle> &input_triangles, std::size_t vertex_count) {
+        // Degenerate triangles do nothing, so drop them
+        std::vector<Triangle> triangles;
+        triangles.reserve(input_triangles.size());
+        for(auto &t : input_triangles) {
+            if(t[0] != t[1] && t[1] != t[2] && t[0] != t[2]) {
+                triangles.emplace_back(t);
+            }
+        }
+
+        std::uint32_t triangle_count = static_cast<std::uint32_t>(triangles.size());
+        std::vector<std::uint32_t> output;
+        if(triangle_count == 0) {
+            return output;
+        }
+        output.reserve(triangle_count * 2 + 2);
+
+        EdgeTable edges(triangles);
+        VertexTriangles vertex_triangles(triangles, vertex_count);
+
+        // Triangles are marked as USED once they're in the output; other values are used when trying out strips
+        std::vector<std::uint32_t> marks(triangle_count, EdgeTable::UNUSED);
+        std::uint32_t pass = EdgeTable::USED;
+
+        // Number of unused neighbors; triangles with fewer neighbors are harder to reach later, so start with them
+        auto neighbor_count = [&triangles, &edges, &marks](std::uint32_t t) -> std::size_t {
+            auto &tri = triangles[t];
+            std::size_t count = 0;
+            for(std::size_t i = 0; i < 3; i++) {
+                if(edges.find(tri[(i + 1) % 3], tri[i], marks, EdgeTable::USED) != NO_TRIANGLE) {
+                    count++;
+                }
+            }
+            return count;
+        };
+
+        static constexpr std::size_t LOOKAHEAD = 16;
+        std::uint32_t cursor = 0;
+        std::uint32_t remaining = triangle_count;
+        std::vector<std::uint32_t> strip, best_strip;
+        std::vector<std::uint32_t> strip_triangles, best_strip_triangles; // triangles each strip took, in order
+
+        while(remaining > 0) {
+            std::uint32_t best_start = NO_TRIANGLE;
+            std::size_t best_neighbors = 0;
+
+            auto consider = [&](std::uint32_t t) {
+                auto neighbors = neighbor_count(t);
+                if(best_start == NO_TRIANGLE || neighbors < best_neighbors || (neighbors == best_neighbors && t < best_start)) {
+                    best_start = t;
+                    best_neighbors = neighbors;
+                }
+            };
+
+            // Prefer starting next to where the last strip ended, since that makes joining them cheaper
+            if(!output.empty()) {
+                auto last = output.back();
+                for(auto *t = vertex_triangles.begin(last); t != vertex_triangles.end(last); t++) {
+                    if(marks[*t] != EdgeTable::USED) {
+                        consider(*t);
+                    }
+                }
+            }
+
+            // Otherwise, look at the next few triangles in cache order
+            if(best_start == NO_TRIANGLE) {
+                while(marks[cursor] == EdgeTable::USED) {
+                    cursor++;
+                }
+                std::size_t looked = 0;
+                for(std::uint32_t t = cursor; t < triangle_count && looked < LOOKAHEAD; t++) {
+                    if(marks[t] != EdgeTable::USED) {
+                        consider(t);
+                        looked++;
+                    }
+                }
+            }
+
+            // Try each rotation of the starting triangle, keeping the longest strip (and the cheapest to join)
+            auto &start = triangles[best_start];
+            std::size_t best_cost = 0;
+            best_strip.clear();
+            best_strip_triangles.clear();
+            for(std::size_t r = 0; r < 3; r++) {
+                strip.clear();
+                strip.emplace_back(start[r]);
+                strip.emplace_back(start[(r + 1) % 3]);
+                strip.emplace_back(start[(r + 2) % 3]);
+                strip_triangles.clear();
+                strip_triangles.emplace_back(best_start);
+
+                marks[best_start] = ++pass;
+                extend_strip(strip, strip_triangles, triangles, edges, marks, pass);
+
+                auto cost = join_cost(output, strip[0]);
+                if(best_strip.empty() || strip.size() > best_strip.size() || (strip.size() == best_strip.size() && cost < best_cost)) {
+                    std::swap(best_strip, strip);
+                    std::swap(best_strip_triangles, strip_triangles);
+                    best_cost = cost;
+                }
+            }
+
+            // Commit it
+            for(auto t : best_strip_triangles) {
+                marks[t] = EdgeTable::USED;
+            }
+            remaining -= static_cast<std::uint32_t>(best_strip_triangles.size());
+
+            join_strip(output, best_strip);
+        }
+
+        return output;
+    }
+
+    std::vector<std::uint32_t> reorder_vertices(std::vector<std::uint32_t> &indices, std::size_t vertex_count) {
+        static constexpr std::uint32_t NOT_SET = std::numeric_limits<std::uint32_t>::max();
+        std::vector<std::uint32_t> new_index(vertex_count, NOT_SET);
+        std::vector<std::uint32_t> old_index;
+        old_index.reserve(vertex_count);
+
+        for(auto &i : indices) {
+            if(new_index[i] == NOT_SET) {
+                new_index[i] = static_cast<std::uint32_t>(old_index.size());
+                old_index.emplace_back(i);
+            }
+            i = new_index[i];
+        }
+
+        for(std::uint32_t v = 0; v < vertex_count; v++) {
+            if(new_index[v] == NOT_SET) {
+                old_index.emplace_back(v);
+            }
+        }
+
+        return old_index;
+    }
+}
@@ -3,56 +3,103 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <chrono>
+#include <thread>
 #include <invader/printf.hpp>
 #include <invader/version.hpp>
 #include <invader/tag/hek/header.hpp>
 #include <invader/tag/hek/definition.hpp>
 #include "../command_line_option.hpp"
+#include "../util/parallel.hpp"
 #include <invader/tag/parser/parser.hpp>
 #include <invader/file/file.hpp>
+#include <invader/file/tag_index.hpp>
 
 using namespace Invader;
 using namespace Invader::File;
 
-std::size_t refactor_tags(const std::filesystem::path &file_path, const std::vector<std::pair<TagFilePath, TagFilePath>> &replacements, bool check_only, bool dry_run) {
+struct RefactorTagResult {
+    // A reference to something being replaced was found when scanning the tag
+    bool matched = false;
+
+    // Number of references replaced
+    std::size_t count = 0;
+
+    // The tag could not be opened or refactored
+    bool failed = false;
+};
+
+// Check if remove_duplicate_slashes() would change the path
+static bool has_duplicate_slashes(std::string_view path) noexcept {
+    auto is_slash = [](char c) {
+        return c == '\\' || c == '/' || c == INVADER_PREFERRED_PATH_SEPARATOR;
+    };
+    for(std::size_t i = 1; i < path.size(); i++) {
+        if(is_slash(path[i - 1]) && is_slash(path[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static RefactorTagResult refactor_tag(const std::filesystem::path &file_path, const std::vector<std::pair<TagFilePath, TagFilePath>> &replacements, bool check_only, bool dry_run) {
+    RefactorTagResult result;
+
     // Open the tag
     auto tag = open_file(file_path);
     if(!tag.has_value()) {
         eprintf_error("Failed to open %s", file_path.string().c_str());
-        std::exit(EXIT_FAILURE);
+        result.failed = true;
+        return result;
     }
 
     // Get the header
     std::vector<std::byte> file_data;
-    std::size_t count = 0;
 
     try {
         const auto *header = reinterpret_cast<const HEK::TagFileHeader *>(tag->data());
         HEK::TagFileHeader::validate_header(header, tag->size());
 
-        auto tag_data = Parser::ParserStruct::parse_hek_tag_file(tag->data(), tag->size());
-        count = tag_data->refactor_references(replacements);
-        if(count) {
-            file_data = tag_data->generate_hek_tag_data(header->tag_fourcc);
+        // Most tags don't reference anything we're replacing, so check for that before parsing the whole tag. Paths with
+        // duplicate slashes are cleaned up when parsed, so those need to be parsed to know for sure.
+        std::vector<Parser::DependencyView> dependencies;
+        Parser::ParserStruct::scan_hek_tag_file_dependencies(tag->data(), tag->size(), dependencies);
+        for(auto &d : dependencies) {
+            for(auto &r : replacements) {
+                if((d.tag_fourcc == r.first.fourcc && d.path == r.first.path) || has_duplicate_slashes(d.path)) {
+                    result.matched = true;
+                    break;
+                }
+            }
+            if(result.matched) {
+                break;
+            }
         }
-        else {
-            return count;
+        if(!result.matched) {
+            return result;
         }
+
+        auto tag_data = Parser::ParserStruct::parse_hek_tag_file(tag->data(), tag->size());
+        result.count = tag_data->refactor_references(replacements);
+        if(result.count == 0 || check_only || dry_run) {
+            return result;
+        }
+        file_data = tag_data->generate_hek_tag_data(header->tag_fourcc);
     }
     catch(std::exception &e) {
         eprintf_error("Error: Failed to refactor in %s", file_path.string().c_str());
-        std::exit(EXIT_FAILURE);
+        result.failed = true;
+        return result;
     }
 
-    if(!check_only) {
-        if(!dry_run && !save_file(file_path, file_data)) {
-            eprintf_error("Error: Failed to write to %s. This tag will need to be manually edited.", file_path.string().c_str());
-            return 0;
-        }
-        oprintf_success("Replaced %zu reference%s in %s", count, count == 1 ? "" : "s", file_path.string().c_str());
+    // Replace the file all at once so an interrupted refactor can't leave a tag half-written
+    if(!save_file_atomically(file_path, file_data)) {
+        eprintf_error("Error: Failed to write to %s. This tag will need to be manually edited.", file_path.string().c_str());
+        result.count = 0;
+        result.failed = true;
     }
 
-    return count;
+    return result;
 }
 
 enum RefactorMode {
@@ -76,7 +123,9 @@ int main(int argc, char * const *argv) {
         CommandLineOption("tag", 'T', 2, "Refactor an individual tag. This can be specified multiple times but cannot be used with --recursive.", "<f> <t>"),
         CommandLineOption("groups", 'g', 2, "Refactor all tags of a given group to another group. All tags in the destination group must exist. This can be specified multiple times but cannot be used with --recursive or -M move.", "<f> <t>"),
         CommandLineOption("single-tag", 's', 1, "Make changes to a single tag, only, rather than the whole tags directory.", "<path>"),
-        CommandLineOption("replace-string", 'R', 2, "Replaces all instances in a path of <a> with <b>. This can be used multiple times for multiple replacements. If --groups or --recursive are used, this applies to the output of those. Otherwise, it applies to all tags.", "<a> <b>")
+        CommandLineOption("replace-string", 'R', 2, "Replaces all instances in a path of <a> with <b>. This can be used multiple times for multiple replacements. If --groups or --recursive are used, this applies to the output of those. Otherwise, it applies to all tags.", "<a> <b>"),
+        CommandLineOption("index", 'x', 0, "Create a tag index (.invader-index) in each tags directory that does not have one. Tag indices are kept up-to-date and used automatically when present, so only tags that reference a replaced tag need to be opened."),
+        CommandLineOption("threads", 'j', 1, "Set the number of threads to use for refactoring tags in parallel. Default: CPU thread count", "<#>")
     };
 
     static constexpr char DESCRIPTION[] = "Find and replace tag references.";
@@ -88,6 +137,8 @@ int main(int argc, char * const *argv) {
         std::optional<RefactorMode> mode;
         const char *single_tag = nullptr;
         bool unsafe = false;
+        bool index = false;
+        std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
 
         std::vector<std::pair<std::string, std::string>> string_replacements;
         std::vector<std::pair<TagFilePath, TagFilePath>> replacements;
@@ -156,6 +207,22 @@ int main(int argc, char * const *argv) {
             case 'R':
                 refactor_options.string_replacements.emplace_back(File::preferred_path_to_halo_path(arguments[0]), File::preferred_path_to_halo_path(arguments[1]));
                 return;
+            case 'x':
+                refactor_options.index = true;
+                return;
+            case 'j':
+                try {
+                    int threads = std::stoi(arguments[0]);
+                    if(threads < 1) {
+                        throw std::exception();
+                    }
+                    refactor_options.max_threads = static_cast<std::size_t>(threads);
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid number of threads %s", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                return;
         }
     });
 
@@ -193,6 +260,24 @@ int main(int argc, char * const *argv) {
         refactor_options.tags.emplace_back("tags");
     }
 
+    // Create any indices we need to create
+    if(refactor_options.index) {
+        for(auto &t : refactor_options.tags) {
+            if(TagIndex::exists(t)) {
+                continue;
+            }
+            try {
+                TagIndex index(t);
+                index.refresh();
+                index.save();
+            }
+            catch(std::exception &e) {
+                eprintf_error("Error: Failed to create a tag index for %s: %s", t.string().c_str(), e.what());
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
     // Figure out what we need to do
     std::vector<TagFile *> replacements_files;
     std::vector<TagFile> all_tags = load_virtual_tag_folder(refactor_options.tags);
@@ -476,10 +561,45 @@ int main(int argc, char * const *argv) {
         all_tags = load_virtual_tag_folder(refactor_options.tags);
     }
 
+    // If a tags directory has an index, use it to skip tags that don't reference anything we're replacing
+    std::vector<std::optional<TagIndex>> indices(refactor_options.tags.size());
+    if(tag_to_modify == &all_tags) {
+        for(std::size_t d = 0; d < refactor_options.tags.size(); d++) {
+            if(TagIndex::exists(refactor_options.tags[d])) {
+                try {
+                    auto &index = indices[d].emplace(refactor_options.tags[d]);
+                    index.refresh();
+                    index.save();
+                }
+                catch(std::exception &e) {
+                    eprintf_warn("Failed to update the tag index for %s: %s", refactor_options.tags[d].string().c_str(), e.what());
+                    indices[d].reset();
+                }
+            }
+        }
+    }
+    
+    auto index_says_unreferenced = [&indices, &replacements](const TagFile &tag) -> bool {
+        if(tag.tag_directory >= indices.size() || !indices[tag.tag_directory].has_value()) {
+            return false;
+        }
+        auto *indexed_tag = indices[tag.tag_directory]->find_tag(tag.tag_path);
+        if(!indexed_tag || !indexed_tag->dependencies_read || indexed_tag->invalid) {
+            return false;
+        }
+        for(auto &d : indexed_tag->dependencies) {
+            for(auto &r : replacements) {
+                if(d == r.first) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
     // Go through all the tags and see what needs edited
-    std::size_t total_tags = 0;
-    std::size_t total_replaced = 0;
-    std::vector<TagFile *> tags_to_do;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<TagFile *> candidates;
 
     for(auto &tag : *tag_to_modify) {
         bool skip = false;
@@ -519,16 +639,51 @@ int main(int argc, char * const *argv) {
                 break;
         }
         
-        if(!skip && refactor_tags(tag.full_path.string().c_str(), replacements, true, refactor_options.dry_run)) {
-            tags_to_do.emplace_back(&tag);
+        if(!skip && tag_to_modify == &all_tags) {
+            skip = index_says_unreferenced(tag);
+        }
+        
+        if(!skip) {
+            candidates.emplace_back(&tag);
+        }
+    }
+
+    // Check everything first so nothing gets written if any tag can't be refactored
+    auto candidate_count = candidates.size();
+    std::vector<RefactorTagResult> results(candidate_count);
+    for_each_in_parallel(candidate_count, refactor_options.max_threads, [&candidates, &results, &replacements, &refactor_options](std::size_t i) {
+        results[i] = refactor_tag(candidates[i]->full_path, replacements, true, refactor_options.dry_run);
+    });
+
+    std::vector<std::size_t> tags_to_do;
+    for(std::size_t i = 0; i < candidate_count; i++) {
+        if(results[i].failed) {
+            return EXIT_FAILURE;
+        }
+        if(results[i].count) {
+            tags_to_do.emplace_back(i);
         }
     }
 
     // Now actually do it
-    for(auto *tag : tags_to_do) {
-        std::size_t count = refactor_tags(tag->full_path.string().c_str(), replacements, false, refactor_options.dry_run);
-        if(count) {
-            total_replaced += count;
+    if(!refactor_options.dry_run) {
+        for_each_in_parallel(tags_to_do.size(), refactor_options.max_threads, [&candidates, &results, &tags_to_do, &replacements](std::size_t i) {
+            auto c = tags_to_do[i];
+            results[c] = refactor_tag(candidates[c]->full_path, replacements, false, false);
+        });
+    }
+
+    std::size_t total_matched = 0;
+    std::size_t total_tags = 0;
+    std::size_t total_replaced = 0;
+    bool write_failed = false;
+    for(std::size_t i = 0; i < candidate_count; i++) {
+        auto &result = results[i];
+        total_matched += result.matched;
+        write_failed = write_failed || result.failed;
+        if(result.count) {
+            oprintf_success("Replaced %zu reference%s in %s", result.count, result.count == 1 ? "" : "s", candidates[i]->full_path.string().c_str());
+            total_replaced += result.count;
             total_tags++;
         }
     }
@@ -536,9 +691,15 @@ int main(int argc, char * const *argv) {
     oprintf("Replaced %zu reference%s in %zu tag%s\n", total_replaced, total_replaced == 1 ? "" : "s", total_tags, total_tags == 1 ? "" : "s");
     
     if(refactor_options.dry_run) {
-        oprintf("Dry run complete\n");
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        oprintf("Dry run complete: %zu tag%s scanned, %zu matched, %zu would be rewritten (%.03f seconds)\n", candidate_count, candidate_count == 1 ? "" : "s", total_matched, total_tags, seconds);
     }
 
-    // Move things if needed
+    // Move things even if a tag couldn't be written; every other tag already points to the new paths, and the ones
+    // that failed were reported so they can be edited manually
     perform_move();
+
+    if(write_failed) {
+        return EXIT_FAILURE;
+    }
 }
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <numbers>
+#include <vector>
+
+#include <invader/sound/sound_resampler.hpp>
+#include <invader/printf.hpp>
+
+// Compare the built-in resampler against libsamplerate (the "best" quality, which was the only resampler before) and
+// fail if the difference is louder than the expected noise floor of each quality.
+int main() {
+    set_up_color_term();
+
+    using namespace Invader;
+    using namespace Invader::SoundResampler;
+
+    struct Conversion {
+        std::size_t from;
+        std::size_t to;
+    };
+    static constexpr const Conversion conversions[] = {
+        { 44100, 22050 },
+        { 22050, 44100 },
+        { 48000, 44100 },
+        { 44100, 48000 },
+        { 32000, 22050 }
+    };
+
+    struct Tier {
+        const char *name;
+        ResampleQuality quality;
+
+        /** Highest tone to test, relative to the lower of the two Nyquist frequencies (the rest is the filter's transition band) */
+        double passband;
+
+        /** Lowest signal-to-noise ratio allowed, treating the difference from libsamplerate as noise */
+        double minimum_snr;
+    };
+    static constexpr const Tier tiers[] = {
+        { "fast", ResampleQuality::RESAMPLE_QUALITY_FAST, 0.6, 55.0 },
+        { "medium", ResampleQuality::RESAMPLE_QUALITY_MEDIUM, 0.8, 85.0 }
+    };
+
+    static constexpr std::size_t CHANNEL_COUNT = 2;
+    bool passed = true;
+
+    for(auto &conversion : conversions) {
+        double ratio = static_cast<double>(conversion.to) / static_cast<double>(conversion.from);
+        double nyquist = static_cast<double>(std::min(conversion.from, conversion.to)) / 2.0;
+
+        for(auto &tier : tiers) {
+            // One second of a few tones spread over the passband, different for each channel
+            std::vector<float> pcm(conversion.from * CHANNEL_COUNT);
+            for(std::size_t f = 0; f < conversion.from; f++) {
+                double time = static_cast<double>(f) / static_cast<double>(conversion.from);
+                for(std::size_t c = 0; c < CHANNEL_COUNT; c++) {
+                    double sample = 0.0;
+                    for(std::size_t t = 1; t <= 4; t++) {
+                        double frequency = nyquist * tier.passband * static_cast<double>(t + c) / 5.0;
+                        sample += 0.2 * std::sin(2.0 * std::numbers::pi * frequency * time);
+                    }
+                    pcm[f * CHANNEL_COUNT + c] = static_cast<float>(sample);
+                }
+            }
+
+            auto reference = resample(pcm, CHANNEL_COUNT, ratio, ResampleQuality::RESAMPLE_QUALITY_BEST);
+            auto output = resample(pcm, CHANNEL_COUNT, ratio, tier.quality);
+
+            // The first and last 5% are skipped, since each resampler treats the edges differently
+            std::size_t frame_count = std::min(output.size(), reference.size()) / CHANNEL_COUNT;
+            std::size_t skip = frame_count / 20;
+            double signal = 0.0;
+            double noise = 0.0;
+            for(std::size_t s = skip * CHANNEL_COUNT; s < (frame_count - skip) * CHANNEL_COUNT; s++) {
+                double difference = static_cast<double>(output[s]) - static_cast<double>(reference[s]);
+                signal += static_cast<double>(reference[s]) * static_cast<double>(reference[s]);
+                noise += difference * difference;
+            }
+            double snr = noise > 0.0 ? 10.0 * std::log10(signal / noise) : INFINITY;
+
+            // Allow the lengths to differ by one frame due to rounding
+            std::size_t output_frames = output.size() / CHANNEL_COUNT;
+            std::size_t reference_frames = reference.size() / CHANNEL_COUNT;
+            bool ok = output_frames + 1 >= reference_frames && reference_frames + 1 >= output_frames && snr >= tier.minimum_snr;
+            passed = passed && ok;
+
+            oprintf("%5zu Hz -> %5zu Hz, %-6s: %6.1f dB (at least %.0f dB), %zu frames (libsamplerate: %zu)",
+                    conversion.from, conversion.to, tier.name, snr, tier.minimum_snr, output_frames, reference_frames);
+            if(ok) {
+                oprintf_success(" OK");
+            }
+            else {
+                oprintf_fail(" FAILED");
+            }
+        }
+    }
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -15,3 +15,15 @@ if(${INVADER_SOUND})
 
     do_windows_rc(invader-sound invader-sound.exe "Invader sound tag generation tool")
 endif()
+
+if(NOT DEFINED ${INVADER_RESAMPLE_CHECK})
+    set(INVADER_RESAMPLE_CHECK false CACHE BOOL "Build invader-resample-check (compares the built-in resampler against libsamplerate; not installed)")
+endif()
+
+if(${INVADER_RESAMPLE_CHECK})
+    add_executable(invader-resample-check
+        src/sound/resample_check.cpp
+    )
+
+    target_link_libraries(invader-resample-check invader ${INVADER_CRT_NOGLOB})
+endif()
@@ -7,9 +7,9 @@
 #include <invader/tag/parser/parser.hpp>
 #include <invader/sound/sound_encoder.hpp>
 #include <invader/sound/sound_reader.hpp>
+#include <invader/sound/sound_resampler.hpp>
 #include <invader/version.hpp>
 #include <vorbis/vorbisenc.h>
-#include <samplerate.h>
 #include <atomic>
 #include <thread>
 
@@ -27,11 +27,12 @@ struct SoundOptions {
     std::optional<SoundClass> sound_class;
     std::optional<std::uint32_t> sample_rate;
     std::optional<std::uint16_t> bitrate;
+    SoundResampler::ResampleQuality resample_quality = SoundResampler::ResampleQuality::RESAMPLE_QUALITY_BEST;
     std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
 };
 
 static void populate_pitch_range(std::vector<SoundReader::Sound> &permutations, const std::filesystem::path &directory, std::uint32_t &highest_sample_rate, std::uint16_t &highest_channel_count);
-static void process_permutation_thread(SoundReader::Sound *permutation, std::uint16_t highest_sample_rate, SoundFormat format, std::uint16_t highest_channel_count, std::atomic<std::size_t> *thread_count, bool fit_adpcm_block_size);
+static void process_permutation_thread(SoundReader::Sound *permutation, std::uint16_t highest_sample_rate, SoundFormat format, std::uint16_t highest_channel_count, std::atomic<std::size_t> *thread_count, bool fit_adpcm_block_size, SoundResampler::ResampleQuality resample_quality);
 
 template<typename T> static std::vector<std::byte> make_sound_tag(const std::filesystem::path &tag_path, const std::filesystem::path &data_path, SoundOptions &sound_options) {
     static constexpr std::size_t XBOX_ADPCM_SPLIT_SIZE = 65520;
@@ -253,7 +254,7 @@ template<typename T> static std::vector<std::byte> make_sound_tag(const std::fil
             total_sound_count++;
             wait_until_threads_are_open();
             thread_count++;
-            std::thread(process_permutation_thread, &permutation, highest_sample_rate, format, highest_channel_count, &thread_count, sound_tag.flags & SoundFlagsFlag::SOUND_FLAGS_FLAG_FIT_TO_ADPCM_BLOCKSIZE).detach();
+            std::thread(process_permutation_thread, &permutation, highest_sample_rate, format, highest_channel_count, &thread_count, sound_tag.flags & SoundFlagsFlag::SOUND_FLAGS_FLAG_FIT_TO_ADPCM_BLOCKSIZE, sound_options.resample_quality).detach();
         }
     }
 
@@ -651,7 +652,8 @@ int main(int argc, const char **argv) {
         CommandLineOption("compress-level", 'l', 1, "Set the compression level. This can be between 0.0 and 1.0. For Ogg Vorbis, higher levels result in better quality but worse sizes. Default: 0.8", "<lvl>"),
         CommandLineOption("bitrate", 'R', 1, "Set the bitrate in kilobits per second. This only applies to vorbis.", "<br>"),
         CommandLineOption("class", 'c', 1, "Set the class. This is required when generating new sounds. Can be: ambient_computers, ambient_machinery, ambient_nature, device_computers, device_door, device_force_field, device_machinery, device_nature, first_person_damage, game_event, music, object_impacts, particle_impacts, projectile_impact, projectile_detonation, scripted_dialog_force_unspatialized, scripted_dialog_other, scripted_dialog_player, scripted_effect, slow_particle_impacts, unit_dialog, unit_footsteps, vehicle_collision, vehicle_engine, weapon_charge, weapon_empty, weapon_fire, weapon_idle, weapon_overheat, weapon_ready, weapon_reload", "<class>"),
-        CommandLineOption("threads", 'j', 1, "Set the number of threads to use for parallel resampling and encoding. Default: CPU thread count")
+        CommandLineOption("threads", 'j', 1, "Set the number of threads to use for parallel resampling and encoding. Default: CPU thread count"),
+        CommandLineOption("resample-quality", 'Q', 1, "Set the resampling quality. Can be: fast, medium, or best. Fast and medium use a built-in polyphase filter and are intended for previews. Default: best", "<q>")
     };
 
     static constexpr char DESCRIPTION[] = "Create or modify a sound tag.";
@@ -750,6 +752,16 @@ int main(int argc, const char **argv) {
                     std::exit(EXIT_FAILURE);
                 }
                 break;
+
+            case 'Q': {
+                auto quality = SoundResampler::ResampleQuality_from_string(arguments[0]);
+                if(!quality.has_value()) {
+                    eprintf_error("Unknown resample quality %s (should be \"fast\", \"medium\", or \"best\")", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                sound_options.resample_quality = *quality;
+                break;
+            }
         }
     });
 
@@ -883,7 +895,7 @@ static void populate_pitch_range(std::vector<SoundReader::Sound> &permutations,
     }
 }
 
-static void process_permutation_thread(SoundReader::Sound *permutation, std::uint16_t highest_sample_rate, SoundFormat format, std::uint16_t highest_channel_count, std::atomic<std::size_t> *thread_count, bool fit_adpcm_block_size) {
+static void process_permutation_thread(SoundReader::Sound *permutation, std::uint16_t highest_sample_rate, SoundFormat format, std::uint16_t highest_channel_count, std::atomic<std::size_t> *thread_count, bool fit_adpcm_block_size, SoundResampler::ResampleQuality resample_quality) {
     // Calculate some stuff
     std::size_t bytes_per_sample = permutation->bits_per_sample / 8;
     std::size_t sample_count = permutation->pcm.size() / bytes_per_sample;
@@ -944,23 +956,18 @@ static void process_permutation_thread(SoundReader::Sound *permutation, std::uin
     if(static_cast<double>(highest_sample_rate) != permutation->sample_rate) {
         double ratio = static_cast<double>(highest_sample_rate) / permutation->sample_rate;
         std::vector<float> float_samples = SoundEncoder::convert_int_to_float(permutation->pcm, permutation->bits_per_sample);
-        std::vector<float> new_samples(float_samples.size() * ratio);
+        std::vector<float> new_samples;
         permutation->sample_rate = highest_sample_rate;
 
         // Resample it
-        SRC_DATA data = {};
-        data.data_in = float_samples.data();
-        data.data_out = new_samples.data();
-        data.input_frames = float_samples.size() / permutation->channel_count;
-        data.output_frames = new_samples.size() / permutation->channel_count;
-        data.src_ratio = ratio;
-        int res = src_simple(&data, SRC_SINC_BEST_QUALITY, permutation->channel_count);
-        if(res) {
+        try {
+            new_samples = SoundResampler::resample(float_samples, permutation->channel_count, ratio, resample_quality);
+        }
+        catch(std::exception &) {
             error_mutex.lock();
-            eprintf_error("Failed to resample: %s", src_strerror(res));
+            eprintf_error("Failed to resample %s", permutation->name.c_str());
             std::exit(EXIT_FAILURE);
         }
-        new_samples.resize(data.output_frames_gen * permutation->channel_count);
 
         // Set stuff
         if(format == SoundFormat::SOUND_FORMAT_16_BIT_PCM) {
@@ -983,24 +990,19 @@ static void process_permutation_thread(SoundReader::Sound *permutation, std::uin
         if(delta > 0) {
             double ratio = delta / static_cast<double>(quad_adpcm_block_size);
             std::vector<float> float_samples = SoundEncoder::convert_int_to_float(permutation->pcm, permutation->bits_per_sample);
-            std::vector<float> new_samples(float_samples.size() * ratio);
+            std::vector<float> new_samples;
             auto new_quad = static_cast<std::size_t>(quad_adpcm_block_size * ratio);
 
             // Resample it
-            SRC_DATA data = {};
-            data.data_in = float_samples.data();
-            data.data_out = new_samples.data();
-            data.input_frames = float_samples.size() / permutation->channel_count;
-            data.output_frames = new_samples.size() / permutation->channel_count;
-            data.src_ratio = ratio;
-            int res = src_simple(&data, SRC_SINC_BEST_QUALITY, permutation->channel_count);
-            if(res) {
+            try {
+                new_samples = SoundResampler::resample(float_samples, permutation->channel_count, ratio, resample_quality);
+            }
+            catch(std::exception &) {
                 error_mutex.lock();
-                eprintf_error("Failed to resample: %s", src_strerror(res));
+                eprintf_error("Failed to resample %s", permutation->name.c_str());
                 std::exit(EXIT_FAILURE);
             }
 
-            new_samples.resize(data.output_frames_gen * permutation->channel_count);
             auto new_int_samples = SoundEncoder::convert_float_to_int(new_samples, permutation->bits_per_sample);
 
             permutation->pcm.erase(permutation->pcm.begin(), permutation->pcm.begin() + quad_adpcm_block_size * bytes_per_sample);
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <invader/sound/sound_resampler.hpp>
+#include <invader/printf.hpp>
+#include <invader/error.hpp>
+#include <samplerate.h>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+namespace Invader::SoundResampler {
+    // Number of taps processed at once in the inner loop. Keeping the accumulators in a fixed-size array lets the
+    // compiler turn the loop into SIMD multiply-adds without needing -ffast-math to reorder the sum.
+    static constexpr std::size_t TAP_BLOCK = 8;
+
+    struct FilterParameters {
+        /** Number of zero crossings of the sinc function on each side of the center tap */
+        std::size_t zero_crossings;
+
+        /** Cutoff frequency relative to the lower of the two Nyquist frequencies */
+        double rolloff;
+
+        /** Kaiser window beta; higher values trade transition width for stopband attenuation */
+        double kaiser_beta;
+
+        /** Maximum number of phases to use for an exact ratio before falling back to interpolated phases */
+        std::size_t max_exact_phases;
+
+        /** Number of phases to use (plus one) when the ratio cannot be expressed exactly */
+        std::size_t interpolated_phases;
+    };
+
+    static const FilterParameters &filter_parameters(ResampleQuality quality) noexcept {
+        static constexpr FilterParameters FAST = { 8, 0.90, 6.0, 256, 64 };
+        static constexpr FilterParameters MEDIUM = { 32, 0.95, 9.0, 1024, 256 };
+        return quality == ResampleQuality::RESAMPLE_QUALITY_FAST ? FAST : MEDIUM;
+    }
+
+    std::optional<ResampleQuality> ResampleQuality_from_string(const char *quality) noexcept {
+        if(std::strcmp(quality, "fast") == 0) {
+            return ResampleQuality::RESAMPLE_QUALITY_FAST;
+        }
+        else if(std::strcmp(quality, "medium") == 0) {
+            return ResampleQuality::RESAMPLE_QUALITY_MEDIUM;
+        }
+        else if(std::strcmp(quality, "best") == 0) {
+            return ResampleQuality::RESAMPLE_QUALITY_BEST;
+        }
+        return std::nullopt;
+    }
+
+    // Zeroth order modified Bessel function of the first kind (for the Kaiser window)
+    static double bessel_i0(double x) noexcept {
+        double sum = 1.0;
+        double term = 1.0;
+        double half_x = x / 2.0;
+        for(std::size_t k = 1; k < 64; k++) {
+            term *= (half_x / k) * (half_x / k);
+            sum += term;
+            if(term < sum * 1E-17) {
+                break;
+            }
+        }
+        return sum;
+    }
+
+    // Find numerator / denominator == ratio where the numerator (number of phases) is at most max_numerator
+    static std::optional<std::pair<std::size_t, std::size_t>> exact_ratio(double ratio, std::size_t max_numerator) noexcept {
+        std::size_t h_prev = 0, h = 1;
+        std::size_t k_prev = 1, k = 0;
+        double x = ratio;
+
+        for(std::size_t i = 0; i < 64; i++) {
+            auto a = static_cast<std::size_t>(std::floor(x));
+            auto h_next = a * h + h_prev;
+            auto k_next = a * k + k_prev;
+            if(h_next > max_numerator || k_next == 0) {
+                break;
+            }
+            h_prev = h;
+            h = h_next;
+            k_prev = k;
+            k = k_next;
+
+            if(std::fabs(static_cast<double>(h) / static_cast<double>(k) - ratio) <= ratio * 1E-12) {
+                return std::pair(h, k);
+            }
+
+            double remainder = x - static_cast<double>(a);
+            if(remainder <= 0.0) {
+                break;
+            }
+            x = 1.0 / remainder;
+        }
+
+        return std::nullopt;
+    }
+
+    namespace {
+        struct FilterBank {
+            /** Number of taps per phase, padded to a multiple of TAP_BLOCK */
+            std::size_t taps;
+
+            /** Number of real taps before the center, i.e. how far back from the current input sample we read */
+            std::size_t history;
+
+            /** Number of phases */
+            std::size_t phases;
+
+            /** Coefficients (phases * taps) */
+            std::vector<float> coefficients;
+
+            const float *phase(std::size_t p) const noexcept {
+                return this->coefficients.data() + p * this->taps;
+            }
+        };
+    }
+
+    // Build a bank of windowed sinc filters. Phase p is evaluated at a fractional input offset of p / phase_divisor.
+    static FilterBank make_filter_bank(const FilterParameters &parameters, double ratio, std::size_t phases, std::size_t phase_divisor) {
+        // When downsampling, the cutoff has to move down to the output's Nyquist frequency to avoid aliasing
+        double cutoff = std::min(ratio, 1.0) * parameters.rolloff;
+        auto half_width = static_cast<std::size_t>(std::ceil(parameters.zero_crossings / cutoff));
+
+        FilterBank bank;
+        bank.history = half_width - 1;
+        bank.taps = (half_width * 2 + TAP_BLOCK - 1) / TAP_BLOCK * TAP_BLOCK;
+        bank.phases = phases;
+        bank.coefficients.resize(bank.taps * phases);
+
+        double window_divisor = bessel_i0(parameters.kaiser_beta);
+
+        for(std::size_t p = 0; p < phases; p++) {
+            double fraction = static_cast<double>(p) / phase_divisor;
+            float *coefficients = bank.coefficients.data() + p * bank.taps;
+            double sum = 0.0;
+
+            for(std::size_t t = 0; t < half_width * 2; t++) {
+                double x = fraction + static_cast<double>(bank.history) - static_cast<double>(t);
+                double u = x / half_width;
+                if(u <= -1.0 || u >= 1.0) {
+                    continue;
+                }
+
+                double sinc_x = std::numbers::pi * cutoff * x;
+                double sinc = sinc_x == 0.0 ? 1.0 : std::sin(sinc_x) / sinc_x;
+                double window = bessel_i0(parameters.kaiser_beta * std::sqrt(1.0 - u * u)) / window_divisor;
+                double value = cutoff * sinc * window;
+
+                coefficients[t] = static_cast<float>(value);
+                sum += value;
+            }
+
+            // Normalize so every phase has unity gain at DC
+            if(sum != 0.0) {
+                for(std::size_t t = 0; t < bank.taps; t++) {
+                    coefficients[t] = static_cast<float>(coefficients[t] / sum);
+                }
+            }
+        }
+
+        return bank;
+    }
+
+    static inline float convolve(const float *input, const float *coefficients, std::size_t taps) noexcept {
+        float sums[TAP_BLOCK] = {};
+        for(std::size_t t = 0; t < taps; t += TAP_BLOCK) {
+            for(std::size_t b = 0; b < TAP_BLOCK; b++) {
+                sums[b] += input[t + b] * coefficients[t + b];
+            }
+        }
+
+        float total = 0.0F;
+        for(std::size_t b = 0; b < TAP_BLOCK; b++) {
+            total += sums[b];
+        }
+        return total;
+    }
+
+    // Copy one channel out of the interleaved data, surrounded by enough silence that the filter never reads out of bounds
+    static std::vector<float> deinterleave_padded(const std::vector<float> &pcm, std::size_t channel, std::size_t channel_count, const FilterBank &bank) {
+        std::size_t frame_count = pcm.size() / channel_count;
+        std::vector<float> channel_data(bank.history + frame_count + bank.taps + 1);
+        for(std::size_t f = 0; f < frame_count; f++) {
+            channel_data[bank.history + f] = pcm[f * channel_count + channel];
+        }
+        return channel_data;
+    }
+
+    static std::vector<float> resample_polyphase(const std::vector<float> &pcm, std::size_t channel_count, double ratio, const FilterParameters &parameters) {
+        std::size_t input_frames = pcm.size() / channel_count;
+        auto exact = exact_ratio(ratio, parameters.max_exact_phases);
+
+        // Output frame f maps to input position f * step_numerator / step_denominator
+        if(exact.has_value()) {
+            auto [upsample, downsample] = *exact;
+            auto bank = make_filter_bank(parameters, ratio, upsample, upsample);
+            std::size_t output_frames = input_frames * upsample / downsample;
+            std::vector<float> output(output_frames * channel_count);
+
+            for(std::size_t c = 0; c < channel_count; c++) {
+                auto channel_data = deinterleave_padded(pcm, c, channel_count, bank);
+                for(std::size_t f = 0; f < output_frames; f++) {
+                    std::size_t position = f * downsample;
+                    output[f * channel_count + c] = convolve(channel_data.data() + position / upsample, bank.phase(position % upsample), bank.taps);
+                }
+            }
+
+            return output;
+        }
+
+        // Otherwise, linearly interpolate between the two nearest phases
+        std::size_t phases = parameters.interpolated_phases;
+        auto bank = make_filter_bank(parameters, ratio, phases + 1, phases);
+        auto output_frames = static_cast<std::size_t>(input_frames * ratio);
+        std::vector<float> output(output_frames * channel_count);
+
+        for(std::size_t c = 0; c < channel_count; c++) {
+            auto channel_data = deinterleave_padded(pcm, c, channel_count, bank);
+            for(std::size_t f = 0; f < output_frames; f++) {
+                double position = f / ratio;
+                double whole = std::floor(position);
+                double phase_position = (position - whole) * phases;
+                auto phase = static_cast<std::size_t>(phase_position);
+                if(phase >= phases) {
+                    phase = phases - 1;
+                }
+                auto weight = static_cast<float>(phase_position - phase);
+
+                const float *input = channel_data.data() + static_cast<std::size_t>(whole);
+                float a = convolve(input, bank.phase(phase), bank.taps);
+                float b = convolve(input, bank.phase(phase + 1), bank.taps);
+                output[f * channel_count + c] = a + (b - a) * weight;
+            }
+        }
+
+        return output;
+    }
+
+    static std::vector<float> resample_libsamplerate(const std::vector<float> &pcm, std::size_t channel_count, double ratio) {
+        std::vector<float> output(static_cast<std::size_t>(pcm.size() / channel_count * ratio) * channel_count);
+
+        SRC_DATA data = {};
+        data.data_in = pcm.data();
+        data.data_out = output.data();
+        data.input_frames = pcm.size() / channel_count;
+        data.output_frames = output.size() / channel_count;
+        data.src_ratio = ratio;
+        int res = src_simple(&data, SRC_SINC_BEST_QUALITY, channel_count);
+        if(res) {
+            eprintf_error("Failed to resample: %s", src_strerror(res));
+            throw InvalidArgumentException();
+        }
+
+        output.resize(data.output_frames_gen * channel_count);
+        return output;
+    }
+
+    std::vector<float> resample(const std::vector<float> &pcm, std::size_t channel_count, double ratio, ResampleQuality quality) {
+        if(channel_count == 0 || !(ratio > 0.0) || !std::isfinite(ratio)) {
+            throw InvalidArgumentException();
+        }
+
+        // Nothing to do
+        if(ratio == 1.0) {
+            return pcm;
+        }
+
+        switch(quality) {
+            case ResampleQuality::RESAMPLE_QUALITY_FAST:
+            case ResampleQuality::RESAMPLE_QUALITY_MEDIUM:
+                return resample_polyphase(pcm, channel_count, ratio, filter_parameters(quality));
+            case ResampleQuality::RESAMPLE_QUALITY_BEST:
+                return resample_libsamplerate(pcm, channel_count, ratio);
+        }
+
+        throw InvalidArgumentException();
+    }
+}
@@ -7,7 +7,7 @@ import os
 from definition import make_definitions
 from parser import make_parser
 
-bitfield_cpp = 15
+bitfield_cpp = 16
 
 if len(sys.argv) < bitfield_cpp+3:
     print("Usage: {} <a lovely bunch of cppoconuts.cpp> <json> [json [...]]".format(sys.argv[0]), file=sys.stderr)
@@ -145,7 +145,7 @@ with open(sys.argv[1], "w") as f:
         with open(sys.argv[bitfield_cpp+1], "w") as ecpp:
             make_definitions(f, ecpp, bcpp, all_enums, all_bitfields, all_structs_arranged)
 
-parser_files = map(lambda fname: open(fname, "w"), sys.argv[2:15])
+parser_files = map(lambda fname: open(fname, "w"), sys.argv[2:bitfield_cpp])
 make_parser(all_enums, all_bitfields, all_structs_arranged, all_structs,
             *parser_files)
 for f in parser_files:
@@ -121,7 +121,7 @@ def make_cache_format_data(struct_name, s, pre_compile, post_compile, all_used_s
             # Now actually work
             cpp_cache_format_data.write("        if(t_{}_count > 0) {{\n".format(name))
             cpp_cache_format_data.write("            r.{}.count = static_cast<std::uint32_t>(t_{}_count);\n".format(name, name))
-            cpp_cache_format_data.write("            auto &n = workload.structs.emplace_back();\n")
+            cpp_cache_format_data.write("            auto &n = workload.add_struct();\n")
             cpp_cache_format_data.write("            static constexpr std::size_t STRUCT_SIZE = sizeof({}::struct_little);\n".format(struct["struct"]))
             cpp_cache_format_data.write("            n.data.resize(t_{}_count * STRUCT_SIZE);\n".format(name))
             cpp_cache_format_data.write("            auto &p = workload.structs[struct_index].pointers.emplace_back();\n")
@@ -140,7 +140,7 @@ def make_cache_format_data(struct_name, s, pre_compile, post_compile, all_used_s
         elif struct["type"] == "TagDataOffset":
             cpp_cache_format_data.write("        std::size_t t_{}_size = this->{}.size();\n".format(name, name))
             cpp_cache_format_data.write("        if(t_{}_size > 0) {{\n".format(name))
-            cpp_cache_format_data.write("            auto &n = workload.structs.emplace_back();\n")
+            cpp_cache_format_data.write("            auto &n = workload.add_struct();\n")
             cpp_cache_format_data.write("            n.bsp = bsp;\n")
             cpp_cache_format_data.write("            n.data.insert(n.data.begin(), this->{}.begin(), this->{}.end());\n".format(name, name))
             cpp_cache_format_data.write("            auto &p = workload.structs[struct_index].pointers.emplace_back();\n")
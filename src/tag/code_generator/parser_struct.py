@@ -2,10 +2,15 @@
 
 def make_parser_struct(cpp_struct_value, all_enums, all_bitfields, all_used_structs, all_used_groups, hpp, struct_name, read_only, struct_title):
     hpp.write("    private:\n".format(struct_name))
-    hpp.write("        std::vector<ParserStructValue> get_values_internal() override;\n".format(struct_name))
+    hpp.write("        const std::vector<ParserStructValue::Descriptor> &get_value_descriptors() const override;\n".format(struct_name))
     hpp.write("    public:\n".format(struct_name))
-    cpp_struct_value.write("std::vector<ParserStructValue> {}::get_values_internal() {{\n".format(struct_name))
-    cpp_struct_value.write("    std::vector<ParserStructValue> values;\n")
+
+    # Descriptors are made once per class, getting each value's offset from a default-constructed struct
+    cpp_struct_value.write("static std::vector<ParserStructValue::Descriptor> {}_value_descriptors() {{\n".format(struct_name))
+    cpp_struct_value.write("    {} p;\n".format(struct_name))
+    cpp_struct_value.write("    const auto *base = reinterpret_cast<const std::byte *>(static_cast<const ParserStruct *>(&p));\n")
+    cpp_struct_value.write("    [[maybe_unused]] auto offset_of = [&base](const auto &member) { return static_cast<std::size_t>(reinterpret_cast<const std::byte *>(&member) - base); };\n")
+    cpp_struct_value.write("    std::vector<ParserStructValue::Descriptor> values;\n")
     cpp_struct_value.write("    values.reserve({});\n".format(len(all_used_structs)))
 
     for struct in all_used_structs:
@@ -31,7 +36,7 @@ def make_parser_struct(cpp_struct_value, all_enums, all_bitfields, all_used_stru
                 cpp_struct_value.write("    values.emplace_back(\"{}\", {});\n".format(i["name"], make_cpp_string(i["description"])))
                 break
 
-        first_arguments = "{},{},{},&this->{}".format(name, member_name_q, comment, struct["member_name"])
+        first_arguments = "{},{},{},offset_of(p.{})".format(name, member_name_q, comment, struct["member_name"])
         type = struct["type"]
 
         if type == "TagDependency":
@@ -60,7 +65,7 @@ def make_parser_struct(cpp_struct_value, all_enums, all_bitfields, all_used_stru
             vstruct = "std::vector<{}>".format(struct["struct"])
             cpp_struct_value.write("    values.emplace_back({}, ParserStructValue::get_object_in_array_template<{}>, ParserStructValue::get_array_size_template<{}>, ParserStructValue::delete_objects_in_array_template<{}>, ParserStructValue::insert_object_in_array_template<{}>, ParserStructValue::duplicate_object_in_array_template<{}>, ParserStructValue::swap_object_in_array_template<{}>, static_cast<std::size_t>({}), static_cast<std::size_t>({}), {});\n".format(first_arguments, vstruct, vstruct, vstruct, vstruct, vstruct, vstruct, minimum, maximum, struct_read_only))
         elif type == "TagDataOffset" or type == "TagString":
-            cpp_struct_value.write("    values.emplace_back({}, {});\n".format(first_arguments, struct_read_only))
+            cpp_struct_value.write("    values.emplace_back({}, ParserStructValue::ValueType::VALUE_TYPE_{}, nullptr, 1, false, false, {});\n".format(first_arguments, type.upper(), struct_read_only))
         elif type == "ScenarioScriptNodeValue" or type == "ScenarioStructureBSPArrayVertex":
             pass
         else:
@@ -130,6 +135,10 @@ def make_parser_struct(cpp_struct_value, all_enums, all_bitfields, all_used_stru
 
     cpp_struct_value.write("    return values;\n")
     cpp_struct_value.write("}\n")
+    cpp_struct_value.write("const std::vector<ParserStructValue::Descriptor> &{}::get_value_descriptors() const {{\n".format(struct_name))
+    cpp_struct_value.write("    static const auto descriptors = {}_value_descriptors();\n".format(struct_name))
+    cpp_struct_value.write("    return descriptors;\n")
+    cpp_struct_value.write("}\n")
 
     hpp.write("        const char *struct_name() const override;\n")
     cpp_struct_value.write("const char *{}::struct_name() const {{\n".format(struct_name))
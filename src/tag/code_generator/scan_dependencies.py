@@ -0,0 +1,87 @@
+# SPDX-License-Identifier: GPL-3.0-only
+
+def make_scan_dependencies_helpers(cpp_scan_dependencies):
+    cpp_scan_dependencies.write("    static void scan_dependency(const char *struct_name, const char *field_name, TagFourCC tag_fourcc, std::size_t path_size, const std::byte *&data, std::size_t &data_size, std::vector<DependencyView> *dependencies) {\n")
+    cpp_scan_dependencies.write("        if(path_size == 0) {\n")
+    cpp_scan_dependencies.write("            return;\n")
+    cpp_scan_dependencies.write("        }\n")
+    cpp_scan_dependencies.write("        if(path_size + 1 > data_size) {\n")
+    cpp_scan_dependencies.write("            eprintf_error(\"Failed to read dependency %s::%s: %zu bytes needed > %zu bytes available\", struct_name, field_name, path_size, data_size);\n")
+    cpp_scan_dependencies.write("            throw OutOfBoundsException();\n")
+    cpp_scan_dependencies.write("        }\n")
+    cpp_scan_dependencies.write("        const char *path = reinterpret_cast<const char *>(data);\n")
+    cpp_scan_dependencies.write("        if(std::memchr(path, 0, path_size) != nullptr) {\n")
+    cpp_scan_dependencies.write("            eprintf_error(\"Failed to read dependency %s::%s: size is smaller than expected (%zu expected > %zu actual)\", struct_name, field_name, path_size, std::strlen(path));\n")
+    cpp_scan_dependencies.write("            throw InvalidTagDataException();\n")
+    cpp_scan_dependencies.write("        }\n")
+    cpp_scan_dependencies.write("        if(path[path_size] != 0) {\n")
+    cpp_scan_dependencies.write("            eprintf_error(\"Failed to read dependency %s::%s: missing null terminator\", struct_name, field_name);\n")
+    cpp_scan_dependencies.write("            throw InvalidTagDataException();\n")
+    cpp_scan_dependencies.write("        }\n")
+    cpp_scan_dependencies.write("        if(dependencies) {\n")
+    cpp_scan_dependencies.write("            dependencies->push_back({ tag_fourcc, std::string_view(path, path_size) });\n")
+    cpp_scan_dependencies.write("        }\n")
+    cpp_scan_dependencies.write("        data += path_size + 1;\n")
+    cpp_scan_dependencies.write("        data_size -= path_size + 1;\n")
+    cpp_scan_dependencies.write("    }\n\n")
+    cpp_scan_dependencies.write("    static const std::byte *scan_block(const char *struct_name, const char *field_name, std::size_t size, const std::byte *&data, std::size_t &data_size) {\n")
+    cpp_scan_dependencies.write("        if(size > data_size) {\n")
+    cpp_scan_dependencies.write("            eprintf_error(\"Failed to read %s::%s: %zu bytes needed > %zu bytes available\", struct_name, field_name, size, data_size);\n")
+    cpp_scan_dependencies.write("            throw OutOfBoundsException();\n")
+    cpp_scan_dependencies.write("        }\n")
+    cpp_scan_dependencies.write("        const auto *block = data;\n")
+    cpp_scan_dependencies.write("        data += size;\n")
+    cpp_scan_dependencies.write("        data_size -= size;\n")
+    cpp_scan_dependencies.write("        return block;\n")
+    cpp_scan_dependencies.write("    }\n\n")
+
+# Whether or not a struct has anything stored after it in the tag data (tag references, data blocks, or reflexives)
+def has_variable_data(struct_name, all_structs):
+    for s in all_structs:
+        if s["name"] == struct_name:
+            if "inherits" in s and has_variable_data(s["inherits"], all_structs):
+                return True
+            for f in s["fields"]:
+                if f["type"] == "TagDependency" or f["type"] == "TagDataOffset" or f["type"] == "TagReflexive":
+                    return True
+            return False
+    return False
+
+def make_scan_dependencies(all_used_structs, all_structs, struct_name, hpp, cpp_scan_dependencies):
+    hpp.write("\n        /**\n")
+    hpp.write("         * Find the tag references in HEK tag data without parsing it.\n")
+    hpp.write("         * @param data         Data to read from for tag references, reflexives, and data blocks; this is advanced past them\n")
+    hpp.write("         * @param data_size    Size of the buffer; this is decreased by the amount of data read\n")
+    hpp.write("         * @param data_this    Pointer to the struct\n")
+    hpp.write("         * @param dependencies Vector to add non-null references to, or nullptr to only skip over the data\n")
+    hpp.write("         */\n")
+    hpp.write("        static void scan_hek_tag_data_dependencies(const std::byte *&data, std::size_t &data_size, const std::byte *data_this, std::vector<DependencyView> *dependencies);\n")
+
+    def is_read(struct):
+        return not ("cache_only" in struct and struct["cache_only"]) and not ("unused" in struct and struct["unused"]) and not ("hidden" in struct and struct["hidden"])
+
+    scanned = [s for s in all_used_structs if s["type"] == "TagDependency" or s["type"] == "TagReflexive" or s["type"] == "TagDataOffset"]
+
+    cpp_scan_dependencies.write("    void {}::scan_hek_tag_data_dependencies([[maybe_unused]] const std::byte *&data, [[maybe_unused]] std::size_t &data_size, [[maybe_unused]] const std::byte *data_this, [[maybe_unused]] std::vector<DependencyView> *dependencies) {{\n".format(struct_name))
+    if len(scanned) > 0:
+        cpp_scan_dependencies.write("        const auto &h = *reinterpret_cast<const struct_big *>(data_this);\n")
+    for struct in scanned:
+        name = struct["member_name"]
+        dependencies = "dependencies" if is_read(struct) else "nullptr"
+        if struct["type"] == "TagDependency":
+            cpp_scan_dependencies.write("        scan_dependency(\"{}\", \"{}\", h.{}.tag_fourcc, h.{}.path_size, data, data_size, {});\n".format(struct_name, name, name, name, dependencies))
+        elif struct["type"] == "TagReflexive":
+            reflexive_struct = struct["struct"]
+            cpp_scan_dependencies.write("        if(std::size_t h_{}_count = h.{}.count; h_{}_count > 0) {{\n".format(name, name, name))
+            if has_variable_data(reflexive_struct, all_structs):
+                cpp_scan_dependencies.write("            const auto *array = scan_block(\"{}\", \"{}\", sizeof({}::struct_big) * h_{}_count, data, data_size);\n".format(struct_name, name, reflexive_struct, name))
+                cpp_scan_dependencies.write("            for(std::size_t ref = 0; ref < h_{}_count; ref++) {{\n".format(name))
+                cpp_scan_dependencies.write("                {}::scan_hek_tag_data_dependencies(data, data_size, array + ref * sizeof({}::struct_big), {});\n".format(reflexive_struct, reflexive_struct, dependencies))
+                cpp_scan_dependencies.write("            }\n")
+            else:
+                # Nothing to find in the elements, so skip over them
+                cpp_scan_dependencies.write("            scan_block(\"{}\", \"{}\", sizeof({}::struct_big) * h_{}_count, data, data_size);\n".format(struct_name, name, reflexive_struct, name))
+            cpp_scan_dependencies.write("        }\n")
+        elif struct["type"] == "TagDataOffset":
+            cpp_scan_dependencies.write("        scan_block(\"{}\", \"{}\", h.{}.size, data, data_size);\n".format(struct_name, name, name))
+    cpp_scan_dependencies.write("    }\n")
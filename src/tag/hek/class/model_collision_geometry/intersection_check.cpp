@@ -1,5 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <algorithm>
+#include <cmath>
 #include "intersection_check.hpp"
 
 namespace Invader::HEK {
@@ -31,323 +33,394 @@ namespace Invader::HEK {
         return node_index;
     }
 
-    bool IntersectionCheck::check_for_intersection(
-        const Point3D<LittleEndian> &point_a,
-        const Point3D<LittleEndian> &point_b,
-        const ModelCollisionGeometryBSP3DNode<LittleEndian> *bsp3d_nodes,
-        std::uint32_t bsp3d_node_count,
-        const ModelCollisionGeometryBSPPlane<LittleEndian> *planes,
-        std::uint32_t plane_count,
-        const ModelCollisionGeometryBSPLeaf<LittleEndian> *leaves,
-        std::uint32_t leaf_count,
-        const ModelCollisionGeometryBSP2DNode<LittleEndian> *bsp2d_nodes,
-        std::uint32_t bsp2d_node_count,
-        const ModelCollisionGeometryBSP2DReference<LittleEndian> *bsp2d_references,
-        std::uint32_t bsp2d_reference_count,
-        const ModelCollisionGeometryBSPSurface<LittleEndian> *surfaces,
-        std::uint32_t surface_count,
-        const ModelCollisionGeometryBSPEdge<LittleEndian> *edges,
-        std::uint32_t edge_count,
-        const ModelCollisionGeometryBSPVertex<LittleEndian> *vertices,
-        std::uint32_t vertex_count,
-        Point3D<LittleEndian> &intersection_point,
-        std::uint32_t &surface_index,
-        std::uint32_t &leaf_index
-    ) {
-        IntersectionCheck check(point_a, point_b, bsp3d_nodes, bsp3d_node_count, planes, plane_count, leaves, leaf_count, bsp2d_nodes, bsp2d_node_count, bsp2d_references, bsp2d_reference_count, surfaces, surface_count, edges, edge_count, vertices, vertex_count);
-        return check.check_for_intersection_recursion(point_a, point_b, surface_index, leaf_index, intersection_point, {0});
-    }
+    IntersectionCheck::IntersectionCheck(const BSPData &bsp) {
+        // Planes
+        this->plane_i.reserve(bsp.plane_count);
+        this->plane_j.reserve(bsp.plane_count);
+        this->plane_k.reserve(bsp.plane_count);
+        this->plane_w.reserve(bsp.plane_count);
+        for(std::uint32_t p = 0; p < bsp.plane_count; p++) {
+            auto &plane = bsp.planes[p].plane;
+            this->plane_i.emplace_back(plane.vector.i);
+            this->plane_j.emplace_back(plane.vector.j);
+            this->plane_k.emplace_back(plane.vector.k);
+            this->plane_w.emplace_back(plane.w);
+        }
 
-    bool IntersectionCheck::check_for_intersection_bsp2d_node (
-        FlaggedInt<std::uint32_t> node_index,
-        const Point2D<LittleEndian> &point,
-        std::uint32_t &surface_index
-    ) {
-        // If we fall out, fail
-        if(node_index.is_null()) {
-            return false;
+        // BSP3D nodes, with their planes copied in so each step only touches one node (invalid planes are left as 0 and
+        // reported if the node is ever reached)
+        this->bsp3d_nodes.reserve(bsp.bsp3d_node_count);
+        for(std::uint32_t n = 0; n < bsp.bsp3d_node_count; n++) {
+            auto &node = bsp.bsp3d_nodes[n];
+            auto &new_node = this->bsp3d_nodes.emplace_back();
+            new_node.plane = node.plane.read();
+            new_node.children[0] = node.back_child.read().value;
+            new_node.children[1] = node.front_child.read().value;
+            if(new_node.plane < bsp.plane_count) {
+                new_node.i = this->plane_i[new_node.plane];
+                new_node.j = this->plane_j[new_node.plane];
+                new_node.k = this->plane_k[new_node.plane];
+                new_node.w = this->plane_w[new_node.plane];
+            }
+            else {
+                new_node.i = 0.0F;
+                new_node.j = 0.0F;
+                new_node.k = 0.0F;
+                new_node.w = 0.0F;
+            }
         }
 
-        // Until it's a surface, search
-        while(!node_index.flag_value() && !node_index.is_null()) {
-            if(node_index.int_value() >= this->bsp2d_node_count) {
-                eprintf_error("Invalid BSP2D node %u / %u in BSP.\n", node_index.int_value(), this->bsp2d_node_count);
-                throw OutOfBoundsException();
+        // Leaves
+        this->leaves.reserve(bsp.leaf_count);
+        for(std::uint32_t l = 0; l < bsp.leaf_count; l++) {
+            auto &leaf = bsp.leaves[l];
+            this->leaves.push_back(Leaf { leaf.first_bsp2d_reference.read(), leaf.bsp2d_reference_count.read() });
+        }
+
+        // BSP2D references, along with which axes to project onto for each (this is from <https://web.archive.org/web/20160605164254/http://www.halomods.com/ips/index.php?/topic/357-collision-bsp-structure/>)
+        static const std::uint8_t PLANE_INDICES[2][3][2] = {
+            {
+                {2, 1},
+                {0, 2},
+                {1, 0}
+            },
+            {
+                {1, 2},
+                {2, 0},
+                {0, 1}
             }
+        };
 
-            auto &bsp2d_node = this->bsp2d_nodes[node_index.int_value()];
-            if(point.distance_from_plane(bsp2d_node.plane) > 0.0F) {
-                node_index = bsp2d_node.right_child.read();
+        this->bsp2d_references.reserve(bsp.bsp2d_reference_count);
+        for(std::uint32_t r = 0; r < bsp.bsp2d_reference_count; r++) {
+            auto &reference = bsp.bsp2d_references[r];
+            auto &new_reference = this->bsp2d_references.emplace_back();
+            new_reference.plane = reference.plane.read().int_value();
+            new_reference.bsp2d_node = reference.bsp2d_node.read().value;
+            new_reference.projection_x = 0;
+            new_reference.projection_y = 1;
+
+            // Invalid planes are reported if the reference is ever reached
+            if(new_reference.plane >= bsp.plane_count) {
+                continue;
+            }
+
+            // Get the axis
+            auto &plane_ref = bsp.planes[new_reference.plane].plane;
+            float x = std::fabs(plane_ref.vector.i);
+            float y = std::fabs(plane_ref.vector.j);
+            float z = std::fabs(plane_ref.vector.k);
+            int axis;
+            float highest;
+            if(z < y || z < x) {
+                if(x > y) {
+                    axis = 0;
+                    highest = x;
+                }
+                else {
+                    axis = 1;
+                    highest = y;
+                }
             }
             else {
-                node_index = bsp2d_node.left_child.read();
+                axis = 2;
+                highest = z;
             }
-        }
+            int sign = highest > 0.0F ? 1 : 0;
 
-        // If we fell out, return false
-        if(node_index.is_null()) {
-            return false;
+            new_reference.projection_x = PLANE_INDICES[sign][axis][0];
+            new_reference.projection_y = PLANE_INDICES[sign][axis][1];
         }
 
-        if(node_index.int_value() >= this->surface_count) {
-            eprintf_error("Invalid surface %u / %u in BSP.\n", node_index.int_value(), this->surface_count);
-            throw OutOfBoundsException();
+        // BSP2D nodes
+        this->bsp2d_nodes.reserve(bsp.bsp2d_node_count);
+        for(std::uint32_t n = 0; n < bsp.bsp2d_node_count; n++) {
+            auto &node = bsp.bsp2d_nodes[n];
+            this->bsp2d_nodes.push_back(BSP2DNode { node.plane.vector.i, node.plane.vector.j, node.plane.w, { node.left_child.read().value, node.right_child.read().value } });
         }
 
-        //auto &surface = this->surfaces[node_index.int_value()];
-        surface_index = node_index.int_value();
-        return true;
+        this->surface_count = bsp.surface_count;
     }
 
-    bool IntersectionCheck::check_for_intersection_recursion (
-        const Point3D<LittleEndian> &point_a,
-        const Point3D<LittleEndian> &point_b,
-        std::uint32_t &surface_index,
-        std::uint32_t &leaf_index,
-        Point3D<LittleEndian> &intersection_point,
-        FlaggedInt<std::uint32_t> node_index)
-    {
-        // Check if they're equal. If so, there's no intersection
-        if(point_a == point_b) {
-            return false;
-        }
+    // Errors are reported out of line so the traversal functions stay small enough to inline
+    [[noreturn]] static void invalid_bsp3d_node(std::uint32_t node_index, std::uint32_t node_count) {
+        eprintf_error("Invalid BSP3D node %u / %u in BSP.\n", node_index, node_count);
+        throw OutOfBoundsException();
+    }
 
-        while(!node_index.flag_value() && !node_index.is_null()) {
-            // Make sure it's a valid index
-            if(node_index >= bsp3d_node_count) {
-                eprintf_error("Invalid BSP3D node %u / %u in BSP.\n", node_index.int_value(), this->bsp3d_node_count);
-                throw OutOfBoundsException();
-            }
+    [[noreturn]] static void invalid_plane(std::uint32_t plane_index, std::uint32_t plane_count) {
+        eprintf_error("Invalid plane index %u / %u in BSP.\n", plane_index, plane_count);
+        throw OutOfBoundsException();
+    }
 
-            // Get the node as well as front/back child info for each point
-            auto &node = bsp3d_nodes[node_index];
-            bool a_in_front_of_plane = point_in_front_of_plane(point_a, this->planes, plane_count, node.plane);
-            bool b_in_front_of_plane = point_in_front_of_plane(point_b, this->planes, plane_count, node.plane);
+    inline const IntersectionCheck::BSP3DNode &IntersectionCheck::get_bsp3d_node(FlaggedInt<std::uint32_t> node_index) const {
+        auto node_count = static_cast<std::uint32_t>(this->bsp3d_nodes.size());
+        if(node_index.value >= node_count) {
+            invalid_bsp3d_node(node_index.int_value(), node_count);
+        }
+        return this->bsp3d_nodes[node_index.value];
+    }
 
-            FlaggedInt<std::uint32_t> node_index_a = a_in_front_of_plane ? node.front_child : node.back_child;
-            FlaggedInt<std::uint32_t> node_index_b = b_in_front_of_plane ? node.front_child : node.back_child;
+    inline bool IntersectionCheck::point_in_front_of_plane(const Point3D<NativeEndian> &point, const BSP3DNode &node) const {
+        auto plane_count = static_cast<std::uint32_t>(this->plane_w.size());
+        if(node.plane >= plane_count) {
+            invalid_plane(node.plane, plane_count);
+        }
+        return (((node.i * point.x) + (node.j * point.y) + (node.k * point.z)) - node.w) >= 0;
+    }
 
-            // If they're the same, set node_index to one of them and keep going
-            if(node_index_a == node_index_b) {
-                node_index = node_index_a;
-            }
-            else {
-                // Calculate a point that's almost on the plane
-                auto &plane = planes[node.plane.read()].plane;
-                Point3D<LittleEndian> intersection_front;
-                bool p = intersect_plane_with_points(plane, point_a, point_b, &intersection_front);
-                if(!p) {
-                    return false;
-                }
+    FlaggedInt<std::uint32_t> IntersectionCheck::leaf_for_point(const Point3D<NativeEndian> &point) const {
+        FlaggedInt<std::uint32_t> node_index = {0};
+        while(!node_index.flag_value() && !node_index.is_null()) {
+            auto &node = this->get_bsp3d_node(node_index);
+            node_index.value = node.children[this->point_in_front_of_plane(point, node)];
+        }
+        return node_index;
+    }
 
-                Point3D<LittleEndian> point_a_intersection;
-                Point3D<LittleEndian> point_b_intersection;
-
-                std::uint32_t leaf_a_intersection, leaf_b_intersection, surface_a_intersection, surface_b_intersection;
-
-                // Can we get anything closer?
-                bool point_a_intersected = check_for_intersection_recursion(
-                    point_a,
-                    intersection_front,
-                    surface_a_intersection,
-                    leaf_a_intersection,
-                    point_a_intersection,
-                    node_index_a
-                );
-
-                bool point_b_intersected = check_for_intersection_recursion(
-                    intersection_front,
-                    point_b,
-                    surface_b_intersection,
-                    leaf_b_intersection,
-                    point_b_intersection,
-                    node_index_b
-                );
-
-                // If neither intersected, we don't have an intersection.
-                if(!point_a_intersected && !point_b_intersected) {
-                    return false;
+    void IntersectionCheck::leaves_for_points(const Point3D<LittleEndian> *points, std::size_t count, FlaggedInt<std::uint32_t> *leaves) const {
+        auto plane_count = static_cast<std::uint32_t>(this->plane_w.size());
+
+        for(std::size_t base = 0; base < count; base += POINT_LANES) {
+            std::size_t lanes = std::min(POINT_LANES, count - base);
+
+            // Unused lanes start out as null so they're already done
+            float x[POINT_LANES] = {}, y[POINT_LANES] = {}, z[POINT_LANES] = {};
+            FlaggedInt<std::uint32_t> node_index[POINT_LANES];
+            for(std::size_t l = 0; l < POINT_LANES; l++) {
+                if(l < lanes) {
+                    Point3D<NativeEndian> point = points[base + l];
+                    x[l] = point.x;
+                    y[l] = point.y;
+                    z[l] = point.z;
+                    node_index[l] = {0};
                 }
+                else {
+                    node_index[l] = FlaggedInt<std::uint32_t>::null();
+                }
+            }
 
-                // If both intersected, invalidate the furthest one
-                if(point_a_intersected && point_b_intersected) {
-                    float a_distance_squared = point_a_intersection.distance_from_point_squared(point_a);
-                    float b_distance_squared = point_b_intersection.distance_from_point_squared(point_a);
-
-                    if(a_distance_squared > b_distance_squared) {
-                        point_a_intersected = false;
+            // Step every lane down one level at a time until they all reach a leaf (or fall out), so the loads for
+            // each lane can be in flight at the same time
+            bool active;
+            do {
+                active = false;
+                for(std::size_t l = 0; l < POINT_LANES; l++) {
+                    if(node_index[l].flag_value()) {
+                        continue;
                     }
-                    else {
-                        point_b_intersected = false;
+                    active = true;
+
+                    auto &node = this->get_bsp3d_node(node_index[l]);
+                    if(node.plane >= plane_count) {
+                        invalid_plane(node.plane, plane_count);
                     }
-                }
 
-                // Now that we have one, return it
-                if(point_a_intersected) {
-                    intersection_point = point_a_intersection;
-                    leaf_index = leaf_a_intersection;
-                    surface_index = surface_a_intersection;
-                }
-                else {
-                    intersection_point = point_b_intersection;
-                    leaf_index = leaf_b_intersection;
-                    surface_index = surface_b_intersection;
+                    float distance = ((node.i * x[l]) + (node.j * y[l]) + (node.k * z[l])) - node.w;
+                    node_index[l].value = node.children[distance >= 0];
                 }
+            }
+            while(active);
 
-                return true;
+            for(std::size_t l = 0; l < lanes; l++) {
+                leaves[base + l] = node_index[l];
+            }
+        }
+    }
+
+    bool IntersectionCheck::check_bsp2d(FlaggedInt<std::uint32_t> node_index, float x, float y, std::uint32_t &surface_index) const {
+        // Until it's a surface, search
+        auto bsp2d_node_count = static_cast<std::uint32_t>(this->bsp2d_nodes.size());
+        while(!node_index.flag_value() && !node_index.is_null()) {
+            if(node_index.int_value() >= bsp2d_node_count) {
+                eprintf_error("Invalid BSP2D node %u / %u in BSP.\n", node_index.int_value(), bsp2d_node_count);
+                throw OutOfBoundsException();
             }
-        };
 
-        // Fell out of the BSP; null
+            auto &bsp2d_node = this->bsp2d_nodes[node_index.int_value()];
+            node_index.value = bsp2d_node.children[(((bsp2d_node.i * x) + (bsp2d_node.j * y)) - bsp2d_node.w) > 0.0F];
+        }
+
+        // If we fell out, return false
         if(node_index.is_null()) {
             return false;
         }
 
-        // Make sure the leaf is valid
-        std::uint32_t leaf_index_t = node_index.int_value();
-        if(leaf_index_t >= leaf_count) {
-            eprintf_error("invalid leaf index #%u / %u\n", leaf_index_t, leaf_count);
+        if(node_index.int_value() >= this->surface_count) {
+            eprintf_error("Invalid surface %u / %u in BSP.\n", node_index.int_value(), this->surface_count);
             throw OutOfBoundsException();
         }
 
-        // Get the leaf
-        auto &leaf = this->leaves[leaf_index_t];
+        surface_index = node_index.int_value();
+        return true;
+    }
+
+    IntersectionCheck::Hit IntersectionCheck::check_leaf(FlaggedInt<std::uint32_t> node_index, const Point3D<NativeEndian> &point_a, const Point3D<NativeEndian> &original_point_a, const Point3D<NativeEndian> &original_point_b) const {
+        // Make sure the leaf is valid
+        std::uint32_t leaf_index = node_index.int_value();
+        auto leaf_count = static_cast<std::uint32_t>(this->leaves.size());
+        if(leaf_index >= leaf_count) {
+            eprintf_error("invalid leaf index #%u / %u\n", leaf_index, leaf_count);
+            throw OutOfBoundsException();
+        }
 
         // Check if we have nil BSP2D references
-        std::uint32_t leaf_bsp2d_reference_count = leaf.bsp2d_reference_count.read();
-        std::uint32_t leaf_bsp2d_reference_index = leaf.first_bsp2d_reference.read();
+        auto &leaf = this->leaves[leaf_index];
+        std::uint32_t leaf_bsp2d_reference_count = leaf.bsp2d_reference_count;
+        std::uint32_t leaf_bsp2d_reference_index = leaf.first_bsp2d_reference;
         if(leaf_bsp2d_reference_count == 0) {
-            return false;
+            return {};
         }
 
         // Make sure the BSP2D references are valid
+        auto bsp2d_reference_count = static_cast<std::uint32_t>(this->bsp2d_references.size());
         std::uint64_t bsp2d_end = static_cast<std::uint64_t>(leaf_bsp2d_reference_index + leaf_bsp2d_reference_count);
-        if(bsp2d_end > this->bsp2d_reference_count) {
-            eprintf_error("invalid bsp2d reference range #%u - %zu / %u\n", leaf_bsp2d_reference_count, static_cast<std::size_t>(leaf_bsp2d_reference_index + leaf_bsp2d_reference_count), this->bsp2d_reference_count);
+        if(bsp2d_end > bsp2d_reference_count) {
+            eprintf_error("invalid bsp2d reference range #%u - %zu / %u\n", leaf_bsp2d_reference_count, static_cast<std::size_t>(leaf_bsp2d_reference_index + leaf_bsp2d_reference_count), bsp2d_reference_count);
             throw OutOfBoundsException();
         }
 
-        // Go through each BSP2D reference
-        bool ever_intersected = false;
+        // Go through each BSP2D reference, keeping the closest surface the segment passes through
+        auto plane_count = static_cast<std::uint32_t>(this->plane_w.size());
+        Hit hit;
         float closest_intersection_distance = 0.0F;
         for(std::uint32_t b = leaf_bsp2d_reference_index; b < bsp2d_end; b++) {
             auto &reference = this->bsp2d_references[b];
-            auto node_index = reference.bsp2d_node.read();
 
             // Make sure the plane is valid
-            auto plane = reference.plane.read();
-            if(plane >= this->plane_count) {
-                eprintf_error("invalid plane range for BSP #%u / %u\n", plane.int_value(), this->plane_count);
+            if(reference.plane >= plane_count) {
+                eprintf_error("invalid plane range for BSP #%u / %u\n", reference.plane, plane_count);
                 throw OutOfBoundsException();
             }
 
             // Make sure point a is in front and point b is behind
-            Point3D<LittleEndian> intersection;
-            if(!intersect_plane_with_points(this->planes[plane].plane, this->original_point_a, this->original_point_b, &intersection)) {
+            Point3D<NativeEndian> intersection;
+            if(!intersect_plane_with_points(this->get_plane(reference.plane), original_point_a, original_point_b, &intersection)) {
                 continue;
             }
 
             // Calculate the distance from the intersection to this. If it's further than what we got previously, disregard it
             float intersection_distance = point_a.distance_from_point_squared(intersection);
-            if(ever_intersected && closest_intersection_distance < intersection_distance) {
+            if(hit.found && closest_intersection_distance < intersection_distance) {
                 continue;
             }
 
-            // Okay, now let's see if we can get this going
-            auto plane_ref = this->planes[plane].plane;
-            float x = std::fabs(plane_ref.vector.i);
-            float y = std::fabs(plane_ref.vector.j);
-            float z = std::fabs(plane_ref.vector.k);
-            int axis = 0;
-            int sign = 0;
+            const float axes[3] = { intersection.x, intersection.y, intersection.z };
+            if(this->check_bsp2d(FlaggedInt<std::uint32_t> { reference.bsp2d_node }, axes[reference.projection_x], axes[reference.projection_y], hit.surface_index)) {
+                hit.found = true;
+                hit.point = intersection;
+                hit.leaf_index = leaf_index;
+                closest_intersection_distance = intersection_distance;
+            }
+        }
 
-            // This is from <https://web.archive.org/web/20160605164254/http://www.halomods.com/ips/index.php?/topic/357-collision-bsp-structure/>
-            // Get the axis
-            float highest;
-            if (z < y || z < x) {
-                if (x > y) {
-                    axis = 0;
-                    highest = x;
+        return hit;
+    }
+
+    bool IntersectionCheck::check_for_intersection(
+        const Point3D<NativeEndian> &point_a,
+        const Point3D<NativeEndian> &point_b,
+        Point3D<NativeEndian> &intersection_point,
+        std::uint32_t &surface_index,
+        std::uint32_t &leaf_index
+    ) const {
+        // Whenever the segment straddles a node's plane, it gets split in two at the plane. Each half is checked, and
+        // the hit closest to the start of the unsplit segment wins. A frame is kept for each split we're inside of.
+        struct Frame {
+            Point3D<NativeEndian> point_a;
+            Point3D<NativeEndian> split_point;
+            Point3D<NativeEndian> point_b;
+            FlaggedInt<std::uint32_t> point_b_node;
+            bool first_half_done;
+            Hit first_half;
+        };
+        std::vector<Frame> frames;
+
+        // Go down the tree from the given node until we reach a leaf, or until a plane splits the segment, in which case
+        // we push a frame and keep going with the first half
+        auto descend = [this, &frames, &point_a, &point_b](Point3D<NativeEndian> segment_a, Point3D<NativeEndian> segment_b, FlaggedInt<std::uint32_t> node_index) -> Hit {
+            while(true) {
+                // If the segment has no length, there's no intersection
+                if(segment_a == segment_b) {
+                    return {};
                 }
-                else {
-                    axis = 1;
-                    highest = y;
+
+                bool split = false;
+                while(!node_index.flag_value() && !node_index.is_null()) {
+                    auto &node = this->get_bsp3d_node(node_index);
+                    FlaggedInt<std::uint32_t> node_index_a = { node.children[this->point_in_front_of_plane(segment_a, node)] };
+                    FlaggedInt<std::uint32_t> node_index_b = { node.children[this->point_in_front_of_plane(segment_b, node)] };
+
+                    // If they're the same, keep going
+                    if(node_index_a.value == node_index_b.value) {
+                        node_index = node_index_a;
+                        continue;
+                    }
+
+                    // Otherwise, split it at the plane
+                    Point3D<NativeEndian> split_point;
+                    if(!intersect_plane_with_points(this->get_plane(node.plane), segment_a, segment_b, &split_point)) {
+                        return {};
+                    }
+
+                    frames.push_back(Frame { segment_a, split_point, segment_b, node_index_b, false, {} });
+                    segment_b = split_point;
+                    node_index = node_index_a;
+                    split = true;
+                    break;
                 }
+
+                if(split) {
+                    continue;
+                }
+
+                // Fell out of the BSP; null
+                if(node_index.is_null()) {
+                    return {};
+                }
+
+                return this->check_leaf(node_index, segment_a, point_a, point_b);
             }
-            else {
-                axis = 2;
-                highest = z;
-            }
+        };
 
-            if(highest > 0.0f) {
-                sign = 1;
+        Hit hit = descend(point_a, point_b, {0});
+        while(!frames.empty()) {
+            auto &frame = frames.back();
+
+            // Do the second half next
+            if(!frame.first_half_done) {
+                frame.first_half_done = true;
+                frame.first_half = hit;
+                auto split_point = frame.split_point;
+                auto segment_b = frame.point_b;
+                auto node_index = frame.point_b_node;
+                hit = descend(split_point, segment_b, node_index); // this may push more frames, so don't use frame after this
+                continue;
             }
 
-            // Projection plane
-            static const short PLANE_INDICES[2][3][2] = {
-                {
-                    {2, 1},
-                    {0, 2},
-                    {1, 0}
-                },
-                {
-                    {1, 2},
-                    {2, 0},
-                    {0, 1}
+            // If both intersected, use the closest one
+            auto &first_half = frame.first_half;
+            if(first_half.found && hit.found) {
+                float a_distance_squared = first_half.point.distance_from_point_squared(frame.point_a);
+                float b_distance_squared = hit.point.distance_from_point_squared(frame.point_a);
+                if(a_distance_squared <= b_distance_squared) {
+                    hit = first_half;
                 }
-            };
+            }
+            else if(first_half.found) {
+                hit = first_half;
+            }
 
-            Point2D<LittleEndian> point;
-            point.x = (&intersection.x)[PLANE_INDICES[sign][axis][0]];
-            point.y = (&intersection.x)[PLANE_INDICES[sign][axis][1]];
+            frames.pop_back();
+        }
 
-            if(check_for_intersection_bsp2d_node(node_index, point, surface_index)) {
-                ever_intersected = true;
-                intersection_point = intersection;
-                leaf_index = leaf_index_t;
-                closest_intersection_distance = intersection_distance;
-            }
+        if(!hit.found) {
+            return false;
         }
 
-        return ever_intersected;
+        intersection_point = hit.point;
+        surface_index = hit.surface_index;
+        leaf_index = hit.leaf_index;
+        return true;
     }
-
-    IntersectionCheck::IntersectionCheck(
-        const Point3D<LittleEndian> &original_point_a,
-        const Point3D<LittleEndian> &original_point_b,
-        const ModelCollisionGeometryBSP3DNode<LittleEndian> *bsp3d_nodes,
-        std::uint32_t bsp3d_node_count,
-        const ModelCollisionGeometryBSPPlane<LittleEndian> *planes,
-        std::uint32_t plane_count,
-        const ModelCollisionGeometryBSPLeaf<LittleEndian> *leaves,
-        std::uint32_t leaf_count,
-        const ModelCollisionGeometryBSP2DNode<LittleEndian> *bsp2d_nodes,
-        std::uint32_t bsp2d_node_count,
-        const ModelCollisionGeometryBSP2DReference<LittleEndian> *bsp2d_references,
-        std::uint32_t bsp2d_reference_count,
-        const ModelCollisionGeometryBSPSurface<LittleEndian> *surfaces,
-        std::uint32_t surface_count,
-        const ModelCollisionGeometryBSPEdge<LittleEndian> *edges,
-        std::uint32_t edge_count,
-        const ModelCollisionGeometryBSPVertex<LittleEndian> *vertices,
-        std::uint32_t vertex_count
-    ) :
-    original_point_a(original_point_a),
-    original_point_b(original_point_b),
-    bsp3d_nodes(bsp3d_nodes),
-    bsp3d_node_count(bsp3d_node_count),
-    planes(planes),
-    plane_count(plane_count),
-    leaves(leaves),
-    leaf_count(leaf_count),
-    bsp2d_nodes(bsp2d_nodes),
-    bsp2d_node_count(bsp2d_node_count),
-    bsp2d_references(bsp2d_references),
-    bsp2d_reference_count(bsp2d_reference_count),
-    surfaces(surfaces),
-    surface_count(surface_count),
-    edges(edges),
-    edge_count(edge_count),
-    vertices(vertices),
-    vertex_count(vertex_count) {}
 }
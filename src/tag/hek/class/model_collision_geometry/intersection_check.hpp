@@ -3,92 +3,124 @@
 #ifndef INVADER__TAG__HEK__CLASS__MODEL_COLLISION_GEOMETRY__INTERSECTION_CHECK_HPP
 #define INVADER__TAG__HEK__CLASS__MODEL_COLLISION_GEOMETRY__INTERSECTION_CHECK_HPP
 
+#include <vector>
 #include <invader/tag/hek/class/model_collision_geometry.hpp>
 
 namespace Invader::HEK {
+    /**
+     * Query-time copy of a collision BSP. Everything is native endian, BSP3D nodes carry their planes inline, the
+     * remaining planes are stored as separate arrays of each component, and traversal is done with loops instead of
+     * recursion.
+     *
+     * Indices are not validated up front since a BSP may have bad data in places that are never reached. They are
+     * checked as they are reached instead, reporting the same errors the tag data would.
+     */
     class IntersectionCheck {
     public:
-        static bool check_for_intersection(
-            const Point3D<LittleEndian> &point_a,
-            const Point3D<LittleEndian> &point_b,
-            const ModelCollisionGeometryBSP3DNode<LittleEndian> *bsp3d_nodes,
-            std::uint32_t bsp3d_node_count,
-            const ModelCollisionGeometryBSPPlane<LittleEndian> *planes,
-            std::uint32_t plane_count,
-            const ModelCollisionGeometryBSPLeaf<LittleEndian> *leaves,
-            std::uint32_t leaf_count,
-            const ModelCollisionGeometryBSP2DNode<LittleEndian> *bsp2d_nodes,
-            std::uint32_t bsp2d_node_count,
-            const ModelCollisionGeometryBSP2DReference<LittleEndian> *bsp2d_references,
-            std::uint32_t bsp2d_reference_count,
-            const ModelCollisionGeometryBSPSurface<LittleEndian> *surfaces,
-            std::uint32_t surface_count,
-            const ModelCollisionGeometryBSPEdge<LittleEndian> *edges,
-            std::uint32_t edge_count,
-            const ModelCollisionGeometryBSPVertex<LittleEndian> *vertices,
-            std::uint32_t vertex_count,
-            Point3D<LittleEndian> &intersection_point,
+        /**
+         * Number of points traversed at once by leaves_for_points()
+         */
+        static constexpr std::size_t POINT_LANES = 8;
+
+        /**
+         * Find the closest intersection of a line segment with the BSP's surfaces to point_a
+         * @param point_a            start of the segment
+         * @param point_b            end of the segment
+         * @param intersection_point set to where the intersection was found, if found
+         * @param surface_index      set to the surface that was hit, if found
+         * @param leaf_index         set to the leaf the surface was found in, if found
+         * @return                   true if an intersection was found
+         */
+        bool check_for_intersection(
+            const Point3D<NativeEndian> &point_a,
+            const Point3D<NativeEndian> &point_b,
+            Point3D<NativeEndian> &intersection_point,
             std::uint32_t &surface_index,
             std::uint32_t &leaf_index
-        );
+        ) const;
+
+        /**
+         * Find the leaf a point is in
+         * @param point point to check
+         * @return      leaf (flagged), or null if outside of the BSP
+         */
+        FlaggedInt<std::uint32_t> leaf_for_point(const Point3D<NativeEndian> &point) const;
+
+        /**
+         * Find the leaves for several points, walking POINT_LANES points down the tree at once
+         * @param points point array
+         * @param count  number of points
+         * @param leaves output leaf for each point (flagged), or null if outside of the BSP
+         */
+        void leaves_for_points(const Point3D<LittleEndian> *points, std::size_t count, FlaggedInt<std::uint32_t> *leaves) const;
+
+        /**
+         * Build the query structure
+         * @param bsp BSP to copy from
+         */
+        IntersectionCheck(const BSPData &bsp);
 
     private:
-        const Point3D<LittleEndian> &original_point_a;
-        const Point3D<LittleEndian> &original_point_b;
-        const ModelCollisionGeometryBSP3DNode<LittleEndian> *bsp3d_nodes;
-        std::uint32_t bsp3d_node_count;
-        const ModelCollisionGeometryBSPPlane<LittleEndian> *planes;
-        std::uint32_t plane_count;
-        const ModelCollisionGeometryBSPLeaf<LittleEndian> *leaves;
-        std::uint32_t leaf_count;
-        const ModelCollisionGeometryBSP2DNode<LittleEndian> *bsp2d_nodes;
-        std::uint32_t bsp2d_node_count;
-        const ModelCollisionGeometryBSP2DReference<LittleEndian> *bsp2d_references;
-        std::uint32_t bsp2d_reference_count;
-        const ModelCollisionGeometryBSPSurface<LittleEndian> *surfaces;
+        struct BSP3DNode {
+            float i, j, k, w;
+            std::uint32_t plane;
+            std::uint32_t children[2]; // back, front
+        };
+
+        struct BSP2DNode {
+            float i, j, w;
+            std::uint32_t children[2]; // left, right
+        };
+
+        struct BSP2DReference {
+            std::uint32_t plane;
+            std::uint32_t bsp2d_node;
+
+            // Axes of the 3D point to use as the 2D point, precomputed from the plane
+            std::uint8_t projection_x;
+            std::uint8_t projection_y;
+        };
+
+        struct Leaf {
+            std::uint32_t first_bsp2d_reference;
+            std::uint32_t bsp2d_reference_count;
+        };
+
+        // Result of a leaf or subtree test
+        struct Hit {
+            bool found = false;
+            Point3D<NativeEndian> point;
+            std::uint32_t surface_index;
+            std::uint32_t leaf_index;
+        };
+
+        // Planes (structure of arrays)
+        std::vector<float> plane_i;
+        std::vector<float> plane_j;
+        std::vector<float> plane_k;
+        std::vector<float> plane_w;
+
+        std::vector<BSP3DNode> bsp3d_nodes;
+        std::vector<Leaf> leaves;
+        std::vector<BSP2DReference> bsp2d_references;
+        std::vector<BSP2DNode> bsp2d_nodes;
         std::uint32_t surface_count;
-        const ModelCollisionGeometryBSPEdge<LittleEndian> *edges;
-        std::uint32_t edge_count;
-        const ModelCollisionGeometryBSPVertex<LittleEndian> *vertices;
-        std::uint32_t vertex_count;
-
-        bool check_for_intersection_bsp2d_node (
-            FlaggedInt<std::uint32_t> node_index,
-            const Point2D<LittleEndian> &point,
-            std::uint32_t &surface_index
-        );
-
-        bool check_for_intersection_recursion (
-            const Point3D<LittleEndian> &point_a,
-            const Point3D<LittleEndian> &point_b,
-            std::uint32_t &surface_index,
-            std::uint32_t &leaf_index,
-            Point3D<LittleEndian> &intersection_point,
-            FlaggedInt<std::uint32_t> node_index
-        );
-
-        IntersectionCheck(
-            const Point3D<LittleEndian> &original_point_a,
-            const Point3D<LittleEndian> &original_point_b,
-            const ModelCollisionGeometryBSP3DNode<LittleEndian> *bsp3d_nodes,
-            std::uint32_t bsp3d_node_count,
-            const ModelCollisionGeometryBSPPlane<LittleEndian> *planes,
-            std::uint32_t plane_count,
-            const ModelCollisionGeometryBSPLeaf<LittleEndian> *leaves,
-            std::uint32_t leaf_count,
-            const ModelCollisionGeometryBSP2DNode<LittleEndian> *bsp2d_nodes,
-            std::uint32_t bsp2d_node_count,
-            const ModelCollisionGeometryBSP2DReference<LittleEndian> *bsp2d_references,
-            std::uint32_t bsp2d_reference_count,
-            const ModelCollisionGeometryBSPSurface<LittleEndian> *surfaces,
-            std::uint32_t surface_count,
-            const ModelCollisionGeometryBSPEdge<LittleEndian> *edges,
-            std::uint32_t edge_count,
-            const ModelCollisionGeometryBSPVertex<LittleEndian> *vertices,
-            std::uint32_t vertex_count
-        );
+
+        Plane3D<NativeEndian> get_plane(std::uint32_t plane) const noexcept {
+            Plane3D<NativeEndian> p;
+            p.vector.i = this->plane_i[plane];
+            p.vector.j = this->plane_j[plane];
+            p.vector.k = this->plane_k[plane];
+            p.w = this->plane_w[plane];
+            return p;
+        }
+
+        const BSP3DNode &get_bsp3d_node(FlaggedInt<std::uint32_t> node_index) const;
+        bool point_in_front_of_plane(const Point3D<NativeEndian> &point, const BSP3DNode &node) const;
+        bool check_bsp2d(FlaggedInt<std::uint32_t> node_index, float x, float y, std::uint32_t &surface_index) const;
+        Hit check_leaf(FlaggedInt<std::uint32_t> node_index, const Point3D<NativeEndian> &point_a, const Point3D<NativeEndian> &original_point_a, const Point3D<NativeEndian> &original_point_b) const;
     };
-    
+
     FlaggedInt<std::uint32_t> leaf_for_point_of_bsp_tree(const Point3D<LittleEndian> &point, const ModelCollisionGeometryBSP3DNode<LittleEndian> *bsp3d_nodes, std::uint32_t bsp3d_node_count, const ModelCollisionGeometryBSPPlane<LittleEndian> *planes, std::uint32_t plane_count);
 }
 
@@ -1,27 +1,70 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include <invader/tag/hek/class/model_collision_geometry.hpp>
+#include <thread>
+#include <exception>
+#include <invader/error.hpp>
 #include "intersection_check.hpp"
 
 namespace Invader::HEK {
-    bool BSPData::check_for_intersection(const Point3D<LittleEndian> &point_a, const Point3D<LittleEndian> &point_b, Point3D<LittleEndian> *intersection_point, std::uint32_t *surface_index, std::uint32_t *leaf_index) const {
+    // Hold any results in a struct
+    struct PositionFound {
+        std::uint32_t leaf_index_found;
+        std::uint32_t surface_index_found;
+        HEK::Point3D<HEK::LittleEndian> intersection_point_found;
+    };
+    
+    static bool check_for_intersection_in_range(const IntersectionCheck &check, const Point3D<LittleEndian> &point, float range, std::vector<PositionFound> &positions_found, Point3D<LittleEndian> *intersection_point, std::uint32_t *surface_index, std::uint32_t *leaf_index);
+    
+    // Minimum number of points each thread should get when splitting up a batch; below this, threads aren't worth starting
+    static constexpr std::size_t MIN_POINTS_PER_THREAD = 64;
+    
+    // Run the function over [0, count) on as many threads as is worthwhile. The function is called once per thread with
+    // the range to process so it can set up anything it can reuse between points.
+    template <typename F> static void split_across_threads(std::size_t count, const F &function) {
+        std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
+        std::size_t thread_count = std::min(max_threads, count / MIN_POINTS_PER_THREAD);
+        if(thread_count <= 1) {
+            function(0, count);
+            return;
+        }
+        
+        // Exceptions can't leave a thread, so hold onto them and rethrow the first one afterwards
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> exceptions(thread_count);
+        threads.reserve(thread_count);
+        for(std::size_t t = 0; t < thread_count; t++) {
+            std::size_t start = count * t / thread_count;
+            std::size_t end = count * (t + 1) / thread_count;
+            threads.emplace_back([&function, &exceptions, t, start, end]() {
+                try {
+                    function(start, end);
+                }
+                catch(...) {
+                    exceptions[t] = std::current_exception();
+                }
+            });
+        }
+        for(auto &t : threads) {
+            t.join();
+        }
+        for(auto &e : exceptions) {
+            if(e) {
+                std::rethrow_exception(e);
+            }
+        }
+    }
+    
+    void BSPData::flatten() {
+        this->intersection_check = std::make_shared<const IntersectionCheck>(*this);
+    }
+    
+    static bool check_for_intersection_with(const IntersectionCheck &check, const Point3D<LittleEndian> &point_a, const Point3D<LittleEndian> &point_b, Point3D<LittleEndian> *intersection_point, std::uint32_t *surface_index, std::uint32_t *leaf_index) {
         // Set our variables up
-        Point3D<LittleEndian> new_intersection_point;
+        Point3D<NativeEndian> new_intersection_point;
         std::uint32_t new_surface_index, new_leaf_index;
         
-        if(IntersectionCheck::check_for_intersection(
-            point_a,
-            point_b,
-            this->bsp3d_nodes, this->bsp3d_node_count,
-            this->planes, this->plane_count,
-            this->leaves, this->leaf_count,
-            this->bsp2d_nodes, this->bsp2d_node_count,
-            this->bsp2d_references, this->bsp2d_reference_count,
-            this->surfaces, this->surface_count,
-            this->edges, this->edge_count, 
-            this->vertices, this->vertex_count,
-            new_intersection_point, new_surface_index, new_leaf_index
-        )) {
+        if(check.check_for_intersection(point_a, point_b, new_intersection_point, new_surface_index, new_leaf_index)) {
             if(intersection_point) *intersection_point = new_intersection_point;
             if(surface_index) *surface_index = new_surface_index;
             if(leaf_index) *leaf_index = new_leaf_index;
@@ -31,20 +74,32 @@ namespace Invader::HEK {
         return false;
     }
     
+    // Building a flattened copy costs as much as the BSP is big, so single queries don't do it behind the caller's back
+    static const IntersectionCheck &require_flattened(const std::shared_ptr<const IntersectionCheck> &check) {
+        if(!check) {
+            throw InvalidArgumentException();
+        }
+        return *check;
+    }
+    
+    bool BSPData::check_for_intersection(const Point3D<LittleEndian> &point_a, const Point3D<LittleEndian> &point_b, Point3D<LittleEndian> *intersection_point, std::uint32_t *surface_index, std::uint32_t *leaf_index) const {
+        return check_for_intersection_with(require_flattened(this->intersection_check), point_a, point_b, intersection_point, surface_index, leaf_index);
+    }
+    
     bool BSPData::check_for_intersection(const Point3D<LittleEndian> &point, float range, Point3D<LittleEndian> *intersection_point, std::uint32_t *surface_index, std::uint32_t *leaf_index) const {
+        std::vector<PositionFound> positions_found;
+        return check_for_intersection_in_range(require_flattened(this->intersection_check), point, range, positions_found, intersection_point, surface_index, leaf_index);
+    }
+    
+    static bool check_for_intersection_in_range(const IntersectionCheck &check, const Point3D<LittleEndian> &point, float range, std::vector<PositionFound> &positions_found, Point3D<LittleEndian> *intersection_point, std::uint32_t *surface_index, std::uint32_t *leaf_index) {
         // Plus or minus distance it
         auto position_above = point;
         position_above.z = position_above.z + range;
         auto position_below = point;
         position_below.z = position_below.z - range;
         
-        // Hold any results in a struct
-        struct PositionFound {
-            std::uint32_t leaf_index_found;
-            std::uint32_t surface_index_found;
-            HEK::Point3D<HEK::LittleEndian> intersection_point_found;
-        };
-        std::vector<PositionFound> positions_found;
+        // Start with nothing found (the vector is reused between calls to save on allocations)
+        positions_found.clear();
         
         // Start with the top position and work our way down
         auto current_position = position_above;
@@ -54,7 +109,8 @@ namespace Invader::HEK {
             std::uint32_t leaf_index_found;
             std::uint32_t surface_index_found;
             HEK::Point3D<HEK::LittleEndian> intersection_point_found;
-            auto val = this->check_for_intersection(
+            auto val = check_for_intersection_with(
+                check,
                 current_position,
                 position_below,
                 &intersection_point_found,
@@ -105,7 +161,15 @@ namespace Invader::HEK {
     }
     
     bool BSPData::check_if_point_inside_bsp(const Point3D<LittleEndian> &point, std::uint32_t *leaf_index) const {
-        auto result = HEK::leaf_for_point_of_bsp_tree(point, this->bsp3d_nodes, this->bsp3d_node_count, this->planes, this->plane_count);
+        FlaggedInt<std::uint32_t> result;
+        
+        // Use the flattened copy if we have it
+        if(this->intersection_check) {
+            result = this->intersection_check->leaf_for_point(point);
+        }
+        else {
+            result = HEK::leaf_for_point_of_bsp_tree(point, this->bsp3d_nodes, this->bsp3d_node_count, this->planes, this->plane_count);
+        }
         
         // If null, then we don't have anything
         if(result.is_null()) {
@@ -119,4 +183,44 @@ namespace Invader::HEK {
         
         return true;
     }
+    
+    std::vector<BSPData::QueryResult> BSPData::check_for_intersections(const std::vector<Point3D<LittleEndian>> &points, float range) const {
+        // Flatten it for just this batch if we haven't already
+        auto check = this->intersection_check;
+        if(!check) {
+            check = std::make_shared<const IntersectionCheck>(*this);
+        }
+        
+        std::vector<QueryResult> results(points.size());
+        split_across_threads(points.size(), [&check, &points, &results, range](std::size_t start, std::size_t end) {
+            std::vector<PositionFound> positions_found;
+            for(std::size_t p = start; p < end; p++) {
+                auto &result = results[p];
+                result.found = check_for_intersection_in_range(*check, points[p], range, positions_found, nullptr, &result.surface_index, &result.leaf_index);
+            }
+        });
+        return results;
+    }
+    
+    std::vector<BSPData::QueryResult> BSPData::check_if_points_inside_bsp(const std::vector<Point3D<LittleEndian>> &points) const {
+        auto check = this->intersection_check;
+        if(!check) {
+            check = std::make_shared<const IntersectionCheck>(*this);
+        }
+        
+        std::vector<QueryResult> results(points.size());
+        split_across_threads(points.size(), [&check, &points, &results](std::size_t start, std::size_t end) {
+            std::vector<FlaggedInt<std::uint32_t>> leaves(end - start);
+            check->leaves_for_points(points.data() + start, end - start, leaves.data());
+            for(std::size_t p = start; p < end; p++) {
+                auto &result = results[p];
+                auto leaf = leaves[p - start];
+                result.found = !leaf.is_null();
+                if(result.found) {
+                    result.leaf_index = leaf.int_value();
+                }
+            }
+        });
+        return results;
+    }
 }
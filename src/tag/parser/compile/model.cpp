@@ -151,9 +151,9 @@ namespace Invader::Parser {
             marker_ptr.struct_index = marker_struct_index;
 
             // Make the struct
-            auto &markers_struct = workload.structs.emplace_back();
+            auto &markers_struct = workload.add_struct();
             ModelMarker::struct_little *markers_struct_arr;
-            markers_struct.data = std::vector<std::byte>(marker_count * sizeof(*markers_struct_arr));
+            markers_struct.data.resize(marker_count * sizeof(*markers_struct_arr));
             markers_struct_arr = reinterpret_cast<decltype(markers_struct_arr)>(markers_struct.data.data());
 
             // Go through each marker
@@ -175,9 +175,9 @@ namespace Invader::Parser {
                 marker_ptr.struct_index = workload.structs.size();
 
                 // Make the instances
-                auto &instance_struct = workload.structs.emplace_back();
+                auto &instance_struct = workload.add_struct();
                 ModelMarkerInstance::struct_little *instances_struct_arr;
-                instance_struct.data = std::vector<std::byte>(sizeof(*instances_struct_arr) * instance_count);
+                instance_struct.data.resize(sizeof(*instances_struct_arr) * instance_count);
                 instances_struct_arr = reinterpret_cast<decltype(instances_struct_arr)>(instance_struct.data.data());
                 for(std::size_t i = 0; i < instance_count; i++) {
                     instances_struct_arr[i].node_index = marker_c.instances[i].node_index;
@@ -41,10 +41,14 @@ namespace Invader::Parser {
             if(object_count) { \
                 auto &object_struct = workload.structs[*scenario_struct.resolve_pointer(&scenario_data.objects.pointer)]; \
                 auto *object_array = reinterpret_cast<array_type::struct_little *>(object_struct.data.data()); \
+                /* find the position of each object and its offset position first so every BSP can check them all at once */ \
+                std::vector<HEK::Point3D<HEK::LittleEndian>> positions(object_count); \
+                std::vector<HEK::Point3D<HEK::LittleEndian>> positions_to_check(object_count); \
+                std::vector<bool> models_present(object_count); \
                 for(std::size_t o = 0; o < object_count; o++) { \
-                    std::uint32_t bsp_indices = 0; \
-                    std::uint32_t bsp_indices_technically_inside = 0; \
                     auto &object = object_array[o]; \
+                    positions[o] = object.position; \
+                    positions_to_check[o] = object.position; \
                     if(object.type != NULL_INDEX) { \
                         auto &type = this->palette[object.type].name; \
                         auto &object_data = *reinterpret_cast<Object::struct_little *>(workload.structs[*workload.tags[type.tag_id.index].base_struct].data.data()); \
@@ -60,14 +64,27 @@ namespace Invader::Parser {
                         } \
                         auto rotation = object.rotation; \
                         auto rotated = rotate_vector(object_bounding_offset, euler_to_matrix(rotation)); \
-                        auto position_to_check = object.position + rotated; \
+                        positions_to_check[o] = object.position + rotated; \
+                        models_present[o] = model_present; \
+                    } \
+                } \
+                std::vector<std::vector<BSPData::QueryResult>> inside_results(bsp_count); \
+                std::vector<std::vector<BSPData::QueryResult>> offset_inside_results(bsp_count); \
+                for(std::size_t b = 0; b < bsp_count; b++) { \
+                    inside_results[b] = bsp_data[b].check_if_points_inside_bsp(positions); \
+                    offset_inside_results[b] = bsp_data[b].check_if_points_inside_bsp(positions_to_check); \
+                } \
+                for(std::size_t o = 0; o < object_count; o++) { \
+                    std::uint32_t bsp_indices = 0; \
+                    std::uint32_t bsp_indices_technically_inside = 0; \
+                    auto &object = object_array[o]; \
+                    if(object.type != NULL_INDEX) { \
                         for(std::size_t b = 0; b < bsp_count; b++) { \
                             /* Check if we're inside this BSP */ \
-                            auto &bsp = bsp_data[b]; \
-                            if(bsp.check_if_point_inside_bsp(object.position)) { \
+                            if(inside_results[b][o].found) { \
                                 bsp_indices_technically_inside |= 1 << b; \
                             } \
-                            if(bsp.check_if_point_inside_bsp(position_to_check)) { \
+                            if(offset_inside_results[b][o].found) { \
                                 bsp_indices |= 1 << b; \
                             } \
                         } \
@@ -77,7 +94,7 @@ namespace Invader::Parser {
                         else if(warn_if_partially_outside) { \
                             /* If it's technically outside of a BSP due to bounding offset and we have a model, warn */ \
                             auto partially_outside = (bsp_indices ^ bsp_indices_technically_inside) & bsp_indices_technically_inside; \
-                            if(partially_outside && model_present) { \
+                            if(partially_outside && models_present[o]) { \
                                 REPORT_ERROR_PRINTF(workload, ERROR_TYPE_WARNING, tag_index, type_name " spawn #%zu is inside a BSP but offset outside, so it will be fullbright", o); \
                             } \
                         } \
@@ -168,6 +185,9 @@ namespace Invader::Parser {
             if(bsp_data_s.render_leaf_count) {
                 bsp_data_s.render_leaves = reinterpret_cast<const ScenarioStructureBSPLeaf::struct_little *>(workload.structs[*bsp_tag_struct->resolve_pointer(&bsp_tag_data.leaves.pointer)].data.data());
             }
+            
+            // Hold onto a flattened copy of the BSP for all of the lookups we're about to do
+            bsp_data_s.flatten();
         }
         
         return bsp_data;
@@ -183,6 +203,42 @@ namespace Invader::Parser {
             auto *encounter_array = reinterpret_cast<ScenarioEncounter::struct_little *>(encounter_struct.data.data());
             auto bsp_count = bsp_data.size();
             
+            // Gather every squad starting location and firing position for each BSP that its encounter will be checked
+            // against, so each BSP can look them all up in one batch. Raycasted and 3D positions are kept separate.
+            std::vector<std::vector<HEK::Point3D<HEK::LittleEndian>>> raycast_points(bsp_count);
+            std::vector<std::vector<HEK::Point3D<HEK::LittleEndian>>> inside_points(bsp_count);
+            std::vector<std::vector<std::size_t>> encounter_result_offsets(bsp_count, std::vector<std::size_t>(encounter_list_count));
+            for(std::size_t i = 0; i < encounter_list_count; i++) {
+                auto &encounter = scenario.encounters[i];
+                bool manual_bsp_index_specified = encounter.flags & HEK::ScenarioEncounterFlagsFlag::SCENARIO_ENCOUNTER_FLAGS_FLAG_MANUAL_BSP_INDEX_SPECIFIED;
+                bool raycast = !(encounter.flags & HEK::ScenarioEncounterFlagsFlag::SCENARIO_ENCOUNTER_FLAGS_FLAG__3D_FIRING_POSITIONS);
+                std::size_t start_bsp = manual_bsp_index_specified ? encounter_array[i].manual_bsp_index.read() : 0;
+                
+                for(std::size_t b = start_bsp; b < bsp_count; b++) {
+                    auto &points = raycast ? raycast_points[b] : inside_points[b];
+                    encounter_result_offsets[b][i] = points.size();
+                    for(auto &squad : encounter.squads) {
+                        for(auto &location : squad.starting_locations) {
+                            points.emplace_back(location.position);
+                        }
+                    }
+                    for(auto &f : encounter.firing_positions) {
+                        points.emplace_back(f.position);
+                    }
+                    if(manual_bsp_index_specified) {
+                        break;
+                    }
+                }
+            }
+            
+            // Raycasted positions look for a surface that is 0.5 world units above/below it
+            std::vector<std::vector<BSPData::QueryResult>> raycast_results(bsp_count);
+            std::vector<std::vector<BSPData::QueryResult>> inside_results(bsp_count);
+            for(std::size_t b = 0; b < bsp_count; b++) {
+                raycast_results[b] = bsp_data[b].check_for_intersections(raycast_points[b], 0.5F);
+                inside_results[b] = bsp_data[b].check_if_points_inside_bsp(inside_points[b]);
+            }
+            
             for(std::size_t i = 0; i < encounter_list_count; i++) {
                 auto &encounter = scenario.encounters[i];
                 auto &encounter_data = encounter_array[i];
@@ -247,6 +303,7 @@ namespace Invader::Parser {
                     firing_positions_indices.clear();
                     squad_positions_found.clear();
                     auto &bsp = bsp_data[b];
+                    auto *results = (raycast ? raycast_results[b] : inside_results[b]).data() + encounter_result_offsets[b][i];
 
                     // Go through each squad; add 1 to hits for every squad we find in the BSP
                     std::size_t squad_hits = 0;
@@ -255,61 +312,30 @@ namespace Invader::Parser {
                         std::size_t location_count = squad.starting_locations.size();
                         
                         for(std::size_t l = 0; l < location_count; l++) {
-                            auto &location = squad.starting_locations[l];
-                            
-                            // If raycasting check for a surface that is 0.5 world units above/below it
-                            bool found;
-                            std::optional<std::uint32_t> leaf_index;
-                            
-                            if(raycast) {
-                                std::uint32_t leaf;
-                                if((found = bsp.check_for_intersection(location.position, 0.5F, nullptr, nullptr, &leaf))) {
-                                    leaf_index = leaf;
-                                }
-                            }
-                            else {
-                                std::uint32_t leaf;
-                                if((found = bsp.check_if_point_inside_bsp(location.position, &leaf))) {
-                                    leaf_index = leaf; 
-                                }
-                            }
+                            auto &result = *(results++);
                             
                             // Set the cluster index
                             HEK::Index cluster_index;
-                            if(leaf_index.has_value()) {
-                                cluster_index = bsp.render_leaves[*leaf_index].cluster;
+                            if(result.found) {
+                                cluster_index = bsp.render_leaves[result.leaf_index].cluster;
                             }
                             else {
                                 cluster_index = NULL_INDEX;
                             }
                             
-                            squad_hits += found;
-                            squad_positions_found.emplace_back(SquadPositionFound { s, l, cluster_index, found });
+                            squad_hits += result.found;
+                            squad_positions_found.emplace_back(SquadPositionFound { s, l, cluster_index, result.found });
                         }
                     }
                     
                     // Go through each firing position
                     std::size_t firing_position_hits = 0;
-                    for(auto &f : encounter.firing_positions) {
-                        // Here are the indices we'll set
-                        bool in_bsp;
-                        std::uint32_t surface_index = 0;
-                        std::uint32_t leaf_index = 0;
-                        
-                        // Raycast stuff
-                        if(raycast) {
-                            in_bsp = bsp.check_for_intersection(f.position, 0.5F, nullptr, &surface_index, &leaf_index);
-                        }
-                        else {
-                            std::uint32_t leaf;
-                            if((in_bsp = bsp.check_if_point_inside_bsp(f.position, &leaf))) {
-                                leaf_index = leaf;
-                            }
-                        }
+                    for(std::size_t f = 0; f < firing_position_count; f++) {
+                        auto &result = *(results++);
                         
                         // If we're in the BSP, add it
-                        if(in_bsp) {
-                            firing_positions_indices.emplace_back(FiringPositionIndex {bsp.render_leaves[leaf_index].cluster, surface_index, true});
+                        if(result.found) {
+                            firing_positions_indices.emplace_back(FiringPositionIndex {bsp.render_leaves[result.leaf_index].cluster, result.surface_index, true});
                             firing_position_hits++;
                         }
                         else {
@@ -528,6 +554,32 @@ namespace Invader::Parser {
             auto &command_list_struct = workload.structs[*scenario_struct.resolve_pointer(&scenario_data.command_lists.pointer)];
             auto *command_list_array = reinterpret_cast<ScenarioCommandList::struct_little *>(command_list_struct.data.data());
             auto bsp_count = bsp_data.size();
+            
+            // Gather every point for each BSP that its command list will be checked against so each BSP can look them
+            // all up in one batch
+            std::vector<std::vector<HEK::Point3D<HEK::LittleEndian>>> points(bsp_count);
+            std::vector<std::vector<std::size_t>> command_list_result_offsets(bsp_count, std::vector<std::size_t>(command_list_count));
+            for(std::size_t i = 0; i < command_list_count; i++) {
+                auto &command_list = scenario.command_lists[i];
+                bool manual_bsp_index_specified = command_list.flags & HEK::ScenarioCommandListFlagsFlag::SCENARIO_COMMAND_LIST_FLAGS_FLAG_MANUAL_BSP_INDEX;
+                std::size_t start = manual_bsp_index_specified ? command_list.manual_bsp_index : 0;
+                for(std::size_t b = start; b < bsp_count; b++) {
+                    command_list_result_offsets[b][i] = points[b].size();
+                    for(auto &p : command_list.points) {
+                        points[b].emplace_back(p.position);
+                    }
+                    if(manual_bsp_index_specified) {
+                        break;
+                    }
+                }
+            }
+            
+            // We need to check if there is a surface that is half a world unit or less below each position
+            std::vector<std::vector<BSPData::QueryResult>> results(bsp_count);
+            for(std::size_t b = 0; b < bsp_count; b++) {
+                results[b] = bsp_data[b].check_for_intersections(points[b], 0.5F);
+            }
+            
             for(std::size_t i = 0; i < command_list_count; i++) {
                 auto &command_list = scenario.command_lists[i];
                 auto &command_list_data = command_list_array[i];
@@ -559,21 +611,17 @@ namespace Invader::Parser {
                 
                 // Go through each BSP (or one BSP for manual) to look for surface indices
                 for(std::size_t b = start; b < bsp_count; b++) {
-                    auto &bsp = bsp_data[b];
+                    auto *bsp_results = results[b].data() + command_list_result_offsets[b][i];
                     std::size_t hits = 0;
-                    std::size_t total_hits = 0;
                     std::vector<std::optional<std::uint32_t>> surface_indices;
                     surface_indices.reserve(point_count);
 
                     // Basically, add 1 for every time we find it in here
-                    // We need to check if there is a surface that is half a world unit or less below the position
-                    for(auto &p : command_list.points) {
-                        total_hits++;
-                        
-                        std::uint32_t surface_index = 0;
-                        if(bsp.check_for_intersection(p.position, 0.5F, nullptr, &surface_index, nullptr)) {
+                    for(std::size_t p = 0; p < point_count; p++) {
+                        auto &result = bsp_results[p];
+                        if(result.found) {
                             hits++;
-                            surface_indices.emplace_back(surface_index); // found a surface
+                            surface_indices.emplace_back(result.surface_index); // found a surface
                         }
                         else {
                             surface_indices.emplace_back(std::nullopt); // no surface underneath
@@ -661,6 +709,12 @@ namespace Invader::Parser {
     static void find_decals(Scenario &scenario, BuildWorkload &workload, const std::vector<BSPData> &bsp_data) {
         std::size_t decal_count = scenario.decals.size();
         if(decal_count > 0) {
+            std::vector<HEK::Point3D<HEK::LittleEndian>> decal_positions;
+            decal_positions.reserve(decal_count);
+            for(auto &decal : scenario.decals) {
+                decal_positions.emplace_back(decal.position);
+            }
+            
             for(std::size_t bsp = 0; bsp < scenario.structure_bsps.size(); bsp++) {
                 auto &b = scenario.structure_bsps[bsp];
                 auto &bsp_id = b.structure_bsp.tag_id;
@@ -688,15 +742,15 @@ namespace Invader::Parser {
                     auto *clusters = reinterpret_cast<ScenarioStructureBSPCluster::struct_little *>(bsp_cluster_struct.data.data());
 
                     // Go through each decal; see what we can come up with
+                    auto &bd = bsp_data[bsp];
+                    auto decal_results = bd.check_if_points_inside_bsp(decal_positions);
+                    
                     std::vector<std::pair<std::size_t, std::size_t>> cluster_decals;
                     for(std::size_t d = 0; d < decal_count; d++) {
-                        auto &decal = scenario.decals[d];
-                        auto &bd = bsp_data[bsp];
-                        std::uint32_t leaf;
-                        if(!bd.check_if_point_inside_bsp(decal.position, &leaf)) {
+                        if(!decal_results[d].found) {
                             continue;
                         }
-                        cluster_decals.emplace_back(bd.render_leaves[leaf].cluster, d);
+                        cluster_decals.emplace_back(bd.render_leaves[decal_results[d].leaf_index].cluster, d);
                     }
 
                     // Get clusters
@@ -737,9 +791,9 @@ namespace Invader::Parser {
                         auto &new_struct_ptr = bsp_tag_struct->pointers.emplace_back();
                         new_struct_ptr.offset = reinterpret_cast<const std::byte *>(&bsp_tag_data.runtime_decals.pointer) - reinterpret_cast<const std::byte *>(&bsp_tag_data);
                         new_struct_ptr.struct_index = workload.structs.size();
-                        auto &new_struct = workload.structs.emplace_back();
+                        auto &new_struct = workload.add_struct();
                         new_struct.bsp = workload.structs[*workload.tags[bsp_id.index].base_struct].bsp;
-                        new_struct.data = std::vector<std::byte>(reinterpret_cast<std::byte *>(runtime_decals.data()), reinterpret_cast<std::byte *>(runtime_decals.data() + runtime_decals.size()));
+                        new_struct.data.assign(reinterpret_cast<std::byte *>(runtime_decals.data()), reinterpret_cast<std::byte *>(runtime_decals.data() + runtime_decals.size()));
                     }
                 }
             }
@@ -10,7 +10,6 @@
 #include <riat/riat.hpp>
 
 namespace Invader::Parser {
-    static void merge_child_scenarios(BuildWorkload &workload, std::size_t tag_index, Scenario &scenario);
     static void check_palettes(BuildWorkload &workload, std::size_t tag_index, Scenario &scenario);
     static void fix_script_data(BuildWorkload &workload, std::size_t tag_index, std::size_t struct_index, Scenario &scenario);
     static void fix_bsp_transitions(BuildWorkload &workload, std::size_t tag_index, Scenario &scenario);
@@ -924,9 +923,9 @@ namespace Invader::Parser {
         }
 
         // Get these things
-        BuildWorkload::BuildWorkloadStruct script_data_struct = {};
-        script_data_struct.data = std::move(scenario.script_syntax_data);
-        scenario.script_syntax_data.clear();
+        BuildWorkload::BuildWorkloadStruct script_data_struct(workload.struct_arena.get());
+        script_data_struct.data.assign(scenario.script_syntax_data.begin(), scenario.script_syntax_data.end());
+        scenario.script_syntax_data = {};
         const char *string_data = reinterpret_cast<const char *>(scenario.script_string_data.data());
         
         auto *syntax_data = script_data_struct.data.data();
@@ -1358,12 +1357,13 @@ namespace Invader::Parser {
         #undef TRANSLATE_PALETTE
     }
 
-    static void merge_child_scenarios(BuildWorkload &workload, std::size_t tag_index, Scenario &scenario) {
+    std::vector<std::string> merge_child_scenarios(BuildWorkload &workload, std::size_t tag_index, Scenario &scenario) {
+        // Let's begin by adding this scenario to the list (in case we reference ourself)
+        std::vector<std::string> merged_scenarios;
+        merged_scenarios.emplace_back(workload.tags[tag_index].path);
+        
         // Merge child scenarios
         if(!scenario.child_scenarios.empty() && !workload.disable_recursion) {
-            // Let's begin by adding this scenario to the list (in case we reference ourself)
-            std::vector<std::string> merged_scenarios;
-            merged_scenarios.emplace_back(workload.tags[tag_index].path);
             
             // Take the scenario off the top
             while(scenario.child_scenarios.size()) {
@@ -1428,6 +1428,10 @@ namespace Invader::Parser {
                 scenario.child_scenarios.erase(scenario.child_scenarios.begin());
             }
         }
+        
+        // Return everything but this scenario
+        merged_scenarios.erase(merged_scenarios.begin());
+        return merged_scenarios;
     }
 
     void ScenarioCutsceneTitle::pre_compile(BuildWorkload &, std::size_t, std::size_t, std::size_t) {
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef INVADER__UTIL_FNV1A_HPP
+#define INVADER__UTIL_FNV1A_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Invader {
+    template <typename T> struct FNV1aParameters;
+
+    template <> struct FNV1aParameters<std::uint32_t> {
+        static constexpr std::uint32_t OFFSET_BASIS = 0x811C9DC5;
+        static constexpr std::uint32_t PRIME = 0x01000193;
+    };
+
+    template <> struct FNV1aParameters<std::uint64_t> {
+        static constexpr std::uint64_t OFFSET_BASIS = 0xCBF29CE484222325;
+        static constexpr std::uint64_t PRIME = 0x100000001B3;
+    };
+
+    /**
+     * Hash bytes with FNV-1a
+     * @param data data to hash
+     * @param size number of bytes
+     * @param hash hash to continue from (for hashing more than one thing together)
+     * @return     hash (32-bit or 64-bit, depending on T)
+     */
+    template <typename T = std::uint64_t> inline T fnv1a(const void *data, std::size_t size, T hash = FNV1aParameters<T>::OFFSET_BASIS) noexcept {
+        auto *bytes = static_cast<const std::uint8_t *>(data);
+        for(std::size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * FNV1aParameters<T>::PRIME;
+        }
+        return hash;
+    }
+}
+
+#endif
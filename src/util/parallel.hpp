@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef INVADER__UTIL_PARALLEL_HPP
+#define INVADER__UTIL_PARALLEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Invader {
+    /**
+     * Call function(i) for each i in [0, count), handing out indices to up to thread_count threads as they finish
+     * @param count        number of items
+     * @param thread_count maximum number of threads to use
+     * @param function     function to call with each index; it must be safe to call from multiple threads at once
+     */
+    template<typename T> void for_each_in_parallel(std::size_t count, std::size_t thread_count, const T &function) {
+        std::mutex mutex;
+        std::size_t next = 0;
+
+        auto work = [&mutex, &next, &count, &function]() {
+            while(true) {
+                mutex.lock();
+                auto i = next++;
+                mutex.unlock();
+                if(i >= count) {
+                    return;
+                }
+                function(i);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        thread_count = std::min(thread_count, count);
+        threads.reserve(thread_count);
+        for(std::size_t t = 0; t < thread_count; t++) {
+            threads.emplace_back(work);
+        }
+        for(auto &t : threads) {
+            t.join();
+        }
+    }
+}
+
+#endif